@@ -0,0 +1,618 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "archive.h"
+
+#include "file.h"
+#include "hash.h"
+#include "mem.h"
+#include "profile.h"
+#include "rgba.h"
+#include "stream.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+static constexpr uint32_t kArchive_Magic = 0x41535452; // "RTSA"
+static constexpr uint32_t kArchive_Version = 1;
+static constexpr uint64_t kArchive_HashSeed = 0x2f8c61d94e07b35aull;
+static constexpr size_t kArchive_HeaderSize = 32;
+static constexpr size_t kArchive_NameAlign = 8;      // names are padded to this, keeping the checksum in words
+static constexpr size_t kArchive_ReadChunk = 1 << 16;
+static constexpr size_t kArchive_PageSize = 4096;     // archivebench touches one byte per page
+static constexpr size_t kArchive_BenchRuns = 5;
+
+// a directory entry as it sits in the file, read in place from the mapping
+typedef struct archiveEntry_s {
+    uint64_t hash;
+    uint64_t offset; // of the payload from the start of the file
+    uint64_t bytes;
+    uint32_t type;
+    uint32_t name;   // offset in the names
+    uint32_t width;
+    uint32_t height;
+} archiveEntry_s;
+
+static_assert( sizeof( archiveEntry_s ) == 40, "archive entries are 40 bytes in the file" );
+
+typedef struct archive_s {
+    fileMapping_s * mapping = nullptr;
+    const uint8_t * data = nullptr;
+    const archiveEntry_s * entry = nullptr; // [ count ] in the mapping
+    size_t count = 0;
+    const char * names = nullptr;           // in the mapping
+} archive_s;
+
+// an input to Archive_Pack, converted
+typedef struct archiveInput_s {
+    const char * name = nullptr;
+    uint64_t hash = 0;
+    uint8_t * data = nullptr;
+    size_t bytes = 0;
+    archiveAsset_e type = kArchiveAsset_Blob;
+    vec2_s< size_t > size;
+} archiveInput_s;
+
+static size_t AlignUp( const size_t size, const size_t align ) {
+    return ( size + align - 1 ) & ~( align - 1 );
+}
+
+// fnv-1a
+static uint64_t HashName( const char * const name ) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for ( const char * c = name; *c != 0; c++ ) {
+        hash ^= ( uint8_t )*c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// over the header, with the checksum itself as zero, the directory and the names; a multiple of 8 bytes
+static uint64_t Checksum( const uint8_t * const header, const uint8_t * const rest, const size_t restSize ) {
+    uint8_t first[ kArchive_HeaderSize ];
+    memcpy( first, header, kArchive_HeaderSize );
+    memset( first + kArchive_HeaderSize - sizeof( uint64_t ), 0, sizeof( uint64_t ) );
+
+    hashLanes_s lanes;
+    Hash_AddWords( &lanes, ( const uint32_t * )first, kArchive_HeaderSize / 4 );
+    Hash_AddWords( &lanes, ( const uint32_t * )rest, restSize / 4 );
+    return Hash_Finish( &lanes, kArchive_HashSeed );
+}
+
+static int Validate( archive_s * const archive ) {
+    const uint8_t * const data = ( const uint8_t * )File_GetData( archive->mapping );
+    const size_t size = File_GetSize( archive->mapping );
+
+    streamReader_s r;
+    Stream_InitReader( &r, data, size );
+    const int known = Stream_ReadU32( &r ) == kArchive_Magic && Stream_ReadU32( &r ) == kArchive_Version;
+    const uint32_t count = Stream_ReadU32( &r );
+    const uint32_t namesSize = Stream_ReadU32( &r );
+    const uint64_t fileSize = Stream_ReadU64( &r );
+    const uint64_t checksum = Stream_ReadU64( &r );
+    if ( !known || r.failed || fileSize != size || count > ( size - kArchive_HeaderSize ) / sizeof( archiveEntry_s ) ) {
+        return 0;
+    }
+
+    const size_t directorySize = count * sizeof( archiveEntry_s );
+    if ( namesSize == 0 || namesSize % kArchive_NameAlign != 0 || namesSize > size - kArchive_HeaderSize - directorySize ||
+         Checksum( data, data + kArchive_HeaderSize, directorySize + namesSize ) != checksum ) {
+        return 0;
+    }
+
+    archive->data = data;
+    archive->entry = ( const archiveEntry_s * )( data + kArchive_HeaderSize );
+    archive->count = count;
+    archive->names = ( const char * )( data + kArchive_HeaderSize + directorySize );
+    if ( archive->names[ namesSize - 1 ] != 0 ) {
+        return 0;
+    }
+
+    // a payload may not overlap the header, directory or names; the hash order and each name's hash are what
+    // Archive_Find relies on
+    const size_t payloadStart = kArchive_HeaderSize + directorySize + namesSize;
+    for ( size_t i = 0; i < count; i++ ) {
+        const archiveEntry_s * const e = &archive->entry[ i ];
+        if ( e->offset % kArchive_Align != 0 || e->offset < payloadStart || e->offset > size || e->bytes > size - e->offset ||
+             e->type >= kArchiveAsset_Count || e->name >= namesSize || HashName( archive->names + e->name ) != e->hash ||
+             ( i > 0 && e->hash <= archive->entry[ i - 1 ].hash ) ) {
+            return 0;
+        }
+
+        const uint64_t pixels = ( uint64_t )e->width * e->height;
+        if ( ( e->type == kArchiveAsset_Image && e->bytes != pixels * sizeof( rgba_s ) ) || ( e->type == kArchiveAsset_Coverage && e->bytes != pixels ) ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+archive_s * Archive_Open( const char * const path ) {
+    PROFILE_ZONE( "Archive_Open" );
+
+    archive_s * const archive = ( archive_s * )Mem_Alloc( kMemTag_Assets, sizeof( archive_s ) );
+    if ( archive == nullptr ) {
+        return nullptr;
+    }
+
+    new ( archive ) archive_s;
+    archive->mapping = File_Map( path, kMemTag_Assets );
+    if ( archive->mapping == nullptr || File_GetSize( archive->mapping ) < kArchive_HeaderSize || !Validate( archive ) ) {
+        Archive_Close( archive );
+        return nullptr;
+    }
+
+    return archive;
+}
+
+void Archive_Close( archive_s * const archive ) {
+    if ( archive == nullptr ) {
+        return;
+    }
+
+    File_Unmap( archive->mapping );
+    archive->~archive_s();
+    Mem_Free( archive );
+}
+
+size_t Archive_GetCount( const archive_s * const archive ) {
+    return archive->count;
+}
+
+static void FillAsset( const archive_s * const archive, const archiveEntry_s * const e, archiveAsset_s * const asset ) {
+    asset->data = archive->data + e->offset;
+    asset->bytes = ( size_t )e->bytes;
+    asset->type = ( archiveAsset_e )e->type;
+    asset->size = { e->width, e->height };
+    asset->name = archive->names + e->name;
+}
+
+int Archive_GetAsset( const archive_s * const archive, const size_t index, archiveAsset_s * const asset ) {
+    if ( index >= archive->count ) {
+        return 0;
+    }
+
+    FillAsset( archive, &archive->entry[ index ], asset );
+    return 1;
+}
+
+int Archive_Find( const archive_s * const archive, const char * const name, archiveAsset_s * const asset ) {
+    const uint64_t hash = HashName( name );
+    size_t first = 0;
+    size_t last = archive->count;
+    while ( first < last ) {
+        const size_t middle = first + ( last - first ) / 2;
+        if ( archive->entry[ middle ].hash < hash ) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    // the packer refuses names that hash the same, so a hash match with another name is a miss
+    if ( first == archive->count || archive->entry[ first ].hash != hash || strcmp( archive->names + archive->entry[ first ].name, name ) != 0 ) {
+        return 0;
+    }
+
+    FillAsset( archive, &archive->entry[ first ], asset );
+    return 1;
+}
+
+// a netpbm header field: whitespace and comments, then a decimal number followed by exactly one whitespace character
+static int ReadPnmNumber( streamReader_s * const r, size_t * const number ) {
+    uint8_t c = Stream_ReadU8( r );
+    for ( ;; ) {
+        if ( c == '#' ) {
+            while ( c != '\n' && !r->failed ) {
+                c = Stream_ReadU8( r );
+            }
+        } else if ( c == ' ' || c == '\t' || c == '\r' || c == '\n' ) {
+            c = Stream_ReadU8( r );
+        } else {
+            break;
+        }
+    }
+
+    if ( c < '0' || c > '9' || r->failed ) {
+        return 0;
+    }
+
+    *number = 0;
+    while ( c >= '0' && c <= '9' && !r->failed && *number <= UINT32_MAX ) {
+        *number = *number * 10 + ( size_t )( c - '0' );
+        c = Stream_ReadU8( r );
+    }
+
+    return !r->failed && ( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
+}
+
+// binary ppm to opaque rgba_s, binary pgm to coverage. returns zero if file isn't one of those, leaving it a blob.
+static int ConvertPnm( archiveInput_s * const input, const uint8_t * const file, const size_t fileSize ) {
+    streamReader_s r;
+    Stream_InitReader( &r, file, fileSize );
+    const uint8_t p = Stream_ReadU8( &r );
+    const uint8_t kind = Stream_ReadU8( &r );
+    size_t width = 0;
+    size_t height = 0;
+    size_t maxValue = 0;
+    if ( p != 'P' || ( kind != '5' && kind != '6' ) || !ReadPnmNumber( &r, &width ) || !ReadPnmNumber( &r, &height ) ||
+         !ReadPnmNumber( &r, &maxValue ) || maxValue == 0 || maxValue > 255 || width == 0 || height == 0 || width > UINT32_MAX || height > UINT32_MAX ||
+         height > fileSize / width ) {
+        return 0;
+    }
+
+    const size_t channels = kind == '6' ? 3 : 1;
+    const uint8_t * const pixels = Stream_ReadBytes( &r, width * height * channels );
+    if ( pixels == nullptr ) {
+        return 0;
+    }
+
+    input->type = kind == '6' ? kArchiveAsset_Image : kArchiveAsset_Coverage;
+    input->size = { width, height };
+    input->bytes = kind == '6' ? width * height * sizeof( rgba_s ) : width * height;
+    input->data = ( uint8_t * )Mem_Alloc( kMemTag_Assets, input->bytes );
+    if ( input->data == nullptr ) {
+        return 0;
+    }
+
+    if ( kind == '5' ) {
+        memcpy( input->data, pixels, input->bytes );
+        return 1;
+    }
+
+    rgba_s * const out = ( rgba_s * )input->data;
+    for ( size_t i = 0; i < width * height; i++ ) {
+        out[ i ].r = pixels[ i * 3 + 0 ];
+        out[ i ].g = pixels[ i * 3 + 1 ];
+        out[ i ].b = pixels[ i * 3 + 2 ];
+        out[ i ].a = 255;
+    }
+    return 1;
+}
+
+// reads the whole of the file at path into w
+static int ReadWholeFile( const char * const path, streamWriter_s * const w ) {
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, path, "rb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( path, "rb" );
+#endif
+    if ( file == nullptr ) {
+        return 0;
+    }
+
+    size_t read = 0;
+    do {
+        if ( !Stream_Reserve( w, kArchive_ReadChunk ) ) {
+            break;
+        }
+        read = fread( w->data + w->size, 1, kArchive_ReadChunk, file );
+        w->size += read;
+    } while ( read == kArchive_ReadChunk );
+    const int ok = !w->failed && !ferror( file );
+    fclose( file );
+    return ok;
+}
+
+static int LoadInput( archiveInput_s * const input, const char * const path ) {
+    streamWriter_s w;
+    w.tag = kMemTag_Assets;
+    if ( !ReadWholeFile( path, &w ) ) {
+        Stream_FreeWriter( &w );
+        return 0;
+    }
+
+    input->name = path;
+    input->hash = HashName( path );
+    if ( ConvertPnm( input, w.data, w.size ) ) {
+        Stream_FreeWriter( &w );
+        return 1;
+    }
+
+    // the writer's buffer becomes the payload
+    input->type = kArchiveAsset_Blob;
+    input->size = {};
+    input->data = w.data;
+    input->bytes = w.size;
+    return 1;
+}
+
+static int WriteArchive( const char * const path, const archiveInput_s * const input, const size_t count ) {
+    size_t namesSize = 0;
+    for ( size_t i = 0; i < count; i++ ) {
+        namesSize += strlen( input[ i ].name ) + 1;
+    }
+    namesSize = AlignUp( namesSize > 0 ? namesSize : 1, kArchive_NameAlign );
+    if ( namesSize > UINT32_MAX ) {
+        return 0;
+    }
+
+    // header, directory and names go out in one write, the payloads after them
+    streamWriter_s w;
+    w.tag = kMemTag_Assets;
+    const size_t directorySize = count * sizeof( archiveEntry_s );
+    const size_t headerSize = AlignUp( kArchive_HeaderSize + directorySize + namesSize, kArchive_Align );
+    if ( !Stream_Reserve( &w, headerSize ) ) {
+        return 0;
+    }
+    memset( w.data, 0, headerSize );
+    w.size = headerSize;
+
+    archiveEntry_s * const entry = ( archiveEntry_s * )( w.data + kArchive_HeaderSize );
+    char * const names = ( char * )( w.data + kArchive_HeaderSize + directorySize );
+    size_t nameOffset = 0;
+    size_t offset = headerSize;
+    for ( size_t i = 0; i < count; i++ ) {
+        entry[ i ].hash = input[ i ].hash;
+        entry[ i ].offset = offset;
+        entry[ i ].bytes = input[ i ].bytes;
+        entry[ i ].type = input[ i ].type;
+        entry[ i ].name = ( uint32_t )nameOffset;
+        entry[ i ].width = ( uint32_t )input[ i ].size.x;
+        entry[ i ].height = ( uint32_t )input[ i ].size.y;
+
+        const size_t length = strlen( input[ i ].name ) + 1;
+        memcpy( names + nameOffset, input[ i ].name, length );
+        nameOffset += length;
+        offset = AlignUp( offset + input[ i ].bytes, kArchive_Align );
+    }
+
+    streamWriter_s header;
+    header.data = w.data;
+    header.capacity = kArchive_HeaderSize;
+    Stream_WriteU32( &header, kArchive_Magic );
+    Stream_WriteU32( &header, kArchive_Version );
+    Stream_WriteU32( &header, ( uint32_t )count );
+    Stream_WriteU32( &header, ( uint32_t )namesSize );
+    Stream_WriteU64( &header, offset );
+    Stream_WriteU64( &header, Checksum( w.data, w.data + kArchive_HeaderSize, directorySize + namesSize ) );
+
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, path, "wb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( path, "wb" );
+#endif
+    if ( file == nullptr ) {
+        Stream_FreeWriter( &w );
+        return 0;
+    }
+
+    static const uint8_t zero[ kArchive_Align ] = {};
+    int ok = fwrite( w.data, 1, headerSize, file ) == headerSize;
+    for ( size_t i = 0; i < count && ok; i++ ) {
+        const size_t pad = AlignUp( input[ i ].bytes, kArchive_Align ) - input[ i ].bytes;
+        ok = fwrite( input[ i ].data, 1, input[ i ].bytes, file ) == input[ i ].bytes && fwrite( zero, 1, pad, file ) == pad;
+    }
+    if ( fclose( file ) != 0 ) {
+        ok = 0;
+    }
+
+    Stream_FreeWriter( &w );
+    return ok;
+}
+
+int Archive_Pack( const char * const path, const char * const * const inputs, const size_t count ) {
+    PROFILE_ZONE( "Archive_Pack" );
+
+    if ( path == nullptr || count > UINT32_MAX ) {
+        return 0;
+    }
+
+    archiveInput_s * const input = ( archiveInput_s * )Mem_Alloc( kMemTag_Assets, ( count > 0 ? count : 1 ) * sizeof( archiveInput_s ) );
+    if ( input == nullptr ) {
+        return 0;
+    }
+    for ( size_t i = 0; i < count; i++ ) {
+        new ( &input[ i ] ) archiveInput_s;
+    }
+
+    int ok = 1;
+    for ( size_t i = 0; i < count && ok; i++ ) {
+        ok = LoadInput( &input[ i ], inputs[ i ] );
+    }
+
+    if ( ok ) {
+        std::sort( input, input + count, []( const archiveInput_s & a, const archiveInput_s & b ) {
+            return a.hash < b.hash;
+        } );
+        for ( size_t i = 1; i < count && ok; i++ ) {
+            ok = input[ i ].hash != input[ i - 1 ].hash;
+        }
+    }
+
+    ok = ok && WriteArchive( path, input, count );
+
+    for ( size_t i = 0; i < count; i++ ) {
+        Mem_Free( input[ i ].data );
+        input[ i ].~archiveInput_s();
+    }
+    Mem_Free( input );
+    return ok;
+}
+
+int Archive_PackList( const char * const path, const char * const listPath ) {
+    streamWriter_s list;
+    list.tag = kMemTag_Assets;
+    if ( listPath == nullptr || !ReadWholeFile( listPath, &list ) || !Stream_Reserve( &list, 1 ) ) {
+        fprintf( stderr, "can't read pack list %s\n", listPath != nullptr ? listPath : "(none)" );
+        Stream_FreeWriter( &list );
+        return 0;
+    }
+    list.data[ list.size ] = 0;
+
+    size_t count = 0;
+    for ( size_t i = 0; i < list.size; i++ ) {
+        count += list.data[ i ] == '\n' ? 1 : 0;
+    }
+    const char ** const inputs = ( const char ** )Mem_Alloc( kMemTag_Assets, ( count + 1 ) * sizeof( const char * ) );
+    if ( inputs == nullptr ) {
+        Stream_FreeWriter( &list );
+        return 0;
+    }
+
+    // lines are cut in place
+    count = 0;
+    char * line = ( char * )list.data;
+    while ( *line != 0 ) {
+        char * end = line;
+        while ( *end != 0 && *end != '\n' ) {
+            end++;
+        }
+        char * const next = *end != 0 ? end + 1 : end;
+        while ( end > line && ( end[ -1 ] == '\r' || end[ -1 ] == ' ' || end[ -1 ] == '\t' ) ) {
+            end--;
+        }
+        *end = 0;
+        if ( *line != 0 && *line != '#' ) {
+            inputs[ count++ ] = line;
+        }
+        line = next;
+    }
+
+    const uint64_t start = Timer_Nanoseconds();
+    const int ok = Archive_Pack( path, inputs, count );
+    if ( ok ) {
+        printf( "packed %zu files into %s in %.1f ms\n", count, path, ( double )( Timer_Nanoseconds() - start ) / 1e6 );
+    } else {
+        fprintf( stderr, "can't pack %s\n", path );
+    }
+
+    Mem_Free( inputs );
+    Stream_FreeWriter( &list );
+    return ok;
+}
+
+typedef struct archiveBenchTimes_s {
+    uint64_t openNs = 0;
+    uint64_t findNs = 0;
+    uint64_t touchNs = 0;
+    uint64_t readNs = 0;
+    uint64_t sum = 0; // of the bytes touched, so the touching isn't optimized away
+} archiveBenchTimes_s;
+
+// cold drops the file from the os file cache before opening it and again before reading it, so both come from disk
+static int BenchOnce( const char * const path, const size_t fileSize, const int cold, archiveBenchTimes_s * const times ) {
+    if ( cold ) {
+        File_DropCache( path );
+    }
+    uint64_t start = Timer_Nanoseconds();
+    archive_s * const archive = Archive_Open( path );
+    times->openNs = Timer_Nanoseconds() - start;
+    if ( archive == nullptr ) {
+        return 0;
+    }
+
+    const size_t count = Archive_GetCount( archive );
+    size_t found = 0;
+    archiveAsset_s asset;
+    start = Timer_Nanoseconds();
+    for ( size_t i = 0; i < count; i++ ) {
+        Archive_GetAsset( archive, i, &asset );
+        found += ( size_t )Archive_Find( archive, asset.name, &asset );
+    }
+    times->findNs = Timer_Nanoseconds() - start;
+
+    start = Timer_Nanoseconds();
+    for ( size_t i = 0; i < count; i++ ) {
+        Archive_GetAsset( archive, i, &asset );
+        const uint8_t * const bytes = ( const uint8_t * )asset.data;
+        for ( size_t offset = 0; offset < asset.bytes; offset += kArchive_PageSize ) {
+            times->sum += bytes[ offset ];
+        }
+    }
+    times->touchNs = Timer_Nanoseconds() - start;
+    Archive_Close( archive );
+
+    if ( cold ) {
+        File_DropCache( path );
+    }
+    // sized up front, as a loader that knew the file size would
+    streamWriter_s w;
+    w.tag = kMemTag_Assets;
+    Stream_Reserve( &w, fileSize + kArchive_ReadChunk );
+    start = Timer_Nanoseconds();
+    const int read = ReadWholeFile( path, &w );
+    times->readNs = Timer_Nanoseconds() - start;
+    Stream_FreeWriter( &w );
+
+    return found == count && read;
+}
+
+static void PrintBench( const char * const label, const archiveBenchTimes_s * const times ) {
+    printf( "%-6s open %8.3f ms  find %8.3f ms  touch %8.3f ms  startup %8.3f ms  read file %8.3f ms\n", label,
+        ( double )times->openNs / 1e6, ( double )times->findNs / 1e6, ( double )times->touchNs / 1e6,
+        ( double )( times->openNs + times->findNs + times->touchNs ) / 1e6, ( double )times->readNs / 1e6 );
+}
+
+int Archive_Bench( const char * const path ) {
+    fileMapping_s * const mapping = File_Map( path, kMemTag_Assets );
+    const size_t fileSize = mapping != nullptr ? File_GetSize( mapping ) : 0;
+    File_Unmap( mapping );
+
+    archive_s * const archive = Archive_Open( path );
+    if ( archive == nullptr ) {
+        fprintf( stderr, "can't open archive %s\n", path );
+        return 0;
+    }
+    const size_t count = Archive_GetCount( archive );
+    size_t bytes = 0;
+    archiveAsset_s asset;
+    for ( size_t i = 0; i < count; i++ ) {
+        Archive_GetAsset( archive, i, &asset );
+        bytes += asset.bytes;
+    }
+    Archive_Close( archive );
+    printf( "archive %s: %zu assets, %.1f MB of payload\n", path, count, ( double )bytes / ( 1024.0 * 1024.0 ) );
+
+    archiveBenchTimes_s cold;
+    if ( !File_DropCache( path ) ) {
+        printf( "cold   not measured: the file cache can't be dropped here\n" );
+    } else if ( BenchOnce( path, fileSize, 1, &cold ) ) {
+        PrintBench( "cold", &cold );
+    }
+
+    archiveBenchTimes_s best;
+    best.openNs = best.findNs = best.touchNs = best.readNs = UINT64_MAX;
+    for ( size_t run = 0; run < kArchive_BenchRuns; run++ ) {
+        archiveBenchTimes_s times;
+        if ( !BenchOnce( path, fileSize, 0, &times ) ) {
+            return 0;
+        }
+        best.openNs = times.openNs < best.openNs ? times.openNs : best.openNs;
+        best.findNs = times.findNs < best.findNs ? times.findNs : best.findNs;
+        best.touchNs = times.touchNs < best.touchNs ? times.touchNs : best.touchNs;
+        best.readNs = times.readNs < best.readNs ? times.readNs : best.readNs;
+    }
+    PrintBench( "warm", &best );
+    return 1;
+}
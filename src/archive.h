@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_ARCHIVE_H___
+#define ___RTSFS_ARCHIVE_H___
+
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// packed asset archives: every asset in one file, loaded by mapping it.
+//
+// a file is a header, a directory of fixed size entries sorted by the 64 bit hash of the asset name, the names, and
+// the payloads on kArchive_Align boundaries. payloads are stored in the layout they are used in: images as rgba_s
+// rows, font sheets as 8 bit coverage, anything else as the bytes of the source file. opening an archive maps it and
+// checks the header, directory and names against their checksum, which costs a few pages however large the
+// payloads are. an asset found in it points straight into the mapping, so nothing is read or copied until it is
+// touched, and then the os pages it in from its file cache.
+//
+// payloads are not compressed. a compressed payload would have to be decoded into a copy before use, which is the
+// cost this format is here to remove.
+//
+// archives are built offline by Archive_Pack, from netpbm images and plain files.
+
+typedef struct archive_s archive_s;
+
+static constexpr size_t kArchive_Align = 64; // of every payload in the file and the mapping
+
+typedef enum archiveAsset_e : uint32_t {
+    kArchiveAsset_Blob = 0, // the source file as it was
+    kArchiveAsset_Image,    // size.x * size.y rgba_s, rows size.x apart; from a binary (P6) ppm, opaque
+    kArchiveAsset_Coverage, // size.x * size.y 8 bit coverage, for Text_CreateFont; from a binary (P5) pgm
+    kArchiveAsset_Count
+} archiveAsset_e;
+
+typedef struct archiveAsset_s {
+    const void * data = nullptr; // in the mapping, valid until Archive_Close
+    size_t bytes = 0;
+    archiveAsset_e type = kArchiveAsset_Blob;
+    vec2_s< size_t > size;       // pixels, for images and coverage
+    const char * name = nullptr; // in the mapping
+} archiveAsset_s;
+
+// maps the archive at path and validates everything but the payloads. returns nullptr if it is missing, damaged,
+// or from another version.
+archive_s * Archive_Open( const char * const path );
+
+void Archive_Close( archive_s * const archive );
+
+size_t Archive_GetCount( const archive_s * const archive );
+
+// the index-th asset in directory order, which is hash order. returns zero if index is out of range.
+int Archive_GetAsset( const archive_s * const archive, const size_t index, archiveAsset_s * const asset );
+
+// a binary search of the directory by name hash. returns zero if no asset has that name.
+int Archive_Find( const archive_s * const archive, const char * const name, archiveAsset_s * const asset );
+
+// writes an archive of the files at inputs[ 0 .. count ) to path, naming each asset by its path as given. ppm and
+// pgm files are converted, the rest stored as they are. returns zero if a file can't be read, two names hash the
+// same, or the archive can't be written.
+int Archive_Pack( const char * const path, const char * const * const inputs, const size_t count );
+
+// the pack tool: Archive_Pack of the files listed in the text file at listPath, one path per line. blank lines and
+// lines starting with '#' are skipped. prints what it did; returns zero on failure.
+int Archive_PackList( const char * const path, const char * const listPath );
+
+// the archivebench tool: prints the startup cost of the archive at path, from the file cache and, where the os can
+// drop the file from its cache, from disk. startup is opening the archive, looking every asset up by name and
+// touching every page of every payload, as first use would. reading the whole file into memory, as a loader of
+// loose files would at best, is timed the same way for comparison. returns zero on failure.
+int Archive_Bench( const char * const path );
+
+#endif // ___RTSFS_ARCHIVE_H___
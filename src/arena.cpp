@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "arena.h"
+
+#include <atomic>
+#include <new>
+
+static constexpr size_t kArena_MinOverflow = 64 * 1024;
+static constexpr size_t kArena_FrameScratch = 64 * 1024; // initial bytes of a thread's scratch arena
+static constexpr size_t kArena_FrameDouble = 16 * 1024;  // and of each of its double arenas
+
+typedef struct arenaBlock_s {
+    arenaBlock_s * next;
+    size_t size;
+    size_t used;
+} arenaBlock_s;
+
+typedef struct frameArena_s {
+    arena_s scratch;
+    arena_s history[ 2 ];
+    uint64_t frame = 0;
+    uint64_t synced = 0;          // frameEnds as of the thread's last frame
+    frameArena_s * next = nullptr;
+} frameArena_s;
+
+static std::atomic< frameArena_s * > frameArenas{ nullptr };
+static std::atomic< uint64_t > frameEnds{ 0 };
+
+static thread_local frameArena_s * threadArena = nullptr;
+
+int Arena_Init( arena_s * const arena, const memTag_e tag, const size_t size ) {
+    new ( arena ) arena_s;
+    arena->tag = tag;
+
+    arena->base = ( uint8_t * )Mem_Alloc( tag, size );
+    if ( arena->base == nullptr ) {
+        return 0;
+    }
+    arena->size = size;
+
+    return 1;
+}
+
+static void FreeOverflow( arena_s * const arena ) {
+    arenaBlock_s * block = arena->overflow;
+    while ( block != nullptr ) {
+        arenaBlock_s * const next = block->next;
+        Mem_Free( block );
+        block = next;
+    }
+    arena->overflow = nullptr;
+    arena->overflowUsed = 0;
+}
+
+void Arena_Free( arena_s * const arena ) {
+    if ( arena == nullptr ) {
+        return;
+    }
+
+    FreeOverflow( arena );
+    Mem_Free( arena->base );
+    new ( arena ) arena_s;
+}
+
+void * Arena_AllocSlow( arena_s * const arena, const size_t size, const size_t align ) {
+    // the main block still has room for this one; only reached when an earlier allocation overflowed
+    arenaBlock_s * block = arena->overflow;
+    if ( block != nullptr ) {
+        const size_t offset = ( block->used + ( align - 1 ) ) & ~( align - 1 );
+        if ( offset + size <= block->size ) {
+            arena->overflowUsed += offset + size - block->used;
+            block->used = offset + size;
+            uint8_t * const data = ( uint8_t * )( block + 1 );
+            if ( arena->used + arena->overflowUsed > arena->highWater ) {
+                arena->highWater = arena->used + arena->overflowUsed;
+            }
+            return data + offset;
+        }
+    } else {
+        const size_t offset = ( arena->used + ( align - 1 ) ) & ~( align - 1 );
+        if ( offset + size <= arena->size ) {
+            arena->used = offset + size;
+            return arena->base + offset;
+        }
+    }
+
+    if ( arena->limit != 0 && arena->used + arena->overflowUsed + size + align > arena->limit ) {
+        return nullptr;
+    }
+
+    // the block header keeps the data 16 byte aligned; larger alignments pad inside the block
+    const size_t want = size + align;
+    const size_t blockSize = want > kArena_MinOverflow ? want : kArena_MinOverflow;
+    block = ( arenaBlock_s * )Mem_Alloc( arena->tag, sizeof( arenaBlock_s ) + blockSize );
+    if ( block == nullptr ) {
+        return nullptr;
+    }
+    block->next = arena->overflow;
+    block->size = blockSize;
+    block->used = 0;
+    arena->overflow = block;
+    arena->overflowCount++;
+
+    uint8_t * const data = ( uint8_t * )( block + 1 );
+    const size_t misalign = ( size_t )( uintptr_t )data & ( align - 1 );
+    const size_t offset = misalign ? align - misalign : 0;
+    block->used = offset + size;
+    arena->overflowUsed += block->used;
+    if ( arena->used + arena->overflowUsed > arena->highWater ) {
+        arena->highWater = arena->used + arena->overflowUsed;
+    }
+
+    return data + offset;
+}
+
+void Arena_Reset( arena_s * const arena ) {
+    if ( arena->used > arena->highWater ) {
+        arena->highWater = arena->used;
+    }
+
+    // overflow freed by a rewind still counts through the high water mark
+    if ( arena->overflow != nullptr || arena->highWater > arena->size ) {
+        FreeOverflow( arena );
+
+        // grow once to cover the worst frame so far, so the next one like it stays in the main block
+        uint8_t * const base = ( uint8_t * )Mem_Alloc( arena->tag, arena->highWater );
+        if ( base != nullptr ) {
+            Mem_Free( arena->base );
+            arena->base = base;
+            arena->size = arena->highWater;
+        }
+    }
+
+    arena->used = 0;
+}
+
+arenaMark_s Arena_GetMark( const arena_s * const arena ) {
+    arenaMark_s mark;
+    mark.used = arena->used;
+    mark.overflow = arena->overflow;
+    mark.blockUsed = arena->overflow != nullptr ? arena->overflow->used : 0;
+    mark.overflowUsed = arena->overflowUsed;
+    return mark;
+}
+
+void Arena_Rewind( arena_s * const arena, const arenaMark_s mark ) {
+    if ( arena->used + arena->overflowUsed > arena->highWater ) {
+        arena->highWater = arena->used + arena->overflowUsed;
+    }
+
+    while ( arena->overflow != mark.overflow ) {
+        arenaBlock_s * const next = arena->overflow->next;
+        Mem_Free( arena->overflow );
+        arena->overflow = next;
+    }
+    if ( arena->overflow != nullptr ) {
+        arena->overflow->used = mark.blockUsed;
+    }
+    arena->overflowUsed = mark.overflowUsed;
+    arena->used = mark.used;
+}
+
+static frameArena_s * GetFrameArena( void ) {
+    frameArena_s * me = threadArena;
+    if ( me != nullptr ) {
+        return me;
+    }
+
+    me = ( frameArena_s * )Mem_Alloc( kMemTag_Frame, sizeof( frameArena_s ) );
+    if ( me == nullptr ) {
+        return nullptr;
+    }
+    new ( me ) frameArena_s;
+
+    if ( !Arena_Init( &me->scratch, kMemTag_Frame, kArena_FrameScratch ) ||
+         !Arena_Init( me->history + 0, kMemTag_Frame, kArena_FrameDouble ) ||
+         !Arena_Init( me->history + 1, kMemTag_Frame, kArena_FrameDouble ) ) {
+        Arena_Free( &me->scratch );
+        Arena_Free( me->history + 0 );
+        Arena_Free( me->history + 1 );
+        me->~frameArena_s();
+        Mem_Free( me );
+        return nullptr;
+    }
+    me->scratch.limit = kArena_FrameLimit;
+    me->history[ 0 ].limit = kArena_FrameLimit;
+    me->history[ 1 ].limit = kArena_FrameLimit;
+    me->synced = frameEnds.load( std::memory_order_relaxed );
+
+    frameArena_s * head = frameArenas.load( std::memory_order_relaxed );
+    do {
+        me->next = head;
+    } while ( !frameArenas.compare_exchange_weak( head, me, std::memory_order_release, std::memory_order_relaxed ) );
+
+    threadArena = me;
+    return me;
+}
+
+static void BeginFrame( frameArena_s * const me ) {
+    // the history arena written two frames ago is the one whose data has now been consumed
+    me->frame++;
+    me->synced = frameEnds.load( std::memory_order_relaxed );
+    Arena_Reset( &me->scratch );
+    Arena_Reset( me->history + ( me->frame & 1 ) );
+}
+
+void FrameArena_BeginFrame( void ) {
+    frameArena_s * const me = GetFrameArena();
+    if ( me != nullptr ) {
+        BeginFrame( me );
+    }
+}
+
+void FrameArena_EndFrame( void ) {
+    frameEnds.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FrameArena_SyncFrame( void ) {
+    // a thread that never allocated has nothing to release, and shouldn't reserve anything to find that out
+    frameArena_s * const me = threadArena;
+    if ( me != nullptr && me->synced != frameEnds.load( std::memory_order_relaxed ) ) {
+        BeginFrame( me );
+    }
+}
+
+void * FrameArena_Alloc( const size_t size, const size_t align ) {
+    frameArena_s * const me = GetFrameArena();
+    return me ? Arena_Alloc( &me->scratch, size, align ) : nullptr;
+}
+
+void * FrameArena_AllocDouble( const size_t size, const size_t align ) {
+    frameArena_s * const me = GetFrameArena();
+    return me ? Arena_Alloc( me->history + ( me->frame & 1 ), size, align ) : nullptr;
+}
+
+arenaMark_s FrameArena_GetMark( void ) {
+    frameArena_s * const me = GetFrameArena();
+    return me ? Arena_GetMark( &me->scratch ) : arenaMark_s{};
+}
+
+void FrameArena_Rewind( const arenaMark_s mark ) {
+    frameArena_s * const me = threadArena;
+    if ( me != nullptr ) {
+        Arena_Rewind( &me->scratch, mark );
+    }
+}
+
+void FrameArena_GetStats( frameArenaStats_s * const stats ) {
+    new ( stats ) frameArenaStats_s;
+
+    for ( frameArena_s * me = frameArenas.load( std::memory_order_acquire ); me != nullptr; me = me->next ) {
+        const arena_s * const arenas[ 3 ] = { &me->scratch, me->history + 0, me->history + 1 };
+        stats->threads++;
+        for ( size_t i = 0; i < 3; i++ ) {
+            const arena_s * const arena = arenas[ i ];
+            const size_t used = arena->used + arena->overflowUsed;
+            stats->capacity += arena->size;
+            stats->highWater += used > arena->highWater ? used : arena->highWater;
+            stats->overflowCount += arena->overflowCount;
+        }
+    }
+}
+
+void FrameArena_Shutdown( void ) {
+    frameArena_s * me = frameArenas.exchange( nullptr, std::memory_order_acquire );
+    while ( me != nullptr ) {
+        frameArena_s * const next = me->next;
+        Arena_Free( &me->scratch );
+        Arena_Free( me->history + 0 );
+        Arena_Free( me->history + 1 );
+        me->~frameArena_s();
+        Mem_Free( me );
+        me = next;
+    }
+    threadArena = nullptr;
+}
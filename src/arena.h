@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_ARENA_H___
+#define ___RTSFS_ARENA_H___
+
+#include "mem.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// linear (bump) arenas. an allocation is an add and a compare; nothing is freed individually, the whole arena is
+// reset at once. an arena that runs out chains overflow blocks from the heap for the rest of the frame, and its
+// next reset grows the main block to the high water mark so steady state frames never touch the heap.
+//
+// an arena belongs to whoever owns the data in it, which resets it when that data is done with: a render buffer's
+// lists are reset with the buffer each frame. every block comes from Mem_Alloc under the arena's tag, so arenas
+// show up in the memory stats. an arena is not thread safe; give each thread its own.
+//
+// frame arenas are a set of these per thread, created on the thread's first allocation:
+//   scratch - FrameArena_Alloc; valid until the calling thread's next frame
+//   double  - FrameArena_AllocDouble; two arenas alternating by frame, valid until the frame after next, for data
+//             produced in one frame and consumed in the following one
+// the main loop and the render thread begin their own frames. job workers begin one between jobs once the main
+// loop has ended a frame, so on a worker anything allocated lasts only until the job that allocated it returns.
+// each frame arena starts small, grows to its high water mark and is capped at kArena_FrameLimit bytes, past which
+// allocations fail. a thread's frame arenas are only ever touched by that thread, so there is no locking.
+
+typedef struct arenaBlock_s arenaBlock_s;
+
+typedef struct arena_s {
+    uint8_t * base = nullptr;
+    size_t size = 0;
+    size_t used = 0;
+    size_t highWater = 0;                // peak bytes in use since creation, overflow included
+    arenaBlock_s * overflow = nullptr;   // heap blocks taken since the last reset
+    size_t overflowUsed = 0;
+    uint64_t overflowCount = 0;          // allocations that went to the heap since creation
+    size_t limit = 0;                    // bytes in use past which allocations fail, 0 for none
+    memTag_e tag = kMemTag_Other;
+} arena_s;
+
+// how far an arena had allocated, for Arena_Rewind
+typedef struct arenaMark_s {
+    size_t used = 0;
+    arenaBlock_s * overflow = nullptr;
+    size_t blockUsed = 0;
+    size_t overflowUsed = 0;
+} arenaMark_s;
+
+typedef struct frameArenaStats_s {
+    size_t threads = 0;
+    size_t capacity = 0;      // bytes reserved by every frame arena
+    size_t highWater = 0;     // sum over every frame arena of its peak bytes in use
+    uint64_t overflowCount = 0;
+} frameArenaStats_s;
+
+static constexpr size_t kArena_FrameLimit = 16 * 1024 * 1024;
+
+// returns zero on failure
+int Arena_Init( arena_s * const arena, const memTag_e tag, const size_t size );
+
+void Arena_Free( arena_s * const arena );
+
+void * Arena_AllocSlow( arena_s * const arena, const size_t size, const size_t align );
+
+// align must be a power of two. returns nullptr only if the heap is exhausted.
+inline void * Arena_Alloc( arena_s * const arena, const size_t size, const size_t align ) {
+    const size_t offset = ( arena->used + ( align - 1 ) ) & ~( align - 1 );
+    if ( offset + size <= arena->size && arena->overflow == nullptr ) {
+        arena->used = offset + size;
+        return arena->base + offset;
+    }
+    return Arena_AllocSlow( arena, size, align );
+}
+
+// releases everything allocated, folding any overflow into a larger main block
+void Arena_Reset( arena_s * const arena );
+
+arenaMark_s Arena_GetMark( const arena_s * const arena );
+
+// releases everything allocated since mark was taken, for scratch scoped tighter than a reset. overflow blocks taken
+// since are freed, and the next reset grows the main block to cover them. the arena must not have been reset since.
+void Arena_Rewind( arena_s * const arena, const arenaMark_s mark );
+
+// the calling thread's frame boundary: releases its scratch arena and the older of its double arenas
+void FrameArena_BeginFrame( void );
+
+// the main loop's frame boundary: job workers begin a frame before their next job
+void FrameArena_EndFrame( void );
+
+// job workers, between jobs: begins a frame if the main loop has ended one since the last
+void FrameArena_SyncFrame( void );
+
+// return nullptr if the thread's arena is at kArena_FrameLimit or the heap is exhausted
+void * FrameArena_Alloc( const size_t size, const size_t align );
+
+void * FrameArena_AllocDouble( const size_t size, const size_t align );
+
+template < typename _type_ >
+_type_ * FrameArena_New( const size_t count ) {
+    return ( _type_ * )FrameArena_Alloc( sizeof( _type_ ) * count, alignof( _type_ ) );
+}
+
+// the calling thread's scratch arena, for scoping scratch work that can happen many times a frame, like a sim tick
+arenaMark_s FrameArena_GetMark( void );
+
+void FrameArena_Rewind( const arenaMark_s mark );
+
+// totals over every thread that has used a frame arena. approximate while other threads are allocating.
+void FrameArena_GetStats( frameArenaStats_s * const stats );
+
+// frees every thread's frame arenas. no other thread may use them again.
+void FrameArena_Shutdown( void );
+
+#endif // ___RTSFS_ARENA_H___
@@ -0,0 +1,568 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "assetloader.h"
+
+#include "digraph.h"
+#include "file.h"
+#include "mem.h"
+#include "profile.h"
+#include "thread.h"
+
+#include <atomic>
+#include <new>
+
+static constexpr uint32_t kAssetLoader_RingSize = 64; // more than kAssetLoader_MaxInFlight, so a ring never fills
+static constexpr uint32_t kAssetLoader_RingMask = kAssetLoader_RingSize - 1;
+static constexpr size_t kAssetLoader_PageSize = 4096;
+
+static_assert( kAssetLoader_MaxInFlight < kAssetLoader_RingSize, "rings must hold every asset in flight" );
+
+// single producer, single consumer queue of asset indices
+typedef struct assetRing_s {
+    uint32_t slot[ kAssetLoader_RingSize ] = {};
+    std::atomic< uint32_t > head{ 0 }; // producer
+    uint8_t headPad[ 60 ];
+    std::atomic< uint32_t > tail{ 0 }; // consumer
+    uint8_t tailPad[ 60 ];
+} assetRing_s;
+
+typedef struct assetNode_s {
+    archiveAsset_s asset;
+    assetDecode_cb decode = nullptr;
+    assetRelease_cb release = nullptr;
+    void * param = nullptr;
+    digraphEntry_s entry;
+    void * object = nullptr;        // written by the decode thread while loading
+    size_t bytes = 0;
+    void ** dependency = nullptr;   // [ dependencyCount ] while loading
+    size_t dependencyCount = 0;
+    uint64_t lastWanted = 0;        // update that last wanted it
+    uint32_t pins = 0;              // assets loading or published that depend on it
+    assetState_e state = kAssetState_Idle;
+    uint32_t parents = 0;           // scratch while sorting
+    uint8_t requested = 0;          // since the last update
+    uint8_t priority = 0;           // with what depends on it, as of the last update
+} assetNode_s;
+
+typedef struct assetLoader_s assetLoader_s;
+
+typedef struct assetDecodeThread_s {
+    assetLoader_s * loader = nullptr;
+    thread_s * thread = nullptr;
+    signal_s * wake = nullptr;
+    assetRing_s queue;              // from the i/o thread
+    assetRing_s done;               // to the updating thread
+} assetDecodeThread_s;
+
+typedef struct assetLoader_s {
+    const archive_s * archive = nullptr;
+    digraph_s * graph = nullptr;
+    assetNode_s * node = nullptr;   // [ capacity ]
+    uint32_t * order = nullptr;     // [ capacity ] every asset, each before everything it depends on
+    size_t count = 0;
+    size_t capacity = 0;
+    int sorted = 0;                 // order is up to date with the graph
+
+    size_t budget = 0;
+    size_t bytes = 0;               // of published assets
+    size_t loadingBytes = 0;        // of the payloads in flight, standing in for what they will cost
+    size_t inFlight = 0;
+    uint64_t updates = 0;
+    size_t pending[ kAssetPriority_Count ] = {};
+    size_t published = 0;
+    size_t failed = 0;
+    uint64_t evicted = 0;
+    uint64_t blocked = 0;
+
+    thread_s * io = nullptr;
+    signal_s * ioWake = nullptr;
+    assetRing_s ioQueue;
+    size_t nextDecode = 0;          // i/o thread
+    uint8_t ioSink = 0;             // i/o thread; keeps the page touches
+    std::atomic< int > ioQuit{ 0 };
+    std::atomic< int > decodeQuit{ 0 };
+
+    assetDecodeThread_s decode[ kAssetLoader_MaxDecodeThreads ];
+    size_t decodeCount = 0;
+} assetLoader_s;
+
+static void PushRing( assetRing_s * const ring, const uint32_t value ) {
+    const uint32_t head = ring->head.load( std::memory_order_relaxed );
+    ring->slot[ head & kAssetLoader_RingMask ] = value;
+    ring->head.store( head + 1, std::memory_order_release );
+}
+
+static int PopRing( assetRing_s * const ring, uint32_t * const value ) {
+    const uint32_t tail = ring->tail.load( std::memory_order_relaxed );
+    if ( tail == ring->head.load( std::memory_order_acquire ) ) {
+        return 0;
+    }
+    *value = ring->slot[ tail & kAssetLoader_RingMask ];
+    ring->tail.store( tail + 1, std::memory_order_release );
+    return 1;
+}
+
+// pages payloads in, which is all loading is for a mapped archive, and hands the assets on to the decode threads in
+// turn. everything queued is prefetched up front so its reads overlap, then touched a byte a page in order.
+static void IoThread( void * const param ) {
+    assetLoader_s * const loader = ( assetLoader_s * )param;
+
+    for ( ;; ) {
+        uint32_t batch[ kAssetLoader_MaxInFlight ];
+        uint32_t batchCount = 0;
+        while ( batchCount < kAssetLoader_MaxInFlight && PopRing( &loader->ioQueue, &batch[ batchCount ] ) ) {
+            const archiveAsset_s * const asset = &loader->node[ batch[ batchCount ] ].asset;
+            File_Prefetch( asset->data, asset->bytes );
+            batchCount++;
+        }
+
+        for ( uint32_t i = 0; i < batchCount; i++ ) {
+            PROFILE_ZONE( "AssetLoader_Io" );
+
+            const archiveAsset_s * const asset = &loader->node[ batch[ i ] ].asset;
+            const volatile uint8_t * const payload = ( const volatile uint8_t * )asset->data;
+            uint8_t sink = 0;
+            for ( size_t offset = 0; offset < asset->bytes; offset += kAssetLoader_PageSize ) {
+                sink = ( uint8_t )( sink + payload[ offset ] );
+            }
+            loader->ioSink = ( uint8_t )( loader->ioSink ^ sink );
+
+            assetDecodeThread_s * const decode = &loader->decode[ loader->nextDecode++ % loader->decodeCount ];
+            PushRing( &decode->queue, batch[ i ] );
+            Signal_Raise( decode->wake );
+        }
+        if ( batchCount > 0 ) {
+            continue;
+        }
+
+        // quit is only set once nothing more will be queued
+        if ( loader->ioQuit.load( std::memory_order_acquire ) ) {
+            break;
+        }
+        Signal_Wait( loader->ioWake );
+    }
+}
+
+static void DecodeThread( void * const param ) {
+    assetDecodeThread_s * const me = ( assetDecodeThread_s * )param;
+    assetLoader_s * const loader = me->loader;
+
+    for ( ;; ) {
+        uint32_t index;
+        while ( PopRing( &me->queue, &index ) ) {
+            PROFILE_ZONE( "AssetLoader_Decode" );
+
+            assetNode_s * const node = &loader->node[ index ];
+            if ( node->decode != nullptr ) {
+                node->bytes = 0;
+                node->object = node->decode( node->param, &node->asset, node->dependency, node->dependencyCount, &node->bytes );
+            } else {
+                node->object = const_cast< void * >( node->asset.data );
+                node->bytes = node->asset.bytes;
+            }
+            PushRing( &me->done, index );
+        }
+
+        // the i/o thread has been joined by the time quit is set
+        if ( loader->decodeQuit.load( std::memory_order_acquire ) &&
+             me->queue.tail.load( std::memory_order_relaxed ) == me->queue.head.load( std::memory_order_acquire ) ) {
+            break;
+        }
+        Signal_Wait( me->wake );
+    }
+}
+
+static void StopThreads( assetLoader_s * const loader ) {
+    if ( loader->io != nullptr ) {
+        loader->ioQuit.store( 1, std::memory_order_release );
+        Signal_Raise( loader->ioWake );
+        Thread_Join( loader->io );
+        loader->io = nullptr;
+    }
+
+    loader->decodeQuit.store( 1, std::memory_order_release );
+    for ( size_t i = 0; i < loader->decodeCount; i++ ) {
+        if ( loader->decode[ i ].thread != nullptr ) {
+            Signal_Raise( loader->decode[ i ].wake );
+            Thread_Join( loader->decode[ i ].thread );
+            loader->decode[ i ].thread = nullptr;
+        }
+    }
+}
+
+assetLoader_s * AssetLoader_Create( const archive_s * const archive, const assetLoaderDesc_s * const desc ) {
+    if ( archive == nullptr || desc->capacity == 0 || desc->capacity >= kAssetLoader_Invalid ) {
+        return nullptr;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Assets, sizeof( assetLoader_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    assetLoader_s * const loader = new ( mem ) assetLoader_s;
+    loader->archive = archive;
+    loader->capacity = desc->capacity;
+    loader->budget = desc->budget;
+    const size_t cores = Thread_GetCoreCount();
+    const size_t threads = desc->decodeThreads > 0 ? desc->decodeThreads : ( cores > 1 ? cores - 1 : 1 );
+    loader->decodeCount = threads < kAssetLoader_MaxDecodeThreads ? threads : kAssetLoader_MaxDecodeThreads;
+
+    loader->graph = Digraph_Create( desc->capacity );
+    loader->node = ( assetNode_s * )Mem_Alloc( kMemTag_Assets, desc->capacity * sizeof( assetNode_s ) );
+    loader->order = ( uint32_t * )Mem_Alloc( kMemTag_Assets, desc->capacity * sizeof( uint32_t ) );
+    if ( loader->graph == nullptr || loader->node == nullptr || loader->order == nullptr ) {
+        AssetLoader_Destroy( loader );
+        return nullptr;
+    }
+    for ( size_t i = 0; i < desc->capacity; i++ ) {
+        new ( &loader->node[ i ] ) assetNode_s;
+    }
+
+    int started = 1;
+    for ( size_t i = 0; i < loader->decodeCount && started; i++ ) {
+        assetDecodeThread_s * const decode = &loader->decode[ i ];
+        decode->loader = loader;
+        decode->wake = Signal_Create();
+        decode->thread = decode->wake != nullptr ? Thread_Create( DecodeThread, decode ) : nullptr;
+        started = decode->thread != nullptr;
+    }
+    loader->ioWake = started ? Signal_Create() : nullptr;
+    loader->io = loader->ioWake != nullptr ? Thread_Create( IoThread, loader ) : nullptr;
+    if ( loader->io == nullptr ) {
+        AssetLoader_Destroy( loader );
+        return nullptr;
+    }
+
+    return loader;
+}
+
+static void Release( assetLoader_s * const loader, assetNode_s * const node ) {
+    ( void )loader;
+    if ( node->decode != nullptr && node->release != nullptr && node->object != nullptr ) {
+        node->release( node->param, node->object );
+    }
+    node->object = nullptr;
+    node->bytes = 0;
+}
+
+static assetNode_s * GetChild( assetLoader_s * const loader, const assetNode_s * const node, const size_t i ) {
+    return ( assetNode_s * )Digraph_GetNode( loader->graph, { Digraph_GetChild( loader->graph, node->entry, i ) } );
+}
+
+static void Unpin( assetLoader_s * const loader, const assetNode_s * const node ) {
+    const size_t childCount = Digraph_GetChildCount( loader->graph, node->entry );
+    for ( size_t i = 0; i < childCount; i++ ) {
+        GetChild( loader, node, i )->pins--;
+    }
+}
+
+// picks up what the decode threads finished
+static void Publish( assetLoader_s * const loader ) {
+    for ( size_t t = 0; t < loader->decodeCount; t++ ) {
+        uint32_t index;
+        while ( PopRing( &loader->decode[ t ].done, &index ) ) {
+            assetNode_s * const node = &loader->node[ index ];
+            Mem_Free( node->dependency );
+            node->dependency = nullptr;
+            node->dependencyCount = 0;
+            loader->inFlight--;
+            loader->loadingBytes -= node->asset.bytes;
+
+            if ( node->object == nullptr ) {
+                node->state = kAssetState_Failed;
+                node->bytes = 0;
+                loader->failed++;
+                Unpin( loader, node );
+                continue;
+            }
+
+            node->state = kAssetState_Published;
+            loader->bytes += node->bytes;
+            loader->published++;
+        }
+    }
+}
+
+// sorts the assets so each comes before everything it depends on, by repeatedly taking the ones nothing left
+// depends on. the graph is acyclic, so every asset is taken.
+static void Sort( assetLoader_s * const loader ) {
+    PROFILE_ZONE( "AssetLoader_Sort" );
+
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        loader->node[ i ].parents = 0;
+    }
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        const assetNode_s * const node = &loader->node[ i ];
+        const size_t childCount = Digraph_GetChildCount( loader->graph, node->entry );
+        for ( size_t c = 0; c < childCount; c++ ) {
+            GetChild( loader, node, c )->parents++;
+        }
+    }
+
+    size_t sorted = 0;
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        if ( loader->node[ i ].parents == 0 ) {
+            loader->order[ sorted++ ] = ( uint32_t )i;
+        }
+    }
+    for ( size_t i = 0; i < sorted; i++ ) {
+        const assetNode_s * const node = &loader->node[ loader->order[ i ] ];
+        const size_t childCount = Digraph_GetChildCount( loader->graph, node->entry );
+        for ( size_t c = 0; c < childCount; c++ ) {
+            assetNode_s * const child = GetChild( loader, node, c );
+            if ( --child->parents == 0 ) {
+                loader->order[ sorted++ ] = ( uint32_t )( child - loader->node );
+            }
+        }
+    }
+    loader->sorted = 1;
+}
+
+// in dependency order every asset's priority is final before it is pushed on, so each edge is followed once
+static void PushPriorities( assetLoader_s * const loader ) {
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        const assetNode_s * const node = &loader->node[ loader->order[ i ] ];
+        if ( node->priority == kAssetPriority_None ) {
+            continue;
+        }
+        const size_t childCount = Digraph_GetChildCount( loader->graph, node->entry );
+        for ( size_t c = 0; c < childCount; c++ ) {
+            assetNode_s * const child = GetChild( loader, node, c );
+            child->priority = node->priority > child->priority ? node->priority : child->priority;
+        }
+    }
+}
+
+// releases the least recently wanted published asset nothing needs. returns zero if there is none.
+static int EvictOne( assetLoader_s * const loader ) {
+    assetNode_s * victim = nullptr;
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        assetNode_s * const node = &loader->node[ i ];
+        if ( node->state == kAssetState_Published && node->priority == kAssetPriority_None && node->pins == 0 &&
+             ( victim == nullptr || node->lastWanted < victim->lastWanted ) ) {
+            victim = node;
+        }
+    }
+    if ( victim == nullptr ) {
+        return 0;
+    }
+
+    loader->bytes -= victim->bytes;
+    loader->published--;
+    loader->evicted++;
+    Release( loader, victim );
+    Unpin( loader, victim );
+    victim->state = kAssetState_Idle;
+    return 1;
+}
+
+// nonzero if everything node depends on is published; fails it if something failed
+static int IsReady( assetLoader_s * const loader, assetNode_s * const node ) {
+    int ready = 1;
+    const size_t childCount = Digraph_GetChildCount( loader->graph, node->entry );
+    for ( size_t i = 0; i < childCount; i++ ) {
+        const assetNode_s * const child = GetChild( loader, node, i );
+        if ( child->state == kAssetState_Failed ) {
+            node->state = kAssetState_Failed;
+            loader->failed++;
+            return 0;
+        }
+        ready = ready && child->state == kAssetState_Published;
+    }
+    return ready;
+}
+
+static int Start( assetLoader_s * const loader, assetNode_s * const node ) {
+    const size_t childCount = Digraph_GetChildCount( loader->graph, node->entry );
+    if ( childCount > 0 ) {
+        node->dependency = ( void ** )Mem_Alloc( kMemTag_Assets, childCount * sizeof( void * ) );
+        if ( node->dependency == nullptr ) {
+            return 0;
+        }
+    }
+    for ( size_t i = 0; i < childCount; i++ ) {
+        assetNode_s * const child = GetChild( loader, node, i );
+        child->pins++;
+        node->dependency[ i ] = child->object;
+    }
+    node->dependencyCount = childCount;
+
+    node->state = kAssetState_Loading;
+    loader->inFlight++;
+    loader->loadingBytes += node->asset.bytes;
+    PushRing( &loader->ioQueue, ( uint32_t )( node - loader->node ) );
+    return 1;
+}
+
+void AssetLoader_Update( assetLoader_s * const loader ) {
+    PROFILE_ZONE( "AssetLoader_Update" );
+
+    Publish( loader );
+
+    if ( !loader->sorted ) {
+        Sort( loader );
+    }
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        loader->node[ i ].priority = loader->node[ i ].requested;
+    }
+    PushPriorities( loader );
+
+    // the most wanted ready assets first, as long as they fit
+    int started = 0;
+    int stop = 0;
+    for ( uint32_t priority = kAssetPriority_Count - 1; priority > kAssetPriority_None && !stop; priority-- ) {
+        for ( size_t i = 0; i < loader->count && !stop; i++ ) {
+            assetNode_s * const node = &loader->node[ i ];
+            if ( node->priority != priority || node->state != kAssetState_Idle || !IsReady( loader, node ) ) {
+                continue;
+            }
+            if ( loader->inFlight == kAssetLoader_MaxInFlight ) {
+                stop = 1;
+                break;
+            }
+            while ( loader->bytes + loader->loadingBytes + node->asset.bytes > loader->budget && EvictOne( loader ) ) {
+            }
+            if ( loader->bytes + loader->loadingBytes + node->asset.bytes > loader->budget || !Start( loader, node ) ) {
+                loader->blocked++;
+                stop = 1;
+                break;
+            }
+            started = 1;
+        }
+    }
+    if ( started ) {
+        Signal_Raise( loader->ioWake );
+    }
+
+    for ( size_t p = 0; p < kAssetPriority_Count; p++ ) {
+        loader->pending[ p ] = 0;
+    }
+    for ( size_t i = 0; i < loader->count; i++ ) {
+        assetNode_s * const node = &loader->node[ i ];
+        if ( node->priority != kAssetPriority_None ) {
+            node->lastWanted = loader->updates;
+            if ( node->state == kAssetState_Idle || node->state == kAssetState_Loading ) {
+                for ( uint32_t p = 0; p <= node->priority; p++ ) {
+                    loader->pending[ p ]++;
+                }
+            }
+        }
+        node->requested = kAssetPriority_None;
+    }
+    loader->updates++;
+}
+
+void AssetLoader_Destroy( assetLoader_s * const loader ) {
+    if ( loader == nullptr ) {
+        return;
+    }
+
+    StopThreads( loader );
+    for ( size_t i = 0; i < kAssetLoader_MaxDecodeThreads; i++ ) {
+        Signal_Destroy( loader->decode[ i ].wake );
+    }
+    Signal_Destroy( loader->ioWake );
+
+    if ( loader->node != nullptr ) {
+        Publish( loader );
+        for ( size_t i = 0; i < loader->count; i++ ) {
+            Release( loader, &loader->node[ i ] );
+        }
+        for ( size_t i = 0; i < loader->capacity; i++ ) {
+            loader->node[ i ].~assetNode_s();
+        }
+        Mem_Free( loader->node );
+    }
+    Mem_Free( loader->order );
+    Digraph_Destroy( loader->graph );
+
+    loader->~assetLoader_s();
+    Mem_Free( loader );
+}
+
+uint32_t AssetLoader_Add( assetLoader_s * const loader, const char * const name, assetDecode_cb const decode, assetRelease_cb const release, void * const param ) {
+    if ( loader->count == loader->capacity ) {
+        return kAssetLoader_Invalid;
+    }
+
+    assetNode_s * const node = &loader->node[ loader->count ];
+    if ( !Archive_Find( loader->archive, name, &node->asset ) ) {
+        return kAssetLoader_Invalid;
+    }
+    node->entry = Digraph_AddNode( loader->graph, node );
+    if ( node->entry.value == SIZE_MAX ) {
+        return kAssetLoader_Invalid;
+    }
+
+    node->decode = decode;
+    node->release = release;
+    node->param = param;
+    loader->sorted = 0;
+    return ( uint32_t )loader->count++;
+}
+
+int AssetLoader_AddDependency( assetLoader_s * const loader, const uint32_t asset, const uint32_t dependency ) {
+    if ( asset >= loader->count || dependency >= loader->count || loader->node[ asset ].state != kAssetState_Idle ) {
+        return 0;
+    }
+
+    if ( Digraph_AddDependency( loader->graph, kDigraphOpt_NonCyclic, loader->node[ asset ].entry, loader->node[ dependency ].entry ) != kDigraphError_None ) {
+        return 0;
+    }
+    loader->sorted = 0;
+    return 1;
+}
+
+void AssetLoader_Request( assetLoader_s * const loader, const uint32_t asset, const assetPriority_e priority ) {
+    if ( asset >= loader->count ) {
+        return;
+    }
+
+    uint8_t * const requested = &loader->node[ asset ].requested;
+    *requested = priority > *requested ? ( uint8_t )priority : *requested;
+}
+
+void * AssetLoader_Get( const assetLoader_s * const loader, const uint32_t asset ) {
+    if ( asset >= loader->count || loader->node[ asset ].state != kAssetState_Published ) {
+        return nullptr;
+    }
+    return loader->node[ asset ].object;
+}
+
+assetState_e AssetLoader_GetState( const assetLoader_s * const loader, const uint32_t asset ) {
+    return asset < loader->count ? loader->node[ asset ].state : kAssetState_Failed;
+}
+
+size_t AssetLoader_GetPending( const assetLoader_s * const loader, const assetPriority_e priority ) {
+    return priority < kAssetPriority_Count ? loader->pending[ priority ] : 0;
+}
+
+void AssetLoader_GetStats( const assetLoader_s * const loader, assetLoaderStats_s * const stats ) {
+    stats->published = loader->published;
+    stats->loading = loader->inFlight;
+    stats->failed = loader->failed;
+    stats->bytes = loader->bytes;
+    stats->evicted = loader->evicted;
+    stats->blocked = loader->blocked;
+}
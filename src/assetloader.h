@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_ASSETLOADER_H___
+#define ___RTSFS_ASSETLOADER_H___
+
+#include "archive.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// streams assets out of an archive in the background, dependencies first, most wanted first.
+//
+// every asset is a node in a digraph_s with an edge to each asset it depends on: a unit to its sprites and sounds, a
+// tileset to its palette. an asset is ready to load once everything it depends on is published, so loading walks
+// the graph from the leaves up. a ready asset goes to the i/o thread, which pages its payload in from the archive,
+// then to one of the decode threads, which turns it into whatever the game uses, given its published dependencies.
+// it is published, and AssetLoader_Get starts returning it, on the first AssetLoader_Update after that.
+//
+// what to load is asked for again every frame: AssetLoader_Request marks an asset wanted at a priority until the
+// next AssetLoader_Update, typically visible for what is on screen and lower for what is near it. the update pushes
+// each wanted asset's priority down to everything it depends on, then starts the highest priority ready assets. only
+// a few are in flight at once, so when the view moves the new visible set overtakes whatever was queued for the
+// old one. wanting the visible set and waiting for AssetLoader_GetPending of it to reach zero gets the first
+// interactive frame without waiting for anything else.
+//
+// published assets count their size against a memory budget. when the next asset doesn't fit, the least recently
+// wanted published assets that aren't wanted now and that nothing loading or published depends on are released,
+// and if that doesn't make room nothing more starts until it does.
+//
+// the graph, the requests and the updates belong to one thread. the decode callbacks run on the decode threads.
+
+typedef struct assetLoader_s assetLoader_s;
+
+static constexpr uint32_t kAssetLoader_Invalid = UINT32_MAX;
+static constexpr size_t kAssetLoader_MaxDecodeThreads = 8;
+static constexpr size_t kAssetLoader_MaxInFlight = 32; // started and not yet published
+
+typedef enum assetPriority_e : uint8_t {
+    kAssetPriority_None = 0,
+    kAssetPriority_Background, // everything else, for when there is nothing better to do
+    kAssetPriority_Nearby,     // just off screen
+    kAssetPriority_Visible,
+    kAssetPriority_Count
+} assetPriority_e;
+
+typedef enum assetState_e : uint8_t {
+    kAssetState_Idle = 0, // not loaded
+    kAssetState_Loading,
+    kAssetState_Published,
+    kAssetState_Failed,   // the decode failed, or something it depends on did; not retried
+} assetState_e;
+
+// builds the object the game uses from the payload, on a decode thread. dependency holds the objects of the assets
+// it depends on, in the order they were added. returns nullptr on failure; otherwise sets bytes to what the object
+// costs against the budget.
+typedef void * ( * assetDecode_cb )( void * const param, const archiveAsset_s * const asset, void * const * const dependency, const size_t dependencyCount,
+                                     size_t * const bytes );
+
+// frees an object decode returned, on the thread calling AssetLoader_Update or AssetLoader_Destroy
+typedef void ( * assetRelease_cb )( void * const param, void * const object );
+
+typedef struct assetLoaderDesc_s {
+    size_t capacity = 1024;       // assets
+    size_t decodeThreads = 0;     // 0 for one per core besides the calling one, at most kAssetLoader_MaxDecodeThreads
+    size_t budget = 256u << 20;   // bytes of published assets
+} assetLoaderDesc_s;
+
+typedef struct assetLoaderStats_s {
+    size_t published = 0;
+    size_t loading = 0;
+    size_t failed = 0;
+    size_t bytes = 0;            // of published assets, against the budget
+    uint64_t evicted = 0;        // since creation
+    uint64_t blocked = 0;        // updates that left ready assets waiting on the budget
+} assetLoaderStats_s;
+
+// loads from archive, which must outlive the loader. returns nullptr on failure.
+assetLoader_s * AssetLoader_Create( const archive_s * const archive, const assetLoaderDesc_s * const desc );
+
+// waits for the assets in flight and releases everything
+void AssetLoader_Destroy( assetLoader_s * const loader );
+
+// adds the asset named name in the archive. without a decode callback the object is the payload itself, in the
+// archive's mapping, costing its size. returns kAssetLoader_Invalid if the name isn't in the archive or the loader is
+// full.
+uint32_t AssetLoader_Add( assetLoader_s * const loader, const char * const name, assetDecode_cb const decode, assetRelease_cb const release, void * const param );
+
+// makes asset depend on dependency. only while neither has started loading. returns zero if that would make a cycle.
+int AssetLoader_AddDependency( assetLoader_s * const loader, const uint32_t asset, const uint32_t dependency );
+
+// wants asset, and so everything it depends on, at priority until the next update. the highest request wins.
+void AssetLoader_Request( assetLoader_s * const loader, const uint32_t asset, const assetPriority_e priority );
+
+// publishes what finished, releases what no longer fits, starts what is ready and clears the requests. once a frame.
+void AssetLoader_Update( assetLoader_s * const loader );
+
+// the asset's object if it is published, otherwise nullptr
+void * AssetLoader_Get( const assetLoader_s * const loader, const uint32_t asset );
+
+assetState_e AssetLoader_GetState( const assetLoader_s * const loader, const uint32_t asset );
+
+// assets wanted at priority or higher, by request or through what depends on them, as of the last update, that are
+// neither published nor failed
+size_t AssetLoader_GetPending( const assetLoader_s * const loader, const assetPriority_e priority );
+
+void AssetLoader_GetStats( const assetLoader_s * const loader, assetLoaderStats_s * const stats );
+
+#endif // ___RTSFS_ASSETLOADER_H___
@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blit.h"
+#include "mem.h"
+#include "simd.h"
+#include "timer.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <stdio.h>
+
+static constexpr size_t kBlit_ColumnChunk = 512; // columns per table; keeps the tables on the stack and in L1
+
+// blitbench: a 4k surface zoomed onto a 4k screen
+static constexpr size_t kBlit_BenchWidth = 3840;
+static constexpr size_t kBlit_BenchHeight = 2160;
+static constexpr double kBlit_BenchScale[] = { 0.25, 0.5, 0.75, 1.0, 1.5, 2.0, 4.0 };
+
+typedef struct blitSetup_s {
+    size_t x0, x1;  // clipped, inclusive destination bounds
+    size_t y0, y1;
+    uint64_t stepX; // 16.16 source pixels per destination pixel
+    uint64_t stepY;
+    size_t srcWidth;
+    size_t srcHeight;
+} blitSetup_s;
+
+static int Setup( blitSetup_s * const setup, const rect_s< size_t > dstClip, const rect_s< size_t > dstRect, const rect_s< size_t > srcRect ) {
+    if ( dstRect.mx.x < dstRect.mn.x || dstRect.mx.y < dstRect.mn.y ) {
+        return 0;
+    }
+    if ( srcRect.mx.x < srcRect.mn.x || srcRect.mx.y < srcRect.mn.y ) {
+        return 0;
+    }
+
+    setup->x0 = dstRect.mn.x > dstClip.mn.x ? dstRect.mn.x : dstClip.mn.x;
+    setup->y0 = dstRect.mn.y > dstClip.mn.y ? dstRect.mn.y : dstClip.mn.y;
+    setup->x1 = dstRect.mx.x < dstClip.mx.x ? dstRect.mx.x : dstClip.mx.x;
+    setup->y1 = dstRect.mx.y < dstClip.mx.y ? dstRect.mx.y : dstClip.mx.y;
+    if ( setup->x1 < setup->x0 || setup->y1 < setup->y0 ) {
+        return 0;
+    }
+
+    setup->srcWidth = srcRect.mx.x - srcRect.mn.x + 1;
+    setup->srcHeight = srcRect.mx.y - srcRect.mn.y + 1;
+    setup->stepX = ( ( uint64_t )setup->srcWidth << 16 ) / ( dstRect.mx.x - dstRect.mn.x + 1 );
+    setup->stepY = ( ( uint64_t )setup->srcHeight << 16 ) / ( dstRect.mx.y - dstRect.mn.y + 1 );
+
+    return 1;
+}
+
+// source column ( or row ) nearest to the center of destination pixel i
+static inline size_t NearestIndex( const size_t i, const uint64_t step ) {
+    return ( size_t )( ( i * step + ( step >> 1 ) ) >> 16 );
+}
+
+// source column ( or row ) pair and 8 bit weight for the center of destination pixel i, clamped at the edges
+static inline void BilinearIndex( const size_t i, const uint64_t step, const size_t count, size_t * const i0, size_t * const i1, uint32_t * const frac ) {
+    const uint64_t center = i * step + ( step >> 1 );
+    const uint64_t pos = center > 0x8000 ? center - 0x8000 : 0;
+    const size_t index = ( size_t )( pos >> 16 );
+
+    if ( index + 1 >= count ) {
+        *i0 = count - 1;
+        *i1 = count - 1;
+        *frac = 0;
+    } else {
+        *i0 = index;
+        *i1 = index + 1;
+        *frac = ( uint32_t )( pos >> 8 ) & 0xff;
+    }
+}
+
+void Blit_ScaleNearest( rgba_s * const dst,
+                        const size_t dstStride,
+                        const rect_s< size_t > dstClip,
+                        const rect_s< size_t > dstRect,
+                        const rgba_s * const src,
+                        const size_t srcStride,
+                        const rect_s< size_t > srcRect ) {
+    blitSetup_s setup;
+    if ( dst == nullptr || src == nullptr || !Setup( &setup, dstClip, dstRect, srcRect ) ) {
+        return;
+    }
+
+    int32_t column[ kBlit_ColumnChunk ];
+
+    for ( size_t cx = setup.x0; cx <= setup.x1; cx += kBlit_ColumnChunk ) {
+        const size_t remain = setup.x1 - cx + 1;
+        const size_t count = remain < kBlit_ColumnChunk ? remain : kBlit_ColumnChunk;
+
+        for ( size_t j = 0; j < count; j++ ) {
+            column[ j ] = ( int32_t )( srcRect.mn.x + NearestIndex( cx - dstRect.mn.x + j, setup.stepX ) );
+        }
+
+        size_t prevRow = SIZE_MAX;
+
+        for ( size_t y = setup.y0; y <= setup.y1; y++ ) {
+            const size_t row = srcRect.mn.y + NearestIndex( y - dstRect.mn.y, setup.stepY );
+            rgba_s * const out = dst + y * dstStride + cx;
+
+            // magnified rows repeat; copying the previous output is cheaper than sampling again
+            if ( row == prevRow ) {
+                memcpy( out, out - dstStride, count * sizeof( rgba_s ) );
+                continue;
+            }
+            prevRow = row;
+
+            const rgba_s * const in = src + row * srcStride;
+            size_t j = 0;
+
+#if defined( RTSFS_SIMD_AVX2 )
+            for ( ; j + 8 <= count; j += 8 ) {
+                const __m256i index = _mm256_loadu_si256( ( const __m256i * )( column + j ) );
+                _mm256_storeu_si256( ( __m256i * )( out + j ), _mm256_i32gather_epi32( ( const int * )in, index, 4 ) );
+            }
+#endif
+
+            for ( ; j < count; j++ ) {
+                out[ j ] = in[ column[ j ] ];
+            }
+        }
+    }
+}
+
+// lerps by an 8 bit weight: ( a * ( 256 - w ) + b * w ) >> 8. the sum stays below 65536, so 16 bit lanes suffice.
+static inline uint32_t Lerp8( const uint32_t a, const uint32_t b, const uint32_t w ) {
+    return ( a * ( 256 - w ) + b * w ) >> 8;
+}
+
+// horizontal pass: resamples one source row through the column tables
+static void LerpColumns( rgba_s * const out,
+                         const rgba_s * const in,
+                         const int32_t * const column0,
+                         const int32_t * const column1,
+                         const uint32_t * const weight,
+                         const size_t count ) {
+    size_t j = 0;
+
+#if defined( RTSFS_SIMD_AVX2 )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i w256 = _mm256_set1_epi16( 256 );
+
+        for ( ; j + 8 <= count; j += 8 ) {
+            const __m256i i0 = _mm256_loadu_si256( ( const __m256i * )( column0 + j ) );
+            const __m256i i1 = _mm256_loadu_si256( ( const __m256i * )( column1 + j ) );
+            const __m256i w = _mm256_loadu_si256( ( const __m256i * )( weight + j ) );
+
+            const __m256i p0 = _mm256_i32gather_epi32( ( const int * )in, i0, 4 );
+            const __m256i p1 = _mm256_i32gather_epi32( ( const int * )in, i1, 4 );
+
+            const __m256i wLo = _mm256_unpacklo_epi8( w, zero );
+            const __m256i wHi = _mm256_unpackhi_epi8( w, zero );
+
+            const __m256i lo = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_unpacklo_epi8( p0, zero ), _mm256_sub_epi16( w256, wLo ) ),
+                                                 _mm256_mullo_epi16( _mm256_unpacklo_epi8( p1, zero ), wLo ) );
+            const __m256i hi = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_unpackhi_epi8( p0, zero ), _mm256_sub_epi16( w256, wHi ) ),
+                                                 _mm256_mullo_epi16( _mm256_unpackhi_epi8( p1, zero ), wHi ) );
+
+            _mm256_storeu_si256( ( __m256i * )( out + j ), _mm256_packus_epi16( _mm256_srli_epi16( lo, 8 ), _mm256_srli_epi16( hi, 8 ) ) );
+        }
+    }
+#elif defined( RTSFS_SIMD_SSE2 )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i w256 = _mm_set1_epi16( 256 );
+        const int32_t * const src = ( const int32_t * )in;
+
+        for ( ; j + 4 <= count; j += 4 ) {
+            const int32_t * const a = column0 + j;
+            const int32_t * const b = column1 + j;
+
+            const __m128i p0 = _mm_set_epi32( src[ a[ 3 ] ], src[ a[ 2 ] ], src[ a[ 1 ] ], src[ a[ 0 ] ] );
+            const __m128i p1 = _mm_set_epi32( src[ b[ 3 ] ], src[ b[ 2 ] ], src[ b[ 1 ] ], src[ b[ 0 ] ] );
+            const __m128i w = _mm_loadu_si128( ( const __m128i * )( weight + j ) );
+
+            const __m128i wLo = _mm_unpacklo_epi8( w, zero );
+            const __m128i wHi = _mm_unpackhi_epi8( w, zero );
+
+            const __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( p0, zero ), _mm_sub_epi16( w256, wLo ) ),
+                                              _mm_mullo_epi16( _mm_unpacklo_epi8( p1, zero ), wLo ) );
+            const __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( p0, zero ), _mm_sub_epi16( w256, wHi ) ),
+                                              _mm_mullo_epi16( _mm_unpackhi_epi8( p1, zero ), wHi ) );
+
+            _mm_storeu_si128( ( __m128i * )( out + j ), _mm_packus_epi16( _mm_srli_epi16( lo, 8 ), _mm_srli_epi16( hi, 8 ) ) );
+        }
+    }
+#endif
+
+    for ( ; j < count; j++ ) {
+        const rgba_s p0 = in[ column0[ j ] ];
+        const rgba_s p1 = in[ column1[ j ] ];
+        const uint32_t fx = weight[ j ] & 0xff;
+
+        out[ j ].b = ( uint8_t )Lerp8( p0.b, p1.b, fx );
+        out[ j ].g = ( uint8_t )Lerp8( p0.g, p1.g, fx );
+        out[ j ].r = ( uint8_t )Lerp8( p0.r, p1.r, fx );
+        out[ j ].a = ( uint8_t )Lerp8( p0.a, p1.a, fx );
+    }
+}
+
+// vertical pass: lerps two resampled rows
+static void LerpRows( rgba_s * const out, const rgba_s * const a, const rgba_s * const b, const uint32_t fy, const size_t count ) {
+    if ( fy == 0 ) {
+        memcpy( out, a, count * sizeof( rgba_s ) );
+        return;
+    }
+
+    size_t j = 0;
+
+#if defined( RTSFS_SIMD_AVX2 )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i wy = _mm256_set1_epi16( ( short )fy );
+        const __m256i iwy = _mm256_set1_epi16( ( short )( 256 - fy ) );
+
+        for ( ; j + 8 <= count; j += 8 ) {
+            const __m256i p0 = _mm256_loadu_si256( ( const __m256i * )( a + j ) );
+            const __m256i p1 = _mm256_loadu_si256( ( const __m256i * )( b + j ) );
+
+            const __m256i lo = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_unpacklo_epi8( p0, zero ), iwy ),
+                                                 _mm256_mullo_epi16( _mm256_unpacklo_epi8( p1, zero ), wy ) );
+            const __m256i hi = _mm256_add_epi16( _mm256_mullo_epi16( _mm256_unpackhi_epi8( p0, zero ), iwy ),
+                                                 _mm256_mullo_epi16( _mm256_unpackhi_epi8( p1, zero ), wy ) );
+
+            _mm256_storeu_si256( ( __m256i * )( out + j ), _mm256_packus_epi16( _mm256_srli_epi16( lo, 8 ), _mm256_srli_epi16( hi, 8 ) ) );
+        }
+    }
+#endif
+
+#if defined( RTSFS_SIMD_SSE2 )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wy = _mm_set1_epi16( ( short )fy );
+        const __m128i iwy = _mm_set1_epi16( ( short )( 256 - fy ) );
+
+        for ( ; j + 4 <= count; j += 4 ) {
+            const __m128i p0 = _mm_loadu_si128( ( const __m128i * )( a + j ) );
+            const __m128i p1 = _mm_loadu_si128( ( const __m128i * )( b + j ) );
+
+            const __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( p0, zero ), iwy ),
+                                              _mm_mullo_epi16( _mm_unpacklo_epi8( p1, zero ), wy ) );
+            const __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( p0, zero ), iwy ),
+                                              _mm_mullo_epi16( _mm_unpackhi_epi8( p1, zero ), wy ) );
+
+            _mm_storeu_si128( ( __m128i * )( out + j ), _mm_packus_epi16( _mm_srli_epi16( lo, 8 ), _mm_srli_epi16( hi, 8 ) ) );
+        }
+    }
+#endif
+
+    for ( ; j < count; j++ ) {
+        out[ j ].b = ( uint8_t )Lerp8( a[ j ].b, b[ j ].b, fy );
+        out[ j ].g = ( uint8_t )Lerp8( a[ j ].g, b[ j ].g, fy );
+        out[ j ].r = ( uint8_t )Lerp8( a[ j ].r, b[ j ].r, fy );
+        out[ j ].a = ( uint8_t )Lerp8( a[ j ].a, b[ j ].a, fy );
+    }
+}
+
+void Blit_ScaleBilinear( rgba_s * const dst,
+                         const size_t dstStride,
+                         const rect_s< size_t > dstClip,
+                         const rect_s< size_t > dstRect,
+                         const rgba_s * const src,
+                         const size_t srcStride,
+                         const rect_s< size_t > srcRect ) {
+    blitSetup_s setup;
+    if ( dst == nullptr || src == nullptr || !Setup( &setup, dstClip, dstRect, srcRect ) ) {
+        return;
+    }
+
+    int32_t column0[ kBlit_ColumnChunk ];
+    int32_t column1[ kBlit_ColumnChunk ];
+    uint32_t weight[ kBlit_ColumnChunk ]; // replicated into all four bytes so it unpacks per channel
+
+    // the filter is separable: source rows are resampled horizontally once and kept while output rows still need
+    // them, so magnifying costs one vertical lerp per output row
+    rgba_s resampled[ 2 ][ kBlit_ColumnChunk ];
+
+    for ( size_t cx = setup.x0; cx <= setup.x1; cx += kBlit_ColumnChunk ) {
+        const size_t remain = setup.x1 - cx + 1;
+        const size_t count = remain < kBlit_ColumnChunk ? remain : kBlit_ColumnChunk;
+
+        for ( size_t j = 0; j < count; j++ ) {
+            size_t i0;
+            size_t i1;
+            uint32_t frac;
+            BilinearIndex( cx - dstRect.mn.x + j, setup.stepX, setup.srcWidth, &i0, &i1, &frac );
+            column0[ j ] = ( int32_t )( srcRect.mn.x + i0 );
+            column1[ j ] = ( int32_t )( srcRect.mn.x + i1 );
+            weight[ j ] = frac * 0x01010101u;
+        }
+
+        size_t cachedRow[ 2 ] = { SIZE_MAX, SIZE_MAX };
+
+        for ( size_t y = setup.y0; y <= setup.y1; y++ ) {
+            size_t r0;
+            size_t r1;
+            uint32_t fy;
+            BilinearIndex( y - dstRect.mn.y, setup.stepY, setup.srcHeight, &r0, &r1, &fy );
+
+            // rows only advance, so a missing row can always replace whichever slot isn't the other needed row
+            size_t s0 = cachedRow[ 0 ] == r0 ? 0 : cachedRow[ 1 ] == r0 ? 1 : SIZE_MAX;
+            if ( s0 == SIZE_MAX ) {
+                s0 = cachedRow[ 0 ] == r1 ? 1 : 0;
+                cachedRow[ s0 ] = r0;
+                LerpColumns( resampled[ s0 ], src + ( srcRect.mn.y + r0 ) * srcStride, column0, column1, weight, count );
+            }
+
+            size_t s1 = s0;
+            if ( fy != 0 ) {
+                s1 = s0 ^ 1;
+                if ( cachedRow[ s1 ] != r1 ) {
+                    cachedRow[ s1 ] = r1;
+                    LerpColumns( resampled[ s1 ], src + ( srcRect.mn.y + r1 ) * srcStride, column0, column1, weight, count );
+                }
+            }
+
+            LerpRows( dst + y * dstStride + cx, resampled[ s0 ], resampled[ s1 ], fy, count );
+        }
+    }
+}
+
+// the source is the whole surface, stretched by scale from the screen's top left corner and clipped to the screen,
+// as a camera zoom is. below 1x the output covers part of the screen, so pixels written per second compare better
+// across scales than milliseconds do.
+static void BenchScale( rgba_s * const dst, const rgba_s * const src, const double scale, const size_t runs ) {
+    const rect_s< size_t > screen = rectFrom( vec2_zero< size_t >(), { kBlit_BenchWidth, kBlit_BenchHeight } );
+    const vec2_s< size_t > size = { ( size_t )( ( double )kBlit_BenchWidth * scale ), ( size_t )( ( double )kBlit_BenchHeight * scale ) };
+    const rect_s< size_t > dstRect = rectFrom( vec2_zero< size_t >(), size );
+    const double pixels = ( double )( size.x < kBlit_BenchWidth ? size.x : kBlit_BenchWidth ) *
+                          ( double )( size.y < kBlit_BenchHeight ? size.y : kBlit_BenchHeight );
+
+    uint64_t best[ 2 ] = { UINT64_MAX, UINT64_MAX };
+    for ( size_t run = 0; run < runs; run++ ) {
+        for ( size_t filter = 0; filter < 2; filter++ ) {
+            const uint64_t start = Timer_Nanoseconds();
+            if ( filter == 0 ) {
+                Blit_ScaleNearest( dst, kBlit_BenchWidth, screen, dstRect, src, kBlit_BenchWidth, screen );
+            } else {
+                Blit_ScaleBilinear( dst, kBlit_BenchWidth, screen, dstRect, src, kBlit_BenchWidth, screen );
+            }
+            const uint64_t ns = Timer_Nanoseconds() - start;
+            best[ filter ] = ns < best[ filter ] ? ns : best[ filter ];
+        }
+    }
+
+    printf( "%5.2fx %14.3f %10.1f %14.3f %10.1f\n", scale, ( double )best[ 0 ] / 1e6, pixels * 1e3 / ( double )best[ 0 ],
+        ( double )best[ 1 ] / 1e6, pixels * 1e3 / ( double )best[ 1 ] );
+}
+
+int Blit_Bench( const size_t runs ) {
+    const size_t count = kBlit_BenchWidth * kBlit_BenchHeight;
+    rgba_s * const src = ( rgba_s * )Mem_Alloc( kMemTag_Surface, count * sizeof( rgba_s ) );
+    rgba_s * const dst = ( rgba_s * )Mem_Alloc( kMemTag_Surface, count * sizeof( rgba_s ) );
+    if ( src == nullptr || dst == nullptr ) {
+        Mem_Free( dst );
+        Mem_Free( src );
+        return 0;
+    }
+
+    // something other than a flat fill, so no row or column repeats
+    for ( size_t i = 0; i < count; i++ ) {
+        const uint32_t x = ( uint32_t )i * 2654435761u;
+        src[ i ] = { ( uint8_t )x, ( uint8_t )( x >> 8 ), ( uint8_t )( x >> 16 ), 255 };
+    }
+    memset( dst, 0, count * sizeof( rgba_s ) );
+
+    printf( "blit %zux%zu onto %zux%zu, best of %zu\n", kBlit_BenchWidth, kBlit_BenchHeight, kBlit_BenchWidth, kBlit_BenchHeight, runs );
+    printf( "%-6s %14s %10s %14s %10s\n", "scale", "nearest ms", "Mpix/s", "bilinear ms", "Mpix/s" );
+    for ( size_t i = 0; i < sizeof( kBlit_BenchScale ) / sizeof( kBlit_BenchScale[ 0 ] ); i++ ) {
+        BenchScale( dst, src, kBlit_BenchScale[ i ], runs );
+    }
+
+    Mem_Free( dst );
+    Mem_Free( src );
+    return 1;
+}
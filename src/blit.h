@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_BLIT_H___
+#define ___RTSFS_BLIT_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// scaled copies between rgba_s surfaces, used for camera zoom.
+//
+// srcRect (inclusive) is stretched over dstRect (inclusive), and only the part of dstRect inside dstClip is written.
+// clipping never changes the mapping, so a zoomed view that scrolls off the edge of the surface doesn't swim.
+// sampling steps through the source in 16.16 fixed point using per column tables built once per call.
+//
+// srcRect must lie within the source surface and dstClip within the destination surface. dstRect may extend past
+// both dstClip and the destination, as a zoomed in view does: it is clipped before anything is sampled, so the cost
+// follows the clipped area.
+
+void Blit_ScaleNearest( rgba_s * const dst,
+                        const size_t dstStride,
+                        const rect_s< size_t > dstClip,
+                        const rect_s< size_t > dstRect,
+                        const rgba_s * const src,
+                        const size_t srcStride,
+                        const rect_s< size_t > srcRect );
+
+// samples pixel centers, so edges clamp instead of wrapping. weights are 8 bit.
+void Blit_ScaleBilinear( rgba_s * const dst,
+                         const size_t dstStride,
+                         const rect_s< size_t > dstClip,
+                         const rect_s< size_t > dstRect,
+                         const rgba_s * const src,
+                         const size_t srcStride,
+                         const rect_s< size_t > srcRect );
+
+// the blitbench tool: prints the best of runs timings of both filters zooming a 4k surface onto a 4k screen at
+// scales from 0.25x to 4x. returns zero if the surfaces can't be allocated.
+int Blit_Bench( const size_t runs );
+
+#endif // ___RTSFS_BLIT_H___
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "capture.h"
+#include "job.h"
+#include "mem.h"
+#include "profile.h"
+#include "simd.h"
+#include "thread.h"
+#include "timer.h"
+
+#include <memory.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+static constexpr uint32_t kCapture_Frames = 4;          // pooled frames the presenting thread can run ahead by
+static constexpr size_t kCapture_MaxPath = 1024;
+static constexpr size_t kCapture_Slack = 64;            // for the file header and whole vector stores past the end
+static constexpr uint32_t kCapture_Opaque = 0xff000000; // alpha of a packed rgba_s; frames are encoded as opaque rgb
+static constexpr size_t kCapture_QoiMaxRun = 62;
+static constexpr size_t kCapture_MinCopyRows = 32;     // rows of a frame copied per job
+
+typedef struct captureFrame_s {
+    rgba_s * pixels = nullptr; // full size, but only dirty is current
+    rect_s< size_t > dirty;
+    int changed = 0;           // zero if dirty is empty
+    uint64_t number = 0;       // of the frame among those offered
+} captureFrame_s;
+
+typedef struct capture_s {
+    char path[ kCapture_MaxPath ] = {};
+    vec2_s< size_t > size;
+    captureFormat_e format = kCaptureFormat_Qoi;
+    size_t every = 1;
+
+    thread_s * thread = nullptr;
+    signal_s * wake = nullptr;  // raised when a frame is queued or on quit
+    signal_s * done = nullptr;  // raised when a frame is written
+
+    captureFrame_s frame[ kCapture_Frames ];
+    std::atomic< uint32_t > head{ 0 }; // presenting thread
+    uint8_t headPad[ 60 ];
+    std::atomic< uint32_t > tail{ 0 }; // capture thread
+    uint8_t tailPad[ 60 ];
+    std::atomic< uint32_t > finished{ 0 }; // capture thread; frames written or failed
+    std::atomic< int > quit{ 0 };
+
+    // presenting thread
+    uint64_t offered = 0;
+    rect_s< size_t > carry;     // changed since the last frame queued
+    int carrying = 0;
+
+    // capture thread
+    rgba_s * image = nullptr;   // as of the last frame applied
+    uint8_t * out = nullptr;    // the encoded file
+    size_t outCapacity = 0;
+
+    std::atomic< uint64_t > encoded{ 0 };
+    std::atomic< uint64_t > dropped{ 0 };
+    std::atomic< uint64_t > failed{ 0 };
+    std::atomic< uint64_t > copyNs{ 0 };
+    std::atomic< uint64_t > encodeNs{ 0 };
+    std::atomic< uint64_t > bytes{ 0 };
+    std::atomic< uint64_t > offeredCount{ 0 };
+} capture_s;
+
+static inline uint32_t LoadPixel( const rgba_s * const pixel ) {
+    uint32_t value;
+    memcpy( &value, pixel, sizeof( value ) );
+    return value | kCapture_Opaque;
+}
+
+// how many of the first count pixels equal value, alpha ignored
+static size_t RunLength( const rgba_s * const pixels, const size_t count, const uint32_t value ) {
+    size_t i = 0;
+#if defined( RTSFS_SIMD_AVX2 )
+    const __m256i opaque256 = _mm256_set1_epi32( ( int )kCapture_Opaque );
+    const __m256i splat256 = _mm256_set1_epi32( ( int )value );
+    for ( ; i + 8 <= count; i += 8 ) {
+        const __m256i px = _mm256_or_si256( _mm256_loadu_si256( ( const __m256i * )( pixels + i ) ), opaque256 );
+        const uint32_t same = ( uint32_t )_mm256_movemask_epi8( _mm256_cmpeq_epi32( px, splat256 ) );
+        if ( same != 0xffffffffu ) {
+            break;
+        }
+    }
+#endif
+#if defined( RTSFS_SIMD_SSE2 )
+    const __m128i opaque = _mm_set1_epi32( ( int )kCapture_Opaque );
+    const __m128i splat = _mm_set1_epi32( ( int )value );
+    for ( ; i + 4 <= count; i += 4 ) {
+        const __m128i px = _mm_or_si128( _mm_loadu_si128( ( const __m128i * )( pixels + i ) ), opaque );
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( px, splat ) ) != 0xffff ) {
+            break;
+        }
+    }
+#endif
+    while ( i < count && LoadPixel( pixels + i ) == value ) {
+        i++;
+    }
+    return i;
+}
+
+static inline uint8_t * PutBigEndian32( uint8_t * const out, const uint32_t value ) {
+    out[ 0 ] = ( uint8_t )( value >> 24 );
+    out[ 1 ] = ( uint8_t )( value >> 16 );
+    out[ 2 ] = ( uint8_t )( value >> 8 );
+    out[ 3 ] = ( uint8_t )value;
+    return out + 4;
+}
+
+// qoi with 3 channels, following the reference encoder op for op. identical pixels are found a vector at a time,
+// which is most of a frame where only part of the screen moves.
+static size_t EncodeQoi( const rgba_s * const image, const vec2_s< size_t > size, uint8_t * const out ) {
+    PROFILE_ZONE( "Capture_EncodeQoi" );
+
+    uint8_t * o = out;
+    *o++ = 'q';
+    *o++ = 'o';
+    *o++ = 'i';
+    *o++ = 'f';
+    o = PutBigEndian32( o, ( uint32_t )size.x );
+    o = PutBigEndian32( o, ( uint32_t )size.y );
+    *o++ = 3; // rgb
+    *o++ = 0; // srgb
+
+    uint32_t index[ 64 ] = {};
+    uint32_t previous = kCapture_Opaque;
+    const size_t count = size.x * size.y;
+    for ( size_t i = 0; i < count; ) {
+        const uint32_t px = LoadPixel( image + i );
+        if ( px == previous ) {
+            size_t run = RunLength( image + i, count - i, previous );
+            i += run;
+            for ( ; run > kCapture_QoiMaxRun; run -= kCapture_QoiMaxRun ) {
+                *o++ = ( uint8_t )( 0xc0 | ( kCapture_QoiMaxRun - 1 ) );
+            }
+            *o++ = ( uint8_t )( 0xc0 | ( run - 1 ) );
+            continue;
+        }
+
+        const uint32_t b = px & 0xff;
+        const uint32_t g = ( px >> 8 ) & 0xff;
+        const uint32_t r = ( px >> 16 ) & 0xff;
+        const uint32_t slot = ( r * 3 + g * 5 + b * 7 + 255 * 11 ) & 63;
+        if ( index[ slot ] == px ) {
+            *o++ = ( uint8_t )slot;
+        } else {
+            index[ slot ] = px;
+
+            const int32_t dr = ( int8_t )( uint8_t )( r - ( ( previous >> 16 ) & 0xff ) );
+            const int32_t dg = ( int8_t )( uint8_t )( g - ( ( previous >> 8 ) & 0xff ) );
+            const int32_t db = ( int8_t )( uint8_t )( b - ( previous & 0xff ) );
+            const int32_t drg = dr - dg;
+            const int32_t dbg = db - dg;
+            if ( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 ) {
+                *o++ = ( uint8_t )( 0x40 | ( ( dr + 2 ) << 4 ) | ( ( dg + 2 ) << 2 ) | ( db + 2 ) );
+            } else if ( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7 ) {
+                *o++ = ( uint8_t )( 0x80 | ( dg + 32 ) );
+                *o++ = ( uint8_t )( ( ( drg + 8 ) << 4 ) | ( dbg + 8 ) );
+            } else {
+                *o++ = 0xfe;
+                *o++ = ( uint8_t )r;
+                *o++ = ( uint8_t )g;
+                *o++ = ( uint8_t )b;
+            }
+        }
+        previous = px;
+        i++;
+    }
+
+    static const uint8_t end[ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    memcpy( o, end, sizeof( end ) );
+    return ( size_t )( o + sizeof( end ) - out );
+}
+
+// bgra to rgb. the vector paths write up to 4 bytes past the row, which the output buffer's slack covers.
+static uint8_t * SwizzleRow( const rgba_s * src, size_t count, uint8_t * out ) {
+#if defined( RTSFS_SIMD_AVX2 )
+    const __m256i shuffle = _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+    for ( ; count >= 8; count -= 8, src += 8, out += 24 ) {
+        const __m256i rgb = _mm256_shuffle_epi8( _mm256_loadu_si256( ( const __m256i * )src ), shuffle );
+        _mm_storeu_si128( ( __m128i * )out, _mm256_castsi256_si128( rgb ) );
+        _mm_storeu_si128( ( __m128i * )( out + 12 ), _mm256_extracti128_si256( rgb, 1 ) );
+    }
+#endif
+#if defined( RTSFS_SIMD_SSE2 )
+    // no byte shuffle: swap red and blue within each pixel, then pack pairs of pixels into 6 byte halves
+    const __m128i green = _mm_set1_epi32( 0x0000ff00 );
+    const __m128i low = _mm_set1_epi32( 0x000000ff );
+    const __m128i even = _mm_set_epi32( 0, -1, 0, -1 );
+    for ( ; count >= 4; count -= 4, src += 4, out += 12 ) {
+        const __m128i px = _mm_loadu_si128( ( const __m128i * )src );
+        const __m128i rgb = _mm_or_si128( _mm_or_si128( _mm_and_si128( px, green ),
+                                                        _mm_and_si128( _mm_srli_epi32( px, 16 ), low ) ),
+                                          _mm_slli_epi32( _mm_and_si128( px, low ), 16 ) );
+        const __m128i packed = _mm_or_si128( _mm_and_si128( rgb, even ), _mm_srli_epi64( _mm_andnot_si128( even, rgb ), 8 ) );
+        _mm_storel_epi64( ( __m128i * )out, packed );
+        _mm_storel_epi64( ( __m128i * )( out + 6 ), _mm_unpackhi_epi64( packed, packed ) );
+    }
+#endif
+    for ( ; count != 0; count--, src++ ) {
+        *out++ = src->r;
+        *out++ = src->g;
+        *out++ = src->b;
+    }
+    return out;
+}
+
+static size_t EncodePpm( const rgba_s * const image, const vec2_s< size_t > size, uint8_t * const out ) {
+    PROFILE_ZONE( "Capture_EncodePpm" );
+
+    const int header = snprintf( ( char * )out, kCapture_Slack, "P6\n%zu %zu\n255\n", size.x, size.y );
+    uint8_t * o = out + ( header > 0 ? header : 0 );
+    for ( size_t y = 0; y < size.y; y++ ) {
+        o = SwizzleRow( image + y * size.x, size.x, o );
+    }
+    return ( size_t )( o - out );
+}
+
+static int WriteFrame( capture_s * const capture, const uint64_t number, size_t * const size ) {
+    *size = capture->format == kCaptureFormat_Qoi ? EncodeQoi( capture->image, capture->size, capture->out )
+                                                  : EncodePpm( capture->image, capture->size, capture->out );
+
+    PROFILE_ZONE( "Capture_Write" );
+
+    char name[ kCapture_MaxPath + 32 ];
+    snprintf( name, sizeof( name ), "%s%06llu.%s", capture->path, ( unsigned long long )number,
+              capture->format == kCaptureFormat_Qoi ? "qoi" : "ppm" );
+
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, name, "wb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( name, "wb" );
+#endif
+    if ( file == nullptr ) {
+        return 0;
+    }
+
+    int ok = fwrite( capture->out, 1, *size, file ) == *size;
+    if ( fclose( file ) != 0 ) {
+        ok = 0;
+    }
+    return ok;
+}
+
+static void CopyRect( rgba_s * const dst, const size_t dstStride, const rgba_s * const src, const size_t srcStride, const rect_s< size_t > rect ) {
+    const size_t bytes = ( rect.mx.x - rect.mn.x + 1 ) * sizeof( rgba_s );
+    for ( size_t y = rect.mn.y; y <= rect.mx.y; y++ ) {
+        memcpy( dst + y * dstStride + rect.mn.x, src + y * srcStride + rect.mn.x, bytes );
+    }
+}
+
+typedef struct captureCopyTask_s {
+    rgba_s * dst;
+    size_t dstStride;
+    const rgba_s * src;
+    size_t srcStride;
+    rect_s< size_t > rect;
+} captureCopyTask_s;
+
+// copies rows of the task's rect with streaming stores where the destination allows, so the copy doesn't pull the
+// pooled frame into this thread's cache only to have the capture thread read it from another core
+static void CopyRowsRange( void * const param, const size_t begin, const size_t end ) {
+    const captureCopyTask_s * const task = ( const captureCopyTask_s * )param;
+    const size_t width = task->rect.mx.x - task->rect.mn.x + 1;
+
+    for ( size_t y = task->rect.mn.y + begin; y < task->rect.mn.y + end; y++ ) {
+        rgba_s * dst = task->dst + y * task->dstStride + task->rect.mn.x;
+        const rgba_s * src = task->src + y * task->srcStride + task->rect.mn.x;
+        size_t count = width;
+#if defined( RTSFS_SIMD_SSE2 )
+        for ( ; count != 0 && ( ( uintptr_t )dst & 15 ) != 0; count--, dst++, src++ ) {
+            *dst = *src;
+        }
+        for ( ; count >= 16; count -= 16, dst += 16, src += 16 ) {
+            const __m128i a = _mm_loadu_si128( ( const __m128i * )src );
+            const __m128i b = _mm_loadu_si128( ( const __m128i * )( src + 4 ) );
+            const __m128i c = _mm_loadu_si128( ( const __m128i * )( src + 8 ) );
+            const __m128i d = _mm_loadu_si128( ( const __m128i * )( src + 12 ) );
+            _mm_stream_si128( ( __m128i * )dst, a );
+            _mm_stream_si128( ( __m128i * )( dst + 4 ), b );
+            _mm_stream_si128( ( __m128i * )( dst + 8 ), c );
+            _mm_stream_si128( ( __m128i * )( dst + 12 ), d );
+        }
+#endif
+        memcpy( dst, src, count * sizeof( rgba_s ) );
+    }
+#if defined( RTSFS_SIMD_SSE2 )
+    _mm_sfence();
+#endif
+}
+
+static void CaptureThread( void * const param ) {
+    capture_s * const capture = ( capture_s * )param;
+
+    uint32_t tail = capture->tail.load( std::memory_order_relaxed );
+    for ( ;; ) {
+        const uint32_t head = capture->head.load( std::memory_order_acquire );
+        while ( tail != head ) {
+            const uint64_t start = Timer_Nanoseconds();
+
+            const captureFrame_s * const frame = &capture->frame[ tail % kCapture_Frames ];
+            if ( frame->changed ) {
+                CopyRect( capture->image, capture->size.x, frame->pixels, capture->size.x, frame->dirty );
+            }
+            const uint64_t number = frame->number;
+
+            // the pooled frame is free again as soon as its changes are applied
+            tail++;
+            capture->tail.store( tail, std::memory_order_release );
+
+            size_t size = 0;
+            if ( WriteFrame( capture, number, &size ) ) {
+                capture->encoded.fetch_add( 1, std::memory_order_relaxed );
+                capture->bytes.fetch_add( size, std::memory_order_relaxed );
+            } else {
+                capture->failed.fetch_add( 1, std::memory_order_relaxed );
+            }
+            capture->encodeNs.fetch_add( Timer_Nanoseconds() - start, std::memory_order_relaxed );
+            capture->finished.store( tail, std::memory_order_release );
+            Signal_Raise( capture->done );
+        }
+
+        // quit is only set after the last frame was queued
+        if ( capture->quit.load( std::memory_order_acquire ) && tail == capture->head.load( std::memory_order_acquire ) ) {
+            break;
+        }
+        Signal_Wait( capture->wake );
+    }
+}
+
+capture_s * Capture_Create( const captureDesc_s * const desc ) {
+    if ( desc == nullptr || desc->path == nullptr || strlen( desc->path ) >= kCapture_MaxPath || desc->size.x == 0 ||
+         desc->size.y == 0 || desc->size.x > UINT32_MAX || desc->size.y > UINT32_MAX ) {
+        return nullptr;
+    }
+
+    capture_s * const capture = ( capture_s * )Mem_Alloc( kMemTag_Surface, sizeof( capture_s ) );
+    if ( capture == nullptr ) {
+        return nullptr;
+    }
+
+    new ( capture ) capture_s;
+    memcpy( capture->path, desc->path, strlen( desc->path ) + 1 );
+    capture->size = desc->size;
+    capture->format = desc->format;
+    capture->every = desc->every > 0 ? desc->every : 1;
+
+    // the capture thread's image starts out black, as the first frame replaces all of it
+    const size_t pixelCount = desc->size.x * desc->size.y;
+    int ok = 1;
+    for ( uint32_t i = 0; i < kCapture_Frames && ok; i++ ) {
+        capture->frame[ i ].pixels = ( rgba_s * )Mem_Alloc( kMemTag_Surface, pixelCount * sizeof( rgba_s ) );
+        ok = capture->frame[ i ].pixels != nullptr;
+    }
+    // a qoi rgb op is 4 bytes a pixel, the worst case of either format
+    capture->outCapacity = pixelCount * 4 + kCapture_Slack;
+    capture->image = ok ? ( rgba_s * )Mem_Alloc( kMemTag_Surface, pixelCount * sizeof( rgba_s ) ) : nullptr;
+    capture->out = capture->image != nullptr ? ( uint8_t * )Mem_Alloc( kMemTag_Surface, capture->outCapacity ) : nullptr;
+    capture->wake = capture->out != nullptr ? Signal_Create() : nullptr;
+    capture->done = capture->wake != nullptr ? Signal_Create() : nullptr;
+    capture->thread = capture->done != nullptr ? Thread_Create( CaptureThread, capture ) : nullptr;
+    if ( capture->thread == nullptr ) {
+        Capture_Destroy( capture );
+        return nullptr;
+    }
+    memset( capture->image, 0, pixelCount * sizeof( rgba_s ) );
+
+    return capture;
+}
+
+void Capture_Destroy( capture_s * const capture ) {
+    if ( capture == nullptr ) {
+        return;
+    }
+
+    if ( capture->thread != nullptr ) {
+        capture->quit.store( 1, std::memory_order_release );
+        Signal_Raise( capture->wake );
+        Thread_Join( capture->thread );
+    }
+    Signal_Destroy( capture->wake );
+    Signal_Destroy( capture->done );
+
+    for ( uint32_t i = 0; i < kCapture_Frames; i++ ) {
+        Mem_Free( capture->frame[ i ].pixels );
+    }
+    Mem_Free( capture->image );
+    Mem_Free( capture->out );
+
+    capture->~capture_s();
+    Mem_Free( capture );
+}
+
+int Capture_Frame( capture_s * const capture, const rgba_s * const pixels, const size_t stride, const rect_s< size_t > * const dirty ) {
+    PROFILE_ZONE( "Capture_Frame" );
+
+    const uint64_t start = Timer_Nanoseconds();
+    const uint64_t number = capture->offered++;
+    capture->offeredCount.store( capture->offered, std::memory_order_relaxed );
+
+    // what changed since the last frame queued, within the frame
+    const vec2_s< size_t > mx = capture->size - vec2_s< size_t >{ 1, 1 };
+    rect_s< size_t > changed = { vec2_zero< size_t >(), mx };
+    if ( dirty != nullptr ) {
+        changed.mn = dirty->mn;
+        changed.mx.x = dirty->mx.x < mx.x ? dirty->mx.x : mx.x;
+        changed.mx.y = dirty->mx.y < mx.y ? dirty->mx.y : mx.y;
+    }
+    int any = changed.mn.x <= changed.mx.x && changed.mn.y <= changed.mx.y;
+    if ( capture->carrying ) {
+        if ( any ) {
+            changed.mn.x = capture->carry.mn.x < changed.mn.x ? capture->carry.mn.x : changed.mn.x;
+            changed.mn.y = capture->carry.mn.y < changed.mn.y ? capture->carry.mn.y : changed.mn.y;
+            changed.mx.x = capture->carry.mx.x > changed.mx.x ? capture->carry.mx.x : changed.mx.x;
+            changed.mx.y = capture->carry.mx.y > changed.mx.y ? capture->carry.mx.y : changed.mx.y;
+        } else {
+            changed = capture->carry;
+            any = 1;
+        }
+    }
+
+    int queued = 0;
+    const uint32_t head = capture->head.load( std::memory_order_relaxed );
+    if ( number % capture->every != 0 ) {
+        // skipped by choice
+    } else if ( head - capture->tail.load( std::memory_order_acquire ) == kCapture_Frames ) {
+        capture->dropped.fetch_add( 1, std::memory_order_relaxed );
+    } else {
+        captureFrame_s * const frame = &capture->frame[ head % kCapture_Frames ];
+        if ( any ) {
+            captureCopyTask_s task;
+            task.dst = frame->pixels;
+            task.dstStride = capture->size.x;
+            task.src = pixels;
+            task.srcStride = stride;
+            task.rect = changed;
+            Job_ParallelFor( changed.mx.y - changed.mn.y + 1, kCapture_MinCopyRows, CopyRowsRange, &task );
+        }
+        frame->dirty = changed;
+        frame->changed = any;
+        frame->number = number;
+        capture->head.store( head + 1, std::memory_order_release );
+        Signal_Raise( capture->wake );
+        queued = 1;
+    }
+
+    // anything not handed over has to go with the next frame that is
+    capture->carry = changed;
+    capture->carrying = !queued && any;
+
+    capture->copyNs.fetch_add( Timer_Nanoseconds() - start, std::memory_order_relaxed );
+    return queued;
+}
+
+void Capture_Flush( capture_s * const capture ) {
+    PROFILE_ZONE( "Capture_Flush" );
+
+    const uint32_t head = capture->head.load( std::memory_order_relaxed );
+    while ( capture->finished.load( std::memory_order_acquire ) != head ) {
+        Signal_Wait( capture->done );
+    }
+}
+
+void Capture_GetStats( const capture_s * const capture, captureStats_s * const stats ) {
+    stats->offered = capture->offeredCount.load( std::memory_order_relaxed );
+    stats->encoded = capture->encoded.load( std::memory_order_relaxed );
+    stats->dropped = capture->dropped.load( std::memory_order_relaxed );
+    stats->failed = capture->failed.load( std::memory_order_relaxed );
+    stats->copyNs = capture->copyNs.load( std::memory_order_relaxed );
+    stats->encodeNs = capture->encodeNs.load( std::memory_order_relaxed );
+    stats->bytes = capture->bytes.load( std::memory_order_relaxed );
+}
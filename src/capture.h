@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_CAPTURE_H___
+#define ___RTSFS_CAPTURE_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// frame capture to numbered image files, for recording benchmark runs and diffing visual regressions.
+//
+// the presenting thread only copies what changed since the last captured frame into one of a small ring of pooled
+// frames. a capture thread applies each frame's changes to its own copy of the image and encodes that to a file,
+// so the presenting thread never waits on encoding or the disk. with every pooled frame still queued, a frame is
+// dropped, not waited for; its changed area is carried over into the next frame that is captured, so later files
+// stay exact.
+//
+// formats are lossless: qoi (the "quite ok image" format, 3 channels) or binary ppm.
+
+typedef struct capture_s capture_s;
+
+typedef enum captureFormat_e : uint8_t {
+    kCaptureFormat_Qoi,
+    kCaptureFormat_Ppm,
+} captureFormat_e;
+
+typedef struct captureDesc_s {
+    const char * path = nullptr;         // file name prefix; the frame number and extension are appended
+    vec2_s< size_t > size;               // of every frame
+    captureFormat_e format = kCaptureFormat_Qoi;
+    size_t every = 1;                    // capture one of every this many frames offered
+} captureDesc_s;
+
+typedef struct captureStats_s {
+    uint64_t offered = 0;   // frames passed to Capture_Frame
+    uint64_t encoded = 0;   // written to disk
+    uint64_t dropped = 0;   // refused with every pooled frame queued
+    uint64_t failed = 0;    // files that couldn't be written
+    uint64_t copyNs = 0;    // presenting thread time spent in Capture_Frame
+    uint64_t encodeNs = 0;  // capture thread time spent encoding and writing
+    uint64_t bytes = 0;     // written to disk
+} captureStats_s;
+
+// returns nullptr on failure
+capture_s * Capture_Create( const captureDesc_s * const desc );
+
+// encodes every frame still queued, then stops the capture thread
+void Capture_Destroy( capture_s * const capture );
+
+// queues pixels (desc size, stride pixels between rows) for encoding. dirty bounds what changed since the previous
+// frame offered, nullptr for everything and an empty rect (min past max) for nothing. returns zero if the frame was skipped or dropped.
+int Capture_Frame( capture_s * const capture, const rgba_s * const pixels, const size_t stride, const rect_s< size_t > * const dirty );
+
+// waits until every queued frame is on disk or failed
+void Capture_Flush( capture_s * const capture );
+
+void Capture_GetStats( const capture_s * const capture, captureStats_s * const stats );
+
+#endif // ___RTSFS_CAPTURE_H___
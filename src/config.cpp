@@ -25,6 +25,18 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined( _MSC_VER )
+#include <strings.h>
+#endif
+
+static int CompareNoCase( const char * const a, const char * const b ) {
+#if defined( _MSC_VER )
+    return _stricmp( a, b );
+#else
+    return strcasecmp( a, b );
+#endif
+}
+
 configResult_s Config_Parse( const size_t count, const char * const * const argv, const size_t ruleCount, configRule_s * const rules ) {
     for ( configRule_s * rule = rules; rule < rules + ruleCount; rule++ ) {
         rule->present = 0;
@@ -106,7 +118,7 @@ void Config_ParseBoolean( void * const result, const char * const value ) {
         "1",
     };
     for ( size_t i = 0; i < sizeof( possibilities ) / sizeof( possibilities[ 0 ] ); i++ ) {
-        if ( _stricmp( possibilities[ i ], value ) == 0 ) {
+        if ( CompareNoCase( possibilities[ i ], value ) == 0 ) {
             *( uint8_t * )( result ) = 1;
             return;
         }
@@ -21,6 +21,8 @@
  */
 
 #include "digraph.h"
+#include "mem.h"
+#include "profile.h"
 
 #include <assert.h>
 #include <memory.h>
@@ -53,7 +55,7 @@ static bool InsertHeadNode( digraph_s * const me, const size_t index ) {
     if ( me->headCount == me->headSize ) {
         constexpr size_t step = 16;
         size_t * const old = me->head;
-        me->head = new size_t[ me->headSize + step ];
+        me->head = ( size_t * )Mem_Alloc( kMemTag_Digraph, sizeof( size_t ) * ( me->headSize + step ) );
         if ( me->head == nullptr ) {
             me->head = old;
             return false;
@@ -61,7 +63,7 @@ static bool InsertHeadNode( digraph_s * const me, const size_t index ) {
         me->headSize += step;
         if ( old != nullptr ) {
             memcpy( me->head, old, sizeof( size_t ) * me->headCount );
-            delete [] old;
+            Mem_Free( old );
        }
     }
 
@@ -116,16 +118,28 @@ static int Walk( digraph_s * const me, const size_t nodeIndex, int ( * onNode )(
     return 1;
 }
 
+static digraphNode_s * AllocNodes( const size_t count ) {
+    digraphNode_s * const node = ( digraphNode_s * )Mem_Alloc( kMemTag_Digraph, sizeof( digraphNode_s ) * count );
+    if ( node != nullptr ) {
+        for ( size_t i = 0; i < count; i++ ) {
+            new ( node + i ) digraphNode_s;
+        }
+    }
+    return node;
+}
+
 digraph_s * Digraph_Create( const size_t hint_initialNodeCount ) {
-    digraph_s * const me = new digraph_s;
+    digraph_s * const me = ( digraph_s * )Mem_Alloc( kMemTag_Digraph, sizeof( digraph_s ) );
     if ( me == nullptr ) {
         return nullptr;
     }
 
+    new ( me ) digraph_s;
+
     if ( hint_initialNodeCount != 0 ) {
-        me->node = new digraphNode_s[ hint_initialNodeCount ];
+        me->node = AllocNodes( hint_initialNodeCount );
         if ( me->node == nullptr ) {
-            delete me;
+            Mem_Free( me );
             return nullptr;
         }
         me->nodeSize = hint_initialNodeCount;
@@ -141,10 +155,12 @@ void Digraph_Destroy( digraph_s * const me ) {
 
     Digraph_Clear( me );
 
-    delete me;
+    Mem_Free( me );
 }
 
 digraphEntry_s Digraph_AddNode( digraph_s * const me, void * const data ) {
+    PROFILE_ZONE( "Digraph_AddNode" );
+
     if ( me == nullptr ) {
         return { SIZE_MAX };
     }
@@ -165,7 +181,7 @@ digraphEntry_s Digraph_AddNode( digraph_s * const me, void * const data ) {
         if ( me->nodeCount == me->nodeSize ) {
             constexpr size_t step = 16;
             digraphNode_s * const old = me->node;
-            me->node = new digraphNode_s[ me->nodeSize + step ];
+            me->node = AllocNodes( me->nodeSize + step );
             if ( me->node == nullptr ) {
                 me->node = old;
                 return { SIZE_MAX };
@@ -173,7 +189,7 @@ digraphEntry_s Digraph_AddNode( digraph_s * const me, void * const data ) {
             me->nodeSize += step;
             if ( old != nullptr ) {
                 memcpy( me->node, old, sizeof( digraphNode_s ) * me->nodeCount );
-                delete [] old;
+                Mem_Free( old );
             }
         }
 
@@ -192,6 +208,8 @@ digraphEntry_s Digraph_AddNode( digraph_s * const me, void * const data ) {
 }
 
 void * Digraph_RemoveNode( digraph_s * const me, const digraphEntry_s entry ) {
+    PROFILE_ZONE( "Digraph_RemoveNode" );
+
     if ( me == nullptr ) {
         return nullptr;
     }
@@ -213,22 +231,26 @@ void * Digraph_RemoveNode( digraph_s * const me, const digraphEntry_s entry ) {
     }
 
     void * const data = node->data;
-    delete [] node->child;
+    Mem_Free( node->child );
     new ( node ) digraphNode_s;
 
     RemoveHeadNode( me, entry.value );
 
+    // only trailing unused nodes can go; an in use node past nodeCount would leak its child array
     for ( size_t i = me->nodeCount; i > 0; i-- ) {
         size_t index = i - 1;
-        if ( me->node[ index ].inUse == false ) {
-            me->nodeCount--;
+        if ( me->node[ index ].inUse ) {
+            break;
         }
+        me->nodeCount--;
     }
 
     return data;
 }
 
 digraphError_e Digraph_AddDependency( digraph_s * const me, const digraphOpt_e opt, const digraphEntry_s parent, const digraphEntry_s child ) {
+    PROFILE_ZONE( "Digraph_AddDependency" );
+
     if ( me == nullptr ) {
         return kDigraphError_InvalidParam;
     }
@@ -249,7 +271,7 @@ digraphError_e Digraph_AddDependency( digraph_s * const me, const digraphOpt_e o
     if ( node->childCount == node->childSize ) {
         constexpr size_t step = 4;
         size_t * const old = node->child;
-        node->child = new size_t[ node->childSize + step ];
+        node->child = ( size_t * )Mem_Alloc( kMemTag_Digraph, sizeof( size_t ) * ( node->childSize + step ) );
         if ( node->child == nullptr ) {
             node->child = old;
             return kDigraphError_OutOfMemory;
@@ -257,7 +279,7 @@ digraphError_e Digraph_AddDependency( digraph_s * const me, const digraphOpt_e o
         node->childSize += step;
         if ( old != nullptr ) {
             memcpy( node->child, old, sizeof( size_t ) * node->childCount );
-            delete [] old;
+            Mem_Free( old );
         }
     }
 
@@ -271,6 +293,8 @@ digraphError_e Digraph_AddDependency( digraph_s * const me, const digraphOpt_e o
 }
 
 digraphError_e Digraph_RemoveDependency( digraph_s * const me, const digraphEntry_s parent, const digraphEntry_s child ) {
+    PROFILE_ZONE( "Digraph_RemoveDependency" );
+
     if ( me == nullptr ) {
         return kDigraphError_InvalidParam;
     }
@@ -301,14 +325,14 @@ digraphError_e Digraph_RemoveDependency( digraph_s * const me, const digraphEntr
     return kDigraphError_None;
 }
 
-void * Digraph_GetNode( digraph_s * const me, const size_t id ) {
+void * Digraph_GetNode( digraph_s * const me, const digraphEntry_s entry ) {
     if ( me == nullptr ) {
         return nullptr;
     }
-    if ( id > me->nodeCount ) {
+    if ( entry.value > me->nodeCount ) {
         return nullptr;
     }
-    return me->node[ id ].data;
+    return me->node[ entry.value ].data;
 }
 
 size_t Digraph_GetChildCount( digraph_s * const me, const digraphEntry_s entry ) {
@@ -335,16 +359,20 @@ size_t Digraph_GetChild( digraph_s * const me, const digraphEntry_s entry, const
 }
 
 void Digraph_Clear( digraph_s * const me ) {
+    PROFILE_ZONE( "Digraph_Clear" );
+
     for ( size_t i = 0; i < me->nodeCount; i++ ) {
-        delete [] me->node[ i ].child;
+        Mem_Free( me->node[ i ].child );
     }
-    delete [] me->node;
-    delete [] me->head;
+    Mem_Free( me->node );
+    Mem_Free( me->head );
 
     new ( me ) digraph_s;
 }
 
 void Digraph_Walk( digraph_s * const me, int ( * onNode )( void * const param, void * const parent, void * const child ), void * const param ) {
+    PROFILE_ZONE( "Digraph_Walk" );
+
     for ( size_t i = 0; i < me->headCount; i++ ) {
         if ( Walk( me, me->head[ i ], onNode, param ) == 0 ) {
             break;
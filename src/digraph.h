@@ -23,6 +23,7 @@
 #ifndef ___RTSFS_DIGRAPH_H___
 #define ___RTSFS_DIGRAPH_H___
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct digraph_s digraph_s;
@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ecs.h"
+#include "mem.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <new>
+
+static constexpr uint32_t kEcs_Absent = UINT32_MAX;
+static constexpr uint32_t kEcs_GenerationMask = ( 1u << ( 32 - kEcs_IndexBits ) ) - 1;
+static constexpr uint32_t kEcs_Dead = 1u << 31; // in the mask of a retired index
+
+// one component's sparse set
+typedef struct ecsPool_s {
+    uint32_t * sparse = nullptr;  // [ entity index ] dense slot, or kEcs_Absent
+    ecsEntity_s * dense = nullptr;
+    uint8_t * data = nullptr;     // [ dense slot ] values, elementSize bytes each
+    size_t elementSize = 0;
+    size_t count = 0;
+} ecsPool_s;
+
+typedef struct ecsGroup_s {
+    uint32_t mask = 0;
+    size_t count = 0; // entities packed at the front of every pool in mask
+} ecsGroup_s;
+
+typedef struct ecs_s {
+    size_t capacity = 0;
+    size_t entityCount = 0;
+    size_t indexCount = 0;          // indices handed out so far, live or free
+    uint32_t * generation = nullptr; // [ entity index ]
+    uint32_t * mask = nullptr;       // [ entity index ] components present, or kEcs_Dead
+    uint32_t * freeIndex = nullptr;  // stack of retired indices
+    size_t freeCount = 0;
+    ecsPool_s pool[ kEcs_ComponentCount ];
+    ecsGroup_s group[ kEcs_MaxGroups ];
+    size_t groupCount = 0;
+} ecs_s;
+
+static const size_t kEcs_ElementSize[ kEcs_ComponentCount ] = {
+    sizeof( vec2_s< fixed_s > ), // position
+    sizeof( vec2_s< fixed_s > ), // velocity
+    sizeof( fixed_s ),           // health
+    sizeof( uint8_t ),           // owner
+    sizeof( uint32_t ),          // order
+};
+
+static inline uint32_t EntityIndex( const ecsEntity_s entity ) {
+    return entity.value & kEcs_IndexMask;
+}
+
+static inline uint32_t EntityGeneration( const ecsEntity_s entity ) {
+    return entity.value >> kEcs_IndexBits;
+}
+
+static inline size_t ComponentIndex( const uint32_t bit ) {
+    size_t i = 0;
+    while ( ( 1u << i ) != bit ) {
+        i++;
+    }
+    return i;
+}
+
+static void PoolSwap( ecsPool_s * const pool, const size_t a, const size_t b ) {
+    if ( a == b ) {
+        return;
+    }
+
+    const ecsEntity_s ea = pool->dense[ a ];
+    const ecsEntity_s eb = pool->dense[ b ];
+    pool->dense[ a ] = eb;
+    pool->dense[ b ] = ea;
+    pool->sparse[ EntityIndex( ea ) ] = ( uint32_t )b;
+    pool->sparse[ EntityIndex( eb ) ] = ( uint32_t )a;
+
+    uint8_t temp[ 8 ];
+    const size_t size = pool->elementSize;
+    assert( size <= sizeof( temp ) );
+    memcpy( temp, pool->data + a * size, size );
+    memcpy( pool->data + a * size, pool->data + b * size, size );
+    memcpy( pool->data + b * size, temp, size );
+}
+
+static void PoolInsert( ecsPool_s * const pool, const ecsEntity_s entity ) {
+    const size_t slot = pool->count++;
+    pool->dense[ slot ] = entity;
+    pool->sparse[ EntityIndex( entity ) ] = ( uint32_t )slot;
+    memset( pool->data + slot * pool->elementSize, 0, pool->elementSize );
+}
+
+static void PoolErase( ecsPool_s * const pool, const ecsEntity_s entity ) {
+    const uint32_t index = EntityIndex( entity );
+    PoolSwap( pool, pool->sparse[ index ], pool->count - 1 );
+    pool->count--;
+    pool->sparse[ index ] = kEcs_Absent;
+}
+
+// the pools of a group share the order of their prefix, so the first one stands in for all of them
+static inline ecsPool_s * GroupLead( ecs_s * const ecs, const ecsGroup_s * const group ) {
+    uint32_t bits = group->mask;
+    return &ecs->pool[ ComponentIndex( bits & ( ~bits + 1 ) ) ];
+}
+
+static void GroupEnter( ecs_s * const ecs, ecsGroup_s * const group, const ecsEntity_s entity ) {
+    const uint32_t index = EntityIndex( entity );
+    for ( uint32_t bits = group->mask; bits != 0; bits &= bits - 1 ) {
+        ecsPool_s * const pool = &ecs->pool[ ComponentIndex( bits & ( ~bits + 1 ) ) ];
+        PoolSwap( pool, pool->sparse[ index ], group->count );
+    }
+    group->count++;
+}
+
+static void GroupLeave( ecs_s * const ecs, ecsGroup_s * const group, const ecsEntity_s entity ) {
+    const uint32_t index = EntityIndex( entity );
+    group->count--;
+    for ( uint32_t bits = group->mask; bits != 0; bits &= bits - 1 ) {
+        ecsPool_s * const pool = &ecs->pool[ ComponentIndex( bits & ( ~bits + 1 ) ) ];
+        PoolSwap( pool, pool->sparse[ index ], group->count );
+    }
+}
+
+static inline int InGroup( ecs_s * const ecs, const ecsGroup_s * const group, const ecsEntity_s entity ) {
+    const ecsPool_s * const lead = GroupLead( ecs, group );
+    const uint32_t slot = lead->sparse[ EntityIndex( entity ) ];
+    return slot != kEcs_Absent && slot < group->count;
+}
+
+ecs_s * Ecs_Create( const size_t capacity, const uint32_t * const groupMasks, const size_t groupCount ) {
+    if ( capacity == 0 || capacity >= kEcs_IndexMask || groupCount > kEcs_MaxGroups ) {
+        return nullptr;
+    }
+
+    uint32_t grouped = 0;
+    for ( size_t i = 0; i < groupCount; i++ ) {
+        const uint32_t groupMask = groupMasks[ i ];
+        if ( groupMask == 0 || ( groupMask & grouped ) != 0 || groupMask >= ( 1u << kEcs_ComponentCount ) ) {
+            return nullptr;
+        }
+        grouped |= groupMask;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( ecs_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    ecs_s * const ecs = new ( mem ) ecs_s;
+    ecs->capacity = capacity;
+    ecs->generation = ( uint32_t * )Mem_Calloc( kMemTag_Sim, capacity, sizeof( uint32_t ) );
+    ecs->mask = ( uint32_t * )Mem_Calloc( kMemTag_Sim, capacity, sizeof( uint32_t ) );
+    ecs->freeIndex = ( uint32_t * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( uint32_t ) );
+    int failed = ecs->generation == nullptr || ecs->mask == nullptr || ecs->freeIndex == nullptr;
+
+    for ( size_t i = 0; i < kEcs_ComponentCount; i++ ) {
+        ecsPool_s * const pool = &ecs->pool[ i ];
+        pool->elementSize = kEcs_ElementSize[ i ];
+        pool->sparse = ( uint32_t * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( uint32_t ) );
+        pool->dense = ( ecsEntity_s * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( ecsEntity_s ) );
+        pool->data = ( uint8_t * )Mem_Alloc( kMemTag_Sim, capacity * pool->elementSize );
+        if ( pool->sparse == nullptr || pool->dense == nullptr || pool->data == nullptr ) {
+            failed = 1;
+            continue;
+        }
+        memset( pool->sparse, 0xff, capacity * sizeof( uint32_t ) );
+    }
+
+    if ( failed ) {
+        Ecs_Destroy( ecs );
+        return nullptr;
+    }
+
+    for ( size_t i = 0; i < groupCount; i++ ) {
+        ecs->group[ i ].mask = groupMasks[ i ];
+    }
+    ecs->groupCount = groupCount;
+
+    return ecs;
+}
+
+void Ecs_Destroy( ecs_s * const ecs ) {
+    if ( ecs == nullptr ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < kEcs_ComponentCount; i++ ) {
+        Mem_Free( ecs->pool[ i ].data );
+        Mem_Free( ecs->pool[ i ].dense );
+        Mem_Free( ecs->pool[ i ].sparse );
+    }
+    Mem_Free( ecs->freeIndex );
+    Mem_Free( ecs->mask );
+    Mem_Free( ecs->generation );
+
+    ecs->~ecs_s();
+    Mem_Free( ecs );
+}
+
+ecsEntity_s Ecs_CreateEntity( ecs_s * const ecs ) {
+    ecsEntity_s entity;
+
+    uint32_t index;
+    if ( ecs->freeCount != 0 ) {
+        index = ecs->freeIndex[ --ecs->freeCount ];
+    } else if ( ecs->indexCount < ecs->capacity ) {
+        index = ( uint32_t )ecs->indexCount++;
+    } else {
+        return entity;
+    }
+
+    entity.value = ( ecs->generation[ index ] << kEcs_IndexBits ) | index;
+    ecs->mask[ index ] = 0;
+    ecs->entityCount++;
+    return entity;
+}
+
+void Ecs_DestroyEntity( ecs_s * const ecs, const ecsEntity_s entity ) {
+    if ( !Ecs_IsAlive( ecs, entity ) ) {
+        return;
+    }
+
+    Ecs_Remove( ecs, entity, ecs->mask[ EntityIndex( entity ) ] );
+
+    const uint32_t index = EntityIndex( entity );
+    ecs->generation[ index ] = ( ecs->generation[ index ] + 1 ) & kEcs_GenerationMask;
+    ecs->mask[ index ] = kEcs_Dead;
+    ecs->freeIndex[ ecs->freeCount++ ] = index;
+    ecs->entityCount--;
+}
+
+int Ecs_IsAlive( const ecs_s * const ecs, const ecsEntity_s entity ) {
+    const uint32_t index = EntityIndex( entity );
+    return index < ecs->indexCount && ecs->generation[ index ] == EntityGeneration( entity ) &&
+        ( ecs->mask[ index ] & kEcs_Dead ) == 0;
+}
+
+size_t Ecs_GetEntityCount( const ecs_s * const ecs ) {
+    return ecs->entityCount;
+}
+
+int Ecs_Add( ecs_s * const ecs, const ecsEntity_s entity, const uint32_t mask ) {
+    if ( !Ecs_IsAlive( ecs, entity ) ) {
+        return 0;
+    }
+
+    const uint32_t index = EntityIndex( entity );
+    const uint32_t added = mask & ~ecs->mask[ index ] & ( ( 1u << kEcs_ComponentCount ) - 1 );
+    for ( uint32_t bits = added; bits != 0; bits &= bits - 1 ) {
+        PoolInsert( &ecs->pool[ ComponentIndex( bits & ( ~bits + 1 ) ) ], entity );
+    }
+    ecs->mask[ index ] |= added;
+
+    for ( size_t i = 0; i < ecs->groupCount; i++ ) {
+        ecsGroup_s * const group = &ecs->group[ i ];
+        if ( ( added & group->mask ) != 0 && ( ecs->mask[ index ] & group->mask ) == group->mask ) {
+            GroupEnter( ecs, group, entity );
+        }
+    }
+
+    return 1;
+}
+
+void Ecs_Remove( ecs_s * const ecs, const ecsEntity_s entity, const uint32_t mask ) {
+    if ( !Ecs_IsAlive( ecs, entity ) ) {
+        return;
+    }
+
+    const uint32_t index = EntityIndex( entity );
+    const uint32_t removed = mask & ecs->mask[ index ];
+
+    for ( size_t i = 0; i < ecs->groupCount; i++ ) {
+        ecsGroup_s * const group = &ecs->group[ i ];
+        if ( ( removed & group->mask ) != 0 && InGroup( ecs, group, entity ) ) {
+            GroupLeave( ecs, group, entity );
+        }
+    }
+
+    for ( uint32_t bits = removed; bits != 0; bits &= bits - 1 ) {
+        PoolErase( &ecs->pool[ ComponentIndex( bits & ( ~bits + 1 ) ) ], entity );
+    }
+    ecs->mask[ index ] &= ~removed;
+}
+
+uint32_t Ecs_GetMask( const ecs_s * const ecs, const ecsEntity_s entity ) {
+    return Ecs_IsAlive( ecs, entity ) ? ecs->mask[ EntityIndex( entity ) ] : 0;
+}
+
+static void * GetComponent( ecs_s * const ecs, const ecsEntity_s entity, const size_t component ) {
+    if ( ( Ecs_GetMask( ecs, entity ) & ( 1u << component ) ) == 0 ) {
+        return nullptr;
+    }
+
+    const ecsPool_s * const pool = &ecs->pool[ component ];
+    return pool->data + pool->sparse[ EntityIndex( entity ) ] * pool->elementSize;
+}
+
+vec2_s< fixed_s > * Ecs_GetPosition( ecs_s * const ecs, const ecsEntity_s entity ) {
+    return ( vec2_s< fixed_s > * )GetComponent( ecs, entity, 0 );
+}
+
+vec2_s< fixed_s > * Ecs_GetVelocity( ecs_s * const ecs, const ecsEntity_s entity ) {
+    return ( vec2_s< fixed_s > * )GetComponent( ecs, entity, 1 );
+}
+
+fixed_s * Ecs_GetHealth( ecs_s * const ecs, const ecsEntity_s entity ) {
+    return ( fixed_s * )GetComponent( ecs, entity, 2 );
+}
+
+uint8_t * Ecs_GetOwner( ecs_s * const ecs, const ecsEntity_s entity ) {
+    return ( uint8_t * )GetComponent( ecs, entity, 3 );
+}
+
+uint32_t * Ecs_GetOrder( ecs_s * const ecs, const ecsEntity_s entity ) {
+    return ( uint32_t * )GetComponent( ecs, entity, 4 );
+}
+
+int Ecs_Query( ecs_s * const ecs, const uint32_t mask, ecsView_s * const view ) {
+    *view = ecsView_s{};
+
+    const ecsPool_s * lead = nullptr;
+    size_t count = 0;
+    if ( mask != 0 && ( mask & ( mask - 1 ) ) == 0 && mask < ( 1u << kEcs_ComponentCount ) ) {
+        lead = &ecs->pool[ ComponentIndex( mask ) ];
+        count = lead->count;
+    } else {
+        for ( size_t i = 0; i < ecs->groupCount; i++ ) {
+            if ( ecs->group[ i ].mask == mask ) {
+                lead = GroupLead( ecs, &ecs->group[ i ] );
+                count = ecs->group[ i ].count;
+                break;
+            }
+        }
+    }
+
+    if ( lead == nullptr ) {
+        return 0;
+    }
+
+    view->count = count;
+    view->entity = lead->dense;
+    view->position = ( mask & kEcsComponent_Position ) ? ( vec2_s< fixed_s > * )ecs->pool[ 0 ].data : nullptr;
+    view->velocity = ( mask & kEcsComponent_Velocity ) ? ( vec2_s< fixed_s > * )ecs->pool[ 1 ].data : nullptr;
+    view->health = ( mask & kEcsComponent_Health ) ? ( fixed_s * )ecs->pool[ 2 ].data : nullptr;
+    view->owner = ( mask & kEcsComponent_Owner ) ? ecs->pool[ 3 ].data : nullptr;
+    view->order = ( mask & kEcsComponent_Order ) ? ( uint32_t * )ecs->pool[ 4 ].data : nullptr;
+    return 1;
+}
+
+void Ecs_Save( const ecs_s * const ecs, streamWriter_s * const w ) {
+    Stream_WriteVarint( w, ecs->capacity );
+    Stream_WriteVarint( w, ecs->groupCount );
+    for ( size_t i = 0; i < ecs->groupCount; i++ ) {
+        Stream_WriteVarint( w, ecs->group[ i ].mask );
+        Stream_WriteVarint( w, ecs->group[ i ].count );
+    }
+
+    Stream_WriteVarint( w, ecs->entityCount );
+    Stream_WriteVarint( w, ecs->indexCount );
+    Stream_WriteVarint( w, ecs->freeCount );
+    Stream_WriteBytes( w, ecs->generation, ecs->indexCount * sizeof( uint32_t ) );
+    Stream_WriteBytes( w, ecs->mask, ecs->indexCount * sizeof( uint32_t ) );
+    Stream_WriteBytes( w, ecs->freeIndex, ecs->freeCount * sizeof( uint32_t ) );
+
+    // the sparse arrays follow from the dense ones
+    for ( size_t c = 0; c < kEcs_ComponentCount; c++ ) {
+        const ecsPool_s * const pool = &ecs->pool[ c ];
+        Stream_WriteVarint( w, pool->count );
+        Stream_WriteBytes( w, pool->dense, pool->count * sizeof( ecsEntity_s ) );
+        Stream_WriteBytes( w, pool->data, pool->count * pool->elementSize );
+    }
+}
+
+static void Clear( ecs_s * const ecs ) {
+    ecs->entityCount = 0;
+    ecs->indexCount = 0;
+    ecs->freeCount = 0;
+    for ( size_t c = 0; c < kEcs_ComponentCount; c++ ) {
+        memset( ecs->pool[ c ].sparse, 0xff, ecs->capacity * sizeof( uint32_t ) );
+        ecs->pool[ c ].count = 0;
+    }
+    for ( size_t i = 0; i < ecs->groupCount; i++ ) {
+        ecs->group[ i ].count = 0;
+    }
+}
+
+int Ecs_Load( ecs_s * const ecs, streamReader_s * const r ) {
+    Clear( ecs );
+
+    int valid = Stream_ReadVarint( r ) == ecs->capacity && Stream_ReadVarint( r ) == ecs->groupCount;
+    size_t groupCount[ kEcs_MaxGroups ] = {};
+    for ( size_t i = 0; valid && i < ecs->groupCount; i++ ) {
+        valid = Stream_ReadVarint( r ) == ecs->group[ i ].mask;
+        groupCount[ i ] = ( size_t )Stream_ReadVarint( r );
+        valid = valid && groupCount[ i ] <= ecs->capacity;
+    }
+
+    const size_t entityCount = ( size_t )Stream_ReadVarint( r );
+    const size_t indexCount = ( size_t )Stream_ReadVarint( r );
+    const size_t freeCount = ( size_t )Stream_ReadVarint( r );
+    valid = valid && !r->failed && indexCount <= ecs->capacity && freeCount <= indexCount && entityCount == indexCount - freeCount;
+    if ( !valid ) {
+        return 0;
+    }
+
+    const uint8_t * const generation = Stream_ReadBytes( r, indexCount * sizeof( uint32_t ) );
+    const uint8_t * const mask = Stream_ReadBytes( r, indexCount * sizeof( uint32_t ) );
+    const uint8_t * const freeIndex = Stream_ReadBytes( r, freeCount * sizeof( uint32_t ) );
+    if ( r->failed ) {
+        return 0;
+    }
+    memcpy( ecs->generation, generation, indexCount * sizeof( uint32_t ) );
+    memcpy( ecs->mask, mask, indexCount * sizeof( uint32_t ) );
+    memcpy( ecs->freeIndex, freeIndex, freeCount * sizeof( uint32_t ) );
+
+    for ( size_t c = 0; c < kEcs_ComponentCount; c++ ) {
+        ecsPool_s * const pool = &ecs->pool[ c ];
+        const size_t count = ( size_t )Stream_ReadVarint( r );
+        const uint8_t * const dense = count <= indexCount ? Stream_ReadBytes( r, count * sizeof( ecsEntity_s ) ) : nullptr;
+        const uint8_t * const data = dense != nullptr ? Stream_ReadBytes( r, count * pool->elementSize ) : nullptr;
+        if ( data == nullptr ) {
+            Clear( ecs );
+            return 0;
+        }
+
+        memcpy( pool->dense, dense, count * sizeof( ecsEntity_s ) );
+        memcpy( pool->data, data, count * pool->elementSize );
+        pool->count = count;
+        for ( size_t i = 0; i < count; i++ ) {
+            const uint32_t index = EntityIndex( pool->dense[ i ] );
+            if ( index >= indexCount ) {
+                Clear( ecs );
+                return 0;
+            }
+            pool->sparse[ index ] = ( uint32_t )i;
+        }
+    }
+
+    ecs->entityCount = entityCount;
+    ecs->indexCount = indexCount;
+    ecs->freeCount = freeCount;
+    for ( size_t i = 0; i < ecs->groupCount; i++ ) {
+        ecs->group[ i ].count = groupCount[ i ];
+    }
+    return 1;
+}
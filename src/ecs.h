@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_ECS_H___
+#define ___RTSFS_ECS_H___
+
+#include "fixed.h"
+#include "stream.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// entity component storage for the simulation.
+//
+// every component type is a sparse set: a sparse array from entity index to dense slot, and dense arrays of the
+// owning entities and their component values, kept packed by swap-and-pop. iterating one component is a linear
+// walk over its dense array.
+//
+// an owning group (a set of components given at create time, up to kEcs_MaxGroups of them, each component in at
+// most one) additionally keeps the entities that have every component of the group packed at the front of each of
+// the group's dense arrays, in the same order. a query for exactly that set is then one contiguous range across all
+// of its arrays, so a system over it is a straight streaming pass with no indirection.
+
+typedef struct ecs_s ecs_s;
+
+typedef enum ecsComponent_e : uint32_t {
+    kEcsComponent_Position = 1 << 0, // world units
+    kEcsComponent_Velocity = 1 << 1, // world units per tick
+    kEcsComponent_Health = 1 << 2,
+    kEcsComponent_Owner = 1 << 3,
+    kEcsComponent_Order = 1 << 4, // a move order: the flow field handle the unit follows
+} ecsComponent_e;
+
+static constexpr size_t kEcs_ComponentCount = 5;
+static constexpr size_t kEcs_MaxGroups = 2;
+static constexpr size_t kEcs_IndexBits = 20;                             // up to ~1M live entities
+static constexpr uint32_t kEcs_IndexMask = ( 1u << kEcs_IndexBits ) - 1;
+
+// an index and a generation. a handle to a destroyed entity stays invalid even after its index is reused.
+typedef struct ecsEntity_s {
+    uint32_t value = UINT32_MAX;
+} ecsEntity_s;
+
+// a query result: count entities, and for each component in the query a pointer to its values for them, in the
+// same order. pointers of components outside the query are nullptr. valid until the next add or remove.
+typedef struct ecsView_s {
+    size_t count = 0;
+    const ecsEntity_s * entity = nullptr;
+    vec2_s< fixed_s > * position = nullptr;
+    vec2_s< fixed_s > * velocity = nullptr;
+    fixed_s * health = nullptr;
+    uint8_t * owner = nullptr;
+    uint32_t * order = nullptr;
+} ecsView_s;
+
+// entities per chunk when a system splits a view: a chunk's values stay well inside l1, and it is the unit of work
+// handed to other threads
+static constexpr size_t kEcs_ChunkSize = 1024;
+
+inline size_t Ecs_GetChunkCount( const ecsView_s * const view ) {
+    return ( view->count + kEcs_ChunkSize - 1 ) / kEcs_ChunkSize;
+}
+
+// the part of view in chunk, offset so index 0 is its first entity
+inline ecsView_s Ecs_GetChunk( const ecsView_s * const view, const size_t chunk ) {
+    const size_t first = chunk * kEcs_ChunkSize;
+    const size_t left = view->count - first;
+
+    ecsView_s part;
+    part.count = left < kEcs_ChunkSize ? left : kEcs_ChunkSize;
+    part.entity = view->entity + first;
+    part.position = view->position ? view->position + first : nullptr;
+    part.velocity = view->velocity ? view->velocity + first : nullptr;
+    part.health = view->health ? view->health + first : nullptr;
+    part.owner = view->owner ? view->owner + first : nullptr;
+    part.order = view->order ? view->order + first : nullptr;
+    return part;
+}
+
+// groupMasks holds groupCount owning groups, each an or of ecsComponent_e. returns nullptr on failure or if a
+// component is in more than one group.
+ecs_s * Ecs_Create( const size_t capacity, const uint32_t * const groupMasks, const size_t groupCount );
+
+void Ecs_Destroy( ecs_s * const ecs );
+
+// returns an invalid handle when capacity is reached
+ecsEntity_s Ecs_CreateEntity( ecs_s * const ecs );
+
+// removes every component and retires the handle
+void Ecs_DestroyEntity( ecs_s * const ecs, const ecsEntity_s entity );
+
+int Ecs_IsAlive( const ecs_s * const ecs, const ecsEntity_s entity );
+
+size_t Ecs_GetEntityCount( const ecs_s * const ecs );
+
+// adds the components in mask, leaving components the entity already has untouched. new values are zero.
+// returns zero if the entity is not alive.
+int Ecs_Add( ecs_s * const ecs, const ecsEntity_s entity, const uint32_t mask );
+
+void Ecs_Remove( ecs_s * const ecs, const ecsEntity_s entity, const uint32_t mask );
+
+// the or of the components the entity has; zero if it is not alive
+uint32_t Ecs_GetMask( const ecs_s * const ecs, const ecsEntity_s entity );
+
+// pointers to one entity's components, nullptr for those it lacks. valid until the next add or remove.
+vec2_s< fixed_s > * Ecs_GetPosition( ecs_s * const ecs, const ecsEntity_s entity );
+vec2_s< fixed_s > * Ecs_GetVelocity( ecs_s * const ecs, const ecsEntity_s entity );
+fixed_s * Ecs_GetHealth( ecs_s * const ecs, const ecsEntity_s entity );
+uint8_t * Ecs_GetOwner( ecs_s * const ecs, const ecsEntity_s entity );
+uint32_t * Ecs_GetOrder( ecs_s * const ecs, const ecsEntity_s entity );
+
+// fills view with the entities that have every component in mask. mask must be a single component or exactly an
+// owning group; returns zero otherwise.
+int Ecs_Query( ecs_s * const ecs, const uint32_t mask, ecsView_s * const view );
+
+// appends every entity, component value and group to w
+void Ecs_Save( const ecs_s * const ecs, streamWriter_s * const w );
+
+// replaces the contents with what Ecs_Save wrote. ecs must have been created with the capacity and groups of the
+// one saved; returns zero otherwise or if the data is damaged, in which case ecs is left empty.
+int Ecs_Load( ecs_s * const ecs, streamReader_s * const r );
+
+#endif // ___RTSFS_ECS_H___
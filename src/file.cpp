@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "file.h"
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdint.h>
+
+#include <new>
+
+static constexpr size_t kFile_PageSize = 4096;
+
+typedef struct fileMapping_s {
+    const void * data = nullptr;
+    size_t size = 0;
+    memTag_e tag = kMemTag_Other;
+} fileMapping_s;
+
+// the os handles are closed right after mapping; the view keeps the file open
+static const void * MapFile( const char * const path, size_t * const size ) {
+#if defined( _WIN32 )
+    const HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( file == INVALID_HANDLE_VALUE ) {
+        return nullptr;
+    }
+
+    const void * data = nullptr;
+    LARGE_INTEGER fileSize;
+    if ( GetFileSizeEx( file, &fileSize ) && fileSize.QuadPart > 0 && ( uint64_t )fileSize.QuadPart <= SIZE_MAX ) {
+        const HANDLE section = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if ( section != nullptr ) {
+            data = MapViewOfFile( section, FILE_MAP_READ, 0, 0, 0 );
+            CloseHandle( section );
+        }
+        *size = ( size_t )fileSize.QuadPart;
+    }
+    CloseHandle( file );
+    return data;
+#else
+    const int fd = open( path, O_RDONLY );
+    if ( fd < 0 ) {
+        return nullptr;
+    }
+
+    const void * data = nullptr;
+    struct stat info;
+    if ( fstat( fd, &info ) == 0 && info.st_size > 0 ) {
+        *size = ( size_t )info.st_size;
+        void * const mapping = mmap( nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        data = mapping != MAP_FAILED ? mapping : nullptr;
+    }
+    close( fd );
+    return data;
+#endif
+}
+
+static void UnmapFile( const void * const data, const size_t size ) {
+#if defined( _WIN32 )
+    ( void )size;
+    UnmapViewOfFile( data );
+#else
+    munmap( const_cast< void * >( data ), size );
+#endif
+}
+
+fileMapping_s * File_Map( const char * const path, const memTag_e tag ) {
+    if ( path == nullptr ) {
+        return nullptr;
+    }
+
+    fileMapping_s * const me = ( fileMapping_s * )Mem_Alloc( tag, sizeof( fileMapping_s ) );
+    if ( me == nullptr ) {
+        return nullptr;
+    }
+
+    new ( me ) fileMapping_s;
+    me->tag = tag;
+    me->data = MapFile( path, &me->size );
+    if ( me->data == nullptr ) {
+        me->~fileMapping_s();
+        Mem_Free( me );
+        return nullptr;
+    }
+
+    Mem_TrackExternal( tag, me->size );
+
+    return me;
+}
+
+void File_Unmap( fileMapping_s * const mapping ) {
+    if ( mapping == nullptr ) {
+        return;
+    }
+
+    UnmapFile( mapping->data, mapping->size );
+    Mem_UntrackExternal( mapping->tag, mapping->size );
+
+    mapping->~fileMapping_s();
+    Mem_Free( mapping );
+}
+
+const void * File_GetData( const fileMapping_s * const mapping ) {
+    return mapping->data;
+}
+
+size_t File_GetSize( const fileMapping_s * const mapping ) {
+    return mapping->size;
+}
+
+void File_Prefetch( const void * const data, const size_t bytes ) {
+    if ( bytes == 0 ) {
+        return;
+    }
+
+    const uintptr_t pageMask = ( uintptr_t )kFile_PageSize - 1;
+    const uintptr_t begin = ( uintptr_t )data & ~pageMask;
+    const uintptr_t end = ( ( uintptr_t )data + bytes + pageMask ) & ~pageMask;
+#if defined( _WIN32 )
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = ( void * )begin;
+    range.NumberOfBytes = ( SIZE_T )( end - begin );
+    PrefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 );
+#else
+    madvise( ( void * )begin, ( size_t )( end - begin ), MADV_WILLNEED );
+#endif
+}
+
+int File_DropCache( const char * const path ) {
+#if defined( _WIN32 )
+    ( void )path;
+    return 0;
+#else
+    const int fd = open( path, O_RDONLY );
+    if ( fd < 0 ) {
+        return 0;
+    }
+
+    // only clean pages can be dropped
+    fdatasync( fd );
+    const int dropped = posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ) == 0;
+    close( fd );
+    return dropped;
+#endif
+}
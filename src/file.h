@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_FILE_H___
+#define ___RTSFS_FILE_H___
+
+#include "mem.h"
+
+#include <stddef.h>
+
+// read only file mappings. the os pages the file in as it is touched and shares the pages with its file cache, so
+// loading a large file costs no read and no copy up front, and data can be used straight from the mapping.
+
+typedef struct fileMapping_s fileMapping_s;
+
+// maps the whole of the file at path, counting its size against tag. returns nullptr if it is missing, empty or
+// can't be mapped.
+fileMapping_s * File_Map( const char * const path, const memTag_e tag );
+
+void File_Unmap( fileMapping_s * const mapping );
+
+// page aligned
+const void * File_GetData( const fileMapping_s * const mapping );
+
+size_t File_GetSize( const fileMapping_s * const mapping );
+
+// asks the os to start reading the pages under a range of a mapping in, without waiting for them. touching them
+// afterwards then waits on reads already under way instead of faulting them in one at a time.
+void File_Prefetch( const void * const data, const size_t bytes );
+
+// asks the os to drop the file at path from its file cache, so the next read or mapping of it comes from disk. for
+// cold start measurements. returns zero where that isn't supported, which is everywhere but posix.
+int File_DropCache( const char * const path );
+
+#endif // ___RTSFS_FILE_H___
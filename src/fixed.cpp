@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "fixed.h"
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+static constexpr uint32_t kFixed_SinSteps = 1024;     // table entries per quarter turn
+static constexpr uint32_t kFixed_SinFracBits = 4;     // angle bits interpolated between entries
+static constexpr uint32_t kFixed_Quarter = kFixed_Turn / 4;
+static constexpr int64_t kFixed_HalfPiQ30 = 1686629713; // pi / 2 in 2.30
+
+static_assert( kFixed_SinSteps << kFixed_SinFracBits == kFixed_Quarter, "sin table must span a quarter turn" );
+
+// sin over a quarter turn and sqrt seeds, built with integer math at compile time so they are the same everywhere
+typedef struct fixedTables_s {
+    int32_t sin[ kFixed_SinSteps + 2 ] = {}; // one past the end, so interpolation never reads out of bounds
+    uint16_t sqrtSeed[ 256 ] = {};           // floor( sqrt( i ) * 256 )
+
+    constexpr fixedTables_s() {
+        for ( uint32_t i = 0; i <= kFixed_SinSteps; i++ ) {
+            // taylor series in 2.30 up to x^13, which is accurate to well under the last 16.16 bit over [ 0, pi / 2 ]
+            const int64_t x = kFixed_HalfPiQ30 * i / kFixed_SinSteps;
+            const int64_t x2 = x * x / ( 1ll << 30 );
+            int64_t term = x;
+            int64_t sum = x;
+            for ( int64_t n = 1; n <= 6; n++ ) {
+                term = -( term * x2 / ( 1ll << 30 ) ) / ( ( 2 * n ) * ( 2 * n + 1 ) );
+                sum += term;
+            }
+            sin[ i ] = ( int32_t )( ( sum + ( 1 << 13 ) ) / ( 1 << 14 ) );
+        }
+        sin[ kFixed_SinSteps + 1 ] = sin[ kFixed_SinSteps ];
+
+        for ( uint32_t i = 0; i < 256; i++ ) {
+            uint32_t r = 0;
+            for ( uint32_t bit = 1u << 11; bit != 0; bit >>= 1 ) {
+                if ( ( r | bit ) * ( r | bit ) <= ( i << 16 ) ) {
+                    r |= bit;
+                }
+            }
+            sqrtSeed[ i ] = ( uint16_t )r;
+        }
+    }
+} fixedTables_s;
+
+static constexpr fixedTables_s kFixed_Tables{};
+
+static inline uint32_t HighBit( const uint64_t value ) {
+#if defined( _MSC_VER )
+    unsigned long bit;
+    _BitScanReverse64( &bit, ( unsigned long long )value );
+    return ( uint32_t )bit;
+#else
+    return ( uint32_t )( 63 - __builtin_clzll( ( unsigned long long )value ) );
+#endif
+}
+
+uint32_t Fixed_SqrtInt( const uint64_t value ) {
+    if ( value < 256 ) {
+        return ( uint32_t )( kFixed_Tables.sqrtSeed[ value ] >> 8 );
+    }
+
+    // seed from the top 7 or 8 bits, shifted by an even amount so the root just shifts by half, then two newton
+    // steps bring it within a few units and the correction makes it exact. newton never undershoots the floor.
+    const uint32_t shift = ( HighBit( value ) - 6 ) & ~1u;
+    uint64_t r = ( ( uint64_t )kFixed_Tables.sqrtSeed[ value >> shift ] << ( shift / 2 ) ) >> 8;
+    // the root of a 64 bit value fits in 32 bits, so clamp there and compare by dividing; squaring near the top of
+    // the range would overflow.
+    r = ( r + value / r ) >> 1;
+    r = ( r + value / r ) >> 1;
+    if ( r > UINT32_MAX ) {
+        r = UINT32_MAX;
+    }
+    while ( r > value / r ) {
+        r--;
+    }
+    while ( r < UINT32_MAX && r + 1 <= value / ( r + 1 ) ) {
+        r++;
+    }
+    return ( uint32_t )r;
+}
+
+fixed_s Fixed_Sqrt( const fixed_s a ) {
+    if ( a.raw <= 0 ) {
+        return fixed_s{};
+    }
+    return fixed_s{ ( int32_t )Fixed_SqrtInt( ( uint64_t )a.raw << kFixed_Shift ) };
+}
+
+// sin of a quarter turn fraction in [ 0, kFixed_Quarter ]
+static inline int32_t QuarterSin( const uint32_t angle ) {
+    const uint32_t i = angle >> kFixed_SinFracBits;
+    const int32_t frac = ( int32_t )( angle & ( ( 1u << kFixed_SinFracBits ) - 1 ) );
+    const int32_t a = kFixed_Tables.sin[ i ];
+    const int32_t b = kFixed_Tables.sin[ i + 1 ];
+    return a + ( ( ( b - a ) * frac ) >> kFixed_SinFracBits );
+}
+
+fixed_s Fixed_Sin( const uint32_t angle ) {
+    const uint32_t a = angle & ( kFixed_Turn - 1 );
+    const uint32_t quadrant = a / kFixed_Quarter;
+    uint32_t within = a & ( kFixed_Quarter - 1 );
+    if ( quadrant & 1 ) {
+        within = kFixed_Quarter - within;
+    }
+    const int32_t value = QuarterSin( within );
+    return fixed_s{ ( quadrant & 2 ) ? -value : value };
+}
+
+fixed_s Fixed_Cos( const uint32_t angle ) {
+    return Fixed_Sin( angle + kFixed_Quarter );
+}
+
+vec2_s< fixed_s > Fixed_Vec2Normalize( const vec2_s< fixed_s > v ) {
+    const fixed_s length = Fixed_Vec2Length( v );
+    if ( length.raw == 0 ) {
+        return vec2_zero< fixed_s >();
+    }
+    return { v.x / length, v.y / length };
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_FIXED_H___
+#define ___RTSFS_FIXED_H___
+
+#include "rect.h"
+
+#include <stdint.h>
+
+// q16.16 fixed point for the simulation. everything here is integer math, so the same inputs give the same bits on
+// every compiler, cpu and thread count, which is what lockstep and replays rely on. floats only appear at the
+// edges: Fixed_FromFloat for tools and tests, Fixed_ToFloat for presentation. neither may feed back into the sim.
+//
+// multiplies and divides go through 64 bit intermediates. multiplies round towards negative infinity, divides
+// truncate towards zero like integer division. results that don't fit wrap; the sim keeps values well inside +-32767.
+//
+// angles are in turns, 65536 to the circle. sin and cos interpolate a quarter wave table, sqrt starts from a seed
+// table and is exact (the floor of the true root). both tables are computed at compile time from integers.
+
+typedef struct fixed_s {
+    int32_t raw = 0;
+} fixed_s;
+
+static constexpr int32_t kFixed_Shift = 16;
+static constexpr int32_t kFixed_One = 1 << kFixed_Shift;
+static constexpr uint32_t kFixed_Turn = 1u << 16; // a full circle
+
+inline constexpr fixed_s Fixed_FromRaw( const int32_t raw ) {
+    return fixed_s{ raw };
+}
+
+inline constexpr fixed_s Fixed_FromInt( const int32_t value ) {
+    return fixed_s{ ( int32_t )( ( uint32_t )value << kFixed_Shift ) };
+}
+
+// numerator / denominator, truncated towards zero; denominator must not be zero
+inline constexpr fixed_s Fixed_FromRatio( const int32_t numerator, const int32_t denominator ) {
+    return fixed_s{ ( int32_t )( ( ( int64_t )numerator * kFixed_One ) / denominator ) };
+}
+
+// rounds towards negative infinity
+inline constexpr int32_t Fixed_ToInt( const fixed_s a ) {
+    return a.raw >> kFixed_Shift;
+}
+
+// not for simulation code
+inline fixed_s Fixed_FromFloat( const float value ) {
+    return fixed_s{ ( int32_t )( value * ( float )kFixed_One ) };
+}
+
+inline float Fixed_ToFloat( const fixed_s a ) {
+    return ( float )a.raw * ( 1.0f / ( float )kFixed_One );
+}
+
+inline constexpr fixed_s operator+( const fixed_s a, const fixed_s b ) {
+    return fixed_s{ ( int32_t )( ( uint32_t )a.raw + ( uint32_t )b.raw ) };
+}
+
+inline constexpr fixed_s operator-( const fixed_s a, const fixed_s b ) {
+    return fixed_s{ ( int32_t )( ( uint32_t )a.raw - ( uint32_t )b.raw ) };
+}
+
+inline constexpr fixed_s operator-( const fixed_s a ) {
+    return fixed_s{ ( int32_t )( 0u - ( uint32_t )a.raw ) };
+}
+
+inline constexpr fixed_s operator*( const fixed_s a, const fixed_s b ) {
+    return fixed_s{ ( int32_t )( ( ( int64_t )a.raw * b.raw ) >> kFixed_Shift ) };
+}
+
+// truncates towards zero. division by zero saturates towards the numerator's sign
+inline constexpr fixed_s operator/( const fixed_s a, const fixed_s b ) {
+    return b.raw != 0 ? fixed_s{ ( int32_t )( ( ( int64_t )a.raw * kFixed_One ) / b.raw ) }
+                      : fixed_s{ a.raw < 0 ? INT32_MIN : INT32_MAX };
+}
+
+inline fixed_s & operator+=( fixed_s & a, const fixed_s b ) { return a = a + b; }
+inline fixed_s & operator-=( fixed_s & a, const fixed_s b ) { return a = a - b; }
+
+inline constexpr bool operator==( const fixed_s a, const fixed_s b ) { return a.raw == b.raw; }
+inline constexpr bool operator!=( const fixed_s a, const fixed_s b ) { return a.raw != b.raw; }
+inline constexpr bool operator<( const fixed_s a, const fixed_s b ) { return a.raw < b.raw; }
+inline constexpr bool operator<=( const fixed_s a, const fixed_s b ) { return a.raw <= b.raw; }
+inline constexpr bool operator>( const fixed_s a, const fixed_s b ) { return a.raw > b.raw; }
+inline constexpr bool operator>=( const fixed_s a, const fixed_s b ) { return a.raw >= b.raw; }
+
+inline constexpr fixed_s Fixed_Abs( const fixed_s a ) {
+    return a.raw < 0 ? -a : a;
+}
+
+inline constexpr fixed_s Fixed_Min( const fixed_s a, const fixed_s b ) {
+    return a.raw < b.raw ? a : b;
+}
+
+inline constexpr fixed_s Fixed_Max( const fixed_s a, const fixed_s b ) {
+    return a.raw > b.raw ? a : b;
+}
+
+// floor( sqrt( value ) ), exact
+uint32_t Fixed_SqrtInt( const uint64_t value );
+
+// zero for negative values
+fixed_s Fixed_Sqrt( const fixed_s a );
+
+fixed_s Fixed_Sin( const uint32_t angle );
+fixed_s Fixed_Cos( const uint32_t angle );
+
+// vec2_s and rect_s over fixed_s. the generic templates zero their members from an int, which fixed_s doesn't
+// convert from, so both are spelled out; vec2_s's + and - work through fixed_s's operators.
+template <>
+struct vec2_s< fixed_s > {
+    fixed_s x;
+    fixed_s y;
+};
+
+template <>
+struct rect_s< fixed_s > {
+    vec2_s< fixed_s > mn;
+    vec2_s< fixed_s > mx;
+};
+
+template <>
+inline vec2_s< fixed_s > vec2_zero< fixed_s >( void ) {
+    return vec2_s< fixed_s >{};
+}
+
+inline vec2_s< fixed_s > Fixed_Vec2FromInt( const int32_t x, const int32_t y ) {
+    return { Fixed_FromInt( x ), Fixed_FromInt( y ) };
+}
+
+inline vec2_s< fixed_s > Fixed_Vec2Scale( const vec2_s< fixed_s > v, const fixed_s s ) {
+    return { v.x * s, v.y * s };
+}
+
+// the length never overflows an intermediate: the squares are summed in 64 bits of raw units
+inline fixed_s Fixed_Vec2Length( const vec2_s< fixed_s > v ) {
+    const uint64_t x = ( uint64_t )( ( int64_t )v.x.raw * v.x.raw );
+    const uint64_t y = ( uint64_t )( ( int64_t )v.y.raw * v.y.raw );
+    return fixed_s{ ( int32_t )Fixed_SqrtInt( x + y ) };
+}
+
+// unit length in the direction of v; zero for a zero vector
+vec2_s< fixed_s > Fixed_Vec2Normalize( const vec2_s< fixed_s > v );
+
+// the unit vector at angle
+inline vec2_s< fixed_s > Fixed_Vec2FromAngle( const uint32_t angle ) {
+    return { Fixed_Cos( angle ), Fixed_Sin( angle ) };
+}
+
+inline bool Fixed_RectContains( const rect_s< fixed_s > * const rect, const vec2_s< fixed_s > p ) {
+    return p.x >= rect->mn.x && p.x <= rect->mx.x && p.y >= rect->mn.y && p.y <= rect->mx.y;
+}
+
+#endif // ___RTSFS_FIXED_H___
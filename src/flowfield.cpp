@@ -0,0 +1,626 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "flowfield.h"
+#include "mem.h"
+#include "profile.h"
+#include "simd.h"
+#include "thread.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+typedef enum flowFieldState_e : uint32_t {
+    kFlowFieldState_Free = 0,
+    kFlowFieldState_Queued, // owned by the worker until ready
+    kFlowFieldState_Ready,
+} flowFieldState_e;
+
+static constexpr uint8_t kFlowField_NoDirection = 8;
+static constexpr uint32_t kFlowField_KeyMax = UINT32_MAX >> 3; // above any reachable integrated cost
+static constexpr size_t kFlowField_Buckets = 256;                // more than the highest cost of entering a cell
+static constexpr size_t kFlowField_MinBucket = 1024;
+
+// cells waiting to spread at one integrated cost, modulo kFlowField_Buckets. kept between builds at their high water.
+typedef struct flowFieldBucket_s {
+    uint32_t * cell = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+} flowFieldBucket_s;
+
+typedef struct flowFieldEntry_s {
+    std::atomic< uint32_t > state{ kFlowFieldState_Free };
+    vec2_s< int32_t > goal;
+    uint32_t version = 0;
+    uint32_t refs = 0;
+    uint64_t lastUse = 0;
+    uint8_t * cost = nullptr;      // [ padded cell ] the cost field as of the request
+    uint8_t * direction = nullptr; // [ padded cell ] index into kFlowField_Step, or kFlowField_NoDirection
+} flowFieldEntry_s;
+
+typedef struct flowField_s {
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;        // width of the padded grids, which have a wall border one cell wide
+    size_t paddedCells = 0;
+    int32_t step[ 8 ];         // kFlowField_Step as padded index offsets
+    uint8_t * cost = nullptr;  // [ y ][ x ] unpadded
+    uint32_t version = 0;
+    uint64_t useClock = 0;
+    flowFieldEntry_s entry[ kFlowField_CacheSize ];
+
+    // single producer, single consumer queue of entries to build
+    uint32_t queue[ kFlowField_CacheSize ];
+    std::atomic< uint32_t > queueHead{ 0 }; // written by the sim thread
+    std::atomic< uint32_t > queueTail{ 0 }; // written by the worker
+
+    // worker scratch
+    uint32_t * integrated = nullptr; // [ cell ] summed cost to the goal
+    flowFieldBucket_s bucket[ kFlowField_Buckets ];
+
+    thread_s * worker = nullptr;
+    signal_s * wake = nullptr;
+    signal_s * done = nullptr;
+    std::atomic< int > quit{ 0 };
+} flowField_s;
+
+// neighbour steps, orthogonal ones at even indices
+static const int32_t kFlowField_Step[ 8 ][ 2 ] = {
+    { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 },
+};
+
+static constexpr fixed_s kFlowField_Zero = Fixed_FromRaw( 0 );
+static constexpr fixed_s kFlowField_Straight = Fixed_FromRaw( kFixed_One );
+static constexpr fixed_s kFlowField_Diagonal = Fixed_FromRaw( 46341 ); // sqrt( 0.5 ) in 16.16, rounded
+
+static const vec2_s< fixed_s > kFlowField_Direction[ 9 ] = {
+    { kFlowField_Straight, kFlowField_Zero }, { kFlowField_Diagonal, kFlowField_Diagonal },
+    { kFlowField_Zero, kFlowField_Straight }, { -kFlowField_Diagonal, kFlowField_Diagonal },
+    { -kFlowField_Straight, kFlowField_Zero }, { -kFlowField_Diagonal, -kFlowField_Diagonal },
+    { kFlowField_Zero, -kFlowField_Straight }, { kFlowField_Diagonal, -kFlowField_Diagonal },
+    { kFlowField_Zero, kFlowField_Zero },
+};
+
+static inline int InBounds( const flowField_s * const ff, const int32_t x, const int32_t y ) {
+    return x >= 0 && y >= 0 && x < ff->width && y < ff->height;
+}
+
+// index of a map cell in the padded grids
+static inline int32_t PaddedIndex( const flowField_s * const ff, const int32_t x, const int32_t y ) {
+    return ( y + 1 ) * ff->stride + x + 1;
+}
+
+static int GrowBucket( flowFieldBucket_s * const bucket ) {
+    const size_t capacity = bucket->capacity != 0 ? bucket->capacity * 2 : kFlowField_MinBucket;
+    uint32_t * const grown = ( uint32_t * )Mem_Realloc( kMemTag_Sim, bucket->cell, capacity * sizeof( uint32_t ) );
+    if ( grown == nullptr ) {
+        return 0;
+    }
+    bucket->cell = grown;
+    bucket->capacity = capacity;
+    return 1;
+}
+
+// returns zero if the buckets can't grow, leaving the field partly integrated
+static int Integrate( flowField_s * const ff, const flowFieldEntry_s * const entry, const int32_t goal ) {
+    PROFILE_ZONE( "FlowField_Integrate" );
+
+    const uint8_t * const cost = entry->cost;
+    uint32_t * const integrated = ff->integrated;
+    const int32_t step[ 4 ] = { ff->step[ 0 ], ff->step[ 2 ], ff->step[ 4 ], ff->step[ 6 ] };
+
+    // walls start at zero, which nothing can improve on, so spreading never has to test for them
+    for ( size_t c = 0; c < ff->paddedCells; c++ ) {
+        integrated[ c ] = cost[ c ] == kFlowField_Wall ? 0 : UINT32_MAX;
+    }
+
+    // dijkstra with a bucket per integrated cost (dial's algorithm): entering a cell costs 1 to 254, so every cell
+    // queued while spreading the bucket at cost d lands in one of the next 254 buckets, and a ring of 256 holds them
+    // all. buckets are spread in cost order, so a cell spreads once, at its final cost; a cell queued again after a
+    // cheaper way in turned up leaves a stale entry behind, which is skipped. the wall border means neighbours never
+    // need a bounds check.
+    for ( size_t i = 0; i < kFlowField_Buckets; i++ ) {
+        ff->bucket[ i ].count = 0;
+    }
+    integrated[ goal ] = 0;
+    if ( ff->bucket[ 0 ].count == ff->bucket[ 0 ].capacity && !GrowBucket( &ff->bucket[ 0 ] ) ) {
+        return 0;
+    }
+    ff->bucket[ 0 ].cell[ ff->bucket[ 0 ].count++ ] = ( uint32_t )goal;
+
+    size_t pending = 1;
+    for ( uint32_t d = 0; pending != 0; d++ ) {
+        flowFieldBucket_s * const bucket = &ff->bucket[ d % kFlowField_Buckets ];
+
+        // nothing spread from here lands back in this bucket, so its count holds still
+        for ( size_t j = 0; j < bucket->count; j++ ) {
+            const uint32_t c = bucket->cell[ j ];
+            if ( integrated[ c ] != d ) {
+                continue;
+            }
+
+            for ( size_t i = 0; i < 4; i++ ) {
+                const uint32_t n = ( uint32_t )( ( int32_t )c + step[ i ] );
+                const uint32_t through = d + cost[ n ];
+                if ( through >= integrated[ n ] ) {
+                    continue;
+                }
+
+                integrated[ n ] = through;
+                flowFieldBucket_s * const next = &ff->bucket[ through % kFlowField_Buckets ];
+                if ( next->count == next->capacity && !GrowBucket( next ) ) {
+                    return 0;
+                }
+                next->cell[ next->count++ ] = n;
+                pending++;
+            }
+        }
+
+        pending -= bucket->count;
+        bucket->count = 0;
+    }
+
+    return 1;
+}
+
+static void Build( flowField_s * const ff, flowFieldEntry_s * const entry ) {
+    PROFILE_ZONE( "FlowField_Build" );
+
+    memset( entry->direction, kFlowField_NoDirection, ff->paddedCells );
+
+    if ( !InBounds( ff, entry->goal.x, entry->goal.y ) ) {
+        return;
+    }
+
+    const int32_t goal = PaddedIndex( ff, entry->goal.x, entry->goal.y );
+    if ( entry->cost[ goal ] == kFlowField_Wall ) {
+        return;
+    }
+
+    if ( !Integrate( ff, entry, goal ) ) {
+        return;
+    }
+
+    PROFILE_ZONE( "FlowField_Directions" );
+    const uint32_t * const integrated = ff->integrated;
+    const uint8_t * const cost = entry->cost;
+    const int32_t * const step = ff->step;
+    for ( int32_t y = 0; y < ff->height; y++ ) {
+        const int32_t rowStart = PaddedIndex( ff, 0, y );
+        int32_t c = rowStart;
+
+#if defined( RTSFS_SIMD_AVX2 )
+        // the scalar loop below, eight cells at a time
+        const __m256i keyMax = _mm256_set1_epi32( ( int )kFlowField_KeyMax );
+        const __m256i wallCost = _mm256_set1_epi32( kFlowField_Wall );
+        const __m256i none = _mm256_set1_epi32( kFlowField_NoDirection );
+        const __m256i ones = _mm256_set1_epi32( -1 );
+        for ( ; c + 8 <= rowStart + ff->width; c += 8 ) {
+            const __m256i best = _mm256_loadu_si256( ( const __m256i * )( integrated + c ) );
+
+            __m256i wall[ 8 ];
+            for ( size_t i = 0; i < 8; i++ ) {
+                const __m128i bytes = _mm_loadl_epi64( ( const __m128i * )( cost + c + step[ i ] ) );
+                wall[ i ] = _mm256_cmpeq_epi32( _mm256_cvtepu8_epi32( bytes ), wallCost );
+            }
+            for ( size_t i = 1; i < 8; i += 2 ) {
+                wall[ i ] = _mm256_or_si256( wall[ i ], _mm256_or_si256( wall[ i - 1 ], wall[ ( i + 1 ) & 7 ] ) );
+            }
+
+            __m256i key = ones;
+            for ( size_t i = 0; i < 8; i++ ) {
+                const __m256i through = _mm256_loadu_si256( ( const __m256i * )( integrated + c + step[ i ] ) );
+                const __m256i k = _mm256_or_si256( _mm256_slli_epi32( _mm256_min_epu32( through, keyMax ), 3 ), _mm256_set1_epi32( ( int )i ) );
+                key = _mm256_min_epu32( key, _mm256_or_si256( k, wall[ i ] ) );
+            }
+
+            // key >> 3 < best, unsigned; and best is neither the goal nor unreachable
+            const __m256i cheaper = _mm256_xor_si256( _mm256_cmpeq_epi32( _mm256_min_epu32( _mm256_srli_epi32( key, 3 ), best ), best ), ones );
+            const __m256i skip = _mm256_or_si256( _mm256_cmpeq_epi32( best, _mm256_setzero_si256() ), _mm256_cmpeq_epi32( best, ones ) );
+            const __m256i take = _mm256_andnot_si256( skip, cheaper );
+            const __m256i direction = _mm256_blendv_epi8( none, _mm256_and_si256( key, _mm256_set1_epi32( 7 ) ), take );
+
+            // eight 32 bit lanes down to eight bytes; the packs work within 128 bit halves
+            const __m256i words = _mm256_packus_epi32( direction, direction );
+            const __m256i bytes = _mm256_packus_epi16( words, words );
+            const uint32_t lo = ( uint32_t )_mm_cvtsi128_si32( _mm256_castsi256_si128( bytes ) );
+            const uint32_t hi = ( uint32_t )_mm256_extract_epi32( bytes, 4 );
+            memcpy( entry->direction + c, &lo, sizeof( lo ) );
+            memcpy( entry->direction + c + 4, &hi, sizeof( hi ) );
+        }
+#elif defined( RTSFS_SIMD_SSE2 )
+        // the scalar loop below, four cells at a time. sse2 has no unsigned compare or minimum, so they are signed
+        // ones on values offset by 2^31.
+        const __m128i bias = _mm_set1_epi32( INT32_MIN );
+        const __m128i keyMax = _mm_set1_epi32( ( int )kFlowField_KeyMax );
+        const __m128i keyMaxBiased = _mm_xor_si128( keyMax, bias );
+        const __m128i wallCost = _mm_set1_epi32( kFlowField_Wall );
+        const __m128i none = _mm_set1_epi32( kFlowField_NoDirection );
+        const __m128i ones = _mm_set1_epi32( -1 );
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; c + 4 <= rowStart + ff->width; c += 4 ) {
+            const __m128i best = _mm_loadu_si128( ( const __m128i * )( integrated + c ) );
+
+            __m128i wall[ 8 ];
+            for ( size_t i = 0; i < 8; i++ ) {
+                int32_t bytes;
+                memcpy( &bytes, cost + c + step[ i ], sizeof( bytes ) );
+                const __m128i lanes = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bytes ), zero ), zero );
+                wall[ i ] = _mm_cmpeq_epi32( lanes, wallCost );
+            }
+            for ( size_t i = 1; i < 8; i += 2 ) {
+                wall[ i ] = _mm_or_si128( wall[ i ], _mm_or_si128( wall[ i - 1 ], wall[ ( i + 1 ) & 7 ] ) );
+            }
+
+            __m128i keyBiased = _mm_set1_epi32( INT32_MAX ); // UINT32_MAX, offset
+            for ( size_t i = 0; i < 8; i++ ) {
+                const __m128i through = _mm_loadu_si128( ( const __m128i * )( integrated + c + step[ i ] ) );
+                const __m128i over = _mm_cmpgt_epi32( _mm_xor_si128( through, bias ), keyMaxBiased );
+                const __m128i clamped = _mm_or_si128( _mm_and_si128( over, keyMax ), _mm_andnot_si128( over, through ) );
+                const __m128i k = _mm_or_si128( _mm_or_si128( _mm_slli_epi32( clamped, 3 ), _mm_set1_epi32( ( int )i ) ), wall[ i ] );
+                const __m128i kBiased = _mm_xor_si128( k, bias );
+                const __m128i lower = _mm_cmpgt_epi32( keyBiased, kBiased );
+                keyBiased = _mm_or_si128( _mm_and_si128( lower, kBiased ), _mm_andnot_si128( lower, keyBiased ) );
+            }
+            const __m128i key = _mm_xor_si128( keyBiased, bias );
+
+            const __m128i cheaper = _mm_cmpgt_epi32( _mm_xor_si128( best, bias ), _mm_xor_si128( _mm_srli_epi32( key, 3 ), bias ) );
+            const __m128i skip = _mm_or_si128( _mm_cmpeq_epi32( best, zero ), _mm_cmpeq_epi32( best, ones ) );
+            const __m128i take = _mm_andnot_si128( skip, cheaper );
+            const __m128i direction = _mm_or_si128( _mm_and_si128( take, _mm_and_si128( key, _mm_set1_epi32( 7 ) ) ), _mm_andnot_si128( take, none ) );
+
+            const __m128i words = _mm_packs_epi32( direction, direction );
+            const uint32_t packed = ( uint32_t )_mm_cvtsi128_si32( _mm_packus_epi16( words, words ) );
+            memcpy( entry->direction + c, &packed, sizeof( packed ) );
+        }
+#endif
+
+        for ( ; c < rowStart + ff->width; c++ ) {
+            const uint32_t best = integrated[ c ];
+            if ( best == 0 || best == UINT32_MAX ) {
+                continue;
+            }
+
+            // branch free minimum over the neighbours: integrated cost above the index, so ties go to the lower
+            // index. walls are out, as their integrated cost of zero would win, and so is a diagonal when either
+            // orthogonal neighbour beside it is a wall, so units never cut corners past one.
+            uint32_t wall[ 8 ];
+            for ( size_t i = 0; i < 8; i += 2 ) {
+                wall[ i ] = cost[ c + step[ i ] ] == kFlowField_Wall;
+            }
+            for ( size_t i = 1; i < 8; i += 2 ) {
+                wall[ i ] = wall[ i - 1 ] | wall[ ( i + 1 ) & 7 ] | ( cost[ c + step[ i ] ] == kFlowField_Wall );
+            }
+
+            uint32_t key = UINT32_MAX;
+            for ( uint32_t i = 0; i < 8; i++ ) {
+                const uint32_t through = integrated[ c + step[ i ] ];
+                const uint32_t k = ( ( through < kFlowField_KeyMax ? through : kFlowField_KeyMax ) << 3 ) | i;
+                key = wall[ i ] == 0 && k < key ? k : key;
+            }
+
+            const uint8_t direction = ( key >> 3 ) < best ? ( uint8_t )( key & 7 ) : kFlowField_NoDirection;
+            entry->direction[ c ] = direction;
+        }
+    }
+}
+
+static void WorkerMain( void * const param ) {
+    flowField_s * const ff = ( flowField_s * )param;
+
+    for ( ;; ) {
+        Signal_Wait( ff->wake );
+
+        for ( ;; ) {
+            if ( ff->quit.load( std::memory_order_acquire ) ) {
+                return;
+            }
+
+            const uint32_t tail = ff->queueTail.load( std::memory_order_relaxed );
+            if ( tail == ff->queueHead.load( std::memory_order_acquire ) ) {
+                break;
+            }
+
+            flowFieldEntry_s * const entry = &ff->entry[ ff->queue[ tail % kFlowField_CacheSize ] ];
+            Build( ff, entry );
+            entry->state.store( kFlowFieldState_Ready, std::memory_order_release );
+            ff->queueTail.store( tail + 1, std::memory_order_release );
+            Signal_Raise( ff->done );
+        }
+    }
+}
+
+flowField_s * FlowField_Create( const vec2_s< size_t > size ) {
+    if ( size.x == 0 || size.y == 0 || size.x > 0x8000 || size.y > 0x8000 ) {
+        return nullptr;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( flowField_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    flowField_s * const ff = new ( mem ) flowField_s;
+    ff->width = ( int32_t )size.x;
+    ff->height = ( int32_t )size.y;
+    ff->stride = ff->width + 2;
+    ff->paddedCells = ( size_t )ff->stride * ( size.y + 2 );
+    for ( size_t i = 0; i < 8; i++ ) {
+        ff->step[ i ] = kFlowField_Step[ i ][ 1 ] * ff->stride + kFlowField_Step[ i ][ 0 ];
+    }
+
+    const size_t cells = size.x * size.y;
+    const size_t padded = ff->paddedCells;
+    ff->cost = ( uint8_t * )Mem_Alloc( kMemTag_Sim, cells );
+    ff->integrated = ( uint32_t * )Mem_Alloc( kMemTag_Sim, padded * sizeof( uint32_t ) );
+    int failed = ff->cost == nullptr || ff->integrated == nullptr;
+
+    for ( size_t i = 0; i < kFlowField_CacheSize; i++ ) {
+        ff->entry[ i ].cost = ( uint8_t * )Mem_Alloc( kMemTag_Sim, padded );
+        ff->entry[ i ].direction = ( uint8_t * )Mem_Alloc( kMemTag_Sim, padded );
+        failed |= ff->entry[ i ].cost == nullptr || ff->entry[ i ].direction == nullptr;
+        if ( ff->entry[ i ].cost != nullptr ) {
+            memset( ff->entry[ i ].cost, kFlowField_Wall, padded ); // the border stays wall
+        }
+    }
+
+    if ( !failed ) {
+        memset( ff->cost, 1, cells );
+        ff->wake = Signal_Create();
+        ff->done = Signal_Create();
+        ff->worker = ff->wake && ff->done ? Thread_Create( WorkerMain, ff ) : nullptr;
+    }
+
+    if ( ff->worker == nullptr ) {
+        FlowField_Destroy( ff );
+        return nullptr;
+    }
+
+    return ff;
+}
+
+void FlowField_Destroy( flowField_s * const ff ) {
+    if ( ff == nullptr ) {
+        return;
+    }
+
+    if ( ff->worker != nullptr ) {
+        ff->quit.store( 1, std::memory_order_release );
+        Signal_Raise( ff->wake );
+        Thread_Join( ff->worker );
+    }
+    Signal_Destroy( ff->done );
+    Signal_Destroy( ff->wake );
+
+    for ( size_t i = 0; i < kFlowField_CacheSize; i++ ) {
+        Mem_Free( ff->entry[ i ].direction );
+        Mem_Free( ff->entry[ i ].cost );
+    }
+    for ( size_t i = 0; i < kFlowField_Buckets; i++ ) {
+        Mem_Free( ff->bucket[ i ].cell );
+    }
+    Mem_Free( ff->integrated );
+    Mem_Free( ff->cost );
+
+    ff->~flowField_s();
+    Mem_Free( ff );
+}
+
+void FlowField_SetCost( flowField_s * const ff, const vec2_s< int32_t > cell, const uint8_t cost ) {
+    if ( !InBounds( ff, cell.x, cell.y ) ) {
+        return;
+    }
+
+    uint8_t * const c = &ff->cost[ cell.y * ff->width + cell.x ];
+    const uint8_t stored = cost != 0 ? cost : 1;
+    if ( *c != stored ) {
+        *c = stored;
+        ff->version++;
+    }
+}
+
+uint8_t FlowField_GetCost( const flowField_s * const ff, const vec2_s< int32_t > cell ) {
+    return InBounds( ff, cell.x, cell.y ) ? ff->cost[ cell.y * ff->width + cell.x ] : kFlowField_Wall;
+}
+
+uint32_t FlowField_GetVersion( const flowField_s * const ff ) {
+    return ff->version;
+}
+
+static inline flowFieldEntry_s * GetEntry( const flowField_s * const ff, const uint32_t handle ) {
+    return handle != 0 && handle <= kFlowField_CacheSize ? ( flowFieldEntry_s * )&ff->entry[ handle - 1 ] : nullptr;
+}
+
+uint32_t FlowField_Acquire( flowField_s * const ff, const vec2_s< int32_t > goal ) {
+    ff->useClock++;
+
+    // cached, or the least recently used slot that nobody holds. whether the worker is still building a slot must
+    // not change the choice, or handles would depend on timing; such a slot is waited for instead.
+    flowFieldEntry_s * victim = nullptr;
+    for ( size_t i = 0; i < kFlowField_CacheSize; i++ ) {
+        flowFieldEntry_s * const entry = &ff->entry[ i ];
+        const uint32_t state = entry->state.load( std::memory_order_acquire );
+        if ( state != kFlowFieldState_Free && entry->goal.x == goal.x && entry->goal.y == goal.y && entry->version == ff->version ) {
+            entry->refs++;
+            entry->lastUse = ff->useClock;
+            return ( uint32_t )i + 1;
+        }
+
+        if ( entry->refs == 0 && ( victim == nullptr || entry->lastUse < victim->lastUse ) ) {
+            victim = entry;
+        }
+    }
+
+    if ( victim == nullptr ) {
+        return 0;
+    }
+
+    const uint32_t index = ( uint32_t )( victim - ff->entry );
+    FlowField_Wait( ff, index + 1 );
+    victim->goal = goal;
+    victim->version = ff->version;
+    victim->refs = 1;
+    victim->lastUse = ff->useClock;
+    for ( int32_t y = 0; y < ff->height; y++ ) {
+        memcpy( victim->cost + PaddedIndex( ff, 0, y ), ff->cost + y * ff->width, ( size_t )ff->width );
+    }
+    victim->state.store( kFlowFieldState_Queued, std::memory_order_relaxed );
+
+    const uint32_t head = ff->queueHead.load( std::memory_order_relaxed );
+    ff->queue[ head % kFlowField_CacheSize ] = index;
+    ff->queueHead.store( head + 1, std::memory_order_release );
+    Signal_Raise( ff->wake );
+
+    return index + 1;
+}
+
+void FlowField_AddRef( flowField_s * const ff, const uint32_t handle ) {
+    flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    if ( entry != nullptr ) {
+        entry->refs++;
+    }
+}
+
+void FlowField_Release( flowField_s * const ff, const uint32_t handle ) {
+    flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    if ( entry != nullptr && entry->refs != 0 ) {
+        entry->refs--;
+    }
+}
+
+int FlowField_IsReady( const flowField_s * const ff, const uint32_t handle ) {
+    const flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    return entry != nullptr && entry->state.load( std::memory_order_acquire ) == kFlowFieldState_Ready;
+}
+
+int FlowField_IsStale( const flowField_s * const ff, const uint32_t handle ) {
+    const flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    return entry == nullptr || entry->version != ff->version;
+}
+
+void FlowField_Wait( flowField_s * const ff, const uint32_t handle ) {
+    const flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    if ( entry == nullptr ) {
+        return;
+    }
+
+    PROFILE_ZONE( "FlowField_Wait" );
+    while ( entry->state.load( std::memory_order_acquire ) == kFlowFieldState_Queued ) {
+        Signal_Wait( ff->done );
+    }
+}
+
+vec2_s< fixed_s > FlowField_Sample( const flowField_s * const ff, const uint32_t handle, const vec2_s< int32_t > cell ) {
+    const flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    if ( entry == nullptr || !InBounds( ff, cell.x, cell.y ) || entry->state.load( std::memory_order_acquire ) != kFlowFieldState_Ready ) {
+        return kFlowField_Direction[ kFlowField_NoDirection ];
+    }
+
+    return kFlowField_Direction[ entry->direction[ PaddedIndex( ff, cell.x, cell.y ) ] ];
+}
+
+vec2_s< int32_t > FlowField_GetGoal( const flowField_s * const ff, const uint32_t handle ) {
+    const flowFieldEntry_s * const entry = GetEntry( ff, handle );
+    return entry != nullptr ? entry->goal : vec2_s< int32_t >{ -1, -1 };
+}
+
+// with the queue drained the worker is idle and every entry is free or ready
+static void WaitAll( flowField_s * const ff ) {
+    for ( uint32_t i = 0; i < kFlowField_CacheSize; i++ ) {
+        FlowField_Wait( ff, i + 1 );
+    }
+}
+
+void FlowField_Save( flowField_s * const ff, streamWriter_s * const w ) {
+    WaitAll( ff );
+
+    Stream_WriteVarint( w, ( uint64_t )ff->width );
+    Stream_WriteVarint( w, ( uint64_t )ff->height );
+    Stream_WriteVarint( w, ff->version );
+    Stream_WriteVarint( w, ff->useClock );
+    Stream_WriteBytes( w, ff->cost, ( size_t )ff->width * ( size_t )ff->height );
+
+    // built fields go out whole rather than being rebuilt on load: a stale one was built from costs that are gone
+    for ( size_t i = 0; i < kFlowField_CacheSize; i++ ) {
+        const flowFieldEntry_s * const entry = &ff->entry[ i ];
+        const uint32_t state = entry->state.load( std::memory_order_relaxed );
+        Stream_WriteU8( w, ( uint8_t )state );
+        if ( state == kFlowFieldState_Free ) {
+            continue;
+        }
+        Stream_WriteZigzag( w, entry->goal.x );
+        Stream_WriteZigzag( w, entry->goal.y );
+        Stream_WriteVarint( w, entry->version );
+        Stream_WriteVarint( w, entry->refs );
+        Stream_WriteVarint( w, entry->lastUse );
+        Stream_WriteBytes( w, entry->cost, ff->paddedCells );
+        Stream_WriteBytes( w, entry->direction, ff->paddedCells );
+    }
+}
+
+int FlowField_Load( flowField_s * const ff, streamReader_s * const r ) {
+    WaitAll( ff );
+
+    const size_t cells = ( size_t )ff->width * ( size_t )ff->height;
+    const int sameSize = Stream_ReadVarint( r ) == ( uint64_t )ff->width && Stream_ReadVarint( r ) == ( uint64_t )ff->height;
+    const uint32_t version = ( uint32_t )Stream_ReadVarint( r );
+    const uint64_t useClock = Stream_ReadVarint( r );
+    const uint8_t * const cost = sameSize ? Stream_ReadBytes( r, cells ) : nullptr;
+    if ( cost == nullptr ) {
+        return 0;
+    }
+    memcpy( ff->cost, cost, cells );
+    ff->version = version;
+    ff->useClock = useClock;
+
+    for ( size_t i = 0; i < kFlowField_CacheSize; i++ ) {
+        flowFieldEntry_s * const entry = &ff->entry[ i ];
+        entry->state.store( kFlowFieldState_Free, std::memory_order_relaxed );
+        entry->refs = 0;
+        entry->lastUse = 0;
+
+        const uint8_t state = Stream_ReadU8( r );
+        if ( state != kFlowFieldState_Ready ) {
+            if ( state != kFlowFieldState_Free ) {
+                r->failed = 1;
+            }
+            continue;
+        }
+
+        entry->goal.x = ( int32_t )Stream_ReadZigzag( r );
+        entry->goal.y = ( int32_t )Stream_ReadZigzag( r );
+        entry->version = ( uint32_t )Stream_ReadVarint( r );
+        entry->refs = ( uint32_t )Stream_ReadVarint( r );
+        entry->lastUse = Stream_ReadVarint( r );
+        const uint8_t * const entryCost = Stream_ReadBytes( r, ff->paddedCells );
+        const uint8_t * const direction = Stream_ReadBytes( r, ff->paddedCells );
+        if ( entryCost != nullptr && direction != nullptr ) {
+            memcpy( entry->cost, entryCost, ff->paddedCells );
+            memcpy( entry->direction, direction, ff->paddedCells );
+            entry->state.store( kFlowFieldState_Ready, std::memory_order_relaxed );
+        }
+    }
+
+    return !r->failed;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_FLOWFIELD_H___
+#define ___RTSFS_FLOWFIELD_H___
+
+#include "fixed.h"
+#include "stream.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// flow field pathfinding on the map grid, for many units moving to one goal.
+//
+// the map is a cost field, one byte per cell: the cost of entering the cell, 1 to 254, or kFlowField_Wall. a field
+// for a goal is built once in two passes. the first integrates cost outwards from the goal over the 4-neighbours, a
+// dijkstra search with one bucket per integrated cost, so every cell spreads once, at its final cost. the second
+// gives each cell a direction, pointing at the 8-neighbour with the lowest integrated cost without cutting a wall's
+// corner; it compares a row's cells eight (avx2) or four (sse2) at a time. units then sample their cell each tick.
+//
+// fields are built on a worker thread from a copy of the cost field, and cached keyed by goal cell and cost field
+// version. any cost change bumps the version, so later requests build fresh fields while units holding the old one
+// keep following it until the new one is ready. all calls are made from one thread, the sim thread.
+
+typedef struct flowField_s flowField_s;
+
+static constexpr uint8_t kFlowField_Wall = 255;
+static constexpr size_t kFlowField_CacheSize = 16; // fields alive at once, built or being built
+
+// returns nullptr on failure. every cell starts at cost 1.
+flowField_s * FlowField_Create( const vec2_s< size_t > size );
+
+// waits for a build in progress
+void FlowField_Destroy( flowField_s * const ff );
+
+// a cost of 0 is stored as 1
+void FlowField_SetCost( flowField_s * const ff, const vec2_s< int32_t > cell, const uint8_t cost );
+
+uint8_t FlowField_GetCost( const flowField_s * const ff, const vec2_s< int32_t > cell );
+
+// bumped by every cost change
+uint32_t FlowField_GetVersion( const flowField_s * const ff );
+
+// returns a handle to the field towards goal at the current cost version holding one reference, and queues the
+// build if it isn't cached. never waits. returns zero if every cache slot is referenced or still building.
+uint32_t FlowField_Acquire( flowField_s * const ff, const vec2_s< int32_t > goal );
+
+void FlowField_AddRef( flowField_s * const ff, const uint32_t handle );
+
+// an unreferenced field stays cached until its slot is needed
+void FlowField_Release( flowField_s * const ff, const uint32_t handle );
+
+int FlowField_IsReady( const flowField_s * const ff, const uint32_t handle );
+
+// nonzero if costs changed since the field was requested
+int FlowField_IsStale( const flowField_s * const ff, const uint32_t handle );
+
+// blocks until the field is ready
+void FlowField_Wait( flowField_s * const ff, const uint32_t handle );
+
+// the unit direction to move in from cell. zero at the goal, in walls, where the goal is unreachable, outside the
+// map, and while the field is still building.
+vec2_s< fixed_s > FlowField_Sample( const flowField_s * const ff, const uint32_t handle, const vec2_s< int32_t > cell );
+
+// the goal cell the field leads to, or -1, -1 for an invalid handle
+vec2_s< int32_t > FlowField_GetGoal( const flowField_s * const ff, const uint32_t handle );
+
+// appends the cost field and every cached field to w, waiting for any still building
+void FlowField_Save( flowField_s * const ff, streamWriter_s * const w );
+
+// replaces the costs and cache with what FlowField_Save wrote for a map of the same size. returns zero if the data
+// doesn't fit or is damaged; the cache may then be partly filled, and the caller should discard the state.
+int FlowField_Load( flowField_s * const ff, streamReader_s * const r );
+
+#endif // ___RTSFS_FLOWFIELD_H___
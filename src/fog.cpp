@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "fog.h"
+#include "job.h"
+#include "mem.h"
+#include "simd.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <stdlib.h>
+
+#include <new>
+
+typedef struct fogUnit_s {
+    int32_t x = 0;
+    int32_t y = 0;
+    uint8_t radius = 0;
+    uint8_t player = 0;
+    bool active = false;
+} fogUnit_s;
+
+typedef struct fog_s {
+    size_t width = 0;
+    size_t height = 0;
+    size_t wordsPerRow = 0;
+    size_t dirtyWords = 0;
+    size_t playerCount = 0;
+    size_t unitCapacity = 0;
+    uint16_t * count = nullptr;   // [ player ][ y ][ x ] number of units seeing the cell
+    uint64_t * visible = nullptr; // [ player ][ y ][ word ]
+    uint64_t * explored = nullptr;
+    uint64_t * dirty = nullptr;   // [ player ][ row bit ] rows whose counts changed since the last commit
+    fogUnit_s * unit = nullptr;
+
+    // half width of the circle of radius r at row offset dy, indexed [ r ][ dy + r ]
+    int32_t halfWidth[ kFog_MaxRadius + 1 ][ 2 * kFog_MaxRadius + 1 ];
+} fog_s;
+
+static constexpr size_t kFog_ShadeChunk = 512; // pixels per column table
+static constexpr size_t kFog_ShadeBandRows = 32; // pixel rows per job in Fog_Shade
+
+// floor( value / 65536 ) for negative values too
+static inline int64_t FixedFloor( const int64_t value ) {
+    return value >= 0 ? value / 65536 : -( ( -value + 65535 ) / 65536 );
+}
+
+static inline void AddSpan( fog_s * const fog, const size_t player, const int32_t y, int32_t x0, int32_t x1, const int delta ) {
+    if ( x1 < x0 ) {
+        return;
+    }
+
+    x0 = x0 < 0 ? 0 : x0;
+    x1 = x1 >= ( int32_t )fog->width ? ( int32_t )fog->width - 1 : x1;
+    if ( x1 < x0 ) {
+        return;
+    }
+
+    uint16_t * const row = fog->count + ( player * fog->height + ( size_t )y ) * fog->width;
+    if ( delta > 0 ) {
+        for ( int32_t x = x0; x <= x1; x++ ) {
+            row[ x ]++;
+        }
+    } else {
+        for ( int32_t x = x0; x <= x1; x++ ) {
+            assert( row[ x ] != 0 );
+            row[ x ]--;
+        }
+    }
+
+    fog->dirty[ player * fog->dirtyWords + ( size_t )y / 64 ] |= 1ull << ( ( size_t )y & 63 );
+}
+
+// returns nonzero if the unit's circle covers row y, with the covered span in x0, x1
+static inline int UnitSpan( const fog_s * const fog, const fogUnit_s * const unit, const int32_t y, int32_t * const x0, int32_t * const x1 ) {
+    if ( !unit->active ) {
+        return 0;
+    }
+
+    const int32_t dy = y - unit->y;
+    if ( dy < -( int32_t )unit->radius || dy > ( int32_t )unit->radius ) {
+        return 0;
+    }
+
+    const int32_t hw = fog->halfWidth[ unit->radius ][ dy + unit->radius ];
+    *x0 = unit->x - hw;
+    *x1 = unit->x + hw;
+    return 1;
+}
+
+// moves a unit's vision from before to after, touching only the cells that enter or leave it. both must belong to
+// the same player.
+static void MoveVision( fog_s * const fog, const fogUnit_s * const before, const fogUnit_s * const after ) {
+    int32_t y0 = INT32_MAX;
+    int32_t y1 = INT32_MIN;
+    if ( before->active ) {
+        y0 = before->y - before->radius;
+        y1 = before->y + before->radius;
+    }
+    if ( after->active ) {
+        y0 = after->y - after->radius < y0 ? after->y - after->radius : y0;
+        y1 = after->y + after->radius > y1 ? after->y + after->radius : y1;
+    }
+
+    const size_t player = after->active ? after->player : before->player;
+
+    y0 = y0 < 0 ? 0 : y0;
+    y1 = y1 >= ( int32_t )fog->height ? ( int32_t )fog->height - 1 : y1;
+
+    for ( int32_t y = y0; y <= y1; y++ ) {
+        int32_t o0;
+        int32_t o1;
+        int32_t n0;
+        int32_t n1;
+        const int inOld = UnitSpan( fog, before, y, &o0, &o1 );
+        const int inNew = UnitSpan( fog, after, y, &n0, &n1 );
+
+        if ( inOld && inNew ) {
+            // the parts of each span not covered by the other
+            AddSpan( fog, player, y, o0, o1 < n0 - 1 ? o1 : n0 - 1, -1 );
+            AddSpan( fog, player, y, o0 > n1 + 1 ? o0 : n1 + 1, o1, -1 );
+            AddSpan( fog, player, y, n0, n1 < o0 - 1 ? n1 : o0 - 1, 1 );
+            AddSpan( fog, player, y, n0 > o1 + 1 ? n0 : o1 + 1, n1, 1 );
+        } else if ( inOld ) {
+            AddSpan( fog, player, y, o0, o1, -1 );
+        } else if ( inNew ) {
+            AddSpan( fog, player, y, n0, n1, 1 );
+        }
+    }
+}
+
+// bit i set where counts[ i ] is nonzero, for up to 64 counts
+static uint64_t NonZeroBits( const uint16_t * const counts, const size_t n ) {
+    uint64_t bits = 0;
+    size_t i = 0;
+
+#if defined( RTSFS_SIMD_SSE2 )
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i + 16 <= n; i += 16 ) {
+        const __m128i a = _mm_cmpeq_epi16( _mm_loadu_si128( ( const __m128i * )( counts + i ) ), zero );
+        const __m128i b = _mm_cmpeq_epi16( _mm_loadu_si128( ( const __m128i * )( counts + i + 8 ) ), zero );
+        const uint32_t empty = ( uint32_t )_mm_movemask_epi8( _mm_packs_epi16( a, b ) );
+        bits |= ( uint64_t )( ~empty & 0xffff ) << i;
+    }
+#endif
+
+    for ( ; i < n; i++ ) {
+        bits |= ( uint64_t )( counts[ i ] != 0 ) << i;
+    }
+
+    return bits;
+}
+
+fog_s * Fog_Create( const vec2_s< size_t > size, const size_t playerCount, const size_t unitCapacity ) {
+    if ( size.x == 0 || size.y == 0 || size.x > INT32_MAX || size.y > INT32_MAX || playerCount == 0 || playerCount > 256 ) {
+        return nullptr;
+    }
+
+    fog_s * const fog = ( fog_s * )Mem_Alloc( kMemTag_Sim, sizeof( fog_s ) );
+    if ( fog == nullptr ) {
+        return nullptr;
+    }
+
+    new ( fog ) fog_s;
+
+    fog->width = size.x;
+    fog->height = size.y;
+    fog->wordsPerRow = ( size.x + 63 ) / 64;
+    fog->dirtyWords = ( size.y + 63 ) / 64;
+    fog->playerCount = playerCount;
+    fog->unitCapacity = unitCapacity;
+
+    const size_t planeWords = playerCount * size.y * fog->wordsPerRow;
+
+    fog->count = ( uint16_t * )Mem_Calloc( kMemTag_Sim, playerCount * size.x * size.y, sizeof( uint16_t ) );
+    fog->visible = ( uint64_t * )Mem_Calloc( kMemTag_Sim, planeWords, sizeof( uint64_t ) );
+    fog->explored = ( uint64_t * )Mem_Calloc( kMemTag_Sim, planeWords, sizeof( uint64_t ) );
+    fog->dirty = ( uint64_t * )Mem_Calloc( kMemTag_Sim, playerCount * fog->dirtyWords, sizeof( uint64_t ) );
+    fog->unit = ( fogUnit_s * )Mem_Alloc( kMemTag_Sim, sizeof( fogUnit_s ) * ( unitCapacity ? unitCapacity : 1 ) );
+
+    if ( fog->count == nullptr || fog->visible == nullptr || fog->explored == nullptr || fog->dirty == nullptr || fog->unit == nullptr ) {
+        Fog_Destroy( fog );
+        return nullptr;
+    }
+
+    for ( size_t i = 0; i < unitCapacity; i++ ) {
+        new ( fog->unit + i ) fogUnit_s;
+    }
+
+    // a cell is inside when its center is within radius + 0.5, which rounds the circle's silhouette nicely
+    for ( int32_t r = 0; r <= kFog_MaxRadius; r++ ) {
+        for ( int32_t dy = -r; dy <= r; dy++ ) {
+            int32_t hw = 0;
+            while ( ( hw + 1 ) * ( hw + 1 ) + dy * dy <= r * r + r ) {
+                hw++;
+            }
+            fog->halfWidth[ r ][ dy + r ] = hw;
+        }
+    }
+
+    return fog;
+}
+
+void Fog_Destroy( fog_s * const fog ) {
+    if ( fog == nullptr ) {
+        return;
+    }
+
+    Mem_Free( fog->count );
+    Mem_Free( fog->visible );
+    Mem_Free( fog->explored );
+    Mem_Free( fog->dirty );
+    Mem_Free( fog->unit );
+    Mem_Free( fog );
+}
+
+void Fog_SetUnit( fog_s * const fog, const size_t unit, const size_t player, const vec2_s< int32_t > cell, const size_t radius ) {
+    if ( fog == nullptr || unit >= fog->unitCapacity || player >= fog->playerCount ) {
+        return;
+    }
+
+    fogUnit_s * const current = fog->unit + unit;
+
+    fogUnit_s next;
+    next.x = cell.x;
+    next.y = cell.y;
+    next.radius = ( uint8_t )( radius > ( size_t )kFog_MaxRadius ? ( size_t )kFog_MaxRadius : radius );
+    next.player = ( uint8_t )player;
+    next.active = true;
+
+    if ( current->active && current->x == next.x && current->y == next.y && current->radius == next.radius &&
+         current->player == next.player ) {
+        return;
+    }
+
+    if ( current->active && current->player != next.player ) {
+        const fogUnit_s none;
+        MoveVision( fog, current, &none );
+        current->active = false;
+    }
+
+    MoveVision( fog, current, &next );
+    *current = next;
+}
+
+void Fog_RemoveUnit( fog_s * const fog, const size_t unit ) {
+    if ( fog == nullptr || unit >= fog->unitCapacity ) {
+        return;
+    }
+
+    fogUnit_s * const current = fog->unit + unit;
+    if ( !current->active ) {
+        return;
+    }
+
+    const fogUnit_s none;
+    MoveVision( fog, current, &none );
+    current->active = false;
+}
+
+void Fog_Commit( fog_s * const fog ) {
+    if ( fog == nullptr ) {
+        return;
+    }
+
+    for ( size_t player = 0; player < fog->playerCount; player++ ) {
+        uint64_t * const dirty = fog->dirty + player * fog->dirtyWords;
+
+        for ( size_t word = 0; word < fog->dirtyWords; word++ ) {
+            while ( dirty[ word ] != 0 ) {
+                uint64_t bits = dirty[ word ];
+                size_t bit = 0;
+                while ( ( bits & 1 ) == 0 ) {
+                    bits >>= 1;
+                    bit++;
+                }
+                dirty[ word ] &= dirty[ word ] - 1;
+
+                const size_t y = word * 64 + bit;
+                const uint16_t * const counts = fog->count + ( player * fog->height + y ) * fog->width;
+                uint64_t * const visible = fog->visible + ( player * fog->height + y ) * fog->wordsPerRow;
+                uint64_t * const explored = fog->explored + ( player * fog->height + y ) * fog->wordsPerRow;
+
+                for ( size_t w = 0; w < fog->wordsPerRow; w++ ) {
+                    const size_t remain = fog->width - w * 64;
+                    const uint64_t bitsNow = NonZeroBits( counts + w * 64, remain < 64 ? remain : 64 );
+                    visible[ w ] = bitsNow;
+                    explored[ w ] |= bitsNow;
+                }
+            }
+        }
+    }
+}
+
+static int TestBit( const fog_s * const fog, const uint64_t * const plane, const size_t player, const vec2_s< int32_t > cell ) {
+    if ( fog == nullptr || player >= fog->playerCount ) {
+        return 0;
+    }
+    if ( cell.x < 0 || cell.y < 0 || ( size_t )cell.x >= fog->width || ( size_t )cell.y >= fog->height ) {
+        return 0;
+    }
+    const uint64_t word = plane[ ( player * fog->height + ( size_t )cell.y ) * fog->wordsPerRow + ( size_t )cell.x / 64 ];
+    return ( int )( ( word >> ( ( size_t )cell.x & 63 ) ) & 1 );
+}
+
+int Fog_IsVisible( const fog_s * const fog, const size_t player, const vec2_s< int32_t > cell ) {
+    return fog ? TestBit( fog, fog->visible, player, cell ) : 0;
+}
+
+int Fog_IsExplored( const fog_s * const fog, const size_t player, const vec2_s< int32_t > cell ) {
+    return fog ? TestBit( fog, fog->explored, player, cell ) : 0;
+}
+
+size_t Fog_GetPlanes( const fog_s * const fog, const size_t player, const uint64_t ** const visible, const uint64_t ** const explored ) {
+    if ( fog == nullptr || player >= fog->playerCount ) {
+        return 0;
+    }
+    if ( visible != nullptr ) {
+        *visible = fog->visible + player * fog->height * fog->wordsPerRow;
+    }
+    if ( explored != nullptr ) {
+        *explored = fog->explored + player * fog->height * fog->wordsPerRow;
+    }
+    return fog->wordsPerRow;
+}
+
+enum {
+    kFogState_Visible = 0,
+    kFogState_Explored = 1,
+    kFogState_Hidden = 2,
+};
+
+#if defined( RTSFS_SIMD_SSE2 )
+// per pixel saturation and light for up to 8 states held in 16 bit lanes
+static inline void StateWeights( const __m128i st16,
+                                 const __m128i satExplored,
+                                 const __m128i lightExplored,
+                                 const __m128i lightHidden,
+                                 __m128i * const sat,
+                                 __m128i * const light ) {
+    const __m128i full = _mm_set1_epi16( 256 );
+    const __m128i visible = _mm_cmpeq_epi16( st16, _mm_set1_epi16( kFogState_Visible ) );
+    const __m128i explored = _mm_cmpeq_epi16( st16, _mm_set1_epi16( kFogState_Explored ) );
+    const __m128i hidden = _mm_cmpeq_epi16( st16, _mm_set1_epi16( kFogState_Hidden ) );
+
+    *sat = _mm_or_si128( _mm_and_si128( visible, full ), _mm_and_si128( explored, satExplored ) );
+    *light = _mm_or_si128( _mm_or_si128( _mm_and_si128( visible, full ), _mm_and_si128( explored, lightExplored ) ),
+                           _mm_and_si128( hidden, lightHidden ) );
+}
+#endif
+
+// applies the style to a span of pixels given their cell states:
+//   mixed = ( pixel * saturation + gray * ( 256 - saturation ) ) >> 8
+//   out   = ( mixed * light ) >> 8
+// alpha is left untouched. every intermediate fits in 16 unsigned bits.
+static void ShadeSpan( rgba_s * dst, const uint8_t * state, size_t count, const fogStyle_s * const style ) {
+    const uint16_t sat[ 3 ] = { 256, style->exploredSaturation, 0 };
+    const uint16_t light[ 3 ] = { 256, style->exploredLight, style->hiddenLight };
+
+#if defined( RTSFS_SIMD_SSE2 )
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16( 256 );
+    const __m128i satExplored = _mm_set1_epi16( ( short )sat[ kFogState_Explored ] );
+    const __m128i lightExplored = _mm_set1_epi16( ( short )light[ kFogState_Explored ] );
+    const __m128i lightHidden = _mm_set1_epi16( ( short )light[ kFogState_Hidden ] );
+#endif
+
+#if defined( RTSFS_SIMD_AVX2 )
+    {
+        const __m256i zero256 = _mm256_setzero_si256();
+        const __m256i full256 = _mm256_set1_epi16( 256 );
+        const __m256i luma = _mm256_set_epi16( 0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29 );
+        const __m256i alpha = _mm256_set1_epi32( ( int )0xff000000u );
+
+        for ( ; count >= 8; count -= 8, dst += 8, state += 8 ) {
+            uint64_t bits;
+            memcpy( &bits, state, sizeof( bits ) );
+            if ( bits == 0 ) {
+                continue;
+            }
+
+            const __m256i d = _mm256_loadu_si256( ( const __m256i * )dst );
+
+            if ( bits == 0x0202020202020202ull && light[ 2 ] == 0 ) {
+                _mm256_storeu_si256( ( __m256i * )dst, _mm256_and_si256( d, alpha ) );
+                continue;
+            }
+
+            __m128i sat16;
+            __m128i light16;
+            const __m128i st16 = _mm_unpacklo_epi8( _mm_loadl_epi64( ( const __m128i * )state ), zero );
+            StateWeights( st16, satExplored, lightExplored, lightHidden, &sat16, &light16 );
+
+            // pixels 0-3 live in the low 128 bit lane and 4-7 in the high one, matching the byte unpacks below
+            const __m256i sat2 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( sat16, sat16 ) ), _mm_unpackhi_epi16( sat16, sat16 ), 1 );
+            const __m256i light2 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( light16, light16 ) ), _mm_unpackhi_epi16( light16, light16 ), 1 );
+
+            __m256i half[ 2 ] = { _mm256_unpacklo_epi8( d, zero256 ), _mm256_unpackhi_epi8( d, zero256 ) };
+            const __m256i sats[ 2 ] = { _mm256_unpacklo_epi32( sat2, sat2 ), _mm256_unpackhi_epi32( sat2, sat2 ) };
+            const __m256i lights[ 2 ] = { _mm256_unpacklo_epi32( light2, light2 ), _mm256_unpackhi_epi32( light2, light2 ) };
+
+            for ( size_t h = 0; h < 2; h++ ) {
+                const __m256i dot = _mm256_madd_epi16( half[ h ], luma );
+                const __m256i sum = _mm256_srli_epi32( _mm256_add_epi32( dot, _mm256_shuffle_epi32( dot, _MM_SHUFFLE( 2, 3, 0, 1 ) ) ), 8 );
+                const __m256i gray2 = _mm256_packs_epi32( sum, sum );
+                const __m256i gray = _mm256_unpacklo_epi16( gray2, gray2 );
+
+                const __m256i mixed = _mm256_srli_epi16( _mm256_add_epi16( _mm256_mullo_epi16( half[ h ], sats[ h ] ),
+                                                                           _mm256_mullo_epi16( gray, _mm256_sub_epi16( full256, sats[ h ] ) ) ), 8 );
+                half[ h ] = _mm256_srli_epi16( _mm256_mullo_epi16( mixed, lights[ h ] ), 8 );
+            }
+
+            const __m256i out = _mm256_packus_epi16( half[ 0 ], half[ 1 ] );
+            _mm256_storeu_si256( ( __m256i * )dst, _mm256_or_si256( _mm256_andnot_si256( alpha, out ), _mm256_and_si256( d, alpha ) ) );
+        }
+    }
+#endif
+
+#if defined( RTSFS_SIMD_SSE2 )
+    {
+        const __m128i luma = _mm_set_epi16( 0, 77, 150, 29, 0, 77, 150, 29 );
+        const __m128i alpha = _mm_set1_epi32( ( int )0xff000000u );
+
+        for ( ; count >= 4; count -= 4, dst += 4, state += 4 ) {
+            int32_t bits;
+            memcpy( &bits, state, sizeof( bits ) );
+            if ( bits == 0 ) {
+                continue;
+            }
+
+            const __m128i d = _mm_loadu_si128( ( const __m128i * )dst );
+
+            if ( bits == 0x02020202 && light[ 2 ] == 0 ) {
+                _mm_storeu_si128( ( __m128i * )dst, _mm_and_si128( d, alpha ) );
+                continue;
+            }
+
+            __m128i sat16;
+            __m128i light16;
+            const __m128i st16 = _mm_unpacklo_epi8( _mm_cvtsi32_si128( bits ), zero );
+            StateWeights( st16, satExplored, lightExplored, lightHidden, &sat16, &light16 );
+
+            const __m128i sat2 = _mm_unpacklo_epi16( sat16, sat16 );
+            const __m128i light2 = _mm_unpacklo_epi16( light16, light16 );
+
+            __m128i half[ 2 ] = { _mm_unpacklo_epi8( d, zero ), _mm_unpackhi_epi8( d, zero ) };
+            const __m128i sats[ 2 ] = { _mm_unpacklo_epi32( sat2, sat2 ), _mm_unpackhi_epi32( sat2, sat2 ) };
+            const __m128i lights[ 2 ] = { _mm_unpacklo_epi32( light2, light2 ), _mm_unpackhi_epi32( light2, light2 ) };
+
+            for ( size_t h = 0; h < 2; h++ ) {
+                const __m128i dot = _mm_madd_epi16( half[ h ], luma );
+                const __m128i sum = _mm_srli_epi32( _mm_add_epi32( dot, _mm_shuffle_epi32( dot, _MM_SHUFFLE( 2, 3, 0, 1 ) ) ), 8 );
+                const __m128i gray2 = _mm_packs_epi32( sum, sum );
+                const __m128i gray = _mm_unpacklo_epi16( gray2, gray2 );
+
+                const __m128i mixed = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( half[ h ], sats[ h ] ),
+                                                                     _mm_mullo_epi16( gray, _mm_sub_epi16( full, sats[ h ] ) ) ), 8 );
+                half[ h ] = _mm_srli_epi16( _mm_mullo_epi16( mixed, lights[ h ] ), 8 );
+            }
+
+            const __m128i out = _mm_packus_epi16( half[ 0 ], half[ 1 ] );
+            _mm_storeu_si128( ( __m128i * )dst, _mm_or_si128( _mm_andnot_si128( alpha, out ), _mm_and_si128( d, alpha ) ) );
+        }
+    }
+#endif
+
+    for ( ; count != 0; count--, dst++, state++ ) {
+        if ( *state == kFogState_Visible ) {
+            continue;
+        }
+        const uint32_t s = sat[ *state ];
+        const uint32_t l = light[ *state ];
+        const uint32_t gray = ( dst->b * 29u + dst->g * 150u + dst->r * 77u ) >> 8;
+        dst->b = ( uint8_t )( ( ( ( dst->b * s + gray * ( 256 - s ) ) >> 8 ) * l ) >> 8 );
+        dst->g = ( uint8_t )( ( ( ( dst->g * s + gray * ( 256 - s ) ) >> 8 ) * l ) >> 8 );
+        dst->r = ( uint8_t )( ( ( ( dst->r * s + gray * ( 256 - s ) ) >> 8 ) * l ) >> 8 );
+    }
+}
+
+static void ShadeRect( const fog_s * const fog,
+                       const size_t player,
+                       rgba_s * const surface,
+                       const size_t stride,
+                       const rect_s< size_t > clip,
+                       const fogView_s * const view,
+                       const fogStyle_s * const style ) {
+    const uint64_t * const visible = fog->visible + player * fog->height * fog->wordsPerRow;
+    const uint64_t * const explored = fog->explored + player * fog->height * fog->wordsPerRow;
+
+    int64_t column[ kFog_ShadeChunk ];
+    uint8_t state[ kFog_ShadeChunk ];
+
+    for ( size_t cx = clip.mn.x; cx <= clip.mx.x; cx += kFog_ShadeChunk ) {
+        const size_t remain = clip.mx.x - cx + 1;
+        const size_t count = remain < kFog_ShadeChunk ? remain : kFog_ShadeChunk;
+
+        for ( size_t j = 0; j < count; j++ ) {
+            column[ j ] = FixedFloor( view->origin.x + ( int64_t )( ( cx + j ) * view->step ) );
+        }
+
+        int64_t stateRow = INT64_MIN;
+        int allVisible = 0;
+
+        for ( size_t y = clip.mn.y; y <= clip.mx.y; y++ ) {
+            const int64_t cellY = FixedFloor( view->origin.y + ( int64_t )( y * view->step ) );
+
+            // the state row is rebuilt only when the pixel row crosses into a new cell row
+            if ( cellY != stateRow ) {
+                stateRow = cellY;
+                allVisible = 1;
+
+                if ( cellY < 0 || cellY >= ( int64_t )fog->height ) {
+                    memset( state, kFogState_Hidden, count );
+                    allVisible = 0;
+                } else {
+                    const uint64_t * const vis = visible + ( size_t )cellY * fog->wordsPerRow;
+                    const uint64_t * const exp = explored + ( size_t )cellY * fog->wordsPerRow;
+
+                    for ( size_t j = 0; j < count; j++ ) {
+                        const int64_t cellX = column[ j ];
+                        uint8_t s = kFogState_Hidden;
+                        if ( cellX >= 0 && cellX < ( int64_t )fog->width ) {
+                            const size_t word = ( size_t )cellX / 64;
+                            const uint64_t bit = 1ull << ( ( size_t )cellX & 63 );
+                            s = ( vis[ word ] & bit ) ? kFogState_Visible : ( exp[ word ] & bit ) ? kFogState_Explored : kFogState_Hidden;
+                        }
+                        state[ j ] = s;
+                        allVisible &= s == kFogState_Visible;
+                    }
+                }
+            }
+
+            if ( allVisible ) {
+                continue;
+            }
+
+            ShadeSpan( surface + y * stride + cx, state, count, style );
+        }
+    }
+}
+
+typedef struct fogShadeTask_s {
+    const fog_s * fog = nullptr;
+    size_t player = 0;
+    rgba_s * surface = nullptr;
+    size_t stride = 0;
+    rect_s< size_t > clip;
+    const fogView_s * view = nullptr;
+    const fogStyle_s * style = nullptr;
+} fogShadeTask_s;
+
+static void ShadeBands( void * const param, const size_t first, const size_t last ) {
+    const fogShadeTask_s * const task = ( const fogShadeTask_s * )param;
+    rect_s< size_t > band = task->clip;
+    band.mn.y = task->clip.mn.y + first * kFog_ShadeBandRows;
+    band.mx.y = task->clip.mn.y + last * kFog_ShadeBandRows - 1;
+    band.mx.y = band.mx.y < task->clip.mx.y ? band.mx.y : task->clip.mx.y;
+    ShadeRect( task->fog, task->player, task->surface, task->stride, band, task->view, task->style );
+}
+
+void Fog_Shade( const fog_s * const fog,
+                const size_t player,
+                rgba_s * const surface,
+                const size_t stride,
+                const rect_s< size_t > clip,
+                const fogView_s * const view,
+                const fogStyle_s * const style ) {
+    if ( fog == nullptr || player >= fog->playerCount || surface == nullptr || view == nullptr || style == nullptr ) {
+        return;
+    }
+    if ( clip.mx.x < clip.mn.x || clip.mx.y < clip.mn.y ) {
+        return;
+    }
+
+    // bands of rows write disjoint pixels, so they shade on any job thread
+    fogShadeTask_s task;
+    task.fog = fog;
+    task.player = player;
+    task.surface = surface;
+    task.stride = stride;
+    task.clip = clip;
+    task.view = view;
+    task.style = style;
+    const size_t bandCount = ( clip.mx.y - clip.mn.y ) / kFog_ShadeBandRows + 1;
+    Job_ParallelFor( bandCount, 1, ShadeBands, &task );
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_FOG_H___
+#define ___RTSFS_FOG_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// per player fog of war over the map's cell grid.
+//
+// each player has two packed bitplanes, one bit per cell, 64 cells per word:
+//   visible  - a unit of that player currently sees the cell
+//   explored - the cell has been visible at some point
+//
+// units are registered by index and stamp a circle of cells using precomputed row spans. a per cell reference count
+// sits behind the visible plane, so moving a unit only touches the cells that enter or leave its circle instead of
+// rebuilding the grid. the bitplanes are refreshed for touched rows by Fog_Commit, once per tick.
+//
+// a fog belongs to the thread that ticks the sim, and every call is made from it. Fog_Shade and Fog_GetPlanes read
+// the planes in place, so shading a frame the render thread executes needs a copy of them per frame in flight, as
+// the minimap keeps.
+
+typedef struct fog_s fog_s;
+
+enum {
+    kFog_MaxRadius = 32, // vision radius in cells; larger radii are clamped
+};
+
+// maps surface pixels to cells: cell = ( origin + pixel * step ) >> 16, both in 16.16 fixed point
+typedef struct fogView_s {
+    vec2_s< int64_t > origin; // cell coordinate of surface pixel 0,0
+    uint32_t step = 0;        // cells per pixel
+} fogView_s;
+
+// how Fog_Shade treats cells that aren't visible. values are out of 256; 256 leaves the pixel untouched.
+typedef struct fogStyle_s {
+    uint16_t exploredLight = 128;      // brightness of explored cells
+    uint16_t exploredSaturation = 96;  // saturation of explored cells
+    uint16_t hiddenLight = 0;          // brightness of never seen cells
+} fogStyle_s;
+
+// returns nullptr on failure
+fog_s * Fog_Create( const vec2_s< size_t > size, const size_t playerCount, const size_t unitCapacity );
+
+void Fog_Destroy( fog_s * const fog );
+
+// places or moves a unit's vision. does nothing when nothing changed.
+void Fog_SetUnit( fog_s * const fog, const size_t unit, const size_t player, const vec2_s< int32_t > cell, const size_t radius );
+
+void Fog_RemoveUnit( fog_s * const fog, const size_t unit );
+
+// brings the bitplanes up to date with the unit changes since the last commit
+void Fog_Commit( fog_s * const fog );
+
+int Fog_IsVisible( const fog_s * const fog, const size_t player, const vec2_s< int32_t > cell );
+int Fog_IsExplored( const fog_s * const fog, const size_t player, const vec2_s< int32_t > cell );
+
+// returns the bitplane rows for a player; bit ( x & 63 ) of word [ y * wordsPerRow + ( x >> 6 ) ] is cell x, y.
+// either output may be nullptr. returns the number of words per row, or zero on error.
+size_t Fog_GetPlanes( const fog_s * const fog, const size_t player, const uint64_t ** const visible, const uint64_t ** const explored );
+
+// darkens and desaturates the pixels inside clip (inclusive) whose cells aren't visible to the player.
+void Fog_Shade( const fog_s * const fog,
+                const size_t player,
+                rgba_s * const surface,
+                const size_t stride,
+                const rect_s< size_t > clip,
+                const fogView_s * const view,
+                const fogStyle_s * const style );
+
+#endif // ___RTSFS_FOG_H___
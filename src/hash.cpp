@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "hash.h"
+#include "simd.h"
+
+void Hash_AddWords( hashLanes_s * const lanes, const uint32_t * const words, const size_t count ) {
+    size_t i = 0;
+
+#if RTSFS_SIMD_SSE2
+    __m128i a = _mm_loadu_si128( ( const __m128i * )lanes->a );
+    __m128i b = _mm_loadu_si128( ( const __m128i * )lanes->b );
+    for ( ; i + 4 <= count; i += 4 ) {
+        a = _mm_add_epi32( a, _mm_loadu_si128( ( const __m128i * )( words + i ) ) );
+        b = _mm_add_epi32( b, a );
+    }
+    _mm_storeu_si128( ( __m128i * )lanes->a, a );
+    _mm_storeu_si128( ( __m128i * )lanes->b, b );
+#endif
+
+    for ( ; i < count; i++ ) {
+        lanes->a[ i & 3 ] += words[ i ];
+        lanes->b[ i & 3 ] += lanes->a[ i & 3 ];
+    }
+}
+
+uint64_t Hash_Finish( const hashLanes_s * const lanes, const uint64_t seed ) {
+    uint64_t h = seed;
+    for ( size_t i = 0; i < 4; i++ ) {
+        h = Hash_Mix( h, ( ( uint64_t )lanes->b[ i ] << 32 ) | lanes->a[ i ] );
+    }
+    return h;
+}
+
+uint64_t Hash_Words( const uint32_t * const words, const size_t count, const uint64_t seed ) {
+    hashLanes_s lanes;
+    Hash_AddWords( &lanes, words, count );
+    return Hash_Finish( &lanes, Hash_Mix( seed, count ) );
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_HASH_H___
+#define ___RTSFS_HASH_H___
+
+#include <stddef.h>
+#include <stdint.h>
+
+// state hashing for desync detection. not cryptographic, and not meant for hash tables.
+//
+// words are summed into four lanes fletcher style, a += word, b += a, with word i going to lane i & 3. that is two
+// adds per word, the lanes map straight onto a 128 bit register, and a kernel that already has the words in
+// registers can fold them in as it writes them instead of reading the state a second time. b makes the sum order
+// sensitive, so swapped or shifted values change it too. Hash_Finish mixes the lanes down to 64 bits.
+
+typedef struct hashLanes_s {
+    uint32_t a[ 4 ] = {};
+    uint32_t b[ 4 ] = {};
+} hashLanes_s;
+
+// combines value into h; order matters
+inline uint64_t Hash_Mix( const uint64_t h, const uint64_t value ) {
+    uint64_t x = h ^ ( value + 0x9e3779b97f4a7c15ull + ( h << 6 ) + ( h >> 2 ) );
+    x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+    x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+    return x ^ ( x >> 31 );
+}
+
+// words[ 0 .. count ) into lanes, continuing from whatever they hold; count should be a multiple of 4 except on the
+// last call, so words keep their lanes
+void Hash_AddWords( hashLanes_s * const lanes, const uint32_t * const words, const size_t count );
+
+uint64_t Hash_Finish( const hashLanes_s * const lanes, const uint64_t seed );
+
+// the whole of words[ 0 .. count ) in one go
+uint64_t Hash_Words( const uint32_t * const words, const size_t count, const uint64_t seed );
+
+#endif // ___RTSFS_HASH_H___
@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "job.h"
+#include "arena.h"
+#include "mem.h"
+#include "profile.h"
+#include "simd.h"
+#include "thread.h"
+#include "timer.h"
+
+#include <stdio.h>
+
+#include <new>
+
+static constexpr size_t kJob_QueueMask = kJob_QueueSize - 1;
+static constexpr uint32_t kJob_SpinCount = 2000;      // empty steal rounds before a worker sleeps
+static constexpr uint32_t kJob_WaitSpinCount = 64;    // empty steal rounds before a waiter yields its time slice
+static constexpr size_t kJob_SplitsPerThread = 8;
+static constexpr size_t kJob_InjectSize = 64;          // jobs queued by threads that aren't job threads
+
+static constexpr size_t kJob_BenchItems = 1 << 22;
+static constexpr uint32_t kJob_BenchTreeDepth = 15;
+static constexpr size_t kJob_BenchRuns = 5;
+
+static_assert( ( kJob_QueueSize & kJob_QueueMask ) == 0, "queue size must be a power of two" );
+
+typedef struct job_s {
+    jobFunc_cb func = nullptr;
+    jobRangeFunc_cb rangeFunc = nullptr; // set for a parallel for range
+    void * param = nullptr;
+    jobCounter_s * counter = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    size_t grain = 0;
+} job_s;
+
+typedef struct jobThread_s {
+    // chase-lev deque; top and bottom sit on their own cache lines, since thieves hammer one and the owner the other
+    std::atomic< int64_t > top{ 0 };
+    uint8_t topPad[ 56 ];
+    std::atomic< int64_t > bottom{ 0 };
+    uint8_t bottomPad[ 56 ];
+    job_s slot[ kJob_QueueSize ];
+
+    size_t index = 0;
+    uint32_t random = 0;
+    std::atomic< int > sleeping{ 0 };
+    signal_s * wake = nullptr;
+    thread_s * thread = nullptr;
+} jobThread_s;
+
+static jobThread_s * jobThread[ kJob_MaxThreads ];
+static size_t jobThreadCount = 0;
+static size_t jobWorkerCount = 0;       // workers that started; injected jobs need one
+static std::atomic< int > jobQuit{ 0 };
+static std::atomic< int > jobSleepers{ 0 };
+static thread_local size_t jobIndex = SIZE_MAX;
+
+// threads that aren't job threads have no deque to push to, so they queue here and the workers take from it before
+// stealing. only a few threads ever use it, a handful of times a frame, so a spin lock is enough.
+typedef struct jobInject_s {
+    std::atomic< int > lock{ 0 };
+    std::atomic< uint32_t > count{ 0 };
+    uint32_t head = 0;
+    job_s slot[ kJob_InjectSize ];
+} jobInject_s;
+
+static jobInject_s jobInject;
+
+static inline void Pause( void ) {
+#if RTSFS_SIMD_SSE2
+    _mm_pause();
+#endif
+}
+
+// owner only
+static int Push( jobThread_s * const me, const job_s * const job ) {
+    const int64_t b = me->bottom.load( std::memory_order_relaxed );
+    const int64_t t = me->top.load( std::memory_order_acquire );
+    if ( b - t >= ( int64_t )kJob_QueueSize ) {
+        return 0;
+    }
+
+    me->slot[ ( size_t )b & kJob_QueueMask ] = *job;
+    std::atomic_thread_fence( std::memory_order_release );
+    me->bottom.store( b + 1, std::memory_order_relaxed );
+    return 1;
+}
+
+// owner only: copies out the newest job
+static int Pop( jobThread_s * const me, job_s * const job ) {
+    const int64_t b = me->bottom.load( std::memory_order_relaxed ) - 1;
+    me->bottom.store( b, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    int64_t t = me->top.load( std::memory_order_relaxed );
+
+    if ( t > b ) {
+        me->bottom.store( b + 1, std::memory_order_relaxed );
+        return 0;
+    }
+
+    *job = me->slot[ ( size_t )b & kJob_QueueMask ];
+    if ( t == b ) {
+        // the last one: race the thieves for it
+        const int won = me->top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+        me->bottom.store( b + 1, std::memory_order_relaxed );
+        return won;
+    }
+    return 1;
+}
+
+// any thread: copies out the oldest job. the copy is taken before the claim; once top moves on the owner may
+// overwrite the slot, and a copy that lost the race is simply dropped.
+static int Steal( jobThread_s * const victim, job_s * const job ) {
+    int64_t t = victim->top.load( std::memory_order_acquire );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    const int64_t b = victim->bottom.load( std::memory_order_acquire );
+    if ( t >= b ) {
+        return 0;
+    }
+
+    *job = victim->slot[ ( size_t )t & kJob_QueueMask ];
+    return victim->top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+}
+
+static void LockInject( void ) {
+    while ( jobInject.lock.exchange( 1, std::memory_order_acquire ) ) {
+        Pause();
+    }
+}
+
+static void UnlockInject( void ) {
+    jobInject.lock.store( 0, std::memory_order_release );
+}
+
+// any thread: queues a copy of job for the workers. returns zero if the queue is full.
+static int Inject( const job_s * const job ) {
+    LockInject();
+    const uint32_t count = jobInject.count.load( std::memory_order_relaxed );
+    const int queued = count < kJob_InjectSize;
+    if ( queued ) {
+        jobInject.slot[ ( jobInject.head + count ) % kJob_InjectSize ] = *job;
+        jobInject.count.store( count + 1, std::memory_order_seq_cst );
+    }
+    UnlockInject();
+    return queued;
+}
+
+// job threads: copies out the oldest injected job
+static int TakeInjected( job_s * const job ) {
+    // seq_cst pairs with WakeOne, so a worker going to sleep either sees the job or gets woken
+    if ( jobInject.count.load( std::memory_order_seq_cst ) == 0 ) {
+        return 0;
+    }
+
+    LockInject();
+    const uint32_t count = jobInject.count.load( std::memory_order_relaxed );
+    if ( count > 0 ) {
+        *job = jobInject.slot[ jobInject.head ];
+        jobInject.head = ( jobInject.head + 1 ) % kJob_InjectSize;
+        jobInject.count.store( count - 1, std::memory_order_relaxed );
+    }
+    UnlockInject();
+    return count > 0;
+}
+
+// me may be nullptr for a thread that isn't a job thread; it can only steal. it leaves injected jobs to the job
+// threads, which can split them.
+static int GetJob( jobThread_s * const me, job_s * const job ) {
+    if ( me != nullptr && ( Pop( me, job ) || TakeInjected( job ) ) ) {
+        return 1;
+    }
+
+    const size_t count = jobThreadCount;
+    if ( count < 2 ) {
+        return 0;
+    }
+
+    // start at a random victim so thieves spread out
+    size_t first = 0;
+    if ( me != nullptr ) {
+        uint32_t x = me->random;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        me->random = x;
+        first = x % count;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        jobThread_s * const victim = jobThread[ ( first + i ) % count ];
+        if ( victim != me && Steal( victim, job ) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void WakeOne( void ) {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( jobSleepers.load( std::memory_order_relaxed ) == 0 ) {
+        return;
+    }
+
+    for ( size_t i = 1; i < jobThreadCount; i++ ) {
+        if ( jobThread[ i ]->sleeping.exchange( 0, std::memory_order_seq_cst ) ) {
+            Signal_Raise( jobThread[ i ]->wake );
+            return;
+        }
+    }
+}
+
+// queues a copy of job on the calling thread's deque, or injects it from a thread that isn't a job thread. returns
+// zero if the caller has to run it inline.
+static int Submit( jobThread_s * const me, const job_s * const job ) {
+    if ( me == nullptr && jobWorkerCount == 0 ) {
+        return 0;
+    }
+
+    if ( job->counter != nullptr ) {
+        job->counter->pending.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    if ( me != nullptr ? !Push( me, job ) : !Inject( job ) ) {
+        if ( job->counter != nullptr ) {
+            job->counter->pending.fetch_sub( 1, std::memory_order_relaxed );
+        }
+        return 0;
+    }
+
+    WakeOne();
+    return 1;
+}
+
+static void Execute( jobThread_s * const me, const job_s * const job ) {
+    const job_s run = *job;
+
+    if ( run.rangeFunc != nullptr ) {
+        // hand off the upper half until what is left is small enough to run
+        size_t end = run.end;
+        while ( end - run.begin > run.grain ) {
+            job_s upper = run;
+            upper.begin = run.begin + ( end - run.begin ) / 2;
+            upper.end = end;
+            if ( !Submit( me, &upper ) ) {
+                break;
+            }
+            end = upper.begin;
+        }
+        run.rangeFunc( run.param, run.begin, end );
+    } else {
+        run.func( run.param );
+    }
+
+    if ( run.counter != nullptr ) {
+        run.counter->pending.fetch_sub( 1, std::memory_order_release );
+    }
+}
+
+static void WorkerMain( void * const param ) {
+    jobThread_s * const me = ( jobThread_s * )param;
+    jobIndex = me->index;
+
+    job_s job;
+    uint32_t spins = 0;
+    while ( !jobQuit.load( std::memory_order_acquire ) ) {
+        if ( GetJob( me, &job ) ) {
+            // between jobs nothing on this thread holds frame arena memory, so it can catch up with the main loop
+            FrameArena_SyncFrame();
+            Execute( me, &job );
+            spins = 0;
+            continue;
+        }
+
+        if ( ++spins < kJob_SpinCount ) {
+            Pause();
+            continue;
+        }
+        spins = 0;
+
+        // announce the sleep, then look once more, so a push that missed the announcement is still seen
+        me->sleeping.store( 1, std::memory_order_seq_cst );
+        jobSleepers.fetch_add( 1, std::memory_order_seq_cst );
+        const int found = GetJob( me, &job );
+        if ( !found && !jobQuit.load( std::memory_order_acquire ) ) {
+            PROFILE_ZONE( "Job_Sleep" );
+            Signal_Wait( me->wake );
+        }
+        me->sleeping.store( 0, std::memory_order_relaxed );
+        jobSleepers.fetch_sub( 1, std::memory_order_relaxed );
+
+        if ( found ) {
+            FrameArena_SyncFrame();
+            Execute( me, &job );
+        }
+    }
+}
+
+static jobThread_s * CreateThread( const size_t index ) {
+    void * const mem = Mem_Alloc( kMemTag_Other, sizeof( jobThread_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    jobThread_s * const me = new ( mem ) jobThread_s;
+    me->index = index;
+    me->random = ( uint32_t )index * 2654435761u + 1;
+    me->wake = Signal_Create();
+    if ( me->wake == nullptr ) {
+        me->~jobThread_s();
+        Mem_Free( me );
+        return nullptr;
+    }
+    return me;
+}
+
+static void DestroyThread( jobThread_s * const me ) {
+    Signal_Destroy( me->wake );
+    me->~jobThread_s();
+    Mem_Free( me );
+}
+
+int Job_Init( const size_t workerCount ) {
+    if ( jobThreadCount != 0 ) {
+        return 0;
+    }
+
+    size_t count = ( workerCount == SIZE_MAX ? Thread_GetCoreCount() - 1 : workerCount ) + 1;
+    count = count > kJob_MaxThreads ? kJob_MaxThreads : count;
+
+    // every deque exists before any worker can go looking for work
+    for ( size_t i = 0; i < count; i++ ) {
+        jobThread[ i ] = CreateThread( i );
+        if ( jobThread[ i ] == nullptr ) {
+            for ( size_t j = 0; j < i; j++ ) {
+                DestroyThread( jobThread[ j ] );
+            }
+            return 0;
+        }
+    }
+
+    jobQuit.store( 0, std::memory_order_relaxed );
+    jobThreadCount = count;
+    jobIndex = 0;
+
+    for ( size_t i = 1; i < count; i++ ) {
+        jobThread[ i ]->thread = Thread_Create( WorkerMain, jobThread[ i ] );
+        if ( jobThread[ i ]->thread == nullptr ) {
+            // run with the workers that did start; nobody steals from the rest but their deques stay empty
+            break;
+        }
+        jobWorkerCount++;
+    }
+
+    return 1;
+}
+
+void Job_Shutdown( void ) {
+    if ( jobThreadCount == 0 ) {
+        return;
+    }
+
+    jobQuit.store( 1, std::memory_order_release );
+    for ( size_t i = 1; i < jobThreadCount; i++ ) {
+        if ( jobThread[ i ]->thread != nullptr ) {
+            Signal_Raise( jobThread[ i ]->wake );
+            Thread_Join( jobThread[ i ]->thread );
+        }
+    }
+
+    for ( size_t i = 0; i < jobThreadCount; i++ ) {
+        DestroyThread( jobThread[ i ] );
+        jobThread[ i ] = nullptr;
+    }
+    jobThreadCount = 0;
+    jobWorkerCount = 0;
+    jobSleepers.store( 0, std::memory_order_relaxed );
+    jobIndex = SIZE_MAX;
+}
+
+size_t Job_GetThreadCount( void ) {
+    return jobThreadCount > 0 ? jobThreadCount : 1;
+}
+
+size_t Job_GetThreadIndex( void ) {
+    return jobIndex;
+}
+
+static inline jobThread_s * Self( void ) {
+    return jobIndex < jobThreadCount ? jobThread[ jobIndex ] : nullptr;
+}
+
+void Job_Run( jobFunc_cb const func, void * const param, jobCounter_s * const counter ) {
+    job_s job;
+    job.func = func;
+    job.param = param;
+    job.counter = counter;
+    if ( !Submit( Self(), &job ) ) {
+        func( param );
+    }
+}
+
+void Job_Wait( jobCounter_s * const counter ) {
+    if ( counter->pending.load( std::memory_order_acquire ) == 0 ) {
+        return;
+    }
+
+    PROFILE_ZONE( "Job_Wait" );
+
+    jobThread_s * const me = Self();
+    job_s job;
+    uint32_t spins = 0;
+    while ( counter->pending.load( std::memory_order_acquire ) != 0 ) {
+        if ( jobThreadCount != 0 && GetJob( me, &job ) ) {
+            Execute( me, &job );
+            spins = 0;
+        } else if ( ++spins < kJob_WaitSpinCount ) {
+            Pause();
+        } else {
+            // the jobs left are running elsewhere; on an oversubscribed machine they need this core
+            Thread_Yield();
+        }
+    }
+}
+
+void Job_ParallelFor( const size_t count, const size_t minChunk, jobRangeFunc_cb const func, void * const param ) {
+    if ( count == 0 ) {
+        return;
+    }
+
+    jobThread_s * const me = Self();
+    const size_t threads = Job_GetThreadCount();
+    size_t grain = count / ( threads * kJob_SplitsPerThread );
+    grain = grain > minChunk ? grain : minChunk;
+    grain = grain > 0 ? grain : 1;
+
+    if ( threads == 1 || count <= grain ) {
+        func( param, 0, count );
+        return;
+    }
+
+    PROFILE_ZONE( "Job_ParallelFor" );
+
+    jobCounter_s counter;
+    job_s root;
+    root.rangeFunc = func;
+    root.param = param;
+    root.counter = &counter;
+    root.begin = 0;
+    root.end = count;
+    root.grain = grain;
+
+    // a job thread starts splitting the range itself; any other thread hands the whole range to a worker, which
+    // splits it on its own deque, and steals pieces back while it waits
+    if ( me != nullptr ) {
+        counter.pending.store( 1, std::memory_order_relaxed );
+        Execute( me, &root );
+    } else if ( !Submit( me, &root ) ) {
+        func( param, 0, count );
+        return;
+    }
+
+    Job_Wait( &counter );
+}
+
+typedef struct jobBenchNode_s {
+    uint32_t depth = 0;
+    std::atomic< uint32_t > * sum = nullptr;
+} jobBenchNode_s;
+
+static void BenchRange( void * const param, const size_t begin, const size_t end ) {
+    float * const items = ( float * )param;
+    for ( size_t i = begin; i < end; i++ ) {
+        const float x = items[ i ];
+        items[ i ] = x * x * 0.25f + x * 0.5f + 0.125f;
+    }
+}
+
+static void BenchTree( void * const param ) {
+    const jobBenchNode_s * const node = ( const jobBenchNode_s * )param;
+    if ( node->depth == 0 ) {
+        uint32_t x = ( uint32_t )( uintptr_t )node | 1;
+        for ( size_t i = 0; i < 64; i++ ) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+        node->sum->fetch_add( x & 1, std::memory_order_relaxed );
+        return;
+    }
+
+    jobBenchNode_s child[ 2 ];
+    jobCounter_s counter;
+    for ( size_t i = 0; i < 2; i++ ) {
+        child[ i ].depth = node->depth - 1;
+        child[ i ].sum = node->sum;
+        Job_Run( BenchTree, &child[ i ], &counter );
+    }
+    Job_Wait( &counter );
+}
+
+int Job_Bench( const size_t maxThreads ) {
+    float * const items = ( float * )Mem_Alloc( kMemTag_Other, kJob_BenchItems * sizeof( float ) );
+    if ( items == nullptr ) {
+        return 0;
+    }
+
+    printf( "%-8s %14s %8s %14s %8s\n", "threads", "parallel ms", "speedup", "job tree ms", "speedup" );
+    double baseFor = 0.0;
+    double baseTree = 0.0;
+    for ( size_t threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2 ) {
+        if ( !Job_Init( threads - 1 ) ) {
+            break;
+        }
+
+        for ( size_t i = 0; i < kJob_BenchItems; i++ ) {
+            items[ i ] = ( float )( i & 255 ) / 256.0f;
+        }
+
+        uint64_t bestFor = UINT64_MAX;
+        uint64_t bestTree = UINT64_MAX;
+        for ( size_t run = 0; run < kJob_BenchRuns; run++ ) {
+            uint64_t start = Timer_Nanoseconds();
+            Job_ParallelFor( kJob_BenchItems, 1024, BenchRange, items );
+            const uint64_t forNs = Timer_Nanoseconds() - start;
+            bestFor = forNs < bestFor ? forNs : bestFor;
+
+            std::atomic< uint32_t > sum{ 0 };
+            jobBenchNode_s root;
+            root.depth = kJob_BenchTreeDepth;
+            root.sum = &sum;
+            start = Timer_Nanoseconds();
+            BenchTree( &root );
+            const uint64_t treeNs = Timer_Nanoseconds() - start;
+            bestTree = treeNs < bestTree ? treeNs : bestTree;
+        }
+
+        const size_t running = Job_GetThreadCount();
+        Job_Shutdown();
+
+        const double forMs = ( double )bestFor / 1e6;
+        const double treeMs = ( double )bestTree / 1e6;
+        baseFor = threads == 1 ? forMs : baseFor;
+        baseTree = threads == 1 ? treeMs : baseTree;
+        printf( "%-8zu %14.3f %8.2f %14.3f %8.2f\n", running, forMs, baseFor / forMs, treeMs, baseTree / treeMs );
+
+        if ( threads == maxThreads ) {
+            break;
+        }
+    }
+
+    Mem_Free( items );
+    return 1;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_JOB_H___
+#define ___RTSFS_JOB_H___
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// work stealing job system.
+//
+// Job_Init starts one worker per core besides the calling thread, which becomes job thread 0. every job thread
+// owns a chase-lev deque: it pushes and pops its own jobs at the bottom without contention, and idle threads steal
+// the oldest jobs from the top of someone else's. workers with nothing to steal spin briefly, then sleep until a
+// push wakes one of them.
+//
+// dependencies are counters: Job_Run adds one to a counter, the job finishing takes it away, and Job_Wait runs
+// other jobs until the counter reaches zero, so a waiting thread, the main one included, keeps helping instead of
+// blocking. jobs can start jobs and wait on them.
+//
+// threads that aren't job threads, like the render thread, hand their jobs to the workers through a small shared
+// queue, and help by stealing while they wait. before Job_Init, after Job_Shutdown, and when that queue is full,
+// jobs run inline on the caller, so code can use the api unconditionally.
+
+typedef void ( * jobFunc_cb )( void * const param );
+typedef void ( * jobRangeFunc_cb )( void * const param, const size_t begin, const size_t end );
+
+typedef struct jobCounter_s {
+    std::atomic< uint32_t > pending{ 0 };
+} jobCounter_s;
+
+static constexpr size_t kJob_MaxThreads = 64;   // job threads, the calling thread included
+static constexpr size_t kJob_QueueSize = 4096;  // jobs in flight per thread; more run inline
+
+// workerCount is the number of threads to start besides the caller; SIZE_MAX for one per core. returns zero on
+// failure, in which case jobs keep running inline.
+int Job_Init( const size_t workerCount );
+
+// waits for the workers to finish their current jobs and stops them; queued jobs must have been waited on
+void Job_Shutdown( void );
+
+// job threads, the one that called Job_Init included; 1 without workers
+size_t Job_GetThreadCount( void );
+
+// 0 for the thread that called Job_Init, 1 .. count - 1 for workers, SIZE_MAX for any other thread
+size_t Job_GetThreadIndex( void );
+
+// queues func( param ) and counts it against counter, which may be nullptr
+void Job_Run( jobFunc_cb const func, void * const param, jobCounter_s * const counter );
+
+// runs jobs until counter reaches zero
+void Job_Wait( jobCounter_s * const counter );
+
+// calls func over [ 0, count ) split into ranges of at least minChunk and returns when all are done. ranges split
+// in halves lazily, as they are taken, until they reach about count / ( 8 * threads ), so idle threads steal big
+// pieces first and the tail stays balanced.
+void Job_ParallelFor( const size_t count, const size_t minChunk, jobRangeFunc_cb const func, void * const param );
+
+// the jobbench tool: prints the scaling from 1 to maxThreads threads of an embarrassingly parallel pass and of a tree
+// of tiny jobs that each wait on their children. starts and stops the job system itself, so it must not be running.
+// returns zero on failure.
+int Job_Bench( const size_t maxThreads );
+
+#endif // ___RTSFS_JOB_H___
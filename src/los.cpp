@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "los.h"
+#include "job.h"
+#include "mem.h"
+#include "profile.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+// a cache entry is the terrain version, the pair of cell indices, and the answer in the low bit
+static constexpr uint64_t kLos_CellBits = 23;
+static constexpr uint64_t kLos_VersionShift = 1 + 2 * kLos_CellBits;
+static constexpr uint64_t kLos_VersionLimit = ( uint64_t )1 << ( 64 - kLos_VersionShift );
+static constexpr size_t kLos_CacheSize = ( size_t )1 << kLos_CacheBits;
+static constexpr uint32_t kLos_SortBits = 11;
+static constexpr uint32_t kLos_SortBuckets = 1u << kLos_SortBits;
+
+static_assert( kLos_MaxCells <= ( ( size_t )1 << kLos_CellBits ), "cell index overflows a cache entry" );
+
+// a query copied out by the sort, so the sorted pass reads them in order rather than gathering them
+typedef struct losSortItem_s {
+    losQuery_s query;
+    uint32_t index = 0; // in the batch
+} losSortItem_s;
+
+typedef struct los_s {
+    vec2_s< int32_t > size;
+    size_t rowWords = 0;          // words per row of cells
+    uint64_t * cells = nullptr;   // [ size.y * rowWords ]
+    size_t columnWords = 0;
+    uint64_t * columns = nullptr; // [ size.x * columnWords ] the same bits, transposed
+    vec2_s< int32_t > blocks;
+    size_t blockRowWords = 0;
+    uint64_t * coarse = nullptr;  // [ blocks.y * blockRowWords ]
+    uint8_t * blockCount = nullptr; // [ blocks.x * blocks.y ] blocking cells in each block
+    uint32_t sortShift = 0;       // drops the low bits of block morton codes that don't fit kLos_SortBits
+    std::atomic< uint64_t > * cache = nullptr; // [ kLos_CacheSize ]
+    uint64_t version = 1;         // never 0, so a zeroed entry never matches
+    losSortItem_s * sorted = nullptr; // [ sortedCapacity ] Los_QueryBatch's queries in block order
+    size_t sortedCapacity = 0;
+} los_s;
+
+los_s * Los_Create( const vec2_s< size_t > size ) {
+    if ( size.x == 0 || size.y == 0 || size.x * size.y > kLos_MaxCells ) {
+        return nullptr;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( los_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    los_s * const los = new ( mem ) los_s;
+    los->size = { ( int32_t )size.x, ( int32_t )size.y };
+    los->rowWords = ( size.x + 63 ) / 64;
+    los->columnWords = ( size.y + 63 ) / 64;
+    los->blocks = { ( los->size.x + kLos_BlockSize - 1 ) >> kLos_BlockShift, ( los->size.y + kLos_BlockSize - 1 ) >> kLos_BlockShift };
+    los->blockRowWords = ( ( size_t )los->blocks.x + 63 ) / 64;
+    const size_t blockCount = ( size_t )los->blocks.x * ( size_t )los->blocks.y;
+    const int32_t maxBlock = los->blocks.x > los->blocks.y ? los->blocks.x - 1 : los->blocks.y - 1;
+    for ( int32_t n = maxBlock; n != 0; n >>= 1 ) {
+        los->sortShift += 2;
+    }
+    los->sortShift = los->sortShift > kLos_SortBits ? los->sortShift - kLos_SortBits : 0;
+
+    const size_t cellBytes = size.y * los->rowWords * sizeof( uint64_t );
+    const size_t columnBytes = size.x * los->columnWords * sizeof( uint64_t );
+    const size_t coarseBytes = ( size_t )los->blocks.y * los->blockRowWords * sizeof( uint64_t );
+    los->cells = ( uint64_t * )Mem_Alloc( kMemTag_Sim, cellBytes );
+    los->columns = ( uint64_t * )Mem_Alloc( kMemTag_Sim, columnBytes );
+    los->coarse = ( uint64_t * )Mem_Alloc( kMemTag_Sim, coarseBytes );
+    los->blockCount = ( uint8_t * )Mem_Alloc( kMemTag_Sim, blockCount );
+    los->cache = ( std::atomic< uint64_t > * )Mem_Alloc( kMemTag_Sim, kLos_CacheSize * sizeof( std::atomic< uint64_t > ) );
+    if ( los->cells == nullptr || los->columns == nullptr || los->coarse == nullptr || los->blockCount == nullptr || los->cache == nullptr ) {
+        // the cache entries aren't constructed yet
+        Mem_Free( los->cache );
+        los->cache = nullptr;
+        Los_Destroy( los );
+        return nullptr;
+    }
+
+    memset( los->cells, 0, cellBytes );
+    memset( los->columns, 0, columnBytes );
+    memset( los->coarse, 0, coarseBytes );
+    memset( los->blockCount, 0, blockCount );
+    for ( size_t i = 0; i < kLos_CacheSize; i++ ) {
+        new ( &los->cache[ i ] ) std::atomic< uint64_t >( 0 );
+    }
+
+    return los;
+}
+
+void Los_Destroy( los_s * const los ) {
+    if ( los == nullptr ) {
+        return;
+    }
+
+    Mem_Free( los->sorted );
+    if ( los->cache != nullptr ) {
+        for ( size_t i = 0; i < kLos_CacheSize; i++ ) {
+            los->cache[ i ].~atomic();
+        }
+        Mem_Free( los->cache );
+    }
+    Mem_Free( los->blockCount );
+    Mem_Free( los->coarse );
+    Mem_Free( los->columns );
+    Mem_Free( los->cells );
+
+    los->~los_s();
+    Mem_Free( los );
+}
+
+static int IsOnGrid( const los_s * const los, const vec2_s< int32_t > cell ) {
+    return ( uint32_t )cell.x < ( uint32_t )los->size.x && ( uint32_t )cell.y < ( uint32_t )los->size.y;
+}
+
+static int TestCell( const los_s * const los, const int32_t x, const int32_t y ) {
+    const uint64_t word = los->cells[ ( size_t )y * los->rowWords + ( ( size_t )x >> 6 ) ];
+    return ( int )( ( word >> ( ( uint32_t )x & 63 ) ) & 1 );
+}
+
+void Los_SetBlocked( los_s * const los, const vec2_s< int32_t > cell, const int blocked ) {
+    if ( !IsOnGrid( los, cell ) || TestCell( los, cell.x, cell.y ) == ( blocked != 0 ) ) {
+        return;
+    }
+
+    const uint64_t bit = ( uint64_t )1 << ( ( uint32_t )cell.x & 63 );
+    los->cells[ ( size_t )cell.y * los->rowWords + ( ( size_t )cell.x >> 6 ) ] ^= bit;
+    los->columns[ ( size_t )cell.x * los->columnWords + ( ( size_t )cell.y >> 6 ) ] ^= ( uint64_t )1 << ( ( uint32_t )cell.y & 63 );
+
+    const int32_t bx = cell.x >> kLos_BlockShift;
+    const int32_t by = cell.y >> kLos_BlockShift;
+    uint8_t * const count = &los->blockCount[ ( size_t )by * ( size_t )los->blocks.x + ( size_t )bx ];
+    *count = ( uint8_t )( blocked ? *count + 1 : *count - 1 );
+    uint64_t * const coarse = &los->coarse[ ( size_t )by * los->blockRowWords + ( ( size_t )bx >> 6 ) ];
+    const uint64_t blockBit = ( uint64_t )1 << ( ( uint32_t )bx & 63 );
+    *coarse = *count != 0 ? *coarse | blockBit : *coarse & ~blockBit;
+
+    // on wrapping, entries from the first pass through the versions would match again
+    if ( ++los->version == kLos_VersionLimit ) {
+        for ( size_t i = 0; i < kLos_CacheSize; i++ ) {
+            los->cache[ i ].store( 0, std::memory_order_relaxed );
+        }
+        los->version = 1;
+    }
+}
+
+int Los_IsBlocked( const los_s * const los, const vec2_s< int32_t > cell ) {
+    return IsOnGrid( los, cell ) ? TestCell( los, cell.x, cell.y ) : 1;
+}
+
+// nonzero if any of bits [ x0, x1 ] of a line of packed bits is set
+static int AnyBits( const uint64_t * const line, const int32_t x0, const int32_t x1 ) {
+    const size_t w0 = ( size_t )x0 >> 6;
+    const size_t w1 = ( size_t )x1 >> 6;
+    const uint64_t first = ~( uint64_t )0 << ( ( uint32_t )x0 & 63 );
+    const uint64_t last = ~( uint64_t )0 >> ( 63 - ( ( uint32_t )x1 & 63 ) );
+    if ( w0 == w1 ) {
+        return ( line[ w0 ] & first & last ) != 0;
+    }
+    uint64_t any = ( line[ w0 ] & first ) | ( line[ w1 ] & last );
+    for ( size_t w = w0 + 1; w < w1; w++ ) {
+        any |= line[ w ];
+    }
+    return any != 0;
+}
+
+static int IsBoxClear( const los_s * const los, const vec2_s< int32_t > a, const vec2_s< int32_t > b ) {
+    const int32_t x0 = ( a.x < b.x ? a.x : b.x ) >> kLos_BlockShift;
+    const int32_t x1 = ( a.x < b.x ? b.x : a.x ) >> kLos_BlockShift;
+    const int32_t y0 = ( a.y < b.y ? a.y : b.y ) >> kLos_BlockShift;
+    const int32_t y1 = ( a.y < b.y ? b.y : a.y ) >> kLos_BlockShift;
+    for ( int32_t y = y0; y <= y1; y++ ) {
+        if ( AnyBits( &los->coarse[ ( size_t )y * los->blockRowWords ], x0, x1 ) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// walks the cells from's centre to to's centre crosses, in order, stepping x when the line reaches the next column
+// boundary first and y when it reaches the next row boundary first. the boundary crossing parameters are compared
+// as ( 2 * ix + 1 ) * dy against ( 2 * iy + 1 ) * dx, kept as their running difference. returns nonzero with the
+// first blocking cell strictly between the ends in hit.
+static int Walk( const los_s * const los, const vec2_s< int32_t > from, const vec2_s< int32_t > to, vec2_s< int32_t > * const hit ) {
+    const int32_t dx = to.x > from.x ? to.x - from.x : from.x - to.x;
+    const int32_t dy = to.y > from.y ? to.y - from.y : from.y - to.y;
+    const int32_t sx = to.x > from.x ? 1 : -1;
+    const int32_t sy = to.y > from.y ? 1 : -1;
+
+    int32_t x = from.x;
+    int32_t y = from.y;
+    int32_t decision = dy - dx;
+    for ( int32_t remaining = dx + dy; remaining > 0; ) {
+        if ( decision == 0 ) {
+            // through a corner; either cell beside it blocks
+            if ( Los_IsBlocked( los, { x + sx, y } ) ) {
+                *hit = { x + sx, y };
+                return 1;
+            }
+            if ( Los_IsBlocked( los, { x, y + sy } ) ) {
+                *hit = { x, y + sy };
+                return 1;
+            }
+            x += sx;
+            y += sy;
+            decision += 2 * ( dy - dx );
+            remaining -= 2;
+        } else if ( decision < 0 ) {
+            x += sx;
+            decision += 2 * dy;
+            remaining--;
+        } else {
+            y += sy;
+            decision -= 2 * dx;
+            remaining--;
+        }
+
+        if ( remaining != 0 && Los_IsBlocked( los, { x, y } ) ) {
+            *hit = { x, y };
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// the same cells as Walk, a line of the bitmap at a time. the line is taken along its major axis, so it crosses
+// each row (or column) of cells once, in one run. a run ends where the decision turns non-negative, at the
+// first ia with ( 2 * ia + 1 ) * db >= ( 2 * ib + 1 ) * da, which is ceil( n / 2db ) for n = ( 2 * ib + 1 ) * da - db,
+// kept as a running quotient and remainder. on equality the line leaves through a corner and the cell past the
+// run's end, beside the corner, is added to it. the next run starts where this one ended.
+// lines [ b ] hold the cells along the major axis, a = a0 + sa * ia and b = b0 + sb * ib, with da >= db.
+static int AnyBlockingRun( const uint64_t * const lines, const size_t lineWords, const int32_t a0, const int32_t b0, const int32_t da,
+                           const int32_t db, const int32_t sa, const int32_t sb ) {
+    const int32_t divisor = db > 0 ? 2 * db : 1;
+    int32_t quotient = ( da - db ) / divisor;
+    int32_t remainder = ( da - db ) % divisor;
+    const int32_t stepQuotient = ( 2 * da ) / divisor;
+    const int32_t stepRemainder = ( 2 * da ) % divisor;
+
+    int32_t start = 1; // from itself never blocks
+    for ( int32_t ib = 0; ib <= db; ib++ ) {
+        int32_t end = da - 1; // and neither does to
+        int32_t last = end;
+        if ( ib < db ) {
+            end = remainder != 0 ? quotient + 1 : quotient;
+            last = remainder == 0 ? end + 1 : end;
+            quotient += stepQuotient;
+            remainder += stepRemainder;
+            if ( remainder >= divisor ) {
+                remainder -= divisor;
+                quotient++;
+            }
+        }
+
+        if ( start <= last ) {
+            const int32_t x0 = sa > 0 ? a0 + start : a0 - last;
+            const int32_t x1 = sa > 0 ? a0 + last : a0 - start;
+            if ( AnyBits( &lines[ ( size_t )( b0 + sb * ib ) * lineWords ], x0, x1 ) ) {
+                return 1;
+            }
+        }
+        start = end;
+    }
+    return 0;
+}
+
+int Los_CanSee( const los_s * const los, const vec2_s< int32_t > from, const vec2_s< int32_t > to ) {
+    if ( !IsOnGrid( los, from ) || !IsOnGrid( los, to ) ) {
+        return 0;
+    }
+    if ( IsBoxClear( los, from, to ) ) {
+        return 1;
+    }
+
+    const uint64_t a = ( uint64_t )from.y * ( uint64_t )los->size.x + ( uint64_t )from.x;
+    const uint64_t b = ( uint64_t )to.y * ( uint64_t )los->size.x + ( uint64_t )to.x;
+    const uint64_t pair = a < b ? ( a << ( kLos_CellBits + 1 ) ) | ( b << 1 ) : ( b << ( kLos_CellBits + 1 ) ) | ( a << 1 );
+    const uint64_t tag = ( los->version << kLos_VersionShift ) | pair;
+    std::atomic< uint64_t > * const entry = &los->cache[ ( size_t )( ( pair * 0x9e3779b97f4a7c15ull ) >> ( 64 - kLos_CacheBits ) ) ];
+
+    const uint64_t cached = entry->load( std::memory_order_relaxed );
+    if ( ( cached & ~( uint64_t )1 ) == tag ) {
+        return ( int )( cached & 1 );
+    }
+
+    const vec2_s< int32_t > p = a < b ? from : to;
+    const vec2_s< int32_t > q = a < b ? to : from;
+    const int32_t dx = q.x > p.x ? q.x - p.x : p.x - q.x;
+    const int32_t dy = q.y - p.y;
+    const int32_t sx = q.x > p.x ? 1 : -1;
+    const int visible = dx >= dy ? !AnyBlockingRun( los->cells, los->rowWords, p.x, p.y, dx, dy, sx, 1 ) :
+                                   !AnyBlockingRun( los->columns, los->columnWords, p.y, p.x, dy, dx, 1, sx );
+    entry->store( tag | ( uint64_t )visible, std::memory_order_relaxed );
+    return visible;
+}
+
+int Los_Raycast( const los_s * const los, const vec2_s< int32_t > from, const vec2_s< int32_t > to, vec2_s< int32_t > * const hit ) {
+    if ( IsOnGrid( los, from ) && IsOnGrid( los, to ) && IsBoxClear( los, from, to ) ) {
+        return 0;
+    }
+    return Walk( los, from, to, hit );
+}
+
+void Los_QueryBatchRange( const los_s * const los, const losBatch_s * const batch, const size_t first, const size_t last ) {
+    for ( size_t i = first; i < last; i++ ) {
+        batch->visible[ i ] = ( uint8_t )Los_CanSee( los, batch->queries[ i ].from, batch->queries[ i ].to );
+    }
+}
+
+typedef struct losBatchTask_s {
+    const los_s * los = nullptr;
+    const losSortItem_s * sorted = nullptr;
+    uint8_t * visible = nullptr;
+} losBatchTask_s;
+
+static void BatchRange( void * const param, const size_t first, const size_t last ) {
+    const losBatchTask_s * const task = ( const losBatchTask_s * )param;
+    for ( size_t i = first; i < last; i++ ) {
+        const losSortItem_s * const item = &task->sorted[ i ];
+        task->visible[ item->index ] = ( uint8_t )Los_CanSee( task->los, item->query.from, item->query.to );
+    }
+}
+
+static int ReserveSorted( los_s * const los, const size_t count ) {
+    if ( count <= los->sortedCapacity ) {
+        return 1;
+    }
+
+    size_t capacity = los->sortedCapacity > 0 ? los->sortedCapacity : kLos_MinBatchChunk;
+    while ( capacity < count ) {
+        capacity *= 2;
+    }
+    Mem_Free( los->sorted );
+    los->sorted = ( losSortItem_s * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( losSortItem_s ) );
+    los->sortedCapacity = los->sorted != nullptr ? capacity : 0;
+    return los->sorted != nullptr;
+}
+
+static uint32_t SpreadBits( uint32_t v ) {
+    v = ( v | ( v << 8 ) ) & 0x00ff00ffu;
+    v = ( v | ( v << 4 ) ) & 0x0f0f0f0fu;
+    v = ( v | ( v << 2 ) ) & 0x33333333u;
+    v = ( v | ( v << 1 ) ) & 0x55555555u;
+    return v;
+}
+
+// the morton code of the coarse block the query's walk starts in, cut down to kLos_SortBits
+static uint32_t SortKey( const los_s * const los, const losQuery_s * const query ) {
+    const int toFirst = query->to.y < query->from.y || ( query->to.y == query->from.y && query->to.x < query->from.x );
+    const vec2_s< int32_t > start = toFirst ? query->to : query->from;
+    if ( !IsOnGrid( los, start ) ) {
+        return 0;
+    }
+    const uint32_t morton = SpreadBits( ( uint32_t )start.x >> kLos_BlockShift ) | ( SpreadBits( ( uint32_t )start.y >> kLos_BlockShift ) << 1 );
+    return morton >> los->sortShift;
+}
+
+// one counting sort pass, so nearby queries end up together without the queries being moved more than once
+static const losSortItem_s * SortByBlock( los_s * const los, const losBatch_s * const batch ) {
+    PROFILE_ZONE( "Los_Sort" );
+
+    uint32_t count[ kLos_SortBuckets ] = {};
+    for ( size_t i = 0; i < batch->count; i++ ) {
+        count[ SortKey( los, &batch->queries[ i ] ) ]++;
+    }
+    uint32_t offset = 0;
+    for ( uint32_t k = 0; k < kLos_SortBuckets; k++ ) {
+        const uint32_t n = count[ k ];
+        count[ k ] = offset;
+        offset += n;
+    }
+    for ( size_t i = 0; i < batch->count; i++ ) {
+        losSortItem_s * const item = &los->sorted[ count[ SortKey( los, &batch->queries[ i ] ) ]++ ];
+        item->query = batch->queries[ i ];
+        item->index = ( uint32_t )i;
+    }
+    return los->sorted;
+}
+
+void Los_QueryBatch( los_s * const los, const losBatch_s * const batch ) {
+    PROFILE_ZONE( "Los_QueryBatch" );
+
+    // without room for the copy the queries are still answered, only unsorted
+    if ( batch->count > UINT32_MAX || !ReserveSorted( los, batch->count ) ) {
+        Los_QueryBatchRange( los, batch, 0, batch->count );
+        return;
+    }
+
+    losBatchTask_s task;
+    task.los = los;
+    task.sorted = SortByBlock( los, batch );
+    task.visible = batch->visible;
+    Job_ParallelFor( batch->count, kLos_MinBatchChunk, BatchRange, &task );
+}
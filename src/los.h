@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_LOS_H___
+#define ___RTSFS_LOS_H___
+
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// line of sight and raycasts over the map grid: can something in one cell see something in another.
+//
+// the grid is kept as an occupancy bitmap, one bit per cell set where the cell blocks sight, 64 cells to a word,
+// once by rows and once by columns. a line from cell centre to cell centre crosses each row (or column, whichever
+// it is longer along) in one run of cells, found with integer dda arithmetic, and a run is tested a word at a time
+// against the bitmap laid out along it. a coarse bitmap with one bit per kLos_BlockSize square of cells, set if any
+// cell in it blocks, answers queries whose bounding box is open ground before any walking.
+//
+// a line that passes exactly through a corner between cells is blocked by either of the two cells beside the corner,
+// so sight doesn't leak through diagonal gaps in walls. the end cells themselves never block.
+//
+// answers are cached per ( source cell, target cell ) pair in a direct mapped table, each entry stamped with the
+// terrain version it was computed for, so they stay good across ticks until a cell changes and then all go stale at
+// once. a lookup and a fill are one relaxed 64 bit load or store, so any number of job threads share the cache
+// without locks. a query is walked from its lower cell index to the higher one, so sight is symmetric and both
+// directions share an entry. the cache only saves work; every answer is the same with or without it.
+
+typedef struct los_s los_s;
+
+static constexpr int32_t kLos_BlockShift = 3;
+static constexpr int32_t kLos_BlockSize = 1 << kLos_BlockShift; // cells per coarse bit, each way
+static constexpr size_t kLos_CacheBits = 18;                    // 2^18 cached pairs, 2 MB
+static constexpr size_t kLos_MaxCells = ( size_t )1 << 23;     // what a cache entry has room for
+static constexpr size_t kLos_MinBatchChunk = 256;               // queries per job in Los_QueryBatch
+
+typedef struct losQuery_s {
+    vec2_s< int32_t > from;
+    vec2_s< int32_t > to;
+} losQuery_s;
+
+// answers queries[ 0 .. count ) into visible, one byte each, nonzero if the target cell can be seen
+typedef struct losBatch_s {
+    const losQuery_s * queries = nullptr;
+    size_t count = 0;
+    uint8_t * visible = nullptr;
+} losBatch_s;
+
+// returns nullptr on failure, or if the grid has more than kLos_MaxCells cells. every cell starts clear.
+los_s * Los_Create( const vec2_s< size_t > size );
+
+void Los_Destroy( los_s * const los );
+
+// marks a cell as blocking sight or not. a change makes every cached answer stale; setting a cell to what it
+// already is doesn't. not safe while queries are running.
+void Los_SetBlocked( los_s * const los, const vec2_s< int32_t > cell, const int blocked );
+
+// cells off the grid block
+int Los_IsBlocked( const los_s * const los, const vec2_s< int32_t > cell );
+
+// nonzero if no cell strictly between from and to blocks. zero if either end is off the grid. thread safe.
+int Los_CanSee( const los_s * const los, const vec2_s< int32_t > from, const vec2_s< int32_t > to );
+
+// walks from towards to and returns nonzero with the first blocking cell in hit, or zero if the ray reaches to.
+// from and to themselves are never hit, and cells off the grid block like walls. uncached, and directional unlike
+// Los_CanSee. thread safe.
+int Los_Raycast( const los_s * const los, const vec2_s< int32_t > from, const vec2_s< int32_t > to, vec2_s< int32_t > * const hit );
+
+// answers queries [ first, last ) of batch on the calling thread, in the order given
+void Los_QueryBatchRange( const los_s * const los, const losBatch_s * const batch, const size_t first, const size_t last );
+
+// answers the whole batch across the job threads, the calling one included. the queries are first bucketed by
+// the morton order of the block their walk starts in, so each job gets queries from one area and walks the same
+// bitmap words. the bucketed copy is owned by los, so only one batch at a time.
+void Los_QueryBatch( los_s * const los, const losBatch_s * const batch );
+
+#endif // ___RTSFS_LOS_H___
@@ -20,147 +20,310 @@
  * SOFTWARE.
  */
 
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
 
+#include "archive.h"
+#include "arena.h"
+#include "assetloader.h"
+#include "blit.h"
+#include "capture.h"
 #include "config.h"
+#include "job.h"
+#include "mem.h"
+#include "pacing.h"
+#include "platform.h"
+#include "profile.h"
+#include "random.h"
+#include "render.h"
+#include "replay.h"
 #include "rgba.h"
+#include "sim.h"
+#include "snapshot.h"
+#include "thread.h"
+#include "timer.h"
+#include "triplebuffer.h"
 #include "window.h"
 
-typedef struct appData_s {
-    BITMAPINFO ** buffers = nullptr;
-    uint32_t bufferForeground = 0;
-    uint32_t bufferCount = 0;
-    HDC dc = nullptr;
-    HBITMAP bmp = nullptr;
-    size_t width = 0;
-    size_t height = 0;
-    size_t framerate = 0;
-    size_t frametime = 0;
-    uint64_t nextframe = 0;
-} appData_s;
-
-static LRESULT CALLBACK myWindowProc( HWND wnd, UINT msg, WPARAM wp, LPARAM lp ) {
-    switch ( msg ) {
-        case WM_CREATE: {
-            CREATESTRUCT * const cs = ( CREATESTRUCT * )lp;
-            appData_s * const me = ( appData_s * )cs->lpCreateParams;
-            SetWindowLongPtr( wnd, GWLP_USERDATA, ( LONG_PTR )me );
-        } break;
+static simDesc_s simDesc;
+static sim_s * sim = nullptr;
+static replayWriter_s * recorder = nullptr;
+static snapshotWriter_s * snapshots = nullptr;
+static const char * savePath = nullptr;
+static capture_s * capture = nullptr;
+static int32_t saveEvery = 0; // ticks between autosaves to savePath, 0 for only at exit
+
+// assets streamed from an archive in the background instead of loaded before the first frame. nothing draws them
+// yet, so every asset is wanted at background priority; what a view draws it requests at kAssetPriority_Visible,
+// and startup waits for those alone.
+static archive_s * assetArchive = nullptr;
+static assetLoader_s * assets = nullptr;
+static size_t assetCount = 0;
+static constexpr uint64_t kMain_AssetPollNs = 1000000; // while startup waits for the visible assets
+
+static int openAssets( const char * const path ) {
+    assetArchive = Archive_Open( path );
+    assetLoaderDesc_s desc;
+    desc.capacity = assetArchive != nullptr ? Archive_GetCount( assetArchive ) : 0;
+    assets = desc.capacity > 0 ? AssetLoader_Create( assetArchive, &desc ) : nullptr;
+    if ( assets == nullptr ) {
+        Archive_Close( assetArchive );
+        assetArchive = nullptr;
+        return 0;
+    }
 
-        case WM_PAINT: {
-            PAINTSTRUCT ps;
-            HDC const dc = BeginPaint( wnd, &ps );;
-
-            RECT r;
-            GetClientRect( wnd, &r );
-
-            appData_s * const me = ( appData_s * )GetWindowLongPtr( wnd, GWLP_USERDATA );
-
-            assert( r.right > r.left );
-            assert( r.bottom > r.top );
-
-            const size_t newWidth = ( size_t )( r.right ) - ( size_t )( r.left );
-            const size_t newHeight = ( size_t )( r.bottom ) - ( size_t )( r.top );
-            if ( me->width != newWidth || me->height != newHeight ) {
-                me->width = newWidth;
-                me->height = newHeight;
-
-                ReleaseDC( nullptr, me->dc );
-                DeleteObject( me->bmp );
-
-                if ( me->buffers != nullptr ) {
-                    for ( size_t i = 0; i < me->bufferCount; i++ ) {
-                        if ( me->buffers[ i ] != nullptr ) {
-                            free( me->buffers[ i ] );
-                        }
-                    }
-                    free( me->buffers );
-                }
-
-                me->dc = CreateCompatibleDC( GetDC( nullptr ) );
-                me->bmp = CreateCompatibleBitmap( GetDC( nullptr ), ( int )me->width, ( int )me->height );
-
-                SelectObject( me->dc, me->bmp );
-
-                me->buffers = ( BITMAPINFO ** )malloc( sizeof( BITMAPINFO * ) * me->bufferCount );
-                if ( me->buffers != nullptr ) {
-                    for ( size_t i = 0; i < me->bufferCount; i++ ) {
-                        const size_t size = sizeof( BITMAPINFO ) + sizeof( COLORREF ) * me->width * me->height;
-                        BITMAPINFO * const bmi = ( BITMAPINFO * )malloc( size );
-                        me->buffers[ i ] = bmi;
-                        if ( bmi == nullptr ) {
-                            continue;
-                        }
-                        memset( bmi, 0, size );
-                        bmi->bmiHeader.biSize = sizeof( BITMAPINFO );
-                        bmi->bmiHeader.biWidth = ( LONG )me->width;
-                        bmi->bmiHeader.biHeight = -( LONG )me->height; // vertically flip
-                        bmi->bmiHeader.biPlanes = 1;
-                        bmi->bmiHeader.biBitCount = 32;
-                        bmi->bmiHeader.biCompression = BI_RGB;
-                        bmi->bmiHeader.biSizeImage = 0;
-                        bmi->bmiHeader.biXPelsPerMeter = 0;
-                        bmi->bmiHeader.biYPelsPerMeter = 0;
-                        bmi->bmiHeader.biClrUsed = 0;
-                        bmi->bmiHeader.biClrImportant = 0;
-                    }
-                }
-            }
+    for ( size_t i = 0; i < desc.capacity; i++ ) {
+        archiveAsset_s asset;
+        if ( Archive_GetAsset( assetArchive, i, &asset ) && AssetLoader_Add( assets, asset.name, nullptr, nullptr, nullptr ) != kAssetLoader_Invalid ) {
+            assetCount++;
+        }
+    }
+    return 1;
+}
 
-            me->bufferForeground++;
-            if ( me->bufferForeground >= me->bufferCount ) {
-                me->bufferForeground = 0;
-            }
+// the loader's threads record profile zones, so this comes before shutdownRuntime
+static void closeAssets( void ) {
+    AssetLoader_Destroy( assets );
+    assets = nullptr;
+    assetCount = 0;
+    Archive_Close( assetArchive );
+    assetArchive = nullptr;
+}
 
-            BITMAPINFO * const bmi = me->buffers[ me->bufferForeground ];
-            if ( bmi != nullptr ) {
-                SetDIBits( me->dc, me->bmp, 0, ( UINT )me->height, bmi + 1, bmi, DIB_RGB_COLORS );
-                BitBlt( dc,
-                        ps.rcPaint.left,
-                        ps.rcPaint.top,
-                        ps.rcPaint.right - ps.rcPaint.left,
-                        ps.rcPaint.bottom - ps.rcPaint.top,
-                        me->dc,
-                        ps.rcPaint.left,
-                        ps.rcPaint.top,
-                        SRCCOPY );
-            }
+// wants every asset, then publishes what finished and starts what is ready. once a frame.
+static void streamAssets( void ) {
+    if ( assets == nullptr ) {
+        return;
+    }
+    for ( size_t i = 0; i < assetCount; i++ ) {
+        AssetLoader_Request( assets, ( uint32_t )i, kAssetPriority_Background );
+    }
+    AssetLoader_Update( assets );
+}
 
-            EndPaint( wnd, &ps );
-        } break;
-        case WM_CLOSE:
-            PostQuitMessage( 0 );
+// scripted orders standing in for player input until there is some, so recordings have commands to replay: every
+// botOrders ticks a run of units from a random start is sent to a random point
+static constexpr size_t kMain_BotOrderUnits = 512;
+static int32_t botOrders = 0;
+static random_s botRandom;
+
+static void issueBotOrders( void ) {
+    if ( botOrders <= 0 || Sim_GetTickCount( sim ) % ( uint64_t )botOrders != 0 ) {
+        return;
+    }
+
+    ecsView_s view;
+    if ( !Ecs_Query( Sim_GetEcs( sim ), kEcsComponent_Position | kEcsComponent_Velocity, &view ) || view.count == 0 ) {
+        return;
+    }
+
+    const size_t first = Random_Below( &botRandom, ( uint32_t )view.count );
+    simCommand_s command;
+    command.type = kSimCommand_Move;
+    command.units = view.entity + first;
+    command.unitCount = view.count - first < kMain_BotOrderUnits ? view.count - first : kMain_BotOrderUnits;
+    command.target.x = Random_Fixed( &botRandom, fixed_s{}, Fixed_FromInt( simDesc.size.x ) );
+    command.target.y = Random_Fixed( &botRandom, fixed_s{}, Fixed_FromInt( simDesc.size.y ) );
+    Sim_Submit( sim, &command );
+}
+
+static int update( void ) {
+    PROFILE_ZONE( "update" );
+    issueBotOrders();
+    Sim_Tick( sim );
+    if ( recorder != nullptr ) {
+        size_t count;
+        const simCommand_s * const commands = Sim_GetTickCommands( sim, &count );
+        ReplayWriter_WriteTick( recorder, Sim_GetTickCount( sim ), commands, count, Sim_GetTickHash( sim ) );
+    }
+    if ( snapshots != nullptr && saveEvery > 0 && Sim_GetTickCount( sim ) % ( uint64_t )saveEvery == 0 ) {
+        SnapshotWriter_Save( snapshots, sim, &simDesc, savePath );
+    }
+    return 0;
+}
+
+// alpha is how far the clock has moved past the last simulation tick, in [0,1) of a tick, for interpolating
+static void render( const float alpha ) {
+    PROFILE_ZONE( "render" );
+    ( void )alpha;
+}
+
+// a stall (debugger, window drag) longer than this is dropped rather than simulated
+static constexpr uint64_t kMain_MaxFrameDeltaNs = 250000000;
+
+// upper bound on simulation ticks per frame, so a slow update cannot fall further behind each frame
+static constexpr size_t kMain_MaxTicksPerFrame = 8;
+
+// live bytes per memory tag before a warning, indexed by memTag_e; 0 for none
+static const size_t kMain_MemBudget[ kMemTag_Count ] = {
+    0,                   // other
+    16 * 1024 * 1024,    // digraph
+    1 * 1024 * 1024,     // window
+    512 * 1024 * 1024,   // surface
+    256 * 1024 * 1024,   // sim
+    512 * 1024 * 1024,   // assets
+    512 * 1024 * 1024,   // replay
+    64 * 1024 * 1024,    // frame
+    0,                   // profile
+};
+
+// what the simulation hands the renderer for one frame
+typedef struct renderFrame_s {
+    uint64_t inputNs = 0; // Timer_Nanoseconds when the events this frame reflects were pumped
+    float alpha = 0.0f;
+    renderBuffer_s * commands = nullptr;
+    rect_s< size_t > drawn; // bounds of what the commands draw; empty (min past max) if nothing
+} renderFrame_s;
+
+// composition on its own thread. the simulation records each frame's drawing into the command buffer of a triple
+// buffer slot, publishes it and raises wake; the render thread always executes the newest one, skipping any it fell
+// behind on, while the next frame is recorded into another slot. the window hierarchy stays on the main thread.
+typedef struct renderThread_s {
+    platform_s * platform = nullptr;
+    tripleBuffer_s handoff;
+    renderFrame_s frames[ 3 ];
+    signal_s * wake = nullptr;
+    std::atomic< int > quit{ 0 };
+    std::atomic< uint64_t > rendered{ 0 };
+} renderThread_s;
+
+// main thread: records the frame's drawing into its command buffer
+static void recordFrame( renderFrame_s * const frame, const vec2_s< size_t > size ) {
+    PROFILE_ZONE( "recordFrame" );
+
+    RenderBuffer_Reset( frame->commands );
+
+    render( frame->alpha );
+
+    // nothing outside the windows is ever drawn, so only their bounds can change between frames
+    if ( !Window_Render( frame->commands, rectFrom( vec2_zero< size_t >(), size ), &frame->drawn ) ) {
+        frame->drawn = { { 1, 1 }, { 0, 0 } };
+    }
+}
+
+static void renderFrame( platform_s * const platform, const renderFrame_s * const frame ) {
+    const platformSurface_s surface = Platform_GetBackBuffer( platform );
+    if ( surface.pixels != nullptr ) {
+        RenderBuffer_Execute( frame->commands, surface.pixels, surface.stride, rectFrom( vec2_zero< size_t >(), surface.size ) );
+
+        // the whole surface is the frame; the drawn bounds are all that can differ from the last one
+        if ( capture != nullptr ) {
+            Capture_Frame( capture, surface.pixels, surface.stride, &frame->drawn );
+        }
+
+        PROFILE_ZONE( "Platform_Present" );
+        Platform_Present( platform, &frame->drawn, frame->inputNs );
+    }
+}
+
+static void renderThreadMain( void * const param ) {
+    renderThread_s * const me = ( renderThread_s * )param;
+
+    for ( ;; ) {
+        Signal_Wait( me->wake );
+        if ( me->quit.load( std::memory_order_acquire ) ) {
             break;
+        }
+        if ( TripleBuffer_Acquire( &me->handoff ) ) {
+            FrameArena_BeginFrame();
+            renderFrame( me->platform, me->frames + TripleBuffer_GetReadSlot( &me->handoff ) );
+            me->rendered.fetch_add( 1, std::memory_order_relaxed );
+        }
     }
+}
 
-    return DefWindowProc( wnd, msg, wp, lp );
+static void printProfile( void ) {
+    profileZoneStats_s stats[ 64 ];
+    const size_t count = Profile_GetSummary( stats, sizeof( stats ) / sizeof( stats[ 0 ] ) );
+    printf( "%-26s %8s %10s %10s %10s %10s\n", "zone per frame", "frames", "min us", "p50 us", "p99 us", "max us" );
+    for ( size_t i = 0; i < count && i < sizeof( stats ) / sizeof( stats[ 0 ] ); i++ ) {
+        printf( "%-26s %8llu %10.2f %10.2f %10.2f %10.2f\n", stats[ i ].name, ( unsigned long long )stats[ i ].frames,
+            ( double )stats[ i ].minNs / 1000.0, ( double )stats[ i ].p50Ns / 1000.0,
+            ( double )stats[ i ].p99Ns / 1000.0, ( double )stats[ i ].maxNs / 1000.0 );
+    }
 }
 
-static ATOM registerWindowClass( const char * const classname ) {
-    WNDCLASSEXA wndClass;
-    memset( &wndClass, 0, sizeof( wndClass ) );
-    wndClass.cbSize = sizeof( wndClass );
-    wndClass.style = CS_HREDRAW | CS_VREDRAW;
-    wndClass.lpfnWndProc = myWindowProc;
-    wndClass.hInstance = GetModuleHandle( nullptr );
-    wndClass.lpszClassName = classname;
-    return RegisterClassExA( &wndClass );
+static void printMemory( const uint64_t frames ) {
+    printf( "%-8s %10s %10s %8s %12s %10s\n", "memory", "live KB", "peak KB", "live", "allocs/frame", "budget KB" );
+    for ( size_t i = 0; i < kMemTag_Count; i++ ) {
+        memTagStats_s stats;
+        Mem_GetStats( ( memTag_e )i, &stats );
+        printf( "%-8s %10zu %10zu %8zu %12.2f %10zu\n", stats.name, stats.liveBytes / 1024, stats.peakBytes / 1024,
+            stats.liveCount, frames ? ( double )stats.allocs / ( double )frames : 0.0, stats.budget / 1024 );
+    }
 }
 
-static void unregisterWindowClass( const char * const classname ) {
-    UnregisterClassA( classname, GetModuleHandle( nullptr ) );
+static void printPacing( const char * const label, const pacing_s * const pacing ) {
+    pacingStats_s stats;
+    Pacing_GetStats( pacing, &stats );
+    printf( "%s us: min %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f\n", label, ( double )stats.minNs / 1000.0,
+        ( double )stats.p50Ns / 1000.0, ( double )stats.p90Ns / 1000.0, ( double )stats.p99Ns / 1000.0,
+        ( double )stats.maxNs / 1000.0 );
 }
 
-static int update( void ) {
-    return 0;
+// headless playback as fast as the sim goes, for regression benchmarks: no window, no rendering, no pacing. with a
+// seek target it then times seeking back to it through the snapshots taken on the way.
+static int runReplay( const char * const path, const int32_t seekTick ) {
+    replay_s * const replay = Replay_Open( path );
+    if ( replay == nullptr ) {
+        fprintf( stderr, "can't read replay %s\n", path );
+        return -1;
+    }
+
+    sim_s * const replaySim = Sim_Create( Replay_GetDesc( replay ) );
+    if ( replaySim == nullptr ) {
+        Replay_Close( replay );
+        return -1;
+    }
+
+    uint64_t desyncTick = 0;
+    replayStep_e step;
+    const uint64_t start = Timer_Nanoseconds();
+    do {
+        Profile_FrameMark();
+        step = Replay_Step( replay, replaySim );
+        if ( step == kReplayStep_Desync && desyncTick == 0 ) {
+            desyncTick = Sim_GetTickCount( replaySim );
+        }
+    } while ( step == kReplayStep_Ok || step == kReplayStep_Desync );
+    const double seconds = ( double )( Timer_Nanoseconds() - start ) / 1e9;
+
+    const uint64_t ticks = Sim_GetTickCount( replaySim );
+    printf( "replay %s: %llu of %llu ticks in %.3f s, %.1f ticks/s, ", path, ( unsigned long long )ticks,
+        ( unsigned long long )Replay_GetEndTick( replay ), seconds, seconds > 0.0 ? ( double )ticks / seconds : 0.0 );
+    if ( step == kReplayStep_Error ) {
+        printf( "failed\n" );
+    } else if ( desyncTick != 0 ) {
+        printf( "desync at tick %llu\n", ( unsigned long long )desyncTick );
+    } else {
+        printf( "in sync\n" );
+    }
+
+    int seekFailed = 0;
+    if ( seekTick >= 0 && step == kReplayStep_End ) {
+        const uint64_t seekStart = Timer_Nanoseconds();
+        seekFailed = !Replay_Seek( replay, replaySim, ( uint64_t )seekTick );
+        printf( "seek to tick %d: %.3f ms%s\n", seekTick, ( double )( Timer_Nanoseconds() - seekStart ) / 1e6, seekFailed ? ", failed" : "" );
+    }
+
+    Sim_Destroy( replaySim );
+    Replay_Close( replay );
+
+    return step == kReplayStep_End && desyncTick == 0 && !seekFailed ? 0 : -1;
 }
 
-static void render( void ) {
+// stops the job workers, then frees every thread's frame arenas and profile ring. any other thread that records zones
+// or allocates from its frame arenas (render, capture, snapshot writer, replay writer, flow field builder, asset
+// loader) must already be joined, or it would touch freed memory.
+static void shutdownRuntime( void ) {
+    Job_Shutdown();
+    FrameArena_Shutdown();
+    Profile_Shutdown();
 }
 
 static uintptr_t windowCallback( window_s * const window, const windowMsg_e msg, const uintptr_t a, const uintptr_t b ) {
@@ -178,12 +341,11 @@ static uintptr_t windowCallback( window_s * const window, const windowMsg_e msg,
 
         case kWindow_OnRender: {
             windowRenderData_s * const renderData = ( windowRenderData_s * )a;
-            // todo: clip
-            rgba_s * pix = renderData->surface + renderData->position.y * renderData->stride +  renderData->position.x;
             const float step = ( float )renderData->size.y / 128.0f;
             for ( size_t y = 0; y < renderData->size.y; y++ ) {
-                memset( pix , 255 - ( 64 + ( uint8_t )( step * ( float )y ) ), ( size_t )(renderData->size.x * sizeof( rgba_s ) ) );
-                pix += renderData->stride;
+                const uint8_t shade = ( uint8_t )( 255 - ( 64 + ( uint8_t )( step * ( float )y ) ) );
+                const rect_s< size_t > row = rectFrom( renderData->position + vec2_s< size_t >{ 0, y }, { renderData->size.x, 1 } );
+                RenderList_Fill( renderData->list, row, { shade, shade, shade, shade } );
             }
         } break;
 
@@ -203,107 +365,465 @@ static uintptr_t windowCallback( window_s * const window, const windowMsg_e msg,
     return 0;
 }
 
-int __stdcall WinMain( HINSTANCE inst, HINSTANCE prev, char * cmdline, int show ) {
-    ( void )inst;
-    ( void )prev;
-    ( void )cmdline;
-    ( void )show;
-
+// command line options, one per row of the configRule table in App_Main and in the same order
+typedef enum mainConfig_e {
+    kMainConfig_Editor,
+    kMainConfig_Frames,
+    kMainConfig_Width,
+    kMainConfig_Height,
+    kMainConfig_Dump,
+    kMainConfig_DumpEvery,
+    kMainConfig_TickRate,
+    kMainConfig_FrameRate,
+    kMainConfig_Stats,
+    kMainConfig_RenderThread,
+    kMainConfig_Shm,
+    kMainConfig_Profile,
+    kMainConfig_Units,
+    kMainConfig_Jobs,
+    kMainConfig_JobBench,
+    kMainConfig_Record,
+    kMainConfig_Replay,
+    kMainConfig_Seek,
+    kMainConfig_BotOrders,
+    kMainConfig_Save,
+    kMainConfig_SaveEvery,
+    kMainConfig_Load,
+    kMainConfig_Pack,
+    kMainConfig_PackList,
+    kMainConfig_ArchiveBench,
+    kMainConfig_Capture,
+    kMainConfig_CaptureFormat,
+    kMainConfig_CaptureEvery,
+    kMainConfig_BlitBench,
+    kMainConfig_Assets,
+    kMainConfig_Count,
+} mainConfig_e;
+
+int App_Main( const size_t argc, const char * const * const argv ) {
     uint8_t runEditor = 0;
+    int32_t frameLimit = 0;
+    int32_t width = 1024;
+    int32_t height = 768;
+    int32_t dumpEvery = 1;
+    int32_t tickRate = 60;
+    int32_t frameRate = 60;
+    uint8_t renderThread = 1;
+    int32_t unitCount = 0;
+    int32_t jobWorkers = -1;
+    int32_t jobBench = 0;
+    int32_t blitBench = 0;
+    int32_t seekTick = -1;
+    int32_t captureEvery = 1;
 
     configRule_s configRule[] = {
-        // name     parseFunction        parseParam  arg
-        { "editor", Config_ParseBoolean, &runEditor, kConfigArg_Required },
+        // name         parseFunction        parseParam   arg
+        { "editor",     Config_ParseBoolean, &runEditor,  kConfigArg_Required },
+        { "frames",     Config_ParseInt32,   &frameLimit, kConfigArg_Required }, // quit after this many frames
+        { "width",      Config_ParseInt32,   &width,      kConfigArg_Required },
+        { "height",     Config_ParseInt32,   &height,     kConfigArg_Required },
+        { "dump",       nullptr,             nullptr,     kConfigArg_Required }, // headless: ppm frame path prefix
+        { "dumpevery",  Config_ParseInt32,   &dumpEvery,  kConfigArg_Required },
+        { "tickrate",   Config_ParseInt32,   &tickRate,   kConfigArg_Required }, // simulation ticks per second
+        { "framerate",  Config_ParseInt32,   &frameRate,  kConfigArg_Required }, // 0 = present as fast as possible
+        { "stats",      nullptr,             nullptr,     kConfigArg_None },     // print frame pacing at exit
+        { "renderthread", Config_ParseBoolean, &renderThread, kConfigArg_Required }, // 0 = render on the main thread
+        { "shm",        nullptr,             nullptr,     kConfigArg_Required }, // headless: framebuffer shm name
+        { "profile",    nullptr,             nullptr,     kConfigArg_Required }, // chrome trace json written at exit
+        { "units",      Config_ParseInt32,   &unitCount,  kConfigArg_Required }, // simulated units at startup
+        { "jobs",       Config_ParseInt32,   &jobWorkers, kConfigArg_Required }, // job workers; -1 = one per other core
+        { "jobbench",   Config_ParseInt32,   &jobBench,   kConfigArg_Required }, // print job scaling up to n threads and quit
+        { "record",     nullptr,             nullptr,     kConfigArg_Required }, // replay file written while running
+        { "replay",     nullptr,             nullptr,     kConfigArg_Required }, // headless: play a replay file and quit
+        { "seek",       Config_ParseInt32,   &seekTick,   kConfigArg_Required }, // replay: then seek back to this tick
+        { "botorders",  Config_ParseInt32,   &botOrders,  kConfigArg_Required }, // scripted move order every n ticks
+        { "save",       nullptr,             nullptr,     kConfigArg_Required }, // snapshot file written at exit
+        { "saveevery",  Config_ParseInt32,   &saveEvery,  kConfigArg_Required }, // and every n ticks
+        { "load",       nullptr,             nullptr,     kConfigArg_Required }, // snapshot file to start from
+        { "pack",       nullptr,             nullptr,     kConfigArg_Required }, // asset archive to build and quit
+        { "packlist",   nullptr,             nullptr,     kConfigArg_Required }, // pack: file listing the inputs
+        { "archivebench", nullptr,           nullptr,     kConfigArg_Required }, // print an archive's startup cost and quit
+        { "capture",    nullptr,             nullptr,     kConfigArg_Required }, // frame capture path prefix
+        { "captureformat", nullptr,          nullptr,     kConfigArg_Required }, // capture: qoi (default) or ppm
+        { "captureevery", Config_ParseInt32, &captureEvery, kConfigArg_Required }, // capture: one of every n frames
+        { "blitbench",  Config_ParseInt32,   &blitBench,  kConfigArg_Required }, // print scaled blit timings, best of n, and quit
+        { "assets",     nullptr,             nullptr,     kConfigArg_Required }, // asset archive streamed in while running
     };
     const size_t configRuleCount = sizeof( configRule ) / sizeof( configRule[ 0 ] );
+    static_assert( sizeof( configRule ) / sizeof( configRule[ 0 ] ) == kMainConfig_Count, "configRule and mainConfig_e differ" );
 
-    const configResult_s result = Config_Parse( ( size_t )__argc, __argv, configRuleCount, configRule );
+    const configResult_s result = Config_Parse( argc, argv, configRuleCount, configRule );
     ( void )result;
 
-    const char * const windowClassName = "rtsfs";
+    if ( width <= 0 || height <= 0 || dumpEvery <= 0 || tickRate <= 0 || frameRate < 0 || unitCount < 0 || jobWorkers < -1 || jobBench < 0 || blitBench < 0 || seekTick < -1 || botOrders < 0 || saveEvery < 0 || captureEvery <= 0 ) {
+        return -1;
+    }
+
+    for ( size_t i = 0; i < kMemTag_Count; i++ ) {
+        Mem_SetBudget( ( memTag_e )i, kMain_MemBudget[ i ] );
+    }
+
+    if ( jobBench > 0 ) {
+        return Job_Bench( ( size_t )jobBench > kJob_MaxThreads ? kJob_MaxThreads : ( size_t )jobBench ) ? 0 : -1;
+    }
+
+    if ( blitBench > 0 ) {
+        return Blit_Bench( ( size_t )blitBench ) ? 0 : -1;
+    }
+
+    if ( configRule[ kMainConfig_Pack ].value != nullptr ) {
+        return Archive_PackList( configRule[ kMainConfig_Pack ].value, configRule[ kMainConfig_PackList ].value ) ? 0 : -1;
+    }
+
+    if ( configRule[ kMainConfig_ArchiveBench ].value != nullptr ) {
+        return Archive_Bench( configRule[ kMainConfig_ArchiveBench ].value ) ? 0 : -1;
+    }
+
+    // without workers everything still runs, inline on this thread
+    Job_Init( jobWorkers < 0 ? SIZE_MAX : ( size_t )jobWorkers );
+
+    const char * const profilePath = configRule[ kMainConfig_Profile ].value;
+    if ( profilePath != nullptr ) {
+        Profile_SetEnabled( 1 );
+    }
+
+    const char * const replayPath = configRule[ kMainConfig_Replay ].value;
+    if ( replayPath != nullptr ) {
+        const int replayResult = runReplay( replayPath, seekTick );
+        if ( profilePath != nullptr ) {
+            Profile_WriteTrace( profilePath );
+            if ( configRule[ kMainConfig_Stats ].present ) {
+                printProfile();
+            }
+        }
+        shutdownRuntime();
+        Mem_ReportLeaks( stderr );
+        return replayResult;
+    }
 
-    ATOM wndAtom = registerWindowClass( windowClassName );
-    if ( wndAtom == 0 ) {
+    platformDesc_s desc;
+    desc.size = { ( size_t )width, ( size_t )height };
+    desc.dumpPath = configRule[ kMainConfig_Dump ].value;
+    desc.dumpEvery = ( size_t )dumpEvery;
+    desc.sharedName = configRule[ kMainConfig_Shm ].value;
+    // an uncapped frame rate never waits, so a virtual clock has to be stepped a tick a frame to run the sim
+    desc.pumpStepNs = frameRate == 0 ? 1000000000ull / ( uint64_t )tickRate : 0;
+
+    platform_s * const platform = Platform_Create( &desc );
+    if ( platform == nullptr ) {
+        Job_Shutdown();
         return -1;
     }
 
-    appData_s appData;
-    memset( &appData, 0, sizeof( appData ) );
+    pacing_s * const pacing = Pacing_Create();
+    pacing_s * const latency = Pacing_Create(); // from pumping a frame's input to showing it
+    if ( pacing == nullptr || latency == nullptr ) {
+        Pacing_Destroy( latency );
+        Pacing_Destroy( pacing );
+        Platform_Destroy( platform );
+        Job_Shutdown();
+        return -1;
+    }
+
+    // a loaded snapshot brings its own desc, so units and tickrate are ignored
+    const char * const loadPath = configRule[ kMainConfig_Load ].value;
+    snapshot_s * const snapshot = loadPath != nullptr ? Snapshot_Open( loadPath ) : nullptr;
+    if ( snapshot != nullptr ) {
+        simDesc = *Snapshot_GetDesc( snapshot );
+    } else {
+        simDesc.unitCount = ( size_t )unitCount;
+        simDesc.tickRate = ( uint32_t )tickRate;
+    }
+    sim = loadPath == nullptr || snapshot != nullptr ? Sim_Create( &simDesc ) : nullptr;
+    if ( sim != nullptr && snapshot != nullptr ) {
+        const uint64_t loadStart = Timer_Nanoseconds();
+        if ( Snapshot_Restore( snapshot, sim ) ) {
+            printf( "loaded %s at tick %llu in %.3f ms\n", loadPath, ( unsigned long long )Sim_GetTickCount( sim ),
+                ( double )( Timer_Nanoseconds() - loadStart ) / 1e6 );
+        } else {
+            Sim_Destroy( sim );
+            sim = nullptr;
+        }
+    }
+    Snapshot_Close( snapshot );
+    if ( sim == nullptr ) {
+        if ( loadPath != nullptr ) {
+            fprintf( stderr, "can't load snapshot %s\n", loadPath );
+        }
+        Pacing_Destroy( latency );
+        Pacing_Destroy( pacing );
+        Platform_Destroy( platform );
+        Job_Shutdown();
+        return -1;
+    }
+
+    Random_Seed( &botRandom, simDesc.seed, 1 );
+
+    savePath = configRule[ kMainConfig_Save ].value;
+    if ( savePath != nullptr ) {
+        snapshots = SnapshotWriter_Create();
+        if ( snapshots == nullptr ) {
+            fprintf( stderr, "can't save to %s\n", savePath );
+        }
+    }
+
+    // replays start from a sim's first tick
+    const char * const recordPath = loadPath == nullptr ? configRule[ kMainConfig_Record ].value : nullptr;
+    if ( recordPath != nullptr ) {
+        recorder = ReplayWriter_Create( recordPath, &simDesc );
+        if ( recorder == nullptr ) {
+            fprintf( stderr, "can't record to %s\n", recordPath );
+        }
+    }
 
-    appData.bufferCount = 3;
-    appData.framerate = 60;
-    appData.frametime = 1000 / appData.framerate;
+    const char * const capturePath = configRule[ kMainConfig_Capture ].value;
+    if ( capturePath != nullptr ) {
+        const char * const captureFormat = configRule[ kMainConfig_CaptureFormat ].value;
+        captureDesc_s captureDesc;
+        captureDesc.path = capturePath;
+        captureDesc.size = desc.size;
+        captureDesc.format = captureFormat != nullptr && strcmp( captureFormat, "ppm" ) == 0 ? kCaptureFormat_Ppm : kCaptureFormat_Qoi;
+        captureDesc.every = ( size_t )captureEvery;
+        capture = Capture_Create( &captureDesc );
+        if ( capture == nullptr ) {
+            fprintf( stderr, "can't capture to %s\n", capturePath );
+        }
+    }
 
-    HWND wnd = CreateWindowExA( 0,
-                                windowClassName,
-                                "RTS From Scratch",
-                                WS_VISIBLE | WS_CAPTION | WS_SYSMENU,
-                                0,
-                                0,
-                                1024,
-                                768,
-                                nullptr,
-                                nullptr,
-                                inst,
-                                &appData );
+    const char * const assetPath = configRule[ kMainConfig_Assets ].value;
+    if ( assetPath != nullptr && !openAssets( assetPath ) ) {
+        fprintf( stderr, "can't stream assets from %s\n", assetPath );
+    }
 
-    appData.nextframe = GetTickCount64() + appData.frametime;
+    // the first interactive frame waits for the visible assets and nothing else
+    const uint64_t assetStart = Timer_Nanoseconds();
+    streamAssets();
+    while ( assets != nullptr && AssetLoader_GetPending( assets, kAssetPriority_Visible ) > 0 ) {
+        Timer_WaitUntil( Timer_Nanoseconds() + kMain_AssetPollNs );
+        streamAssets();
+    }
+    const uint64_t assetWaitNs = Timer_Nanoseconds() - assetStart;
 
     window_s * const w = Window_Create( 0, windowCallback, vec2_zero< size_t >(), { 100, 100 }, 64, 0 );
 
-    if ( wnd != nullptr ) {
-        for ( ;; ) {
-            for ( ;; ) {
-                const ULONGLONG now = GetTickCount64();
-                if ( now >= appData.nextframe ) {
-                    appData.nextframe += appData.frametime;
-                    break;
-                }
-                Sleep( 1 );
-            }
+    renderThread_s rt;
+    rt.platform = platform;
+    int commandsCreated = 1;
+    for ( size_t i = 0; i < 3; i++ ) {
+        rt.frames[ i ].commands = RenderBuffer_Create();
+        commandsCreated = commandsCreated && rt.frames[ i ].commands != nullptr;
+    }
+    thread_s * thread = nullptr;
+    if ( renderThread && commandsCreated ) {
+        rt.wake = Signal_Create();
+        thread = rt.wake ? Thread_Create( renderThreadMain, &rt ) : nullptr;
+        if ( thread == nullptr ) {
+            Signal_Destroy( rt.wake );
+            rt.wake = nullptr;
+        }
+    }
 
-            MSG msg;
-            while ( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) ) {
-                if ( msg.message == WM_QUIT ) {
-                    break;
-                }
-                TranslateMessage( &msg );
-                DispatchMessage( &msg );
-            }
+    // the simulation runs in fixed ticks drained from an accumulator; rendering runs once per frame at its own
+    // rate and interpolates between the last two ticks
+    const uint64_t tickNs = 1000000000ull / ( uint64_t )tickRate;
+    const uint64_t frameNs = frameRate > 0 ? 1000000000ull / ( uint64_t )frameRate : 0;
+
+    uint64_t previous = Platform_GetNanoseconds( platform );
+    uint64_t deadline = previous + frameNs;
+    uint64_t accumulator = 0;
+    uint64_t frameStart = Timer_Nanoseconds();
+    const uint64_t runStart = frameStart;
+    uint64_t shownCount = 0;
+    int quit = 0;
+
+    const vec2_s< size_t > frameSize = { ( size_t )width, ( size_t )height };
+    for ( size_t frame = 0; commandsCreated && !quit && ( frameLimit <= 0 || frame < ( size_t )frameLimit ); frame++ ) {
+        Profile_FrameMark();
+        FrameArena_BeginFrame();
+
+        if ( !Platform_PumpEvents( platform ) ) {
+            break;
+        }
 
-            if ( msg.message == WM_QUIT ) {
+        const uint64_t inputNs = Timer_Nanoseconds();
+
+        uint64_t shownStamp;
+        if ( Platform_TakeShown( platform, &shownStamp ) ) {
+            Pacing_RecordFrame( latency, inputNs - shownStamp, 0, 0 );
+            shownCount++;
+        }
+
+        const uint64_t now = Platform_GetNanoseconds( platform );
+        const uint64_t delta = now - previous;
+        previous = now;
+        accumulator += delta < kMain_MaxFrameDeltaNs ? delta : kMain_MaxFrameDeltaNs;
+
+        size_t ticks = 0;
+        while ( accumulator >= tickNs ) {
+            if ( ticks == kMain_MaxTicksPerFrame ) {
+                accumulator %= tickNs;
                 break;
             }
+            if ( update() != 0 ) {
+                quit = 1;
+                break;
+            }
+            accumulator -= tickNs;
+            ticks++;
+        }
 
-            rgba_s * const rgba = ( rgba_s * )( appData.buffers[ appData.bufferForeground ] + 1 );
-            const rect_s< size_t > clip = rectFrom( vec2_zero< size_t >(), { appData.width, appData.height } );
-            Window_Render( rgba, appData.width, clip );
+        streamAssets();
 
-            InvalidateRect( wnd, 0, FALSE );
+        // the write slot is never the one the render thread is executing
+        renderFrame_s * const renderData = rt.frames + ( thread != nullptr ? TripleBuffer_GetWriteSlot( &rt.handoff ) : 0 );
+        renderData->inputNs = inputNs;
+        renderData->alpha = ( float )accumulator / ( float )tickNs;
+        recordFrame( renderData, frameSize );
 
-            render();
+        if ( thread != nullptr ) {
+            TripleBuffer_Publish( &rt.handoff );
+            Signal_Raise( rt.wake );
+        } else {
+            renderFrame( platform, renderData );
+            rt.rendered.fetch_add( 1, std::memory_order_relaxed );
+        }
 
-            if ( update() != 0 ) {
-                break;
+        // a late frame resyncs the deadline instead of running short frames to catch up
+        int missed = 0;
+        if ( frameNs != 0 ) {
+            const uint64_t finished = Platform_GetNanoseconds( platform );
+            if ( finished > deadline ) {
+                missed = 1;
+                deadline = finished;
+            } else {
+                PROFILE_ZONE( "Platform_WaitUntil" );
+                Platform_WaitUntil( platform, deadline );
             }
+            deadline += frameNs;
         }
+
+        const uint64_t frameEnd = Timer_Nanoseconds();
+        Pacing_RecordFrame( pacing, frameEnd - frameStart, missed, ticks );
+        frameStart = frameEnd;
+
+        FrameArena_EndFrame();
+    }
+
+    const double seconds = ( double )( Timer_Nanoseconds() - runStart ) / 1e9;
+
+    if ( thread != nullptr ) {
+        rt.quit.store( 1, std::memory_order_release );
+        Signal_Raise( rt.wake );
+        Thread_Join( thread );
+        Signal_Destroy( rt.wake );
+    }
+    if ( !commandsCreated ) {
+        fprintf( stderr, "can't create render command buffers\n" );
+    }
+    for ( size_t i = 0; i < 3; i++ ) {
+        RenderBuffer_Destroy( rt.frames[ i ].commands );
+    }
+
+    if ( profilePath != nullptr ) {
+        Profile_FrameMark();
+        Profile_WriteTrace( profilePath );
+    }
+
+    if ( configRule[ kMainConfig_Stats ].present ) {
+        pacingStats_s stats;
+        Pacing_GetStats( pacing, &stats );
+        const uint64_t rendered = rt.rendered.load( std::memory_order_relaxed );
+        printf( "frames %llu, missed %llu, ticks %llu, rendered %llu, shown %llu (%.1f/s) on %s\n",
+            ( unsigned long long )stats.frames, ( unsigned long long )stats.missed,
+            ( unsigned long long )stats.ticks, ( unsigned long long )rendered, ( unsigned long long )shownCount,
+            seconds > 0.0 ? ( double )shownCount / seconds : 0.0, thread ? "render thread" : "main thread" );
+        printPacing( "frame", pacing );
+        printPacing( "input to shown", latency );
+        if ( profilePath != nullptr ) {
+            printProfile();
+        }
+
+        frameArenaStats_s arenaStats;
+        FrameArena_GetStats( &arenaStats );
+        printf( "frame arenas: %zu threads, %zu KB reserved, %zu KB high water, %llu heap overflows\n",
+            arenaStats.threads, arenaStats.capacity / 1024, arenaStats.highWater / 1024,
+            ( unsigned long long )arenaStats.overflowCount );
+
+        printMemory( stats.frames );
     }
 
     Window_Destroy( w );
 
-    ReleaseDC( wnd, appData.dc );
-    DeleteObject( appData.bmp );
+    if ( snapshots != nullptr ) {
+        SnapshotWriter_Save( snapshots, sim, &simDesc, savePath );
+        SnapshotWriter_Flush( snapshots );
 
-    if ( appData.buffers != nullptr ) {
-        for ( size_t i = 0; i < appData.bufferCount; i++ ) {
-            if ( appData.buffers[ i ] != nullptr ) {
-                free( appData.buffers[ i ] );
-            }
+        snapshotStats_s stats;
+        SnapshotWriter_GetStats( snapshots, &stats );
+        if ( stats.failed != 0 ) {
+            fprintf( stderr, "%llu saves to %s failed\n", ( unsigned long long )stats.failed, savePath );
+        }
+        if ( configRule[ kMainConfig_Stats ].present ) {
+            printf( "snapshots: %llu saved, %llu skipped busy, last %zu KB, %.3f ms copying on this thread, %.3f ms writing\n",
+                ( unsigned long long )stats.saves, ( unsigned long long )stats.busy, stats.bytes / 1024,
+                ( double )stats.copyNs / 1e6, ( double )stats.writeNs / 1e6 );
+        }
+
+        SnapshotWriter_Destroy( snapshots );
+        snapshots = nullptr;
+    }
+
+    if ( recorder != nullptr && !ReplayWriter_Destroy( recorder ) ) {
+        fprintf( stderr, "recording to %s failed\n", recordPath );
+    }
+    recorder = nullptr;
+
+    if ( capture != nullptr ) {
+        Capture_Flush( capture );
+
+        captureStats_s stats;
+        Capture_GetStats( capture, &stats );
+        if ( stats.failed != 0 ) {
+            fprintf( stderr, "%llu frames captured to %s failed\n", ( unsigned long long )stats.failed, capturePath );
         }
-        free( appData.buffers );
+        if ( configRule[ kMainConfig_Stats ].present ) {
+            const double encodeSeconds = ( double )stats.encodeNs / 1e9;
+            printf( "capture: %llu of %llu frames encoded, %llu dropped, %.3f ms copying per frame on the presenting thread, "
+                    "encoding %.1f frames/s, %.1f MB/s out\n",
+                ( unsigned long long )stats.encoded, ( unsigned long long )stats.offered, ( unsigned long long )stats.dropped,
+                stats.offered > 0 ? ( double )stats.copyNs / 1e6 / ( double )stats.offered : 0.0,
+                encodeSeconds > 0.0 ? ( double )stats.encoded / encodeSeconds : 0.0,
+                encodeSeconds > 0.0 ? ( double )stats.bytes / 1e6 / encodeSeconds : 0.0 );
+        }
+
+        Capture_Destroy( capture );
+        capture = nullptr;
+    }
+
+    if ( assets != nullptr ) {
+        if ( configRule[ kMainConfig_Stats ].present ) {
+            assetLoaderStats_s stats;
+            AssetLoader_GetStats( assets, &stats );
+            printf( "assets: %zu of %zu published, %zu loading, %zu failed, %zu KB, %llu evicted, %llu updates blocked, "
+                    "%.3f ms waiting for the visible set\n",
+                stats.published, assetCount, stats.loading, stats.failed, stats.bytes / 1024, ( unsigned long long )stats.evicted,
+                ( unsigned long long )stats.blocked, ( double )assetWaitNs / 1e6 );
+        }
+        closeAssets();
     }
 
-    unregisterWindowClass( windowClassName );
+    Sim_Destroy( sim );
+    sim = nullptr;
+
+    shutdownRuntime();
+
+    Pacing_Destroy( latency );
+    Pacing_Destroy( pacing );
+
+    Platform_Destroy( platform );
+
+    // everything tagged should be gone by now
+    Mem_ReportLeaks( stderr );
 
     return 0;
 }
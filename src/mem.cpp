@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+static constexpr uint32_t kMem_Magic = 0x4d454d21; // 'MEM!'
+static constexpr size_t kMem_MaxSites = 256;       // distinct call sites a leak report groups by
+
+typedef struct memHeader_s {
+#if RTSFS_MEM_SITES
+    memHeader_s * prev;
+    memHeader_s * next;
+    const char * file;
+    int32_t line;
+#endif
+    uint32_t magic;
+    size_t size;
+    memTag_e tag;
+} memHeader_s;
+
+// keeps the caller's block as aligned as malloc's
+static constexpr size_t kMem_HeaderSize = ( sizeof( memHeader_s ) + 15 ) & ~( size_t )15;
+
+// two atomic adds per allocation and two per free; the allocation count is the histogram total and the live count
+// is allocations minus frees
+typedef struct memTag_s {
+    std::atomic< size_t > liveBytes{ 0 };
+    std::atomic< size_t > peakBytes{ 0 };
+    std::atomic< uint64_t > frees{ 0 };
+    std::atomic< size_t > budget{ 0 };
+    std::atomic< int > overBudget{ 0 };
+    std::atomic< uint64_t > histogram[ kMem_HistogramBuckets ];
+} memTag_s;
+
+static const char * const tagNames[ kMemTag_Count ] = { "other", "digraph", "window", "surface", "sim", "assets", "replay", "frame", "profile" };
+
+static memTag_s tags[ kMemTag_Count ];
+
+#if RTSFS_MEM_SITES
+typedef struct memSite_s {
+    const char * file;
+    int32_t line;
+    memTag_e tag;
+    size_t count;
+    size_t bytes;
+} memSite_s;
+
+static std::mutex liveMutex;
+static memHeader_s * liveList = nullptr;
+#endif
+
+static size_t Bucket( const size_t size ) {
+    if ( size <= 1 ) {
+        return 0;
+    }
+#if defined( _MSC_VER )
+    unsigned long bit;
+    _BitScanReverse64( &bit, ( unsigned long long )size );
+    const size_t bucket = bit;
+#else
+    const size_t bucket = ( size_t )( 63 - __builtin_clzll( ( unsigned long long )size ) );
+#endif
+    return bucket < kMem_HistogramBuckets ? bucket : kMem_HistogramBuckets - 1;
+}
+
+static void Count( const memTag_e tag, const size_t size ) {
+    memTag_s * const t = tags + tag;
+
+    const size_t live = t->liveBytes.fetch_add( size, std::memory_order_relaxed ) + size;
+    t->histogram[ Bucket( size ) ].fetch_add( 1, std::memory_order_relaxed );
+
+    size_t peak = t->peakBytes.load( std::memory_order_relaxed );
+    while ( live > peak && !t->peakBytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) ) {
+    }
+
+    const size_t budget = t->budget.load( std::memory_order_relaxed );
+    if ( budget != 0 && live > budget && t->overBudget.exchange( 1, std::memory_order_relaxed ) == 0 ) {
+        fprintf( stderr, "memory: %s is over budget, %zu of %zu bytes\n", tagNames[ tag ], live, budget );
+    }
+}
+
+static void Uncount( const memTag_e tag, const size_t size ) {
+    memTag_s * const t = tags + tag;
+
+    const size_t live = t->liveBytes.fetch_sub( size, std::memory_order_relaxed ) - size;
+    t->frees.fetch_add( 1, std::memory_order_relaxed );
+
+    if ( t->overBudget.load( std::memory_order_relaxed ) && live <= t->budget.load( std::memory_order_relaxed ) ) {
+        t->overBudget.store( 0, std::memory_order_relaxed );
+    }
+}
+
+static void * Attach( memHeader_s * const header, const memTag_e tag, const size_t size, const char * const file, const int line ) {
+    header->magic = kMem_Magic;
+    header->size = size;
+    header->tag = tag;
+
+#if RTSFS_MEM_SITES
+    header->file = file;
+    header->line = line;
+    header->prev = nullptr;
+    {
+        std::lock_guard< std::mutex > lock( liveMutex );
+        header->next = liveList;
+        if ( liveList != nullptr ) {
+            liveList->prev = header;
+        }
+        liveList = header;
+    }
+#else
+    ( void )file;
+    ( void )line;
+#endif
+
+    Count( tag, size );
+
+    return ( uint8_t * )header + kMem_HeaderSize;
+}
+
+static memHeader_s * Detach( void * const ptr ) {
+    memHeader_s * const header = ( memHeader_s * )( ( uint8_t * )ptr - kMem_HeaderSize );
+    if ( header->magic != kMem_Magic ) {
+        fprintf( stderr, "memory: freeing %p, which Mem_Alloc did not allocate\n", ptr );
+        abort();
+    }
+
+#if RTSFS_MEM_SITES
+    {
+        std::lock_guard< std::mutex > lock( liveMutex );
+        if ( header->prev != nullptr ) {
+            header->prev->next = header->next;
+        } else {
+            liveList = header->next;
+        }
+        if ( header->next != nullptr ) {
+            header->next->prev = header->prev;
+        }
+    }
+#endif
+
+    Uncount( header->tag, header->size );
+
+    return header;
+}
+
+void * Mem_AllocAt( const memTag_e tag, const size_t size, const char * const file, const int line ) {
+    if ( tag >= kMemTag_Count || size > SIZE_MAX - kMem_HeaderSize ) {
+        return nullptr;
+    }
+
+    memHeader_s * const header = ( memHeader_s * )malloc( kMem_HeaderSize + size );
+    if ( header == nullptr ) {
+        return nullptr;
+    }
+
+    return Attach( header, tag, size, file, line );
+}
+
+void * Mem_CallocAt( const memTag_e tag, const size_t count, const size_t size, const char * const file, const int line ) {
+    if ( size != 0 && count > ( SIZE_MAX - kMem_HeaderSize ) / size ) {
+        return nullptr;
+    }
+
+    void * const ptr = Mem_AllocAt( tag, count * size, file, line );
+    if ( ptr != nullptr ) {
+        memset( ptr, 0, count * size );
+    }
+
+    return ptr;
+}
+
+void * Mem_ReallocAt( const memTag_e tag, void * const ptr, const size_t size, const char * const file, const int line ) {
+    if ( ptr == nullptr ) {
+        return Mem_AllocAt( tag, size, file, line );
+    }
+    if ( size > SIZE_MAX - kMem_HeaderSize ) {
+        return nullptr;
+    }
+
+    // detached while realloc runs, so the live list never holds a moved block
+    memHeader_s * const header = Detach( ptr );
+    const memTag_e blockTag = header->tag;
+
+    memHeader_s * const grown = ( memHeader_s * )realloc( header, kMem_HeaderSize + size );
+    if ( grown == nullptr ) {
+        Attach( header, blockTag, header->size, file, line );
+        return nullptr;
+    }
+
+    return Attach( grown, blockTag, size, file, line );
+}
+
+void Mem_Free( void * const ptr ) {
+    if ( ptr == nullptr ) {
+        return;
+    }
+
+    free( Detach( ptr ) );
+}
+
+void Mem_TrackExternal( const memTag_e tag, const size_t size ) {
+    if ( tag < kMemTag_Count ) {
+        Count( tag, size );
+    }
+}
+
+void Mem_UntrackExternal( const memTag_e tag, const size_t size ) {
+    if ( tag < kMemTag_Count ) {
+        Uncount( tag, size );
+    }
+}
+
+void Mem_SetBudget( const memTag_e tag, const size_t bytes ) {
+    if ( tag < kMemTag_Count ) {
+        tags[ tag ].budget.store( bytes, std::memory_order_relaxed );
+        tags[ tag ].overBudget.store( 0, std::memory_order_relaxed );
+    }
+}
+
+void Mem_GetStats( const memTag_e tag, memTagStats_s * const stats ) {
+    new ( stats ) memTagStats_s;
+
+    if ( tag >= kMemTag_Count ) {
+        return;
+    }
+
+    const memTag_s * const t = tags + tag;
+    stats->name = tagNames[ tag ];
+    stats->liveBytes = t->liveBytes.load( std::memory_order_relaxed );
+    stats->peakBytes = t->peakBytes.load( std::memory_order_relaxed );
+    stats->frees = t->frees.load( std::memory_order_relaxed );
+    stats->budget = t->budget.load( std::memory_order_relaxed );
+    for ( size_t i = 0; i < kMem_HistogramBuckets; i++ ) {
+        stats->histogram[ i ] = t->histogram[ i ].load( std::memory_order_relaxed );
+        stats->allocs += stats->histogram[ i ];
+    }
+    stats->liveCount = ( size_t )( stats->allocs - stats->frees );
+}
+
+size_t Mem_ReportLeaks( FILE * const file ) {
+    size_t total = 0;
+
+    for ( size_t i = 0; i < kMemTag_Count; i++ ) {
+        memTagStats_s stats;
+        Mem_GetStats( ( memTag_e )i, &stats );
+        if ( stats.liveCount != 0 ) {
+            fprintf( file, "memory: %s still holds %zu bytes in %zu allocations\n", stats.name, stats.liveBytes,
+                stats.liveCount );
+        }
+        total += stats.liveCount;
+    }
+
+#if RTSFS_MEM_SITES
+    memSite_s site[ kMem_MaxSites ];
+    size_t siteCount = 0;
+
+    std::lock_guard< std::mutex > lock( liveMutex );
+    for ( const memHeader_s * header = liveList; header != nullptr; header = header->next ) {
+        size_t s = 0;
+        while ( s < siteCount && ( site[ s ].line != header->line || site[ s ].file != header->file ) ) {
+            s++;
+        }
+        if ( s == siteCount ) {
+            if ( siteCount == kMem_MaxSites ) {
+                continue;
+            }
+            site[ s ] = { header->file, header->line, header->tag, 0, 0 };
+            siteCount++;
+        }
+        site[ s ].count++;
+        site[ s ].bytes += header->size;
+    }
+
+    for ( size_t s = 0; s < siteCount; s++ ) {
+        fprintf( file, "memory:   %s(%d): %zu bytes in %zu allocations (%s)\n", site[ s ].file ? site[ s ].file : "?",
+            site[ s ].line, site[ s ].bytes, site[ s ].count, tagNames[ site[ s ].tag ] );
+    }
+#endif
+
+    return total;
+}
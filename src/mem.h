@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_MEM_H___
+#define ___RTSFS_MEM_H___
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// tagged heap allocation. every block carries a small header with its size and tag, and per-tag counters track
+// live and peak bytes, allocation counts and a log2 size histogram. the counters are always on.
+//
+// RTSFS_MEM_SITES (on when NDEBUG is not defined) also records the file and line of every allocation in a live
+// list, so Mem_ReportLeaks can name the call sites of whatever is still allocated at shutdown.
+//
+// memory that does not come from Mem_Alloc (dib sections, mappings) can still be counted with Mem_TrackExternal.
+
+#if !defined( RTSFS_MEM_SITES )
+#if defined( NDEBUG )
+#define RTSFS_MEM_SITES 0
+#else
+#define RTSFS_MEM_SITES 1
+#endif
+#endif
+
+typedef enum memTag_e : uint8_t {
+    kMemTag_Other = 0,
+    kMemTag_Digraph,
+    kMemTag_Window,
+    kMemTag_Surface, // presentation surfaces and other pixel buffers
+    kMemTag_Sim,     // simulation state
+    kMemTag_Assets,  // loaded fonts, images and archives
+    kMemTag_Replay,  // replay streams and the snapshots kept for seeking
+    kMemTag_Frame,   // per thread frame arenas
+    kMemTag_Profile, // profiler rings, zone history and the trace capture
+    kMemTag_Count
+} memTag_e;
+
+static constexpr size_t kMem_HistogramBuckets = 32; // bucket i counts sizes in [ 2^i, 2^( i + 1 ) )
+
+typedef struct memTagStats_s {
+    const char * name = nullptr;
+    size_t liveBytes = 0;
+    size_t peakBytes = 0;
+    size_t liveCount = 0;
+    uint64_t allocs = 0;      // since startup; divide by elapsed frames or seconds for a rate
+    uint64_t frees = 0;
+    size_t budget = 0;        // 0 for none
+    uint64_t histogram[ kMem_HistogramBuckets ] = {};
+} memTagStats_s;
+
+void * Mem_AllocAt( const memTag_e tag, const size_t size, const char * const file, const int line );
+
+void * Mem_CallocAt( const memTag_e tag, const size_t count, const size_t size, const char * const file, const int line );
+
+// a block keeps the tag it was allocated with; tag only applies when ptr is nullptr and a new block is allocated
+void * Mem_ReallocAt( const memTag_e tag, void * const ptr, const size_t size, const char * const file, const int line );
+
+void Mem_Free( void * const ptr );
+
+#if RTSFS_MEM_SITES
+#define Mem_Alloc( tag, size ) Mem_AllocAt( tag, size, __FILE__, __LINE__ )
+#define Mem_Calloc( tag, count, size ) Mem_CallocAt( tag, count, size, __FILE__, __LINE__ )
+#define Mem_Realloc( tag, ptr, size ) Mem_ReallocAt( tag, ptr, size, __FILE__, __LINE__ )
+#else
+#define Mem_Alloc( tag, size ) Mem_AllocAt( tag, size, nullptr, 0 )
+#define Mem_Calloc( tag, count, size ) Mem_CallocAt( tag, count, size, nullptr, 0 )
+#define Mem_Realloc( tag, ptr, size ) Mem_ReallocAt( tag, ptr, size, nullptr, 0 )
+#endif
+
+// counts memory allocated some other way against a tag
+void Mem_TrackExternal( const memTag_e tag, const size_t size );
+
+void Mem_UntrackExternal( const memTag_e tag, const size_t size );
+
+// a warning is printed to stderr each time a tag's live bytes rise above its budget. 0 removes the budget.
+void Mem_SetBudget( const memTag_e tag, const size_t bytes );
+
+void Mem_GetStats( const memTag_e tag, memTagStats_s * const stats );
+
+// prints every tag with live allocations and, with RTSFS_MEM_SITES, the call sites still holding them. returns
+// the number of live allocations.
+size_t Mem_ReportLeaks( FILE * const file );
+
+#endif // ___RTSFS_MEM_H___
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "minimap.h"
+#include "blit.h"
+#include "mem.h"
+#include "render.h"
+#include "simd.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <stdlib.h>
+
+#include <new>
+
+static constexpr size_t kMinimap_BlipSize = 2; // blips are squares of this many output pixels
+
+typedef struct minimap_s {
+    vec2_s< size_t > cells;
+    vec2_s< size_t > size;
+    rgba_s * terrain = nullptr;     // cells
+    rgba_s * shaded = nullptr;      // cells
+    rgba_s * base = nullptr;        // size
+    rgba_s * output[ kMinimap_Outputs ] = {}; // size, one per triple buffer slot
+    size_t current = 0;                       // the output Minimap_Update wrote last
+    uint64_t * dirty = nullptr;     // one bit per cell row needing shaded and base refreshed
+    size_t dirtyWords = 0;
+
+    const fog_s * fog = nullptr;
+    size_t player = 0;
+    fogStyle_s style;
+    uint64_t * fogCopy = nullptr;   // visible then explored planes as of the last update
+    size_t fogWordsPerRow = 0;
+
+    rgba_s palette[ 256 ];
+} minimap_s;
+
+static void MarkRows( minimap_s * const minimap, const size_t y0, const size_t y1 ) {
+    for ( size_t y = y0; y <= y1; y++ ) {
+        minimap->dirty[ y / 64 ] |= 1ull << ( y & 63 );
+    }
+}
+
+// marks the cell rows where the fog planes differ from the copy, and updates the copy
+static void PollFog( minimap_s * const minimap ) {
+    if ( minimap->fog == nullptr || minimap->fogCopy == nullptr ) {
+        return;
+    }
+
+    const uint64_t * visible;
+    const uint64_t * explored;
+    const size_t wordsPerRow = Fog_GetPlanes( minimap->fog, minimap->player, &visible, &explored );
+    if ( wordsPerRow != minimap->fogWordsPerRow ) {
+        return;
+    }
+
+    uint64_t * const copyVisible = minimap->fogCopy;
+    uint64_t * const copyExplored = minimap->fogCopy + minimap->cells.y * wordsPerRow;
+
+    for ( size_t y = 0; y < minimap->cells.y; y++ ) {
+        const size_t offset = y * wordsPerRow;
+        if ( memcmp( copyVisible + offset, visible + offset, wordsPerRow * sizeof( uint64_t ) ) == 0 &&
+             memcmp( copyExplored + offset, explored + offset, wordsPerRow * sizeof( uint64_t ) ) == 0 ) {
+            continue;
+        }
+        memcpy( copyVisible + offset, visible + offset, wordsPerRow * sizeof( uint64_t ) );
+        memcpy( copyExplored + offset, explored + offset, wordsPerRow * sizeof( uint64_t ) );
+        MarkRows( minimap, y, y );
+    }
+}
+
+// refreshes shaded and base for cell rows y0 through y1
+static void RefreshRows( minimap_s * const minimap, const size_t y0, const size_t y1 ) {
+    const size_t width = minimap->cells.x;
+
+    memcpy( minimap->shaded + y0 * width, minimap->terrain + y0 * width, ( y1 - y0 + 1 ) * width * sizeof( rgba_s ) );
+
+    if ( minimap->fog != nullptr ) {
+        fogView_s view;
+        view.step = 1 << 16;
+        Fog_Shade( minimap->fog,
+                   minimap->player,
+                   minimap->shaded,
+                   width,
+                   { { 0, y0 }, { width - 1, y1 } },
+                   &view,
+                   &minimap->style );
+    }
+
+    // the output rows sampling these cell rows, padded by one since the nearest mapping may round either way
+    const size_t outY0 = y0 * minimap->size.y / minimap->cells.y;
+    const size_t outY1 = ( y1 + 1 ) * minimap->size.y / minimap->cells.y + 1;
+    const rect_s< size_t > clip = {
+        { 0, outY0 > 0 ? outY0 - 1 : 0 },
+        { minimap->size.x - 1, outY1 < minimap->size.y ? outY1 : minimap->size.y - 1 }
+    };
+
+    Blit_ScaleNearest( minimap->base,
+                       minimap->size.x,
+                       clip,
+                       rectFrom( vec2_zero< size_t >(), minimap->size ),
+                       minimap->shaded,
+                       width,
+                       rectFrom( vec2_zero< size_t >(), minimap->cells ) );
+}
+
+static inline void PutBlip( minimap_s * const minimap, const size_t x, const size_t y, const uint8_t owner ) {
+    const rgba_s color = minimap->palette[ owner ];
+    rgba_s * pix = minimap->output[ minimap->current ] + y * minimap->size.x + x;
+    for ( size_t by = 0; by < kMinimap_BlipSize; by++ ) {
+        for ( size_t bx = 0; bx < kMinimap_BlipSize; bx++ ) {
+            pix[ bx ] = color;
+        }
+        pix += minimap->size.x;
+    }
+}
+
+static void SplatUnits( minimap_s * const minimap, const minimapUnits_s * const units ) {
+    if ( units == nullptr || units->x == nullptr || units->y == nullptr || minimap->size.x < kMinimap_BlipSize ||
+         minimap->size.y < kMinimap_BlipSize ) {
+        return;
+    }
+
+    const float scaleX = ( float )minimap->size.x / ( float )minimap->cells.x;
+    const float scaleY = ( float )minimap->size.y / ( float )minimap->cells.y;
+
+    // blips are anchored at their top left, so the last few rows and columns can't hold an anchor
+    const float limitX = ( float )( minimap->size.x - kMinimap_BlipSize + 1 );
+    const float limitY = ( float )( minimap->size.y - kMinimap_BlipSize + 1 );
+
+    const float * const xs = units->x;
+    const float * const ys = units->y;
+    const uint8_t * const owner = units->owner;
+    size_t i = 0;
+
+#if defined( RTSFS_SIMD_AVX2 )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256 sx = _mm256_set1_ps( scaleX );
+        const __m256 sy = _mm256_set1_ps( scaleY );
+        const __m256 lx = _mm256_set1_ps( limitX );
+        const __m256 ly = _mm256_set1_ps( limitY );
+        const __m256 lo = _mm256_setzero_ps();
+        int32_t px[ 8 ];
+        int32_t py[ 8 ];
+
+        for ( ; i + 8 <= units->count; i += 8 ) {
+            const __m256 fx = _mm256_mul_ps( _mm256_loadu_ps( xs + i ), sx );
+            const __m256 fy = _mm256_mul_ps( _mm256_loadu_ps( ys + i ), sy );
+
+            // ordered compares, so nan positions fall out too
+            const __m256 inside = _mm256_and_ps( _mm256_and_ps( _mm256_cmp_ps( fx, lo, _CMP_GE_OQ ), _mm256_cmp_ps( fx, lx, _CMP_LT_OQ ) ),
+                                                 _mm256_and_ps( _mm256_cmp_ps( fy, lo, _CMP_GE_OQ ), _mm256_cmp_ps( fy, ly, _CMP_LT_OQ ) ) );
+            unsigned mask = ( unsigned )_mm256_movemask_ps( inside );
+            if ( mask == 0 ) {
+                continue;
+            }
+
+            _mm256_storeu_si256( ( __m256i * )px, _mm256_max_epi32( _mm256_cvttps_epi32( fx ), zero ) );
+            _mm256_storeu_si256( ( __m256i * )py, _mm256_max_epi32( _mm256_cvttps_epi32( fy ), zero ) );
+
+            for ( size_t lane = 0; mask != 0; lane++, mask >>= 1 ) {
+                if ( mask & 1 ) {
+                    PutBlip( minimap, ( size_t )px[ lane ], ( size_t )py[ lane ], owner ? owner[ i + lane ] : 0 );
+                }
+            }
+        }
+    }
+#elif defined( RTSFS_SIMD_SSE2 )
+    {
+        const __m128 sx = _mm_set1_ps( scaleX );
+        const __m128 sy = _mm_set1_ps( scaleY );
+        const __m128 lx = _mm_set1_ps( limitX );
+        const __m128 ly = _mm_set1_ps( limitY );
+        const __m128 lo = _mm_setzero_ps();
+        int32_t px[ 4 ];
+        int32_t py[ 4 ];
+
+        for ( ; i + 4 <= units->count; i += 4 ) {
+            const __m128 fx = _mm_mul_ps( _mm_loadu_ps( xs + i ), sx );
+            const __m128 fy = _mm_mul_ps( _mm_loadu_ps( ys + i ), sy );
+
+            const __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( fx, lo ), _mm_cmplt_ps( fx, lx ) ),
+                                              _mm_and_ps( _mm_cmpge_ps( fy, lo ), _mm_cmplt_ps( fy, ly ) ) );
+            unsigned mask = ( unsigned )_mm_movemask_ps( inside );
+            if ( mask == 0 ) {
+                continue;
+            }
+
+            _mm_storeu_si128( ( __m128i * )px, _mm_cvttps_epi32( fx ) );
+            _mm_storeu_si128( ( __m128i * )py, _mm_cvttps_epi32( fy ) );
+
+            for ( size_t lane = 0; mask != 0; lane++, mask >>= 1 ) {
+                if ( mask & 1 ) {
+                    PutBlip( minimap, ( size_t )px[ lane ], ( size_t )py[ lane ], owner ? owner[ i + lane ] : 0 );
+                }
+            }
+        }
+    }
+#endif
+
+    for ( ; i < units->count; i++ ) {
+        const float fx = xs[ i ] * scaleX;
+        const float fy = ys[ i ] * scaleY;
+        if ( fx >= 0.0f && fx < limitX && fy >= 0.0f && fy < limitY ) {
+            PutBlip( minimap, ( size_t )fx, ( size_t )fy, owner ? owner[ i ] : 0 );
+        }
+    }
+}
+
+static void DrawViewport( minimap_s * const minimap, const rect_s< float > * const viewport ) {
+    const float scaleX = ( float )minimap->size.x / ( float )minimap->cells.x;
+    const float scaleY = ( float )minimap->size.y / ( float )minimap->cells.y;
+    const float maxX = ( float )( minimap->size.x - 1 );
+    const float maxY = ( float )( minimap->size.y - 1 );
+
+    float fx0 = viewport->mn.x * scaleX;
+    float fy0 = viewport->mn.y * scaleY;
+    float fx1 = viewport->mx.x * scaleX;
+    float fy1 = viewport->mx.y * scaleY;
+    if ( !( fx0 <= fx1 && fy0 <= fy1 ) || fx1 < 0.0f || fy1 < 0.0f || fx0 > maxX || fy0 > maxY ) {
+        return;
+    }
+
+    // edges outside the minimap are clamped to its border so the camera is always shown
+    fx0 = fx0 < 0.0f ? 0.0f : fx0;
+    fy0 = fy0 < 0.0f ? 0.0f : fy0;
+    fx1 = fx1 > maxX ? maxX : fx1;
+    fy1 = fy1 > maxY ? maxY : fy1;
+
+    const size_t x0 = ( size_t )fx0;
+    const size_t y0 = ( size_t )fy0;
+    const size_t x1 = ( size_t )fx1;
+    const size_t y1 = ( size_t )fy1;
+    const rgba_s white = { 255, 255, 255, 255 };
+    rgba_s * const out = minimap->output[ minimap->current ];
+    const size_t stride = minimap->size.x;
+
+    for ( size_t x = x0; x <= x1; x++ ) {
+        out[ y0 * stride + x ] = white;
+        out[ y1 * stride + x ] = white;
+    }
+    for ( size_t y = y0; y <= y1; y++ ) {
+        out[ y * stride + x0 ] = white;
+        out[ y * stride + x1 ] = white;
+    }
+}
+
+minimap_s * Minimap_Create( const vec2_s< size_t > cells, const vec2_s< size_t > size ) {
+    if ( cells.x == 0 || cells.y == 0 || size.x == 0 || size.y == 0 ) {
+        return nullptr;
+    }
+
+    minimap_s * const minimap = ( minimap_s * )Mem_Alloc( kMemTag_Surface, sizeof( minimap_s ) );
+    if ( minimap == nullptr ) {
+        return nullptr;
+    }
+
+    new ( minimap ) minimap_s;
+
+    minimap->cells = cells;
+    minimap->size = size;
+    minimap->dirtyWords = ( cells.y + 63 ) / 64;
+    minimap->terrain = ( rgba_s * )Mem_Calloc( kMemTag_Surface, cells.x * cells.y, sizeof( rgba_s ) );
+    minimap->shaded = ( rgba_s * )Mem_Calloc( kMemTag_Surface, cells.x * cells.y, sizeof( rgba_s ) );
+    minimap->base = ( rgba_s * )Mem_Calloc( kMemTag_Surface, size.x * size.y, sizeof( rgba_s ) );
+    minimap->dirty = ( uint64_t * )Mem_Calloc( kMemTag_Surface, minimap->dirtyWords, sizeof( uint64_t ) );
+
+    if ( minimap->terrain == nullptr || minimap->shaded == nullptr || minimap->base == nullptr || minimap->dirty == nullptr ) {
+        Minimap_Destroy( minimap );
+        return nullptr;
+    }
+
+    for ( size_t i = 0; i < kMinimap_Outputs; i++ ) {
+        minimap->output[ i ] = ( rgba_s * )Mem_Calloc( kMemTag_Surface, size.x * size.y, sizeof( rgba_s ) );
+        if ( minimap->output[ i ] == nullptr ) {
+            Minimap_Destroy( minimap );
+            return nullptr;
+        }
+    }
+
+    for ( size_t i = 0; i < 256; i++ ) {
+        minimap->palette[ i ] = { 255, 255, 255, 255 };
+    }
+
+    MarkRows( minimap, 0, cells.y - 1 );
+
+    return minimap;
+}
+
+void Minimap_Destroy( minimap_s * const minimap ) {
+    if ( minimap == nullptr ) {
+        return;
+    }
+
+    Mem_Free( minimap->terrain );
+    Mem_Free( minimap->shaded );
+    Mem_Free( minimap->base );
+    for ( size_t i = 0; i < kMinimap_Outputs; i++ ) {
+        Mem_Free( minimap->output[ i ] );
+    }
+    Mem_Free( minimap->dirty );
+    Mem_Free( minimap->fogCopy );
+    Mem_Free( minimap );
+}
+
+void Minimap_SetTerrain( minimap_s * const minimap, const rect_s< size_t > cells, const rgba_s * const colors, const size_t stride ) {
+    if ( minimap == nullptr || colors == nullptr ) {
+        return;
+    }
+    if ( cells.mx.x < cells.mn.x || cells.mx.y < cells.mn.y || cells.mx.x >= minimap->cells.x || cells.mx.y >= minimap->cells.y ) {
+        return;
+    }
+
+    const size_t width = cells.mx.x - cells.mn.x + 1;
+    for ( size_t y = cells.mn.y; y <= cells.mx.y; y++ ) {
+        memcpy( minimap->terrain + y * minimap->cells.x + cells.mn.x, colors + ( y - cells.mn.y ) * stride, width * sizeof( rgba_s ) );
+    }
+
+    MarkRows( minimap, cells.mn.y, cells.mx.y );
+}
+
+void Minimap_SetFog( minimap_s * const minimap, const fog_s * const fog, const size_t player, const fogStyle_s * const style ) {
+    if ( minimap == nullptr ) {
+        return;
+    }
+
+    Mem_Free( minimap->fogCopy );
+    minimap->fogCopy = nullptr;
+    minimap->fog = nullptr;
+
+    MarkRows( minimap, 0, minimap->cells.y - 1 );
+
+    if ( fog == nullptr ) {
+        return;
+    }
+
+    // the copy starts zeroed; PollFog picks up every row that already has something in it
+    const size_t wordsPerRow = Fog_GetPlanes( fog, player, nullptr, nullptr );
+    if ( wordsPerRow != ( minimap->cells.x + 63 ) / 64 ) {
+        return;
+    }
+
+    minimap->fogCopy = ( uint64_t * )Mem_Calloc( kMemTag_Surface, 2 * minimap->cells.y * wordsPerRow, sizeof( uint64_t ) );
+    if ( minimap->fogCopy == nullptr ) {
+        return;
+    }
+
+    minimap->fog = fog;
+    minimap->player = player;
+    minimap->fogWordsPerRow = wordsPerRow;
+    minimap->style = style ? *style : fogStyle_s{};
+}
+
+void Minimap_SetPalette( minimap_s * const minimap, const uint8_t owner, const rgba_s color ) {
+    if ( minimap == nullptr ) {
+        return;
+    }
+    minimap->palette[ owner ] = color;
+}
+
+void Minimap_Update( minimap_s * const minimap, const size_t slot, const minimapUnits_s * const units, const rect_s< float > * const viewport ) {
+    if ( minimap == nullptr || slot >= kMinimap_Outputs ) {
+        return;
+    }
+
+    PollFog( minimap );
+
+    // refresh runs of consecutive dirty rows together so each run is a single blit
+    size_t runStart = SIZE_MAX;
+    for ( size_t y = 0; y <= minimap->cells.y; y++ ) {
+        const int isDirty = y < minimap->cells.y && ( ( minimap->dirty[ y / 64 ] >> ( y & 63 ) ) & 1 );
+        if ( isDirty && runStart == SIZE_MAX ) {
+            runStart = y;
+        } else if ( !isDirty && runStart != SIZE_MAX ) {
+            RefreshRows( minimap, runStart, y - 1 );
+            runStart = SIZE_MAX;
+        }
+    }
+    memset( minimap->dirty, 0, minimap->dirtyWords * sizeof( uint64_t ) );
+
+    minimap->current = slot;
+    memcpy( minimap->output[ slot ], minimap->base, minimap->size.x * minimap->size.y * sizeof( rgba_s ) );
+
+    SplatUnits( minimap, units );
+
+    if ( viewport != nullptr ) {
+        DrawViewport( minimap, viewport );
+    }
+}
+
+const rgba_s * Minimap_GetOutput( const minimap_s * const minimap, vec2_s< size_t > * const size ) {
+    if ( minimap == nullptr ) {
+        return nullptr;
+    }
+    if ( size != nullptr ) {
+        *size = minimap->size;
+    }
+    return minimap->output[ minimap->current ];
+}
+
+uintptr_t Minimap_WindowCallback( window_s * const window, const windowMsg_e msg, const uintptr_t a, const uintptr_t b ) {
+    ( void )window;
+
+    switch ( msg ) {
+        case kWindow_OnCreate: {
+            minimap_s ** const userData = ( minimap_s ** )b;
+            if ( userData == nullptr || a == 0 ) {
+                return 0;
+            }
+            *userData = ( minimap_s * )a;
+            return 1;
+        }
+
+        case kWindow_OnRender: {
+            const windowRenderData_s * const renderData = ( const windowRenderData_s * )a;
+            minimap_s * const * const userData = ( minimap_s * const * )b;
+            if ( renderData == nullptr || userData == nullptr || *userData == nullptr ) {
+                return 0;
+            }
+
+            const minimap_s * const minimap = *userData;
+            const size_t width = renderData->size.x < minimap->size.x ? renderData->size.x : minimap->size.x;
+            const size_t height = renderData->size.y < minimap->size.y ? renderData->size.y : minimap->size.y;
+            if ( width == 0 || height == 0 ) {
+                return 0;
+            }
+
+            // the window's clip is already on the list
+            RenderList_Blit( renderData->list,
+                             rectFrom( renderData->position, { width, height } ),
+                             minimap->output[ minimap->current ],
+                             minimap->size.x,
+                             rectFrom( vec2_zero< size_t >(), { width, height } ) );
+        } break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
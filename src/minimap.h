@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_MINIMAP_H___
+#define ___RTSFS_MINIMAP_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+#include "window.h"
+#include "fog.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// minimap rendering, cached in layers so a frame only redoes what changed:
+//   terrain - one color per map cell, pushed by the caller when terrain changes
+//   shaded  - terrain with the player's fog applied, rebuilt for rows whose terrain or fog changed
+//   base    - shaded scaled to the minimap's size, rescaled for the same rows
+//   output  - base plus unit blips and the camera viewport, rebuilt by Minimap_Update every frame, one per slot
+//
+// the window callback only records a blit of output, so the minimap costs nothing extra however often it is drawn.
+//
+// a minimap and the fog it shades with belong to one thread, the one that ticks the sim and records frames; every
+// call here is made from it. the blit reads output later, when the render thread executes the frame's render buffer,
+// so there is an output per slot of the triple buffer that hands frames to the render thread. Minimap_Update writes
+// the output of the slot being recorded, which the render thread never holds, and the callback then records a blit
+// of that one. the renderer in main.cpp draws no map yet, so it creates neither a minimap nor a fog.
+
+typedef struct minimap_s minimap_s;
+
+static constexpr size_t kMinimap_Outputs = 3; // one per triple buffer slot
+
+// compact unit positions in cell units, one entry per unit
+typedef struct minimapUnits_s {
+    const float * x = nullptr;
+    const float * y = nullptr;
+    const uint8_t * owner = nullptr; // palette index
+    size_t count = 0;
+} minimapUnits_s;
+
+// returns nullptr on failure
+minimap_s * Minimap_Create( const vec2_s< size_t > cells, const vec2_s< size_t > size );
+
+void Minimap_Destroy( minimap_s * const minimap );
+
+// copies terrain colors for a rect of cells (inclusive); colors[ 0 ] is the color of cells.mn
+void Minimap_SetTerrain( minimap_s * const minimap, const rect_s< size_t > cells, const rgba_s * const colors, const size_t stride );
+
+// shades the terrain with a player's fog. the fog must cover the same cells as the minimap; nullptr disables shading.
+// the fog is polled for changes by Minimap_Update.
+void Minimap_SetFog( minimap_s * const minimap, const fog_s * const fog, const size_t player, const fogStyle_s * const style );
+
+void Minimap_SetPalette( minimap_s * const minimap, const uint8_t owner, const rgba_s color );
+
+// rebuilds slot's output: refreshes changed terrain and fog rows, then draws unit blips and the viewport outline.
+// slot is the triple buffer slot of the frame being recorded, below kMinimap_Outputs. viewport is in cell units and
+// may be nullptr.
+void Minimap_Update( minimap_s * const minimap, const size_t slot, const minimapUnits_s * const units, const rect_s< float > * const viewport );
+
+// the output Minimap_Update wrote last
+const rgba_s * Minimap_GetOutput( const minimap_s * const minimap, vec2_s< size_t > * const size );
+
+// window handler: create the window with userDataSize = sizeof( minimap_s * ) and the minimap as param.
+// kWindow_OnRender records a blit of the output Minimap_Update wrote last.
+uintptr_t Minimap_WindowCallback( window_s * const window, const windowMsg_e msg, const uintptr_t a, const uintptr_t b );
+
+#endif // ___RTSFS_MINIMAP_H___
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pacing.h"
+#include "mem.h"
+
+#include <memory.h>
+
+#include <new>
+
+static constexpr uint64_t kPacing_BucketNs = 25000;  // 25 us
+static constexpr size_t kPacing_BucketCount = 4000; // up to 100 ms; slower frames land in the last bucket
+
+typedef struct pacing_s {
+    uint64_t frames = 0;
+    uint64_t missed = 0;
+    uint64_t ticks = 0;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t maxNs = 0;
+    uint32_t bucket[ kPacing_BucketCount ];
+} pacing_s;
+
+// upper edge of the bucket holding the given rank, clamped to the exact extremes
+static uint64_t Percentile( const pacing_s * const pacing, const uint64_t rank ) {
+    uint64_t seen = 0;
+    for ( size_t i = 0; i < kPacing_BucketCount; i++ ) {
+        seen += pacing->bucket[ i ];
+        if ( seen > rank ) {
+            const uint64_t edge = ( i + 1 ) * kPacing_BucketNs;
+            return edge < pacing->minNs ? pacing->minNs : edge > pacing->maxNs ? pacing->maxNs : edge;
+        }
+    }
+    return pacing->maxNs;
+}
+
+pacing_s * Pacing_Create( void ) {
+    pacing_s * const pacing = ( pacing_s * )Mem_Alloc( kMemTag_Other, sizeof( pacing_s ) );
+    if ( pacing == nullptr ) {
+        return nullptr;
+    }
+
+    Pacing_Reset( pacing );
+
+    return pacing;
+}
+
+void Pacing_Destroy( pacing_s * const pacing ) {
+    Mem_Free( pacing );
+}
+
+void Pacing_RecordFrame( pacing_s * const pacing, const uint64_t frameNs, const int missedDeadline, const size_t ticks ) {
+    if ( pacing == nullptr ) {
+        return;
+    }
+
+    const uint64_t index = frameNs / kPacing_BucketNs;
+    pacing->bucket[ index < kPacing_BucketCount ? index : kPacing_BucketCount - 1 ]++;
+
+    pacing->frames++;
+    pacing->missed += missedDeadline ? 1 : 0;
+    pacing->ticks += ticks;
+    pacing->minNs = frameNs < pacing->minNs ? frameNs : pacing->minNs;
+    pacing->maxNs = frameNs > pacing->maxNs ? frameNs : pacing->maxNs;
+}
+
+void Pacing_GetStats( const pacing_s * const pacing, pacingStats_s * const stats ) {
+    if ( pacing == nullptr || stats == nullptr ) {
+        return;
+    }
+
+    new ( stats ) pacingStats_s;
+
+    if ( pacing->frames == 0 ) {
+        return;
+    }
+
+    stats->frames = pacing->frames;
+    stats->missed = pacing->missed;
+    stats->ticks = pacing->ticks;
+    stats->minNs = pacing->minNs;
+    stats->maxNs = pacing->maxNs;
+    stats->p50Ns = Percentile( pacing, pacing->frames * 50 / 100 );
+    stats->p90Ns = Percentile( pacing, pacing->frames * 90 / 100 );
+    stats->p99Ns = Percentile( pacing, pacing->frames * 99 / 100 );
+}
+
+void Pacing_Reset( pacing_s * const pacing ) {
+    if ( pacing == nullptr ) {
+        return;
+    }
+
+    new ( pacing ) pacing_s;
+    memset( pacing->bucket, 0, sizeof( pacing->bucket ) );
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_PACING_H___
+#define ___RTSFS_PACING_H___
+
+#include <stddef.h>
+#include <stdint.h>
+
+// frame pacing statistics. frame times go into a fixed histogram, so recording is constant time and never
+// allocates; percentiles are read back from the histogram to bucket resolution.
+
+typedef struct pacing_s pacing_s;
+
+typedef struct pacingStats_s {
+    uint64_t frames = 0;  // frames recorded since the last reset
+    uint64_t missed = 0;  // frames that finished after their deadline
+    uint64_t ticks = 0;   // simulation ticks run
+    uint64_t minNs = 0;
+    uint64_t p50Ns = 0;
+    uint64_t p90Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t maxNs = 0;
+} pacingStats_s;
+
+// returns nullptr on failure
+pacing_s * Pacing_Create( void );
+
+void Pacing_Destroy( pacing_s * const pacing );
+
+void Pacing_RecordFrame( pacing_s * const pacing, const uint64_t frameNs, const int missedDeadline, const size_t ticks );
+
+void Pacing_GetStats( const pacing_s * const pacing, pacingStats_s * const stats );
+
+void Pacing_Reset( pacing_s * const pacing );
+
+#endif // ___RTSFS_PACING_H___
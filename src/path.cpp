@@ -0,0 +1,737 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "path.h"
+#include "mem.h"
+#include "profile.h"
+
+#include <string.h>
+
+#include <new>
+
+static constexpr int32_t kPath_LocalCells = kPath_ClusterSize * kPath_ClusterSize;
+static constexpr size_t kPath_LocalHeap = 4 * kPath_LocalCells + 1; // every relaxation can push once
+static constexpr int32_t kPath_SplitRun = 6;      // border runs at least this long get a transition at each end
+static constexpr uint32_t kPath_NoNode = UINT32_MAX;
+static constexpr uint32_t kPath_GoalNode = UINT32_MAX - 1;
+static constexpr uint32_t kPath_Unreached = UINT32_MAX;
+static constexpr uint8_t kPath_TreeRoot = 4;
+static constexpr uint8_t kPath_TreeNone = 0xff;
+
+// tree steps: the next cell towards the root is cell + step
+static const int32_t kPath_Step[ 4 ][ 2 ] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 } };
+
+typedef struct pathNode_s {
+    vec2_s< int32_t > cell;
+    uint32_t cluster = 0;
+    uint32_t border = 0;       // border the transition crosses: cluster * 2, + 1 for its south border
+    uint32_t partner = kPath_NoNode;
+    uint32_t slot = 0;         // index in its cluster's node list
+} pathNode_s;
+
+typedef struct pathCluster_s {
+    vec2_s< int32_t > mn;      // first cell
+    vec2_s< int32_t > mx;      // one past the last cell
+    uint32_t * node = nullptr; // node ids
+    size_t nodeCount = 0;
+    size_t nodeCapacity = 0;
+    uint32_t * cost = nullptr; // [ from slot * nodeCount + to slot ] cheapest path inside the cluster
+    size_t costCapacity = 0;
+    uint8_t * tree = nullptr;  // [ slot ][ local cell ] step towards that node
+    size_t treeCapacity = 0;
+    uint8_t dirty = 0;
+    uint32_t stamp = 0;
+} pathCluster_s;
+
+typedef struct path_s {
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t clustersX = 0;
+    int32_t clustersY = 0;
+    uint8_t * cost = nullptr;
+    pathCluster_s * cluster = nullptr;
+    pathNode_s * node = nullptr;
+    size_t nodeCount = 0;      // ids handed out, live or free
+    size_t nodeCapacity = 0;
+    uint32_t * freeNode = nullptr;
+    size_t freeCount = 0;
+    size_t freeCapacity = 0;
+    uint32_t * borderStamp = nullptr; // [ border ]
+    uint32_t stamp = 0;
+    int anyDirty = 0;
+
+    // rebuild scratch
+    uint32_t localDist[ kPath_LocalCells ];
+    uint32_t localHeap[ kPath_LocalHeap ];
+} path_s;
+
+// an open list entry. ties on f go to the larger g, the one further along: with uniform costs the manhattan
+// heuristic is exact and whole plateaus of nodes share an f, and this walks straight through them.
+typedef struct pathOpen_s {
+    uint64_t key = 0; // ( f << 32 ) | ~g
+    uint32_t node = 0;
+} pathOpen_s;
+
+typedef struct pathSearch_s {
+    size_t capacity = 0;
+    uint32_t * g = nullptr;
+    uint32_t * parent = nullptr;
+    uint32_t * stamp = nullptr;
+    uint32_t searchStamp = 0;
+    pathOpen_s * heap = nullptr;
+    size_t heapCount = 0;
+    size_t heapCapacity = 0;
+    uint32_t * chain = nullptr;     // abstract path, goal first
+    uint32_t startDist[ kPath_LocalCells ];
+    uint32_t goalDist[ kPath_LocalCells ];
+    uint8_t goalTree[ kPath_LocalCells ];
+    uint32_t localHeap[ kPath_LocalHeap ];
+} pathSearch_s;
+
+static inline int InBounds( const path_s * const path, const vec2_s< int32_t > cell ) {
+    return cell.x >= 0 && cell.y >= 0 && cell.x < path->width && cell.y < path->height;
+}
+
+static inline uint8_t CellCost( const path_s * const path, const vec2_s< int32_t > cell ) {
+    return path->cost[ cell.y * path->width + cell.x ];
+}
+
+static inline uint32_t ClusterOf( const path_s * const path, const vec2_s< int32_t > cell ) {
+    return ( uint32_t )( ( cell.y / kPath_ClusterSize ) * path->clustersX + cell.x / kPath_ClusterSize );
+}
+
+static inline int32_t Local( const pathCluster_s * const cluster, const vec2_s< int32_t > cell ) {
+    return ( cell.y - cluster->mn.y ) * kPath_ClusterSize + ( cell.x - cluster->mn.x );
+}
+
+static inline uint32_t Heuristic( const vec2_s< int32_t > a, const vec2_s< int32_t > b ) {
+    const int32_t dx = a.x > b.x ? a.x - b.x : b.x - a.x;
+    const int32_t dy = a.y > b.y ? a.y - b.y : b.y - a.y;
+    return ( uint32_t )( dx + dy ); // every step costs at least 1
+}
+
+// grows *array to hold count elements of size bytes; returns zero on failure, leaving it as it was
+static int Reserve( void ** const array, size_t * const capacity, const size_t count, const size_t size ) {
+    if ( count <= *capacity ) {
+        return 1;
+    }
+
+    size_t grown = *capacity < 16 ? 16 : *capacity * 2;
+    grown = grown < count ? count : grown;
+    void * const resized = Mem_Realloc( kMemTag_Sim, *array, grown * size );
+    if ( resized == nullptr ) {
+        return 0;
+    }
+
+    *array = resized;
+    *capacity = grown;
+    return 1;
+}
+
+static inline void HeapPush32( uint32_t * const heap, size_t * const count, const uint32_t key ) {
+    size_t i = ( *count )++;
+    while ( i > 0 && heap[ ( i - 1 ) / 2 ] > key ) {
+        heap[ i ] = heap[ ( i - 1 ) / 2 ];
+        i = ( i - 1 ) / 2;
+    }
+    heap[ i ] = key;
+}
+
+static inline uint32_t HeapPop32( uint32_t * const heap, size_t * const count ) {
+    const uint32_t top = heap[ 0 ];
+    const uint32_t last = heap[ --( *count ) ];
+    size_t i = 0;
+    for ( ;; ) {
+        size_t child = i * 2 + 1;
+        if ( child >= *count ) {
+            break;
+        }
+        child += child + 1 < *count && heap[ child + 1 ] < heap[ child ];
+        if ( heap[ child ] >= last ) {
+            break;
+        }
+        heap[ i ] = heap[ child ];
+        i = child;
+    }
+    heap[ i ] = last;
+    return top;
+}
+
+// dijkstra from root over the cells of one cluster. dist gets the cost of reaching each local cell from root, and
+// tree (if not nullptr) the step from each cell back towards root. keys pack the distance above the 8 bit local
+// index; the largest in-cluster distance, 254 * 256, fits in the 24 bits left.
+static void LocalDijkstra( const path_s * const path, const pathCluster_s * const cluster, const vec2_s< int32_t > root,
+    uint32_t * const dist, uint8_t * const tree, uint32_t * const heap ) {
+    for ( int32_t i = 0; i < kPath_LocalCells; i++ ) {
+        dist[ i ] = kPath_Unreached;
+    }
+    if ( tree != nullptr ) {
+        memset( tree, kPath_TreeNone, kPath_LocalCells );
+    }
+
+    const int32_t rootLocal = Local( cluster, root );
+    dist[ rootLocal ] = 0;
+    if ( tree != nullptr ) {
+        tree[ rootLocal ] = kPath_TreeRoot;
+    }
+
+    size_t heapCount = 0;
+    HeapPush32( heap, &heapCount, ( uint32_t )rootLocal );
+
+    while ( heapCount != 0 ) {
+        const uint32_t key = HeapPop32( heap, &heapCount );
+        const int32_t u = ( int32_t )( key & 0xff );
+        const uint32_t d = key >> 8;
+        if ( d != dist[ u ] ) {
+            continue;
+        }
+
+        const vec2_s< int32_t > cell{ cluster->mn.x + u % kPath_ClusterSize, cluster->mn.y + u / kPath_ClusterSize };
+        for ( uint8_t i = 0; i < 4; i++ ) {
+            const vec2_s< int32_t > next{ cell.x + kPath_Step[ i ][ 0 ], cell.y + kPath_Step[ i ][ 1 ] };
+            if ( next.x < cluster->mn.x || next.y < cluster->mn.y || next.x >= cluster->mx.x || next.y >= cluster->mx.y ) {
+                continue;
+            }
+
+            const uint8_t enter = CellCost( path, next );
+            const int32_t v = Local( cluster, next );
+            if ( enter == kPath_Wall || d + enter >= dist[ v ] ) {
+                continue;
+            }
+
+            dist[ v ] = d + enter;
+            if ( tree != nullptr ) {
+                tree[ v ] = ( uint8_t )( ( i + 2 ) & 3 ); // back the way we came
+            }
+            HeapPush32( heap, &heapCount, ( ( d + enter ) << 8 ) | ( uint32_t )v );
+        }
+    }
+}
+
+static uint32_t AllocNode( path_s * const path ) {
+    if ( path->freeCount != 0 ) {
+        return path->freeNode[ --path->freeCount ];
+    }
+
+    // the free list can hold every id
+    if ( !Reserve( ( void ** )&path->node, &path->nodeCapacity, path->nodeCount + 1, sizeof( pathNode_s ) ) ||
+        !Reserve( ( void ** )&path->freeNode, &path->freeCapacity, path->nodeCount + 1, sizeof( uint32_t ) ) ) {
+        return kPath_NoNode;
+    }
+    return ( uint32_t )path->nodeCount++;
+}
+
+static int AddToCluster( path_s * const path, const uint32_t id ) {
+    pathCluster_s * const cluster = &path->cluster[ path->node[ id ].cluster ];
+    if ( !Reserve( ( void ** )&cluster->node, &cluster->nodeCapacity, cluster->nodeCount + 1, sizeof( uint32_t ) ) ) {
+        return 0;
+    }
+    cluster->node[ cluster->nodeCount++ ] = id;
+    return 1;
+}
+
+// adds the node pair of a transition between cells a and b
+static int AddTransition( path_s * const path, const uint32_t border, const vec2_s< int32_t > a, const vec2_s< int32_t > b ) {
+    const uint32_t na = AllocNode( path );
+    if ( na == kPath_NoNode ) {
+        return 0;
+    }
+    const uint32_t nb = AllocNode( path );
+    if ( nb == kPath_NoNode ) {
+        path->freeNode[ path->freeCount++ ] = na;
+        return 0;
+    }
+
+    path->node[ na ] = pathNode_s{ a, ClusterOf( path, a ), border, nb, 0 };
+    path->node[ nb ] = pathNode_s{ b, ClusterOf( path, b ), border, na, 0 };
+    return AddToCluster( path, na ) && AddToCluster( path, nb );
+}
+
+// scans the border: runs of cells open on both sides get a transition in the middle, or one at each end if long
+static int BuildBorder( path_s * const path, const uint32_t border ) {
+    const pathCluster_s * const cluster = &path->cluster[ border / 2 ];
+    const int south = ( border & 1 ) != 0;
+    const int32_t length = south ? cluster->mx.x - cluster->mn.x : cluster->mx.y - cluster->mn.y;
+
+    int32_t runStart = -1;
+    for ( int32_t i = 0; i <= length; i++ ) {
+        vec2_s< int32_t > a;
+        vec2_s< int32_t > b;
+        if ( south ) {
+            a = { cluster->mn.x + i, cluster->mx.y - 1 };
+            b = { a.x, a.y + 1 };
+        } else {
+            a = { cluster->mx.x - 1, cluster->mn.y + i };
+            b = { a.x + 1, a.y };
+        }
+
+        const int open = i < length && CellCost( path, a ) != kPath_Wall && CellCost( path, b ) != kPath_Wall;
+        if ( open ) {
+            runStart = runStart < 0 ? i : runStart;
+            continue;
+        }
+        if ( runStart < 0 ) {
+            continue;
+        }
+
+        const int32_t runEnd = i - 1;
+        const vec2_s< int32_t > along = south ? vec2_s< int32_t >{ 1, 0 } : vec2_s< int32_t >{ 0, 1 };
+        const vec2_s< int32_t > across = south ? vec2_s< int32_t >{ 0, 1 } : vec2_s< int32_t >{ 1, 0 };
+        const vec2_s< int32_t > first = { a.x - along.x * ( i - runStart ), a.y - along.y * ( i - runStart ) };
+        if ( runEnd - runStart + 1 < kPath_SplitRun ) {
+            const int32_t mid = ( runEnd - runStart ) / 2;
+            const vec2_s< int32_t > m{ first.x + along.x * mid, first.y + along.y * mid };
+            if ( !AddTransition( path, border, m, m + across ) ) {
+                return 0;
+            }
+        } else {
+            const int32_t last = runEnd - runStart;
+            const vec2_s< int32_t > e{ first.x + along.x * last, first.y + along.y * last };
+            if ( !AddTransition( path, border, first, first + across ) || !AddTransition( path, border, e, e + across ) ) {
+                return 0;
+            }
+        }
+        runStart = -1;
+    }
+
+    return 1;
+}
+
+// drops the cluster's nodes on borders stamped for rebuilding
+static void RemoveBorderNodes( path_s * const path, pathCluster_s * const cluster ) {
+    size_t kept = 0;
+    for ( size_t i = 0; i < cluster->nodeCount; i++ ) {
+        const uint32_t id = cluster->node[ i ];
+        if ( path->borderStamp[ path->node[ id ].border ] == path->stamp ) {
+            path->freeNode[ path->freeCount++ ] = id;
+        } else {
+            cluster->node[ kept++ ] = id;
+        }
+    }
+    cluster->nodeCount = kept;
+}
+
+// the cost matrix and shortest path trees for the cluster's current nodes
+static int BuildIntra( path_s * const path, pathCluster_s * const cluster ) {
+    const size_t n = cluster->nodeCount;
+    if ( !Reserve( ( void ** )&cluster->cost, &cluster->costCapacity, n * n, sizeof( uint32_t ) ) ||
+        !Reserve( ( void ** )&cluster->tree, &cluster->treeCapacity, n * kPath_LocalCells, 1 ) ) {
+        return 0;
+    }
+
+    for ( size_t i = 0; i < n; i++ ) {
+        path->node[ cluster->node[ i ] ].slot = ( uint32_t )i;
+    }
+
+    for ( size_t i = 0; i < n; i++ ) {
+        const pathNode_s * const from = &path->node[ cluster->node[ i ] ];
+        LocalDijkstra( path, cluster, from->cell, path->localDist, cluster->tree + i * kPath_LocalCells, path->localHeap );
+        for ( size_t j = 0; j < n; j++ ) {
+            cluster->cost[ i * n + j ] = path->localDist[ Local( cluster, path->node[ cluster->node[ j ] ].cell ) ];
+        }
+    }
+
+    return 1;
+}
+
+path_s * Path_Create( const vec2_s< size_t > size ) {
+    if ( size.x == 0 || size.y == 0 || size.x > 0x8000 || size.y > 0x8000 ) {
+        return nullptr;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( path_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    path_s * const path = new ( mem ) path_s;
+    path->width = ( int32_t )size.x;
+    path->height = ( int32_t )size.y;
+    path->clustersX = ( path->width + kPath_ClusterSize - 1 ) / kPath_ClusterSize;
+    path->clustersY = ( path->height + kPath_ClusterSize - 1 ) / kPath_ClusterSize;
+
+    const size_t clusters = ( size_t )path->clustersX * ( size_t )path->clustersY;
+    path->cost = ( uint8_t * )Mem_Alloc( kMemTag_Sim, size.x * size.y );
+    path->cluster = ( pathCluster_s * )Mem_Alloc( kMemTag_Sim, clusters * sizeof( pathCluster_s ) );
+    path->borderStamp = ( uint32_t * )Mem_Calloc( kMemTag_Sim, clusters * 2, sizeof( uint32_t ) );
+    if ( path->cost == nullptr || path->cluster == nullptr || path->borderStamp == nullptr ) {
+        Mem_Free( path->cluster );
+        path->cluster = nullptr;
+        Path_Destroy( path );
+        return nullptr;
+    }
+
+    memset( path->cost, 1, size.x * size.y );
+    for ( int32_t cy = 0; cy < path->clustersY; cy++ ) {
+        for ( int32_t cx = 0; cx < path->clustersX; cx++ ) {
+            pathCluster_s * const cluster = new ( &path->cluster[ cy * path->clustersX + cx ] ) pathCluster_s;
+            cluster->mn = { cx * kPath_ClusterSize, cy * kPath_ClusterSize };
+            cluster->mx = { cluster->mn.x + kPath_ClusterSize, cluster->mn.y + kPath_ClusterSize };
+            cluster->mx.x = cluster->mx.x < path->width ? cluster->mx.x : path->width;
+            cluster->mx.y = cluster->mx.y < path->height ? cluster->mx.y : path->height;
+            cluster->dirty = 1;
+        }
+    }
+    path->anyDirty = 1;
+
+    return path;
+}
+
+void Path_Destroy( path_s * const path ) {
+    if ( path == nullptr ) {
+        return;
+    }
+
+    if ( path->cluster != nullptr ) {
+        for ( size_t i = 0; i < ( size_t )path->clustersX * ( size_t )path->clustersY; i++ ) {
+            Mem_Free( path->cluster[ i ].tree );
+            Mem_Free( path->cluster[ i ].cost );
+            Mem_Free( path->cluster[ i ].node );
+        }
+    }
+    Mem_Free( path->borderStamp );
+    Mem_Free( path->freeNode );
+    Mem_Free( path->node );
+    Mem_Free( path->cluster );
+    Mem_Free( path->cost );
+
+    path->~path_s();
+    Mem_Free( path );
+}
+
+void Path_SetCost( path_s * const path, const vec2_s< int32_t > cell, const uint8_t cost ) {
+    if ( !InBounds( path, cell ) ) {
+        return;
+    }
+
+    uint8_t * const c = &path->cost[ cell.y * path->width + cell.x ];
+    const uint8_t stored = cost != 0 ? cost : 1;
+    if ( *c != stored ) {
+        *c = stored;
+        path->cluster[ ClusterOf( path, cell ) ].dirty = 1;
+        path->anyDirty = 1;
+    }
+}
+
+uint8_t Path_GetCost( const path_s * const path, const vec2_s< int32_t > cell ) {
+    return InBounds( path, cell ) ? CellCost( path, cell ) : kPath_Wall;
+}
+
+size_t Path_Update( path_s * const path ) {
+    if ( !path->anyDirty ) {
+        return 0;
+    }
+
+    PROFILE_ZONE( "Path_Update" );
+
+    // stamp the borders of dirty clusters, and every cluster on either side of one. a stamped cluster loses its
+    // nodes on stamped borders and gets its matrix rebuilt.
+    const uint32_t stamp = ++path->stamp;
+    const int32_t cw = path->clustersX;
+    const int32_t ch = path->clustersY;
+    for ( int32_t cy = 0; cy < ch; cy++ ) {
+        for ( int32_t cx = 0; cx < cw; cx++ ) {
+            const int32_t c = cy * cw + cx;
+            if ( !path->cluster[ c ].dirty ) {
+                continue;
+            }
+
+            path->cluster[ c ].stamp = stamp;
+            if ( cx + 1 < cw ) {
+                path->borderStamp[ c * 2 ] = stamp;
+                path->cluster[ c + 1 ].stamp = stamp;
+            }
+            if ( cy + 1 < ch ) {
+                path->borderStamp[ c * 2 + 1 ] = stamp;
+                path->cluster[ c + cw ].stamp = stamp;
+            }
+            if ( cx > 0 ) {
+                path->borderStamp[ ( c - 1 ) * 2 ] = stamp;
+                path->cluster[ c - 1 ].stamp = stamp;
+            }
+            if ( cy > 0 ) {
+                path->borderStamp[ ( c - cw ) * 2 + 1 ] = stamp;
+                path->cluster[ c - cw ].stamp = stamp;
+            }
+        }
+    }
+
+    const size_t clusters = ( size_t )cw * ( size_t )ch;
+    for ( size_t c = 0; c < clusters; c++ ) {
+        if ( path->cluster[ c ].stamp == stamp ) {
+            RemoveBorderNodes( path, &path->cluster[ c ] );
+        }
+    }
+
+    int failed = 0;
+    for ( size_t b = 0; b < clusters * 2 && !failed; b++ ) {
+        if ( path->borderStamp[ b ] == stamp ) {
+            failed = !BuildBorder( path, ( uint32_t )b );
+        }
+    }
+
+    size_t rebuilt = 0;
+    for ( size_t c = 0; c < clusters && !failed; c++ ) {
+        if ( path->cluster[ c ].stamp == stamp ) {
+            failed = !BuildIntra( path, &path->cluster[ c ] );
+            path->cluster[ c ].dirty = 0;
+            rebuilt++;
+        }
+    }
+
+    if ( failed ) {
+        // start over from scratch next time rather than leave half a graph
+        for ( size_t c = 0; c < clusters; c++ ) {
+            path->cluster[ c ].dirty = 1;
+        }
+        return SIZE_MAX;
+    }
+
+    path->anyDirty = 0;
+    return rebuilt;
+}
+
+pathSearch_s * Path_CreateSearch( void ) {
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( pathSearch_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+    return new ( mem ) pathSearch_s;
+}
+
+void Path_DestroySearch( pathSearch_s * const search ) {
+    if ( search == nullptr ) {
+        return;
+    }
+
+    Mem_Free( search->heap );
+    Mem_Free( search->chain );
+    Mem_Free( search->stamp );
+    Mem_Free( search->parent );
+    Mem_Free( search->g );
+
+    search->~pathSearch_s();
+    Mem_Free( search );
+}
+
+static int Prepare( const path_s * const path, pathSearch_s * const search ) {
+    if ( path->nodeCount > search->capacity ) {
+        size_t capacity = search->capacity;
+        size_t parentCapacity = capacity;
+        size_t stampCapacity = capacity;
+        size_t chainCapacity = capacity;
+        if ( !Reserve( ( void ** )&search->g, &capacity, path->nodeCount, sizeof( uint32_t ) ) ||
+            !Reserve( ( void ** )&search->parent, &parentCapacity, capacity, sizeof( uint32_t ) ) ||
+            !Reserve( ( void ** )&search->stamp, &stampCapacity, capacity, sizeof( uint32_t ) ) ||
+            !Reserve( ( void ** )&search->chain, &chainCapacity, capacity, sizeof( uint32_t ) ) ) {
+            return 0;
+        }
+        memset( search->stamp + search->capacity, 0, ( capacity - search->capacity ) * sizeof( uint32_t ) );
+        search->capacity = capacity;
+    }
+
+    if ( ++search->searchStamp == 0 ) {
+        memset( search->stamp, 0, search->capacity * sizeof( uint32_t ) );
+        search->searchStamp = 1;
+    }
+    search->heapCount = 0;
+    return 1;
+}
+
+static int HeapPush( pathSearch_s * const search, const uint32_t f, const uint32_t g, const uint32_t node ) {
+    if ( !Reserve( ( void ** )&search->heap, &search->heapCapacity, search->heapCount + 1, sizeof( pathOpen_s ) ) ) {
+        return 0;
+    }
+
+    const pathOpen_s entry{ ( ( uint64_t )f << 32 ) | ( uint32_t )~g, node };
+    pathOpen_s * const heap = search->heap;
+    size_t i = search->heapCount++;
+    while ( i > 0 && heap[ ( i - 1 ) / 2 ].key > entry.key ) {
+        heap[ i ] = heap[ ( i - 1 ) / 2 ];
+        i = ( i - 1 ) / 2;
+    }
+    heap[ i ] = entry;
+    return 1;
+}
+
+static pathOpen_s HeapPop( pathSearch_s * const search ) {
+    pathOpen_s * const heap = search->heap;
+    const pathOpen_s top = heap[ 0 ];
+    const pathOpen_s last = heap[ --search->heapCount ];
+    const size_t count = search->heapCount;
+    size_t i = 0;
+    for ( ;; ) {
+        size_t child = i * 2 + 1;
+        if ( child >= count ) {
+            break;
+        }
+        child += child + 1 < count && heap[ child + 1 ].key < heap[ child ].key;
+        if ( heap[ child ].key >= last.key ) {
+            break;
+        }
+        heap[ i ] = heap[ child ];
+        i = child;
+    }
+    heap[ i ] = last;
+    return top;
+}
+
+static inline int Relax( pathSearch_s * const search, const uint32_t node, const uint32_t g, const uint32_t from, const uint32_t h ) {
+    if ( search->stamp[ node ] == search->searchStamp && g >= search->g[ node ] ) {
+        return 1;
+    }
+    search->stamp[ node ] = search->searchStamp;
+    search->g[ node ] = g;
+    search->parent[ node ] = from;
+    return HeapPush( search, g + h, g, node );
+}
+
+static inline size_t Emit( vec2_s< int32_t > * const cells, const size_t maxCells, const size_t count, const vec2_s< int32_t > cell ) {
+    if ( count < maxCells ) {
+        cells[ count ] = cell;
+    }
+    return count + 1;
+}
+
+// emits the cells after from down the tree to its root
+static size_t WalkTree( const pathCluster_s * const cluster, const uint8_t * const tree, vec2_s< int32_t > cell,
+    vec2_s< int32_t > * const cells, const size_t maxCells, size_t count ) {
+    for ( uint8_t step = tree[ Local( cluster, cell ) ]; step < kPath_TreeRoot; step = tree[ Local( cluster, cell ) ] ) {
+        cell = { cell.x + kPath_Step[ step ][ 0 ], cell.y + kPath_Step[ step ][ 1 ] };
+        count = Emit( cells, maxCells, count, cell );
+    }
+    return count;
+}
+
+size_t Path_Find( const path_s * const path, pathSearch_s * const search, const vec2_s< int32_t > start, const vec2_s< int32_t > goal,
+    vec2_s< int32_t > * const cells, const size_t maxCells ) {
+    PROFILE_ZONE( "Path_Find" );
+
+    if ( !InBounds( path, start ) || !InBounds( path, goal ) || CellCost( path, start ) == kPath_Wall || CellCost( path, goal ) == kPath_Wall ) {
+        return 0;
+    }
+
+    const pathCluster_s * const startCluster = &path->cluster[ ClusterOf( path, start ) ];
+    const pathCluster_s * const goalCluster = &path->cluster[ ClusterOf( path, goal ) ];
+
+    // the goal's tree serves both the last leg and a path that never leaves the cluster. its distances run from the
+    // goal outwards; the cost the other way differs only by the two end cells, since each step pays for the cell
+    // it enters.
+    LocalDijkstra( path, goalCluster, goal, search->goalDist, search->goalTree, search->localHeap );
+    if ( startCluster == goalCluster && search->goalDist[ Local( goalCluster, start ) ] != kPath_Unreached ) {
+        const size_t count = Emit( cells, maxCells, 0, start );
+        return WalkTree( goalCluster, search->goalTree, start, cells, maxCells, count );
+    }
+
+    if ( !Prepare( path, search ) ) {
+        return 0;
+    }
+
+    LocalDijkstra( path, startCluster, start, search->startDist, nullptr, search->localHeap );
+    for ( size_t i = 0; i < startCluster->nodeCount; i++ ) {
+        const uint32_t id = startCluster->node[ i ];
+        const uint32_t d = search->startDist[ Local( startCluster, path->node[ id ].cell ) ];
+        if ( d != kPath_Unreached && !Relax( search, id, d, kPath_NoNode, Heuristic( path->node[ id ].cell, goal ) ) ) {
+            return 0;
+        }
+    }
+
+    const uint8_t goalCost = CellCost( path, goal );
+    uint32_t goalParent = kPath_NoNode;
+    uint32_t goalG = kPath_Unreached;
+
+    while ( search->heapCount != 0 ) {
+        const pathOpen_s open = HeapPop( search );
+        const uint32_t u = open.node;
+        const uint32_t f = ( uint32_t )( open.key >> 32 );
+        if ( u == kPath_GoalNode ) {
+            if ( f == goalG ) {
+                break;
+            }
+            continue;
+        }
+
+        const pathNode_s * const node = &path->node[ u ];
+        const uint32_t g = search->g[ u ];
+        if ( g + Heuristic( node->cell, goal ) != f ) {
+            continue; // superseded by a cheaper push
+        }
+
+        const pathCluster_s * const cluster = &path->cluster[ node->cluster ];
+        if ( cluster == goalCluster ) {
+            const uint32_t d = search->goalDist[ Local( cluster, node->cell ) ];
+            if ( d != kPath_Unreached ) {
+                const uint32_t total = g + d - CellCost( path, node->cell ) + goalCost;
+                if ( total < goalG ) {
+                    goalG = total;
+                    goalParent = u;
+                    if ( !HeapPush( search, total, total, kPath_GoalNode ) ) {
+                        return 0;
+                    }
+                }
+            }
+        }
+
+        const size_t n = cluster->nodeCount;
+        const uint32_t * const row = cluster->cost + node->slot * n;
+        for ( size_t j = 0; j < n; j++ ) {
+            const uint32_t v = cluster->node[ j ];
+            if ( row[ j ] == kPath_Unreached || v == u ) {
+                continue;
+            }
+            if ( !Relax( search, v, g + row[ j ], u, Heuristic( path->node[ v ].cell, goal ) ) ) {
+                return 0;
+            }
+        }
+
+        const pathNode_s * const partner = &path->node[ node->partner ];
+        if ( !Relax( search, node->partner, g + CellCost( path, partner->cell ), u, Heuristic( partner->cell, goal ) ) ) {
+            return 0;
+        }
+    }
+
+    if ( goalParent == kPath_NoNode ) {
+        return 0;
+    }
+
+    // the abstract path, goal end first
+    size_t chainCount = 0;
+    for ( uint32_t id = goalParent; id != kPath_NoNode; id = search->parent[ id ] ) {
+        search->chain[ chainCount++ ] = id;
+    }
+
+    // start to the first node down that node's tree, then node to node, then down the goal's tree
+    size_t count = Emit( cells, maxCells, 0, start );
+    vec2_s< int32_t > at = start;
+    for ( size_t i = chainCount; i-- > 0; ) {
+        const pathNode_s * const node = &path->node[ search->chain[ i ] ];
+        const pathCluster_s * const cluster = &path->cluster[ node->cluster ];
+        if ( &path->cluster[ ClusterOf( path, at ) ] == cluster ) {
+            count = WalkTree( cluster, cluster->tree + node->slot * kPath_LocalCells, at, cells, maxCells, count );
+        } else {
+            count = Emit( cells, maxCells, count, node->cell ); // across the border
+        }
+        at = node->cell;
+    }
+
+    return WalkTree( goalCluster, search->goalTree, at, cells, maxCells, count );
+}
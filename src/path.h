@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_PATH_H___
+#define ___RTSFS_PATH_H___
+
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hierarchical pathfinding (hpa*) for single units over long distances.
+//
+// the map is the same kind of cost field as the flow fields use: the cost of entering a cell, 1 to 254, or
+// kPath_Wall. it is cut into kPath_ClusterSize square clusters. wherever a run of open cells crosses the border
+// between two clusters there are one or two transitions, each a pair of abstract nodes, one on either side. inside
+// a cluster every pair of nodes is joined by the cost of the cheapest path between them, found with a dijkstra
+// restricted to the cluster, and the shortest path tree of every node is kept, so turning an abstract path back
+// into cells is a walk down cached trees rather than a search.
+//
+// the abstract graph is kept in a compact form per cluster: its node ids, a dense node to node cost matrix, and
+// the trees; each node also links to its partner across the border. a cost change only marks its cluster, and
+// Path_Update rebuilds the marked clusters, their borders, and the neighbours sharing those borders.
+//
+// searches read the graph only, so any number may run at once, each with its own pathSearch_s, as long as no
+// Path_SetCost or Path_Update runs at the same time.
+
+typedef struct path_s path_s;
+typedef struct pathSearch_s pathSearch_s;
+
+static constexpr uint8_t kPath_Wall = 255;
+static constexpr int32_t kPath_ClusterSize = 16;
+
+// returns nullptr on failure. every cell starts at cost 1, and the abstract graph is built on the first update.
+path_s * Path_Create( const vec2_s< size_t > size );
+
+void Path_Destroy( path_s * const path );
+
+// a cost of 0 is stored as 1. takes effect at the next Path_Update.
+void Path_SetCost( path_s * const path, const vec2_s< int32_t > cell, const uint8_t cost );
+
+uint8_t Path_GetCost( const path_s * const path, const vec2_s< int32_t > cell );
+
+// rebuilds the clusters touched by cost changes. returns the number of clusters rebuilt, or SIZE_MAX if out of
+// memory, in which case the graph is left marked for another try.
+size_t Path_Update( path_s * const path );
+
+// scratch for one thread's searches; returns nullptr on failure
+pathSearch_s * Path_CreateSearch( void );
+
+void Path_DestroySearch( pathSearch_s * const search );
+
+// finds a path from start to goal and writes its first maxCells cells to cells, start and goal included. returns
+// the length of the whole path in cells, which can be larger than maxCells, or zero if there is none.
+size_t Path_Find( const path_s * const path, pathSearch_s * const search, const vec2_s< int32_t > start, const vec2_s< int32_t > goal,
+    vec2_s< int32_t > * const cells, const size_t maxCells );
+
+#endif // ___RTSFS_PATH_H___
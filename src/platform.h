@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_PLATFORM_H___
+#define ___RTSFS_PLATFORM_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// the platform layer: an os window (or none), the presentation surfaces, and the pacing clock.
+//
+// exactly one backend is linked in:
+//   platform_win32.cpp    - gdi window; renders straight into dib sections and BitBlts only the dirty area; the
+//                           clock is Timer_Nanoseconds
+//   platform_headless.cpp - no window; surfaces optionally in named shared memory (platformShared_s) for an
+//                           external viewer or capture process, optional ppm frame dumps, and a virtual clock that
+//                           Platform_WaitUntil advances instead of waiting, so runs are deterministic and as fast
+//                           as the cpu allows. runs that never wait step the clock on every pump instead.
+//
+// the backend owns the os entry point and calls App_Main with the command line.
+//
+// presentation is a lock-free triple buffer (triplebuffer.h): one thread renders into the back buffer and
+// publishes it with Platform_Present, while the thread pumping events shows the newest published buffer. the two
+// may be the same thread. neither ever blocks on the other, and a buffer is never shown while it is rendered.
+
+typedef struct platform_s platform_s;
+
+typedef struct platformDesc_s {
+    const char * title = "RTS From Scratch";
+    vec2_s< size_t > size{ 1024, 768 }; // client area in pixels
+    const char * dumpPath = nullptr;    // headless: prefix of ppm frame dumps, nullptr for none
+    size_t dumpEvery = 1;               // headless: dump one of every this many presented frames
+    const char * sharedName = nullptr;  // headless: shm_open name of the framebuffer, nullptr for private memory
+    uint64_t pumpStepNs = 0;            // headless: virtual nanoseconds each Platform_PumpEvents adds to the clock,
+                                        // for runs that never call Platform_WaitUntil; 0 for none
+} platformDesc_s;
+
+// headless: layout of the shared framebuffer. the header is followed by the three surfaces at pixelOffset, each
+// stride * height pixels, one after another. a viewer reads sequence, waits for it to be even, reads shown and
+// dirty, copies what it needs from surface shown, and keeps the copy only if sequence is unchanged afterwards.
+static constexpr uint32_t kPlatform_SharedMagic = 0x46535452; // 'RTSF'
+static constexpr uint32_t kPlatform_SharedVersion = 1;
+
+typedef struct platformShared_s {
+    uint32_t magic = kPlatform_SharedMagic;
+    uint32_t version = kPlatform_SharedVersion;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0;      // pixels between rows
+    uint32_t pixelOffset = 0; // bytes from the start of the header to the first surface
+    std::atomic< uint32_t > sequence{ 0 }; // odd while shown and dirty are being updated
+    uint32_t shown = 0;       // surface holding the newest shown frame
+    uint32_t dirty[ 4 ] = {}; // min x, min y, max x, max y (inclusive) that changed since the previous shown frame;
+                              // a min past its max if nothing did
+} platformShared_s;
+
+typedef struct platformSurface_s {
+    rgba_s * pixels = nullptr; // nullptr if there is nothing to render into yet
+    size_t stride = 0;         // pixels between rows
+    vec2_s< size_t > size;
+} platformSurface_s;
+
+// implemented by the application
+int App_Main( const size_t argc, const char * const * const argv );
+
+// returns nullptr on failure
+platform_s * Platform_Create( const platformDesc_s * const desc );
+
+void Platform_Destroy( platform_s * const platform );
+
+// pump thread: handles pending os events, showing the newest presented frame. returns zero when the application
+// should quit.
+int Platform_PumpEvents( platform_s * const platform );
+
+// pump thread: nonzero if a frame newer than the last one reported has been shown; stamp receives the value it was
+// presented with
+int Platform_TakeShown( platform_s * const platform, uint64_t * const stamp );
+
+// render thread: the surface to render the next frame into. valid until Platform_Present.
+platformSurface_s Platform_GetBackBuffer( platform_s * const platform );
+
+// render thread: publishes the back buffer as the newest frame and moves on to a free surface. dirty bounds what
+// changed since the previous frame, nullptr for everything and an empty rect (min past max) for nothing; only that
+// area is copied out. every surface is still
+// expected to be rendered in full. stamp is opaque to the platform and handed back by Platform_TakeShown.
+void Platform_Present( platform_s * const platform, const rect_s< size_t > * const dirty, const uint64_t stamp );
+
+// the clock frame deadlines are measured against, in nanoseconds
+uint64_t Platform_GetNanoseconds( platform_s * const platform );
+
+// returns once Platform_GetNanoseconds() >= deadline
+void Platform_WaitUntil( platform_s * const platform, const uint64_t deadline );
+
+#endif // ___RTSFS_PLATFORM_H___
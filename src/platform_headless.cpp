@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if !defined( _WIN32 )
+
+#include "platform.h"
+#include "mem.h"
+#include "triplebuffer.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <new>
+
+// the header is padded so every surface starts on a cache line
+static constexpr size_t kPlatform_SharedHeaderSize = ( sizeof( platformShared_s ) + 63 ) & ~( size_t )63;
+
+typedef struct platform_s {
+    platformShared_s * shared = nullptr; // mapping holding the header and all three surfaces
+    size_t sharedSize = 0;
+    const char * sharedName = nullptr;   // unlinked on destroy
+    rgba_s * buffers[ 3 ] = {};
+    uint64_t stamps[ 3 ] = {};
+    rect_s< size_t > dirty[ 3 ];         // change since the previous published frame, including skipped ones
+    tripleBuffer_s swap;
+    uint64_t shownStamp = 0;
+    int shownFresh = 0;
+    size_t width = 0;
+    size_t height = 0;
+    const char * dumpPath = nullptr;
+    size_t dumpEvery = 1;
+    uint8_t * dumpRow = nullptr; // one row of rgb for the ppm writer
+    size_t presented = 0;        // render thread
+    uint64_t clock = 0;          // virtual nanoseconds, advanced by Platform_WaitUntil and pumpStep
+    uint64_t pumpStep = 0;       // added to clock by every Platform_PumpEvents
+} platform_s;
+
+static void DumpFrame( platform_s * const me, const rgba_s * const pixels ) {
+    char name[ 1024 ];
+    snprintf( name, sizeof( name ), "%s%06zu.ppm", me->dumpPath, me->presented );
+
+    FILE * const file = fopen( name, "wb" );
+    if ( file == nullptr ) {
+        return;
+    }
+
+    fprintf( file, "P6\n%zu %zu\n255\n", me->width, me->height );
+
+    for ( size_t y = 0; y < me->height; y++ ) {
+        const rgba_s * const src = pixels + y * me->width;
+        uint8_t * dst = me->dumpRow;
+        for ( size_t x = 0; x < me->width; x++ ) {
+            *dst++ = src[ x ].r;
+            *dst++ = src[ x ].g;
+            *dst++ = src[ x ].b;
+        }
+        fwrite( me->dumpRow, 3, me->width, file );
+    }
+
+    fclose( file );
+}
+
+platform_s * Platform_Create( const platformDesc_s * const desc ) {
+    if ( desc == nullptr || desc->size.x == 0 || desc->size.y == 0 ) {
+        return nullptr;
+    }
+
+    platform_s * const me = ( platform_s * )Mem_Alloc( kMemTag_Other, sizeof( platform_s ) );
+    if ( me == nullptr ) {
+        return nullptr;
+    }
+
+    new ( me ) platform_s;
+
+    me->width = desc->size.x;
+    me->height = desc->size.y;
+    me->dumpPath = desc->dumpPath;
+    me->dumpEvery = desc->dumpEvery ? desc->dumpEvery : 1;
+    me->pumpStep = desc->pumpStepNs;
+
+    const size_t surfaceSize = me->width * me->height * sizeof( rgba_s );
+    me->sharedSize = kPlatform_SharedHeaderSize + surfaceSize * 3;
+
+    void * mapping = MAP_FAILED;
+    if ( desc->sharedName != nullptr ) {
+        const int fd = shm_open( desc->sharedName, O_CREAT | O_RDWR, 0600 );
+        if ( fd >= 0 ) {
+            if ( ftruncate( fd, ( off_t )me->sharedSize ) == 0 ) {
+                mapping = mmap( nullptr, me->sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+            }
+            close( fd );
+            if ( mapping == MAP_FAILED ) {
+                shm_unlink( desc->sharedName );
+            } else {
+                me->sharedName = desc->sharedName;
+            }
+        }
+    } else {
+        mapping = mmap( nullptr, me->sharedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    }
+
+    if ( mapping == MAP_FAILED ) {
+        Platform_Destroy( me );
+        return nullptr;
+    }
+
+    Mem_TrackExternal( kMemTag_Surface, me->sharedSize );
+
+    me->shared = new ( mapping ) platformShared_s;
+    me->shared->width = ( uint32_t )me->width;
+    me->shared->height = ( uint32_t )me->height;
+    me->shared->stride = ( uint32_t )me->width;
+    me->shared->pixelOffset = ( uint32_t )kPlatform_SharedHeaderSize;
+    me->shared->shown = TripleBuffer_GetReadSlot( &me->swap );
+
+    for ( size_t i = 0; i < 3; i++ ) {
+        me->buffers[ i ] = ( rgba_s * )( ( uint8_t * )mapping + kPlatform_SharedHeaderSize + surfaceSize * i );
+        me->dirty[ i ] = rectFrom( vec2_zero< size_t >(), vec2_s< size_t >{ me->width, me->height } );
+    }
+
+    if ( me->dumpPath != nullptr ) {
+        me->dumpRow = ( uint8_t * )Mem_Alloc( kMemTag_Surface, me->width * 3 );
+        if ( me->dumpRow == nullptr ) {
+            Platform_Destroy( me );
+            return nullptr;
+        }
+    }
+
+    return me;
+}
+
+void Platform_Destroy( platform_s * const platform ) {
+    if ( platform == nullptr ) {
+        return;
+    }
+
+    if ( platform->shared != nullptr ) {
+        platform->shared->~platformShared_s();
+        munmap( platform->shared, platform->sharedSize );
+        Mem_UntrackExternal( kMemTag_Surface, platform->sharedSize );
+    }
+    if ( platform->sharedName != nullptr ) {
+        shm_unlink( platform->sharedName );
+    }
+
+    Mem_Free( platform->dumpRow );
+    Mem_Free( platform );
+}
+
+int Platform_PumpEvents( platform_s * const platform ) {
+    if ( platform == nullptr ) {
+        return 1;
+    }
+
+    platform->clock += platform->pumpStep;
+
+    // there is no display; showing means pointing the shared header at the newest frame
+    if ( TripleBuffer_Acquire( &platform->swap ) ) {
+        const uint32_t slot = TripleBuffer_GetReadSlot( &platform->swap );
+        const rect_s< size_t > dirty = platform->dirty[ slot ];
+
+        platformShared_s * const shared = platform->shared;
+        shared->sequence.fetch_add( 1, std::memory_order_acq_rel );
+        shared->shown = slot;
+        shared->dirty[ 0 ] = ( uint32_t )dirty.mn.x;
+        shared->dirty[ 1 ] = ( uint32_t )dirty.mn.y;
+        shared->dirty[ 2 ] = ( uint32_t )dirty.mx.x;
+        shared->dirty[ 3 ] = ( uint32_t )dirty.mx.y;
+        shared->sequence.fetch_add( 1, std::memory_order_release );
+
+        platform->shownStamp = platform->stamps[ slot ];
+        platform->shownFresh = 1;
+    }
+
+    return 1;
+}
+
+int Platform_TakeShown( platform_s * const platform, uint64_t * const stamp ) {
+    if ( platform == nullptr || platform->shownFresh == 0 ) {
+        return 0;
+    }
+
+    platform->shownFresh = 0;
+    if ( stamp != nullptr ) {
+        *stamp = platform->shownStamp;
+    }
+
+    return 1;
+}
+
+platformSurface_s Platform_GetBackBuffer( platform_s * const platform ) {
+    platformSurface_s surface;
+
+    if ( platform == nullptr ) {
+        return surface;
+    }
+
+    surface.pixels = platform->buffers[ TripleBuffer_GetWriteSlot( &platform->swap ) ];
+    surface.stride = platform->width;
+    surface.size = { platform->width, platform->height };
+
+    return surface;
+}
+
+void Platform_Present( platform_s * const platform, const rect_s< size_t > * const dirty, const uint64_t stamp ) {
+    if ( platform == nullptr ) {
+        return;
+    }
+
+    const uint32_t slot = TripleBuffer_GetWriteSlot( &platform->swap );
+
+    rect_s< size_t > changed = rectFrom( vec2_zero< size_t >(), vec2_s< size_t >{ platform->width, platform->height } );
+    if ( dirty != nullptr ) {
+        changed.mn.x = dirty->mn.x;
+        changed.mn.y = dirty->mn.y;
+        changed.mx.x = dirty->mx.x < changed.mx.x ? dirty->mx.x : changed.mx.x;
+        changed.mx.y = dirty->mx.y < changed.mx.y ? dirty->mx.y : changed.mx.y;
+    }
+
+    // a frame the pump never picked up is replaced by this one, so its changes have to be carried over
+    uint32_t pending;
+    if ( TripleBuffer_IsPending( &platform->swap, &pending ) ) {
+        const rect_s< size_t > skipped = platform->dirty[ pending ];
+        if ( changed.mn.x > changed.mx.x || changed.mn.y > changed.mx.y ) {
+            changed = skipped;
+        } else if ( skipped.mn.x <= skipped.mx.x && skipped.mn.y <= skipped.mx.y ) {
+            changed.mn.x = skipped.mn.x < changed.mn.x ? skipped.mn.x : changed.mn.x;
+            changed.mn.y = skipped.mn.y < changed.mn.y ? skipped.mn.y : changed.mn.y;
+            changed.mx.x = skipped.mx.x > changed.mx.x ? skipped.mx.x : changed.mx.x;
+            changed.mx.y = skipped.mx.y > changed.mx.y ? skipped.mx.y : changed.mx.y;
+        }
+    }
+    platform->dirty[ slot ] = changed;
+
+    // dumped from the render thread so every presented frame is eligible, not just the ones the pump sees
+    if ( platform->dumpPath != nullptr && platform->presented % platform->dumpEvery == 0 ) {
+        DumpFrame( platform, platform->buffers[ slot ] );
+    }
+
+    platform->stamps[ slot ] = stamp;
+    TripleBuffer_Publish( &platform->swap );
+
+    platform->presented++;
+}
+
+uint64_t Platform_GetNanoseconds( platform_s * const platform ) {
+    return platform ? platform->clock : 0;
+}
+
+void Platform_WaitUntil( platform_s * const platform, const uint64_t deadline ) {
+    if ( platform != nullptr && platform->clock < deadline ) {
+        platform->clock = deadline;
+    }
+}
+
+int main( int argc, char ** argv ) {
+    return App_Main( ( size_t )argc, argv );
+}
+
+#endif // !defined( _WIN32 )
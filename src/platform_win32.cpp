@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if defined( _WIN32 )
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <timeapi.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "platform.h"
+#include "mem.h"
+#include "timer.h"
+#include "triplebuffer.h"
+
+#pragma comment( lib, "winmm.lib" )
+
+typedef struct platform_s {
+    HWND wnd = nullptr;
+    HDC dcs[ 3 ] = {};          // a memory dc per surface with its dib section selected
+    HBITMAP dibs[ 3 ] = {};
+    HGDIOBJ previous[ 3 ] = {}; // what the dcs held before, restored before deleting them
+    rgba_s * pixels[ 3 ] = {};  // the dib section bits, rendered into directly
+    uint64_t stamps[ 3 ] = {};
+    tripleBuffer_s swap;
+    uint64_t shownStamp = 0;    // pump thread
+    int shownFresh = 0;
+    size_t width = 0;           // fixed at creation; the window has no sizing border
+    size_t height = 0;
+} platform_s;
+
+static const char * const windowClassName = "rtsfs";
+
+static void FreeBuffers( platform_s * const me ) {
+    for ( size_t i = 0; i < 3; i++ ) {
+        if ( me->dcs[ i ] != nullptr ) {
+            SelectObject( me->dcs[ i ], me->previous[ i ] );
+            DeleteDC( me->dcs[ i ] );
+            me->dcs[ i ] = nullptr;
+        }
+        if ( me->dibs[ i ] != nullptr ) {
+            DeleteObject( me->dibs[ i ] );
+            me->dibs[ i ] = nullptr;
+        }
+        if ( me->pixels[ i ] != nullptr ) {
+            Mem_UntrackExternal( kMemTag_Surface, me->width * me->height * sizeof( rgba_s ) );
+            me->pixels[ i ] = nullptr;
+        }
+    }
+}
+
+// top down 32 bit dib sections, so the gdi bitmap and the surface the game renders into are the same memory and
+// WM_PAINT is a single BitBlt of the dirty area
+static void CreateBuffers( platform_s * const me, const size_t width, const size_t height ) {
+    FreeBuffers( me );
+
+    me->width = width;
+    me->height = height;
+
+    BITMAPINFO bmi;
+    memset( &bmi, 0, sizeof( bmi ) );
+    bmi.bmiHeader.biSize = sizeof( BITMAPINFOHEADER );
+    bmi.bmiHeader.biWidth = ( LONG )me->width;
+    bmi.bmiHeader.biHeight = -( LONG )me->height; // vertically flip
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    HDC const screen = GetDC( nullptr );
+
+    for ( size_t i = 0; i < 3; i++ ) {
+        void * bits = nullptr;
+        me->dibs[ i ] = CreateDIBSection( screen, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0 );
+        if ( me->dibs[ i ] == nullptr ) {
+            continue;
+        }
+        me->dcs[ i ] = CreateCompatibleDC( screen );
+        if ( me->dcs[ i ] == nullptr ) {
+            DeleteObject( me->dibs[ i ] );
+            me->dibs[ i ] = nullptr;
+            continue;
+        }
+        me->previous[ i ] = SelectObject( me->dcs[ i ], me->dibs[ i ] );
+        me->pixels[ i ] = ( rgba_s * )bits;
+        Mem_TrackExternal( kMemTag_Surface, me->width * me->height * sizeof( rgba_s ) );
+    }
+
+    ReleaseDC( nullptr, screen );
+}
+
+static LRESULT CALLBACK myWindowProc( HWND wnd, UINT msg, WPARAM wp, LPARAM lp ) {
+    switch ( msg ) {
+        case WM_CREATE: {
+            CREATESTRUCT * const cs = ( CREATESTRUCT * )lp;
+            platform_s * const me = ( platform_s * )cs->lpCreateParams;
+            SetWindowLongPtr( wnd, GWLP_USERDATA, ( LONG_PTR )me );
+        } break;
+
+        case WM_PAINT: {
+            PAINTSTRUCT ps;
+            HDC const dc = BeginPaint( wnd, &ps );
+
+            platform_s * const me = ( platform_s * )GetWindowLongPtr( wnd, GWLP_USERDATA );
+
+            // the buffers are shared with the render thread, so they are never reallocated here
+            if ( TripleBuffer_Acquire( &me->swap ) ) {
+                me->shownStamp = me->stamps[ TripleBuffer_GetReadSlot( &me->swap ) ];
+                me->shownFresh = 1;
+            }
+
+            // the update region is the union of every dirty rect presented since the last paint
+            HDC const src = me->dcs[ TripleBuffer_GetReadSlot( &me->swap ) ];
+            if ( src != nullptr ) {
+                BitBlt( dc,
+                        ps.rcPaint.left,
+                        ps.rcPaint.top,
+                        ps.rcPaint.right - ps.rcPaint.left,
+                        ps.rcPaint.bottom - ps.rcPaint.top,
+                        src,
+                        ps.rcPaint.left,
+                        ps.rcPaint.top,
+                        SRCCOPY );
+            }
+
+            EndPaint( wnd, &ps );
+        } break;
+
+        case WM_CLOSE:
+            PostQuitMessage( 0 );
+            break;
+    }
+
+    return DefWindowProc( wnd, msg, wp, lp );
+}
+
+static ATOM registerWindowClass( const char * const classname ) {
+    WNDCLASSEXA wndClass;
+    memset( &wndClass, 0, sizeof( wndClass ) );
+    wndClass.cbSize = sizeof( wndClass );
+    wndClass.style = CS_HREDRAW | CS_VREDRAW;
+    wndClass.lpfnWndProc = myWindowProc;
+    wndClass.hInstance = GetModuleHandle( nullptr );
+    wndClass.lpszClassName = classname;
+    return RegisterClassExA( &wndClass );
+}
+
+static void unregisterWindowClass( const char * const classname ) {
+    UnregisterClassA( classname, GetModuleHandle( nullptr ) );
+}
+
+platform_s * Platform_Create( const platformDesc_s * const desc ) {
+    if ( desc == nullptr ) {
+        return nullptr;
+    }
+
+    if ( registerWindowClass( windowClassName ) == 0 ) {
+        return nullptr;
+    }
+
+    // 1 ms scheduler granularity so Timer_WaitUntil can sleep most of a frame and only spin the tail
+    timeBeginPeriod( 1 );
+
+    platform_s * const me = ( platform_s * )Mem_Alloc( kMemTag_Other, sizeof( platform_s ) );
+    if ( me == nullptr ) {
+        timeEndPeriod( 1 );
+        unregisterWindowClass( windowClassName );
+        return nullptr;
+    }
+
+    new ( me ) platform_s;
+
+    const DWORD style = WS_VISIBLE | WS_CAPTION | WS_SYSMENU;
+    RECT outer = { 0, 0, ( LONG )desc->size.x, ( LONG )desc->size.y };
+    AdjustWindowRectEx( &outer, style, FALSE, 0 );
+
+    me->wnd = CreateWindowExA( 0,
+                               windowClassName,
+                               desc->title,
+                               style,
+                               0,
+                               0,
+                               outer.right - outer.left,
+                               outer.bottom - outer.top,
+                               nullptr,
+                               nullptr,
+                               GetModuleHandle( nullptr ),
+                               me );
+
+    if ( me->wnd == nullptr ) {
+        Platform_Destroy( me );
+        return nullptr;
+    }
+
+    RECT r;
+    GetClientRect( me->wnd, &r );
+    CreateBuffers( me, ( size_t )( r.right - r.left ), ( size_t )( r.bottom - r.top ) );
+
+    return me;
+}
+
+void Platform_Destroy( platform_s * const platform ) {
+    if ( platform == nullptr ) {
+        return;
+    }
+
+    FreeBuffers( platform );
+
+    if ( platform->wnd != nullptr ) {
+        DestroyWindow( platform->wnd );
+    }
+
+    Mem_Free( platform );
+
+    timeEndPeriod( 1 );
+    unregisterWindowClass( windowClassName );
+}
+
+int Platform_PumpEvents( platform_s * const platform ) {
+    ( void )platform;
+
+    MSG msg;
+    while ( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) ) {
+        if ( msg.message == WM_QUIT ) {
+            return 0;
+        }
+        TranslateMessage( &msg );
+        DispatchMessage( &msg );
+    }
+
+    return 1;
+}
+
+int Platform_TakeShown( platform_s * const platform, uint64_t * const stamp ) {
+    if ( platform == nullptr || platform->shownFresh == 0 ) {
+        return 0;
+    }
+
+    platform->shownFresh = 0;
+    if ( stamp != nullptr ) {
+        *stamp = platform->shownStamp;
+    }
+
+    return 1;
+}
+
+platformSurface_s Platform_GetBackBuffer( platform_s * const platform ) {
+    platformSurface_s surface;
+
+    if ( platform == nullptr ) {
+        return surface;
+    }
+
+    rgba_s * const pixels = platform->pixels[ TripleBuffer_GetWriteSlot( &platform->swap ) ];
+    if ( pixels == nullptr ) {
+        return surface;
+    }
+
+    surface.pixels = pixels;
+    surface.stride = platform->width;
+    surface.size = { platform->width, platform->height };
+
+    return surface;
+}
+
+void Platform_Present( platform_s * const platform, const rect_s< size_t > * const dirty, const uint64_t stamp ) {
+    if ( platform == nullptr ) {
+        return;
+    }
+
+    platform->stamps[ TripleBuffer_GetWriteSlot( &platform->swap ) ] = stamp;
+    TripleBuffer_Publish( &platform->swap );
+
+    // safe from any thread; the paint is handled by the pump thread. invalidating after publishing means a paint
+    // that misses this frame is followed by one that shows it.
+    if ( dirty != nullptr ) {
+        if ( dirty->mn.x > dirty->mx.x || dirty->mn.y > dirty->mx.y ) {
+            return;
+        }
+        const RECT r = { ( LONG )dirty->mn.x, ( LONG )dirty->mn.y, ( LONG )dirty->mx.x + 1, ( LONG )dirty->mx.y + 1 };
+        InvalidateRect( platform->wnd, &r, FALSE );
+    } else {
+        InvalidateRect( platform->wnd, nullptr, FALSE );
+    }
+}
+
+uint64_t Platform_GetNanoseconds( platform_s * const platform ) {
+    ( void )platform;
+    return Timer_Nanoseconds();
+}
+
+void Platform_WaitUntil( platform_s * const platform, const uint64_t deadline ) {
+    ( void )platform;
+    Timer_WaitUntil( deadline );
+}
+
+int __stdcall WinMain( HINSTANCE inst, HINSTANCE prev, char * cmdline, int show ) {
+    ( void )inst;
+    ( void )prev;
+    ( void )cmdline;
+    ( void )show;
+
+    return App_Main( ( size_t )__argc, __argv );
+}
+
+#endif // defined( _WIN32 )
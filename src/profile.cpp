@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "profile.h"
+#include "mem.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+static constexpr size_t kProfile_RingSize = 16384;            // zones per thread between frame marks
+static constexpr size_t kProfile_MaxZones = 256;               // distinct zone names
+static constexpr size_t kProfile_MaxFrames = 4096;             // per-frame totals kept per zone, newest win
+static constexpr size_t kProfile_MaxCapture = 1024 * 1024;     // trace events kept, later ones are dropped
+static constexpr uint64_t kProfile_CalibrateNs = 1000000;
+
+typedef struct profileEvent_s {
+    const char * name;
+    uint64_t begin;
+    uint64_t end;
+} profileEvent_s;
+
+// single producer (the owning thread), single consumer (Profile_FrameMark)
+typedef struct profileRing_s {
+    profileEvent_s event[ kProfile_RingSize ];
+    std::atomic< size_t > head{ 0 }; // written by the owner
+    std::atomic< size_t > tail{ 0 }; // written by the consumer
+    std::atomic< uint64_t > dropped{ 0 };
+    uint32_t tid = 0;
+    profileRing_s * next = nullptr;
+} profileRing_s;
+
+typedef struct profileCaptured_s {
+    const char * name; // nullptr marks a frame boundary
+    uint64_t begin;
+    uint64_t end;
+    uint32_t tid;
+} profileCaptured_s;
+
+typedef struct profileZoneData_s {
+    const char * name = nullptr;
+    uint64_t calls = 0;
+    uint64_t frameTicks = 0; // accumulated for the frame being drained
+    int inFrame = 0;
+    uint32_t * frameNs = nullptr; // ring of per-frame totals
+    size_t frameCount = 0;        // total frames recorded, frameNs holds the last kProfile_MaxFrames
+} profileZoneData_s;
+
+typedef struct profile_s {
+    std::atomic< profileRing_s * > rings{ nullptr };
+    std::atomic< uint32_t > nextTid{ 0 };
+    double nsPerTick = 1.0;
+    int calibrated = 0;
+    profileZoneData_s zone[ kProfile_MaxZones ];
+    size_t zoneCount = 0;
+    profileCaptured_s * capture = nullptr;
+    size_t captureCount = 0;
+    size_t captureSize = 0;
+    uint64_t captureDropped = 0;
+    uint64_t epoch = 0; // ticks at the first enable, trace time zero
+} profile_s;
+
+std::atomic< int > profileEnabled{ 0 };
+
+static profile_s profile;
+
+static thread_local profileRing_s * threadRing = nullptr;
+
+static profileRing_s * CreateRing( void ) {
+    profileRing_s * const ring = ( profileRing_s * )Mem_Alloc( kMemTag_Profile, sizeof( profileRing_s ) );
+    if ( ring == nullptr ) {
+        return nullptr;
+    }
+
+    new ( ring ) profileRing_s;
+    ring->tid = profile.nextTid.fetch_add( 1, std::memory_order_relaxed );
+
+    profileRing_s * head = profile.rings.load( std::memory_order_relaxed );
+    do {
+        ring->next = head;
+    } while ( !profile.rings.compare_exchange_weak( head, ring, std::memory_order_release, std::memory_order_relaxed ) );
+
+    return ring;
+}
+
+void Profile_Record( const char * const name, const uint64_t begin, const uint64_t end ) {
+    profileRing_s * ring = threadRing;
+    if ( ring == nullptr ) {
+        ring = CreateRing();
+        if ( ring == nullptr ) {
+            return;
+        }
+        threadRing = ring;
+    }
+
+    const size_t head = ring->head.load( std::memory_order_relaxed );
+    if ( head - ring->tail.load( std::memory_order_acquire ) >= kProfile_RingSize ) {
+        ring->dropped.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    profileEvent_s * const event = ring->event + ( head % kProfile_RingSize );
+    event->name = name;
+    event->begin = begin;
+    event->end = end;
+
+    ring->head.store( head + 1, std::memory_order_release );
+}
+
+static void Calibrate( void ) {
+#if defined( RTSFS_PROFILE_RDTSC )
+    const uint64_t ns0 = Timer_Nanoseconds();
+    const uint64_t tick0 = Profile_Ticks();
+    uint64_t ns1;
+    do {
+        ns1 = Timer_Nanoseconds();
+    } while ( ns1 - ns0 < kProfile_CalibrateNs );
+    const uint64_t tick1 = Profile_Ticks();
+    profile.nsPerTick = ( double )( ns1 - ns0 ) / ( double )( tick1 - tick0 );
+#else
+    profile.nsPerTick = 1.0;
+#endif
+    profile.calibrated = 1;
+    profile.epoch = Profile_Ticks();
+}
+
+void Profile_SetEnabled( const int enabled ) {
+    if ( enabled && !profile.calibrated ) {
+        Calibrate();
+    }
+    profileEnabled.store( enabled ? 1 : 0, std::memory_order_relaxed );
+}
+
+static profileZoneData_s * FindZone( const char * const name ) {
+    // pointers first, since the same literal almost always has one address; then by contents, since it need not
+    for ( size_t i = 0; i < profile.zoneCount; i++ ) {
+        if ( profile.zone[ i ].name == name ) {
+            return profile.zone + i;
+        }
+    }
+    for ( size_t i = 0; i < profile.zoneCount; i++ ) {
+        if ( strcmp( profile.zone[ i ].name, name ) == 0 ) {
+            return profile.zone + i;
+        }
+    }
+
+    if ( profile.zoneCount == kProfile_MaxZones ) {
+        return nullptr;
+    }
+
+    uint32_t * const frameNs = ( uint32_t * )Mem_Alloc( kMemTag_Profile, sizeof( uint32_t ) * kProfile_MaxFrames );
+    if ( frameNs == nullptr ) {
+        return nullptr;
+    }
+
+    profileZoneData_s * const zone = profile.zone + profile.zoneCount++;
+    zone->name = name;
+    zone->frameNs = frameNs;
+    return zone;
+}
+
+static void Capture( const char * const name, const uint64_t begin, const uint64_t end, const uint32_t tid ) {
+    if ( profile.captureCount == profile.captureSize ) {
+        if ( profile.captureSize == kProfile_MaxCapture ) {
+            profile.captureDropped++;
+            return;
+        }
+        const size_t size = profile.captureSize ? profile.captureSize * 2 : 4096;
+        profileCaptured_s * const capture = ( profileCaptured_s * )Mem_Realloc( kMemTag_Profile, profile.capture, sizeof( profileCaptured_s ) * size );
+        if ( capture == nullptr ) {
+            profile.captureDropped++;
+            return;
+        }
+        profile.capture = capture;
+        profile.captureSize = size;
+    }
+
+    profileCaptured_s * const captured = profile.capture + profile.captureCount++;
+    captured->name = name;
+    captured->begin = begin;
+    captured->end = end;
+    captured->tid = tid;
+}
+
+void Profile_FrameMark( void ) {
+    if ( !profile.calibrated ) {
+        return;
+    }
+
+    const uint64_t now = Profile_Ticks();
+
+    // the last zone most likely to be hit first; a one entry cache saves most FindZone scans
+    profileZoneData_s * last = nullptr;
+
+    for ( profileRing_s * ring = profile.rings.load( std::memory_order_acquire ); ring != nullptr; ring = ring->next ) {
+        const size_t head = ring->head.load( std::memory_order_acquire );
+        for ( size_t i = ring->tail.load( std::memory_order_relaxed ); i != head; i++ ) {
+            const profileEvent_s * const event = ring->event + ( i % kProfile_RingSize );
+            profileZoneData_s * const zone = ( last != nullptr && last->name == event->name ) ? last : FindZone( event->name );
+            if ( zone != nullptr ) {
+                zone->calls++;
+                zone->frameTicks += event->end - event->begin;
+                zone->inFrame = 1;
+                last = zone;
+            }
+            Capture( event->name, event->begin, event->end, ring->tid );
+        }
+        ring->tail.store( head, std::memory_order_release );
+    }
+
+    for ( size_t i = 0; i < profile.zoneCount; i++ ) {
+        profileZoneData_s * const zone = profile.zone + i;
+        if ( !zone->inFrame ) {
+            continue;
+        }
+        const double ns = ( double )zone->frameTicks * profile.nsPerTick;
+        zone->frameNs[ zone->frameCount % kProfile_MaxFrames ] = ns < 4294967295.0 ? ( uint32_t )ns : UINT32_MAX;
+        zone->frameCount++;
+        zone->frameTicks = 0;
+        zone->inFrame = 0;
+    }
+
+    Capture( nullptr, now, now, 0 );
+}
+
+int Profile_WriteTrace( const char * const path ) {
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, path, "wb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( path, "wb" );
+#endif
+    if ( file == nullptr ) {
+        return 0;
+    }
+
+    // chrome wants microseconds; three decimals keeps nanosecond resolution
+    const double usPerTick = profile.nsPerTick / 1000.0;
+
+    fprintf( file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+    for ( size_t i = 0; i < profile.captureCount; i++ ) {
+        const profileCaptured_s * const e = profile.capture + i;
+        const double ts = ( double )( e->begin - profile.epoch ) * usPerTick;
+        const char * const separator = i + 1 < profile.captureCount ? "," : "";
+        if ( e->name == nullptr ) {
+            fprintf( file, "{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}%s\n", ts, separator );
+        } else {
+            const double dur = ( double )( e->end - e->begin ) * usPerTick;
+            fprintf( file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n", e->name,
+                e->tid, ts, dur, separator );
+        }
+    }
+    uint64_t dropped = profile.captureDropped;
+    for ( profileRing_s * ring = profile.rings.load( std::memory_order_acquire ); ring != nullptr; ring = ring->next ) {
+        dropped += ring->dropped.load( std::memory_order_relaxed );
+    }
+    fprintf( file, "],\"otherData\":{\"droppedZones\":%llu}}\n", ( unsigned long long )dropped );
+
+    const int ok = ferror( file ) == 0;
+    fclose( file );
+    return ok;
+}
+
+size_t Profile_GetSummary( profileZoneStats_s * const stats, const size_t capacity ) {
+    const size_t count = profile.zoneCount < capacity ? profile.zoneCount : capacity;
+
+    uint32_t * const sorted = ( uint32_t * )Mem_Alloc( kMemTag_Profile, sizeof( uint32_t ) * kProfile_MaxFrames );
+    if ( sorted == nullptr ) {
+        return 0;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const profileZoneData_s * const zone = profile.zone + i;
+        const size_t n = zone->frameCount < kProfile_MaxFrames ? zone->frameCount : kProfile_MaxFrames;
+
+        profileZoneStats_s * const out = stats + i;
+        out->name = zone->name;
+        out->frames = zone->frameCount;
+        out->calls = zone->calls;
+        out->minNs = out->p50Ns = out->p99Ns = out->maxNs = 0;
+        if ( n == 0 ) {
+            continue;
+        }
+
+        memcpy( sorted, zone->frameNs, sizeof( uint32_t ) * n );
+        std::sort( sorted, sorted + n );
+        out->minNs = sorted[ 0 ];
+        out->p50Ns = sorted[ n / 2 ];
+        out->p99Ns = sorted[ ( n * 99 ) / 100 ];
+        out->maxNs = sorted[ n - 1 ];
+    }
+
+    Mem_Free( sorted );
+
+    std::sort( stats, stats + count, []( const profileZoneStats_s & a, const profileZoneStats_s & b ) {
+        return a.p50Ns > b.p50Ns;
+    } );
+
+    return profile.zoneCount;
+}
+
+void Profile_Shutdown( void ) {
+    profileEnabled.store( 0, std::memory_order_relaxed );
+
+    profileRing_s * ring = profile.rings.exchange( nullptr, std::memory_order_acquire );
+    while ( ring != nullptr ) {
+        profileRing_s * const next = ring->next;
+        Mem_Free( ring );
+        ring = next;
+    }
+    threadRing = nullptr;
+
+    for ( size_t i = 0; i < profile.zoneCount; i++ ) {
+        Mem_Free( profile.zone[ i ].frameNs );
+        profile.zone[ i ] = profileZoneData_s();
+    }
+    profile.zoneCount = 0;
+
+    Mem_Free( profile.capture );
+    profile.capture = nullptr;
+    profile.captureCount = 0;
+    profile.captureSize = 0;
+    profile.captureDropped = 0;
+    profile.calibrated = 0;
+}
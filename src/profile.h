@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_PROFILE_H___
+#define ___RTSFS_PROFILE_H___
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#if defined( _M_X64 ) || defined( _M_IX86 )
+#define RTSFS_PROFILE_RDTSC 1
+#include <intrin.h>
+#elif defined( __i386__ ) || defined( __x86_64__ )
+#define RTSFS_PROFILE_RDTSC 1
+#include <x86intrin.h>
+#else
+#include "timer.h"
+#endif
+
+// hierarchical frame profiler. PROFILE_ZONE( "name" ) times the rest of the enclosing scope and records it in a
+// lock-free ring owned by the calling thread; Profile_FrameMark drains every ring once per frame into a chrome
+// trace capture and per-frame zone totals. names must be string literals or otherwise outlive the profiler.
+//
+// RTSFS_PROFILE 0 compiles zones out entirely. compiled in but disabled, a zone is a relaxed load and a branch on
+// entry and a branch on exit.
+
+#if !defined( RTSFS_PROFILE )
+#define RTSFS_PROFILE 1
+#endif
+
+typedef struct profileZoneStats_s {
+    const char * name = nullptr;
+    uint64_t frames = 0; // frames the zone ran in
+    uint64_t calls = 0;
+    uint64_t minNs = 0;  // per frame, summed over every call on every thread
+    uint64_t p50Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t maxNs = 0;
+} profileZoneStats_s;
+
+extern std::atomic< int > profileEnabled;
+
+// rdtsc where available; Profile_FrameMark converts to nanoseconds
+inline uint64_t Profile_Ticks( void ) {
+#if defined( RTSFS_PROFILE_RDTSC )
+    return __rdtsc();
+#else
+    return Timer_Nanoseconds();
+#endif
+}
+
+// stores one finished zone in the calling thread's ring; drops it if the ring is full
+void Profile_Record( const char * const name, const uint64_t begin, const uint64_t end );
+
+typedef struct profileZone_s {
+    const char * name;
+    uint64_t begin;
+
+    explicit profileZone_s( const char * const zoneName ) : name( zoneName ), begin( 0 ) {
+        if ( profileEnabled.load( std::memory_order_relaxed ) ) {
+            begin = Profile_Ticks();
+        }
+    }
+
+    ~profileZone_s() {
+        if ( begin != 0 ) {
+            Profile_Record( name, begin, Profile_Ticks() );
+        }
+    }
+} profileZone_s;
+
+#if RTSFS_PROFILE
+#define PROFILE_CONCAT_( a, b ) a##b
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT_( a, b )
+#define PROFILE_ZONE( name ) profileZone_s PROFILE_CONCAT( profileZone_, __LINE__ )( name )
+#else
+#define PROFILE_ZONE( name ) ( void )0
+#endif
+
+// starts or stops recording. the first enable calibrates the tick rate, which takes about a millisecond.
+void Profile_SetEnabled( const int enabled );
+
+// main thread, once per frame: drains every thread's ring, closes the current frame's zone totals and marks the
+// frame boundary in the trace
+void Profile_FrameMark( void );
+
+// writes everything captured so far as chrome / perfetto trace event json. returns nonzero on success.
+int Profile_WriteTrace( const char * const path );
+
+// fills up to capacity zones, slowest median first, and returns how many zones there are
+size_t Profile_GetSummary( profileZoneStats_s * const stats, const size_t capacity );
+
+// frees every ring and the capture. every other thread that recorded zones must have finished.
+void Profile_Shutdown( void );
+
+#endif // ___RTSFS_PROFILE_H___
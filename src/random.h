@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_RANDOM_H___
+#define ___RTSFS_RANDOM_H___
+
+#include "fixed.h"
+
+#include <stdint.h>
+
+// pcg32: 64 bits of state, 32 bit outputs, fully specified by integer math, so a seed replays the same sequence on
+// every machine. the sim owns one and is its only user; anything that isn't simulation (effects, ui) must take its
+// own, or it would shift the sim's sequence and desync.
+
+typedef struct random_s {
+    uint64_t state = 0x853c49e6748fea9bull;
+    uint64_t stream = 0xda3e39cb94b95bdbull; // odd
+} random_s;
+
+inline uint32_t Random_Next( random_s * const rng ) {
+    const uint64_t old = rng->state;
+    rng->state = old * 6364136223846793005ull + rng->stream;
+    const uint32_t xorshifted = ( uint32_t )( ( ( old >> 18 ) ^ old ) >> 27 );
+    const uint32_t rot = ( uint32_t )( old >> 59 );
+    return ( xorshifted >> rot ) | ( xorshifted << ( ( 0u - rot ) & 31 ) );
+}
+
+// streams with different ids are independent sequences for the same seed
+inline void Random_Seed( random_s * const rng, const uint64_t seed, const uint64_t streamId ) {
+    rng->state = 0;
+    rng->stream = ( streamId << 1 ) | 1;
+    Random_Next( rng );
+    rng->state += seed;
+    Random_Next( rng );
+}
+
+// uniform in [ 0, bound ), without modulo bias; bound must not be zero
+inline uint32_t Random_Below( random_s * const rng, const uint32_t bound ) {
+    const uint32_t threshold = ( 0u - bound ) % bound;
+    for ( ;; ) {
+        const uint64_t m = ( uint64_t )Random_Next( rng ) * bound;
+        if ( ( uint32_t )m >= threshold ) {
+            return ( uint32_t )( m >> 32 );
+        }
+    }
+}
+
+// uniform in [ lo, hi ] at full 16.16 resolution
+inline fixed_s Random_Fixed( random_s * const rng, const fixed_s lo, const fixed_s hi ) {
+    const uint32_t span = ( uint32_t )hi.raw - ( uint32_t )lo.raw;
+    const uint32_t offset = span == UINT32_MAX ? Random_Next( rng ) : Random_Below( rng, span + 1 );
+    return fixed_s{ ( int32_t )( ( uint32_t )lo.raw + offset ) };
+}
+
+#endif // ___RTSFS_RANDOM_H___
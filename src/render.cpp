@@ -0,0 +1,656 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "render.h"
+#include "arena.h"
+#include "blit.h"
+#include "job.h"
+#include "mem.h"
+#include "profile.h"
+#include "simd.h"
+#include "text.h"
+
+#include <memory.h>
+
+#include <algorithm>
+#include <new>
+
+static constexpr size_t kRender_Lists = kJob_MaxThreads + 1; // the last is shared by threads that aren't job threads
+static constexpr size_t kRender_ChunkCommands = 256;
+static constexpr size_t kRender_ArenaSize = 64 * 1024;
+static constexpr size_t kRender_BandRows = 64;
+static constexpr uint32_t kRender_TileShift = 6;
+static constexpr size_t kRender_MaxCoord = UINT16_MAX;
+
+typedef enum renderCmd_e : uint8_t {
+    kRenderCmd_Fill,
+    kRenderCmd_Blend,
+    kRenderCmd_Blit,
+    kRenderCmd_Sprite,
+    kRenderCmd_Text,
+} renderCmd_e;
+
+typedef struct renderText_s {
+    const font_s * font = nullptr;
+    size_t glyphCount = 0;
+    const textGlyph_s * glyph = nullptr; // follows this in the arena
+} renderText_s;
+
+// 48 bytes. rects are inclusive; rect is where the command draws before clipping.
+typedef struct renderCmd_s {
+    rect_s< uint16_t > rect;
+    rect_s< uint16_t > clip;
+    rect_s< uint16_t > src;     // blit and sprite: in the texture
+    rgba_s color;               // fill, blend and text
+    uint32_t stride = 0;        // blit and sprite: of the texture
+    const void * data = nullptr; // blit and sprite: the texture; text: renderText_s
+    uint16_t layer = 0;
+    renderCmd_e kind = kRenderCmd_Fill;
+} renderCmd_s;
+
+typedef struct renderChunk_s {
+    renderChunk_s * next = nullptr;
+    size_t count = 0;
+    renderCmd_s cmd[ kRender_ChunkCommands ];
+} renderChunk_s;
+
+typedef struct renderList_s {
+    arena_s arena;
+    renderChunk_s * first = nullptr;
+    renderChunk_s * last = nullptr;
+    size_t count = 0;
+    uint16_t layer = 0;
+    rect_s< uint16_t > clip{ { 0, 0 }, { kRender_MaxCoord, kRender_MaxCoord } };
+    uint8_t pad[ 64 ]; // lists recorded by different threads don't share cache lines
+} renderList_s;
+
+typedef struct renderSortItem_s {
+    uint64_t key;
+    const renderCmd_s * cmd;
+} renderSortItem_s;
+
+typedef struct renderBatch_s {
+    size_t begin;
+    size_t count;
+} renderBatch_s;
+
+typedef struct renderBuffer_s {
+    renderList_s list[ kRender_Lists ];
+    renderSortItem_s * item = nullptr;
+    size_t itemCapacity = 0;
+    size_t itemCount = 0;
+    renderBatch_s * batch = nullptr;
+    size_t batchCapacity = 0;
+    size_t batchCount = 0;
+} renderBuffer_s;
+
+renderBuffer_s * RenderBuffer_Create( void ) {
+    void * const mem = Mem_Alloc( kMemTag_Surface, sizeof( renderBuffer_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+    return new ( mem ) renderBuffer_s;
+}
+
+void RenderBuffer_Destroy( renderBuffer_s * const buffer ) {
+    if ( buffer == nullptr ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < kRender_Lists; i++ ) {
+        Arena_Free( &buffer->list[ i ].arena );
+    }
+    Mem_Free( buffer->item );
+    Mem_Free( buffer->batch );
+
+    buffer->~renderBuffer_s();
+    Mem_Free( buffer );
+}
+
+void RenderBuffer_Reset( renderBuffer_s * const buffer ) {
+    PROFILE_ZONE( "RenderBuffer_Reset" );
+
+    for ( size_t i = 0; i < kRender_Lists; i++ ) {
+        renderList_s * const list = &buffer->list[ i ];
+        if ( list->arena.base != nullptr ) {
+            Arena_Reset( &list->arena );
+        }
+        list->first = nullptr;
+        list->last = nullptr;
+        list->count = 0;
+        list->layer = 0;
+        list->clip = { { 0, 0 }, { kRender_MaxCoord, kRender_MaxCoord } };
+    }
+    buffer->itemCount = 0;
+    buffer->batchCount = 0;
+}
+
+renderList_s * RenderBuffer_GetList( renderBuffer_s * const buffer ) {
+    const size_t thread = Job_GetThreadIndex();
+    renderList_s * const list = &buffer->list[ thread < kJob_MaxThreads ? thread : kRender_Lists - 1 ];
+    if ( list->arena.base == nullptr && !Arena_Init( &list->arena, kMemTag_Surface, kRender_ArenaSize ) ) {
+        return nullptr;
+    }
+    return list;
+}
+
+static inline uint16_t ToCoord( const size_t value ) {
+    return ( uint16_t )( value < kRender_MaxCoord ? value : kRender_MaxCoord );
+}
+
+void RenderList_SetLayer( renderList_s * const list, const uint16_t layer ) {
+    list->layer = layer;
+}
+
+void RenderList_SetClip( renderList_s * const list, const rect_s< size_t > clip ) {
+    list->clip = { { ToCoord( clip.mn.x ), ToCoord( clip.mn.y ) }, { ToCoord( clip.mx.x ), ToCoord( clip.mx.y ) } };
+}
+
+// the next command, or nullptr if it is clipped away entirely or can't be allocated
+static renderCmd_s * Push( renderList_s * const list, const rect_s< size_t > rect, const renderCmd_e kind ) {
+    const rect_s< uint16_t > clip = list->clip;
+    if ( rect.mn.x > clip.mx.x || rect.mn.y > clip.mx.y || rect.mx.x < clip.mn.x || rect.mx.y < clip.mn.y ||
+         rect.mn.x > rect.mx.x || rect.mn.y > rect.mx.y ) {
+        return nullptr;
+    }
+
+    if ( list->last == nullptr || list->last->count == kRender_ChunkCommands ) {
+        void * const mem = Arena_Alloc( &list->arena, sizeof( renderChunk_s ), 16 );
+        if ( mem == nullptr ) {
+            return nullptr;
+        }
+        renderChunk_s * const chunk = new ( mem ) renderChunk_s;
+        if ( list->last != nullptr ) {
+            list->last->next = chunk;
+        } else {
+            list->first = chunk;
+        }
+        list->last = chunk;
+    }
+
+    renderCmd_s * const cmd = &list->last->cmd[ list->last->count++ ];
+    list->count++;
+    cmd->rect = { { ToCoord( rect.mn.x ), ToCoord( rect.mn.y ) }, { ToCoord( rect.mx.x ), ToCoord( rect.mx.y ) } };
+    cmd->clip = clip;
+    cmd->layer = list->layer;
+    cmd->kind = kind;
+    return cmd;
+}
+
+void RenderList_Fill( renderList_s * const list, const rect_s< size_t > rect, const rgba_s color ) {
+    renderCmd_s * const cmd = Push( list, rect, kRenderCmd_Fill );
+    if ( cmd != nullptr ) {
+        cmd->color = color;
+    }
+}
+
+void RenderList_Blend( renderList_s * const list, const rect_s< size_t > rect, const rgba_s color ) {
+    if ( color.a == 0 ) {
+        return;
+    }
+    renderCmd_s * const cmd = Push( list, rect, color.a == 255 ? kRenderCmd_Fill : kRenderCmd_Blend );
+    if ( cmd != nullptr ) {
+        cmd->color = color;
+    }
+}
+
+void RenderList_Blit( renderList_s * const list,
+                      const rect_s< size_t > dstRect,
+                      const rgba_s * const texture,
+                      const size_t stride,
+                      const rect_s< size_t > srcRect ) {
+    if ( texture == nullptr || stride > UINT32_MAX || srcRect.mn.x > srcRect.mx.x || srcRect.mn.y > srcRect.mx.y ) {
+        return;
+    }
+    renderCmd_s * const cmd = Push( list, dstRect, kRenderCmd_Blit );
+    if ( cmd != nullptr ) {
+        cmd->src = { { ToCoord( srcRect.mn.x ), ToCoord( srcRect.mn.y ) }, { ToCoord( srcRect.mx.x ), ToCoord( srcRect.mx.y ) } };
+        cmd->stride = ( uint32_t )stride;
+        cmd->data = texture;
+    }
+}
+
+void RenderList_Sprite( renderList_s * const list,
+                        const vec2_s< size_t > position,
+                        const rgba_s * const texture,
+                        const size_t stride,
+                        const rect_s< size_t > srcRect ) {
+    if ( texture == nullptr || stride > UINT32_MAX || srcRect.mn.x > srcRect.mx.x || srcRect.mn.y > srcRect.mx.y ) {
+        return;
+    }
+    const rect_s< size_t > rect = { position, position + ( srcRect.mx - srcRect.mn ) };
+    renderCmd_s * const cmd = Push( list, rect, kRenderCmd_Sprite );
+    if ( cmd != nullptr ) {
+        cmd->src = { { ToCoord( srcRect.mn.x ), ToCoord( srcRect.mn.y ) }, { ToCoord( srcRect.mx.x ), ToCoord( srcRect.mx.y ) } };
+        cmd->stride = ( uint32_t )stride;
+        cmd->data = texture;
+    }
+}
+
+void RenderList_Text( renderList_s * const list, const vec2_s< size_t > position, const textRun_s * const run, const rgba_s color ) {
+    if ( run == nullptr || run->font == nullptr || run->glyphCount == 0 || color.a == 0 ) {
+        return;
+    }
+    const rect_s< size_t > rect = rectFrom( position, run->size );
+    renderCmd_s * const cmd = Push( list, rect, kRenderCmd_Text );
+    if ( cmd == nullptr ) {
+        return;
+    }
+
+    renderText_s * const text = ( renderText_s * )Arena_Alloc( &list->arena, sizeof( renderText_s ) + run->glyphCount * sizeof( textGlyph_s ), 8 );
+    if ( text == nullptr ) {
+        // the slot is already taken; leave it drawing nothing
+        cmd->kind = kRenderCmd_Blend;
+        cmd->color = { 0, 0, 0, 0 };
+        return;
+    }
+    textGlyph_s * const glyph = ( textGlyph_s * )( text + 1 );
+    memcpy( glyph, run->glyph, run->glyphCount * sizeof( textGlyph_s ) );
+    text->font = run->font;
+    text->glyphCount = run->glyphCount;
+    text->glyph = glyph;
+    cmd->color = color;
+    cmd->data = text;
+}
+
+// interleaves the low 10 bits of v with zeros
+static inline uint64_t Spread10( uint64_t v ) {
+    v &= 0x3ff;
+    v = ( v | ( v << 8 ) ) & 0x00ff00ff;
+    v = ( v | ( v << 4 ) ) & 0x0f0f0f0f;
+    v = ( v | ( v << 2 ) ) & 0x33333333;
+    v = ( v | ( v << 1 ) ) & 0x55555555;
+    return v;
+}
+
+// layer : 16 | morton order of the top left tile : 20 | kind : 3 | what it draws with, folded : 25
+static uint64_t SortKey( const renderCmd_s * const cmd ) {
+    uint64_t with = cmd->kind == kRenderCmd_Fill || cmd->kind == kRenderCmd_Blend ? 0 : ( uint64_t )( uintptr_t )cmd->data;
+    if ( cmd->kind != kRenderCmd_Blit && cmd->kind != kRenderCmd_Sprite ) {
+        uint32_t color;
+        memcpy( &color, &cmd->color, sizeof( color ) );
+        with ^= color;
+    }
+    with *= 0x9e3779b97f4a7c15ull;
+
+    const uint64_t tile = Spread10( cmd->rect.mn.x >> kRender_TileShift ) | ( Spread10( cmd->rect.mn.y >> kRender_TileShift ) << 1 );
+    return ( ( uint64_t )cmd->layer << 48 ) | ( tile << 28 ) | ( ( uint64_t )cmd->kind << 25 ) | ( with >> 39 );
+}
+
+// nonzero if b can run in the same kernel call as a
+static int SameBatch( const renderCmd_s * const a, const renderCmd_s * const b ) {
+    if ( a->kind != b->kind ) {
+        return 0;
+    }
+    switch ( a->kind ) {
+        case kRenderCmd_Fill:
+        case kRenderCmd_Blend:
+            return memcmp( &a->color, &b->color, sizeof( rgba_s ) ) == 0;
+        case kRenderCmd_Blit:
+        case kRenderCmd_Sprite:
+            return a->data == b->data && a->stride == b->stride;
+        case kRenderCmd_Text:
+            return ( ( const renderText_s * )a->data )->font == ( ( const renderText_s * )b->data )->font &&
+                   memcmp( &a->color, &b->color, sizeof( rgba_s ) ) == 0;
+    }
+    return 0;
+}
+
+template < typename _type_ >
+static int Reserve( _type_ ** const array, size_t * const capacity, const size_t count ) {
+    if ( count <= *capacity ) {
+        return 1;
+    }
+    size_t grown = *capacity > 0 ? *capacity : 1024;
+    while ( grown < count ) {
+        grown *= 2;
+    }
+    _type_ * const fresh = ( _type_ * )Mem_Alloc( kMemTag_Surface, grown * sizeof( _type_ ) );
+    if ( fresh == nullptr ) {
+        return 0;
+    }
+    Mem_Free( *array );
+    *array = fresh;
+    *capacity = grown;
+    return 1;
+}
+
+// gathers every list into one sorted array and splits it into batches. returns zero on failure.
+static int Sort( renderBuffer_s * const buffer ) {
+    PROFILE_ZONE( "RenderBuffer_Sort" );
+
+    size_t count = 0;
+    for ( size_t i = 0; i < kRender_Lists; i++ ) {
+        count += buffer->list[ i ].count;
+    }
+    if ( !Reserve( &buffer->item, &buffer->itemCapacity, count ) || !Reserve( &buffer->batch, &buffer->batchCapacity, count ) ) {
+        return 0;
+    }
+
+    // lists in thread order and commands in record order, so the stable sort is deterministic for a given split
+    // of recording over threads
+    renderSortItem_s * item = buffer->item;
+    for ( size_t i = 0; i < kRender_Lists; i++ ) {
+        for ( const renderChunk_s * chunk = buffer->list[ i ].first; chunk != nullptr; chunk = chunk->next ) {
+            for ( size_t c = 0; c < chunk->count; c++ ) {
+                item->key = SortKey( &chunk->cmd[ c ] );
+                item->cmd = &chunk->cmd[ c ];
+                item++;
+            }
+        }
+    }
+    std::stable_sort( buffer->item, buffer->item + count, []( const renderSortItem_s & a, const renderSortItem_s & b ) {
+        return a.key < b.key;
+    } );
+    buffer->itemCount = count;
+
+    size_t batchCount = 0;
+    for ( size_t i = 0; i < count; i++ ) {
+        if ( batchCount > 0 && SameBatch( buffer->item[ i - 1 ].cmd, buffer->item[ i ].cmd ) ) {
+            buffer->batch[ batchCount - 1 ].count++;
+        } else {
+            buffer->batch[ batchCount++ ] = { i, 1 };
+        }
+    }
+    buffer->batchCount = batchCount;
+    return 1;
+}
+
+// the part of cmd inside band, as size_t. returns zero if there is none.
+static inline int ClipCmd( const renderCmd_s * const cmd, const rect_s< size_t > band, rect_s< size_t > * const out ) {
+    size_t x0 = cmd->rect.mn.x > cmd->clip.mn.x ? cmd->rect.mn.x : cmd->clip.mn.x;
+    size_t y0 = cmd->rect.mn.y > cmd->clip.mn.y ? cmd->rect.mn.y : cmd->clip.mn.y;
+    size_t x1 = cmd->rect.mx.x < cmd->clip.mx.x ? cmd->rect.mx.x : cmd->clip.mx.x;
+    size_t y1 = cmd->rect.mx.y < cmd->clip.mx.y ? cmd->rect.mx.y : cmd->clip.mx.y;
+    x0 = x0 > band.mn.x ? x0 : band.mn.x;
+    y0 = y0 > band.mn.y ? y0 : band.mn.y;
+    x1 = x1 < band.mx.x ? x1 : band.mx.x;
+    y1 = y1 < band.mx.y ? y1 : band.mx.y;
+    *out = { { x0, y0 }, { x1, y1 } };
+    return x0 <= x1 && y0 <= y1;
+}
+
+// ( x + 128 ) * 257 >> 16 is x / 255 rounded, for x in [ 0, 255 * 255 ]; the same math as text blending
+static inline uint32_t Div255( const uint32_t x ) {
+    return ( ( x + 128 ) * 257 ) >> 16;
+}
+
+static void FillBatch( const renderSortItem_s * const item, const size_t count, rgba_s * const surface, const size_t stride, const rect_s< size_t > band ) {
+    const rgba_s color = item[ 0 ].cmd->color;
+#if defined( RTSFS_SIMD_SSE2 )
+    uint32_t bits;
+    memcpy( &bits, &color, sizeof( bits ) );
+    const __m128i splat = _mm_set1_epi32( ( int )bits );
+#endif
+
+    for ( size_t i = 0; i < count; i++ ) {
+        rect_s< size_t > r;
+        if ( !ClipCmd( item[ i ].cmd, band, &r ) ) {
+            continue;
+        }
+        const size_t width = r.mx.x - r.mn.x + 1;
+        rgba_s * row = surface + r.mn.y * stride + r.mn.x;
+        for ( size_t y = r.mn.y; y <= r.mx.y; y++, row += stride ) {
+            size_t x = 0;
+#if defined( RTSFS_SIMD_SSE2 )
+            for ( ; x + 4 <= width; x += 4 ) {
+                _mm_storeu_si128( ( __m128i * )( row + x ), splat );
+            }
+#endif
+            for ( ; x < width; x++ ) {
+                row[ x ] = color;
+            }
+        }
+    }
+}
+
+// one color over every rect of the batch, so its premultiplied terms are set up once
+static void BlendBatch( const renderSortItem_s * const item, const size_t count, rgba_s * const surface, const size_t stride, const rect_s< size_t > band ) {
+    const rgba_s color = item[ 0 ].cmd->color;
+    const uint32_t a = color.a;
+    const uint32_t ia = 255 - a;
+    const uint32_t sb = color.b * a, sg = color.g * a, sr = color.r * a, sa = 255 * a;
+#if defined( RTSFS_SIMD_SSE2 )
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i m257 = _mm_set1_epi16( 257 );
+    const __m128i inverse = _mm_set1_epi16( ( short )ia );
+    // the source terms with the rounding bias folded in
+    const __m128i src = _mm_set_epi16( ( short )( sa + 128 ), ( short )( sr + 128 ), ( short )( sg + 128 ), ( short )( sb + 128 ),
+                                       ( short )( sa + 128 ), ( short )( sr + 128 ), ( short )( sg + 128 ), ( short )( sb + 128 ) );
+#endif
+
+    for ( size_t i = 0; i < count; i++ ) {
+        rect_s< size_t > r;
+        if ( !ClipCmd( item[ i ].cmd, band, &r ) ) {
+            continue;
+        }
+        const size_t width = r.mx.x - r.mn.x + 1;
+        rgba_s * row = surface + r.mn.y * stride + r.mn.x;
+        for ( size_t y = r.mn.y; y <= r.mx.y; y++, row += stride ) {
+            size_t x = 0;
+#if defined( RTSFS_SIMD_SSE2 )
+            for ( ; x + 4 <= width; x += 4 ) {
+                const __m128i d = _mm_loadu_si128( ( const __m128i * )( row + x ) );
+                __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), inverse ), src );
+                __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), inverse ), src );
+                lo = _mm_mulhi_epu16( lo, m257 );
+                hi = _mm_mulhi_epu16( hi, m257 );
+                _mm_storeu_si128( ( __m128i * )( row + x ), _mm_packus_epi16( lo, hi ) );
+            }
+#endif
+            for ( ; x < width; x++ ) {
+                rgba_s * const dst = row + x;
+                dst->b = ( uint8_t )Div255( dst->b * ia + sb );
+                dst->g = ( uint8_t )Div255( dst->g * ia + sg );
+                dst->r = ( uint8_t )Div255( dst->r * ia + sr );
+                dst->a = ( uint8_t )Div255( dst->a * ia + sa );
+            }
+        }
+    }
+}
+
+static void BlitBatch( const renderSortItem_s * const item, const size_t count, rgba_s * const surface, const size_t stride, const rect_s< size_t > band ) {
+    const rgba_s * const texture = ( const rgba_s * )item[ 0 ].cmd->data;
+    const size_t textureStride = item[ 0 ].cmd->stride;
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const renderCmd_s * const cmd = item[ i ].cmd;
+        rect_s< size_t > r;
+        if ( !ClipCmd( cmd, band, &r ) ) {
+            continue;
+        }
+
+        const rect_s< size_t > dstRect = { { cmd->rect.mn.x, cmd->rect.mn.y }, { cmd->rect.mx.x, cmd->rect.mx.y } };
+        const rect_s< size_t > srcRect = { { cmd->src.mn.x, cmd->src.mn.y }, { cmd->src.mx.x, cmd->src.mx.y } };
+        if ( dstRect.mx.x - dstRect.mn.x != srcRect.mx.x - srcRect.mn.x || dstRect.mx.y - dstRect.mn.y != srcRect.mx.y - srcRect.mn.y ) {
+            Blit_ScaleNearest( surface, stride, r, dstRect, texture, textureStride, srcRect );
+            continue;
+        }
+
+        const rgba_s * src = texture + ( srcRect.mn.y + r.mn.y - dstRect.mn.y ) * textureStride + srcRect.mn.x + r.mn.x - dstRect.mn.x;
+        rgba_s * row = surface + r.mn.y * stride + r.mn.x;
+        const size_t bytes = ( r.mx.x - r.mn.x + 1 ) * sizeof( rgba_s );
+        for ( size_t y = r.mn.y; y <= r.mx.y; y++, row += stride, src += textureStride ) {
+            memcpy( row, src, bytes );
+        }
+    }
+}
+
+// source over, by each source pixel's alpha
+static void SpriteSpan( rgba_s * dst, const rgba_s * src, size_t count ) {
+#if defined( RTSFS_SIMD_SSE2 )
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16( 128 );
+    const __m128i m257 = _mm_set1_epi16( 257 );
+    const __m128i c255 = _mm_set1_epi16( 255 );
+    const __m128i alphaMask = _mm_set1_epi32( ( int )0xff000000 );
+    // the alpha lane blends toward 255, like text
+    const __m128i opaqueLane = _mm_set_epi16( 255, 0, 0, 0, 255, 0, 0, 0 );
+    const __m128i colorLanes = _mm_set_epi16( 0, -1, -1, -1, 0, -1, -1, -1 );
+
+    for ( ; count >= 4; count -= 4, dst += 4, src += 4 ) {
+        const __m128i s = _mm_loadu_si128( ( const __m128i * )src );
+        const int alpha = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128( s, alphaMask ), alphaMask ) ) & 0x8888;
+        if ( alpha == 0x8888 ) {
+            _mm_storeu_si128( ( __m128i * )dst, s );
+            continue;
+        }
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_and_si128( s, alphaMask ), zero ) ) == 0xffff ) {
+            continue;
+        }
+
+        const __m128i sLo = _mm_unpacklo_epi8( s, zero );
+        const __m128i sHi = _mm_unpackhi_epi8( s, zero );
+        const __m128i aLo = _mm_shufflehi_epi16( _mm_shufflelo_epi16( sLo, 0xff ), 0xff );
+        const __m128i aHi = _mm_shufflehi_epi16( _mm_shufflelo_epi16( sHi, 0xff ), 0xff );
+        const __m128i cLo = _mm_or_si128( _mm_and_si128( sLo, colorLanes ), opaqueLane );
+        const __m128i cHi = _mm_or_si128( _mm_and_si128( sHi, colorLanes ), opaqueLane );
+
+        const __m128i d = _mm_loadu_si128( ( const __m128i * )dst );
+        __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( d, zero ), _mm_sub_epi16( c255, aLo ) ), _mm_mullo_epi16( cLo, aLo ) );
+        __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( d, zero ), _mm_sub_epi16( c255, aHi ) ), _mm_mullo_epi16( cHi, aHi ) );
+        lo = _mm_mulhi_epu16( _mm_add_epi16( lo, bias ), m257 );
+        hi = _mm_mulhi_epu16( _mm_add_epi16( hi, bias ), m257 );
+        _mm_storeu_si128( ( __m128i * )dst, _mm_packus_epi16( lo, hi ) );
+    }
+#endif
+
+    for ( ; count != 0; count--, dst++, src++ ) {
+        const uint32_t a = src->a;
+        if ( a == 0 ) {
+            continue;
+        }
+        const uint32_t ia = 255 - a;
+        dst->b = ( uint8_t )Div255( dst->b * ia + src->b * a );
+        dst->g = ( uint8_t )Div255( dst->g * ia + src->g * a );
+        dst->r = ( uint8_t )Div255( dst->r * ia + src->r * a );
+        dst->a = ( uint8_t )Div255( dst->a * ia + 255 * a );
+    }
+}
+
+static void SpriteBatch( const renderSortItem_s * const item, const size_t count, rgba_s * const surface, const size_t stride, const rect_s< size_t > band ) {
+    const rgba_s * const texture = ( const rgba_s * )item[ 0 ].cmd->data;
+    const size_t textureStride = item[ 0 ].cmd->stride;
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const renderCmd_s * const cmd = item[ i ].cmd;
+        rect_s< size_t > r;
+        if ( !ClipCmd( cmd, band, &r ) ) {
+            continue;
+        }
+
+        const rgba_s * src = texture + ( cmd->src.mn.y + r.mn.y - cmd->rect.mn.y ) * textureStride + cmd->src.mn.x + r.mn.x - cmd->rect.mn.x;
+        rgba_s * row = surface + r.mn.y * stride + r.mn.x;
+        const size_t width = r.mx.x - r.mn.x + 1;
+        for ( size_t y = r.mn.y; y <= r.mx.y; y++, row += stride, src += textureStride ) {
+            SpriteSpan( row, src, width );
+        }
+    }
+}
+
+static void TextBatch( const renderSortItem_s * const item, const size_t count, rgba_s * const surface, const size_t stride, const rect_s< size_t > band ) {
+    for ( size_t i = 0; i < count; i++ ) {
+        const renderCmd_s * const cmd = item[ i ].cmd;
+        rect_s< size_t > r;
+        if ( !ClipCmd( cmd, band, &r ) ) {
+            continue;
+        }
+
+        // glyphs clip themselves; only the command's own clip and the band matter
+        const rect_s< size_t > clip = {
+            { cmd->clip.mn.x > band.mn.x ? cmd->clip.mn.x : band.mn.x, cmd->clip.mn.y > band.mn.y ? cmd->clip.mn.y : band.mn.y },
+            { cmd->clip.mx.x < band.mx.x ? cmd->clip.mx.x : band.mx.x, cmd->clip.mx.y < band.mx.y ? cmd->clip.mx.y : band.mx.y }
+        };
+        const renderText_s * const text = ( const renderText_s * )cmd->data;
+        Text_DrawGlyphs( text->font, text->glyph, text->glyphCount, surface, stride, clip, { cmd->rect.mn.x, cmd->rect.mn.y }, cmd->color );
+    }
+}
+
+typedef struct renderExecuteTask_s {
+    const renderBuffer_s * buffer;
+    rgba_s * surface;
+    size_t stride;
+    rect_s< size_t > clip;
+} renderExecuteTask_s;
+
+// every band runs every batch clipped to its rows, so bands never touch the same pixels and each keeps the
+// sorted order
+static void ExecuteBands( void * const param, const size_t begin, const size_t end ) {
+    const renderExecuteTask_s * const task = ( const renderExecuteTask_s * )param;
+    const renderBuffer_s * const buffer = task->buffer;
+
+    for ( size_t b = begin; b < end; b++ ) {
+        PROFILE_ZONE( "RenderBuffer_ExecuteBand" );
+
+        const size_t top = task->clip.mn.y + b * kRender_BandRows;
+        const size_t bottom = top + kRender_BandRows - 1;
+        const rect_s< size_t > band = { { task->clip.mn.x, top }, { task->clip.mx.x, bottom < task->clip.mx.y ? bottom : task->clip.mx.y } };
+
+        for ( size_t i = 0; i < buffer->batchCount; i++ ) {
+            const renderSortItem_s * const item = buffer->item + buffer->batch[ i ].begin;
+            const size_t count = buffer->batch[ i ].count;
+            switch ( item->cmd->kind ) {
+                case kRenderCmd_Fill:
+                    FillBatch( item, count, task->surface, task->stride, band );
+                    break;
+                case kRenderCmd_Blend:
+                    BlendBatch( item, count, task->surface, task->stride, band );
+                    break;
+                case kRenderCmd_Blit:
+                    BlitBatch( item, count, task->surface, task->stride, band );
+                    break;
+                case kRenderCmd_Sprite:
+                    SpriteBatch( item, count, task->surface, task->stride, band );
+                    break;
+                case kRenderCmd_Text:
+                    TextBatch( item, count, task->surface, task->stride, band );
+                    break;
+            }
+        }
+    }
+}
+
+void RenderBuffer_Execute( renderBuffer_s * const buffer, rgba_s * const surface, const size_t stride, const rect_s< size_t > clip ) {
+    PROFILE_ZONE( "RenderBuffer_Execute" );
+
+    if ( !Sort( buffer ) || surface == nullptr || buffer->batchCount == 0 || clip.mn.x > clip.mx.x || clip.mn.y > clip.mx.y ) {
+        return;
+    }
+
+    renderExecuteTask_s task;
+    task.buffer = buffer;
+    task.surface = surface;
+    task.stride = stride;
+    task.clip = clip;
+    const size_t bandCount = ( clip.mx.y - clip.mn.y ) / kRender_BandRows + 1;
+    Job_ParallelFor( bandCount, 1, ExecuteBands, &task );
+}
+
+void RenderBuffer_GetStats( const renderBuffer_s * const buffer, renderStats_s * const stats ) {
+    stats->commands = 0;
+    stats->bytes = 0;
+    for ( size_t i = 0; i < kRender_Lists; i++ ) {
+        stats->commands += buffer->list[ i ].count;
+        stats->bytes += buffer->list[ i ].arena.size;
+    }
+    stats->batches = buffer->batchCount;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_RENDER_H___
+#define ___RTSFS_RENDER_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// deferred 2d drawing through a command buffer.
+//
+// drawing is recorded as small fixed size commands instead of touching pixels. every job thread records into its
+// own list, backed by an arena that keeps its high water mark, so recording takes no locks and steady state frames
+// don't allocate. executing sorts every command by layer, then by screen tile, then by what it draws with, merges
+// runs of commands of one kind drawing with the same texture, color or font into batches, and runs the batches
+// in horizontal bands spread over the job threads, whether the thread executing is one of them or not.
+//
+// layers are painter's order: a layer is drawn entirely over the ones below it. commands within a layer may be
+// drawn in any order, so anything that has to stack goes in a layer of its own.
+//
+// a buffer holds one frame. keeping one per frame in flight lets one thread record the next frame while another
+// executes the previous one. textures are referenced, not copied, and must stay unchanged until the buffer has
+// executed; text is copied when recorded. coordinates must fit in 16 bits.
+
+typedef struct renderBuffer_s renderBuffer_s;
+typedef struct renderList_s renderList_s;
+typedef struct textRun_s textRun_s;
+
+typedef struct renderStats_s {
+    size_t commands = 0;   // recorded since the last reset
+    size_t batches = 0;    // they were merged into by the last execute
+    size_t bytes = 0;      // held by the lists' arenas
+} renderStats_s;
+
+// returns nullptr on failure
+renderBuffer_s * RenderBuffer_Create( void );
+
+void RenderBuffer_Destroy( renderBuffer_s * const buffer );
+
+// empties the buffer for a new frame. nothing may be recording into it or executing it.
+void RenderBuffer_Reset( renderBuffer_s * const buffer );
+
+// the calling thread's list, with layer 0 and no clip. job threads each have their own; every other thread shares
+// one, so only one of them may record at a time. returns nullptr if it can't be allocated.
+renderList_s * RenderBuffer_GetList( renderBuffer_s * const buffer );
+
+// draws recorded from here on go in layer
+void RenderList_SetLayer( renderList_s * const list, const uint16_t layer );
+
+// and are clipped to clip (inclusive)
+void RenderList_SetClip( renderList_s * const list, const rect_s< size_t > clip );
+
+// opaque rect
+void RenderList_Fill( renderList_s * const list, const rect_s< size_t > rect, const rgba_s color );
+
+// rect blended over what is below it by color.a
+void RenderList_Blend( renderList_s * const list, const rect_s< size_t > rect, const rgba_s color );
+
+// opaque copy of srcRect of a texture, stretched over dstRect with nearest sampling if they differ in size
+void RenderList_Blit( renderList_s * const list,
+                      const rect_s< size_t > dstRect,
+                      const rgba_s * const texture,
+                      const size_t stride,
+                      const rect_s< size_t > srcRect );
+
+// srcRect of a texture blended over what is below it by each pixel's alpha, unscaled
+void RenderList_Sprite( renderList_s * const list,
+                        const vec2_s< size_t > position,
+                        const rgba_s * const texture,
+                        const size_t stride,
+                        const rect_s< size_t > srcRect );
+
+// the run's glyphs are copied, so the run may change as soon as this returns
+void RenderList_Text( renderList_s * const list, const vec2_s< size_t > position, const textRun_s * const run, const rgba_s color );
+
+// draws everything recorded into the surface, within clip (inclusive). recording must have finished.
+void RenderBuffer_Execute( renderBuffer_s * const buffer, rgba_s * const surface, const size_t stride, const rect_s< size_t > clip );
+
+void RenderBuffer_GetStats( const renderBuffer_s * const buffer, renderStats_s * const stats );
+
+#endif // ___RTSFS_RENDER_H___
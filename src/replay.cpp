@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "replay.h"
+
+#include "profile.h"
+#include "stream.h"
+#include "thread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+static constexpr uint32_t kReplay_Magic = 0x52535452; // "RTSR"
+static constexpr uint32_t kReplay_Version = 1;
+static constexpr size_t kReplay_BlockSize = 64 * 1024;
+static constexpr uint32_t kReplay_RingSize = 16; // blocks the disk may fall behind before recording waits on it
+static constexpr uint32_t kReplay_RingMask = kReplay_RingSize - 1;
+
+// the delta state of the move encoding, the same on both sides
+typedef struct replayDelta_s {
+    uint32_t unit = 0;
+    vec2_s< int32_t > target;
+} replayDelta_s;
+
+typedef struct replayBlock_s {
+    size_t size = 0;
+    uint8_t data[ kReplay_BlockSize ];
+} replayBlock_s;
+
+typedef struct replayWriter_s {
+    FILE * file = nullptr;
+    thread_s * thread = nullptr;
+    signal_s * wake = nullptr; // raised when a block is queued or on quit
+    signal_s * done = nullptr; // raised when a block is written
+
+    // full blocks from the sim thread to the writer thread
+    replayBlock_s * ring[ kReplay_RingSize ] = {};
+    std::atomic< uint32_t > head{ 0 }; // sim thread
+    uint8_t headPad[ 60 ];
+    std::atomic< uint32_t > tail{ 0 }; // writer thread
+    uint8_t tailPad[ 60 ];
+    std::atomic< int > quit{ 0 };
+    std::atomic< int > writeFailed{ 0 };
+
+    // sim thread
+    replayBlock_s * block = nullptr; // being filled
+    streamWriter_s record;
+    replayDelta_s delta;
+    uint64_t recordTick = 0; // of the last record
+    uint64_t lastTick = 0;
+    uint64_t lastHash = 0;
+    int failed = 0;
+} replayWriter_s;
+
+// where the next record starts, and the delta state up to it
+typedef struct replayCursor_s {
+    size_t offset = 0;          // of the record's body, past its tick delta
+    uint64_t tick = UINT64_MAX; // of the record, or UINT64_MAX past the last one
+    replayDelta_s delta;
+} replayCursor_s;
+
+typedef struct replaySnapshot_s {
+    streamWriter_s state; // empty until taken
+    replayCursor_s cursor;
+} replaySnapshot_s;
+
+typedef struct replay_s {
+    simDesc_s desc;
+    uint8_t * data = nullptr;
+    size_t size = 0;
+    uint64_t endTick = 0;
+    replayCursor_s cursor;
+    ecsEntity_s * unit = nullptr; // units of the move being decoded
+    size_t unitCapacity = 0;
+    replaySnapshot_s * snapshot = nullptr;
+    size_t snapshotCount = 0;
+} replay_s;
+
+static void WriterThread( void * const param ) {
+    replayWriter_s * const w = ( replayWriter_s * )param;
+
+    uint32_t tail = w->tail.load( std::memory_order_relaxed );
+    for ( ;; ) {
+        const uint32_t head = w->head.load( std::memory_order_acquire );
+        while ( tail != head ) {
+            replayBlock_s * const block = w->ring[ tail & kReplay_RingMask ];
+            if ( fwrite( block->data, 1, block->size, w->file ) != block->size ) {
+                w->writeFailed.store( 1, std::memory_order_relaxed );
+            }
+            Mem_Free( block );
+            tail++;
+            w->tail.store( tail, std::memory_order_release );
+            Signal_Raise( w->done );
+        }
+
+        // quit is only set after the last block was queued
+        if ( w->quit.load( std::memory_order_acquire ) && tail == w->head.load( std::memory_order_acquire ) ) {
+            break;
+        }
+        Signal_Wait( w->wake );
+    }
+}
+
+static void QueueBlock( replayWriter_s * const w ) {
+    const uint32_t head = w->head.load( std::memory_order_relaxed );
+    while ( head - w->tail.load( std::memory_order_acquire ) == kReplay_RingSize ) {
+        PROFILE_ZONE( "ReplayWriter_Wait" );
+        Signal_Wait( w->done );
+    }
+
+    w->ring[ head & kReplay_RingMask ] = w->block;
+    w->head.store( head + 1, std::memory_order_release );
+    Signal_Raise( w->wake );
+
+    w->block = ( replayBlock_s * )Mem_Alloc( kMemTag_Replay, sizeof( replayBlock_s ) );
+    if ( w->block == nullptr ) {
+        w->failed = 1;
+        return;
+    }
+    w->block->size = 0;
+}
+
+// appends the encoded record to the blocks; the file is one byte stream, so records may straddle blocks
+static void EmitRecord( replayWriter_s * const w ) {
+    if ( w->record.failed ) {
+        w->failed = 1;
+    }
+
+    const uint8_t * bytes = w->record.data;
+    size_t size = w->record.size;
+    while ( size > 0 && !w->failed ) {
+        const size_t room = kReplay_BlockSize - w->block->size;
+        const size_t count = size < room ? size : room;
+        memcpy( w->block->data + w->block->size, bytes, count );
+        w->block->size += count;
+        bytes += count;
+        size -= count;
+        if ( w->block->size == kReplay_BlockSize ) {
+            QueueBlock( w );
+        }
+    }
+    w->record.size = 0;
+}
+
+static void WriteRecord( replayWriter_s * const w, const uint64_t tick, const simCommand_s * const commands, const size_t count, const uint64_t * const hash ) {
+    streamWriter_s * const r = &w->record;
+    Stream_WriteVarint( r, tick - w->recordTick );
+    Stream_WriteVarint( r, ( ( uint64_t )count << 1 ) | ( hash != nullptr ? 1u : 0u ) );
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const simCommand_s * const command = &commands[ i ];
+        Stream_WriteU8( r, command->type );
+        switch ( command->type ) {
+            case kSimCommand_Move:
+                Stream_WriteVarint( r, command->unitCount );
+                for ( size_t j = 0; j < command->unitCount; j++ ) {
+                    Stream_WriteZigzag( r, ( int64_t )command->units[ j ].value - ( int64_t )w->delta.unit );
+                    w->delta.unit = command->units[ j ].value;
+                }
+                Stream_WriteZigzag( r, ( int64_t )command->target.x.raw - ( int64_t )w->delta.target.x );
+                Stream_WriteZigzag( r, ( int64_t )command->target.y.raw - ( int64_t )w->delta.target.y );
+                w->delta.target = { command->target.x.raw, command->target.y.raw };
+                break;
+
+            case kSimCommand_Terrain:
+                Stream_WriteZigzag( r, command->cell.x );
+                Stream_WriteZigzag( r, command->cell.y );
+                Stream_WriteU8( r, command->cost );
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if ( hash != nullptr ) {
+        Stream_WriteU64( r, *hash );
+    }
+
+    w->recordTick = tick;
+    EmitRecord( w );
+}
+
+replayWriter_s * ReplayWriter_Create( const char * const path, const simDesc_s * const desc ) {
+    if ( path == nullptr ) {
+        return nullptr;
+    }
+
+    replayWriter_s * const w = ( replayWriter_s * )Mem_Alloc( kMemTag_Replay, sizeof( replayWriter_s ) );
+    if ( w == nullptr ) {
+        return nullptr;
+    }
+
+    new ( w ) replayWriter_s;
+    w->record.tag = kMemTag_Replay;
+
+#if defined( _MSC_VER )
+    if ( fopen_s( &w->file, path, "wb" ) != 0 ) {
+        w->file = nullptr;
+    }
+#else
+    w->file = fopen( path, "wb" );
+#endif
+    w->block = ( replayBlock_s * )Mem_Alloc( kMemTag_Replay, sizeof( replayBlock_s ) );
+    w->wake = Signal_Create();
+    w->done = Signal_Create();
+    if ( w->file == nullptr || w->block == nullptr || w->wake == nullptr || w->done == nullptr ) {
+        ReplayWriter_Destroy( w );
+        return nullptr;
+    }
+    w->block->size = 0;
+
+    Stream_WriteU32( &w->record, kReplay_Magic );
+    Stream_WriteU32( &w->record, kReplay_Version );
+    Sim_SaveDesc( desc, &w->record );
+    EmitRecord( w );
+
+    w->thread = Thread_Create( WriterThread, w );
+    if ( w->thread == nullptr || w->failed ) {
+        ReplayWriter_Destroy( w );
+        return nullptr;
+    }
+
+    return w;
+}
+
+void ReplayWriter_WriteTick( replayWriter_s * const w, const uint64_t tick, const simCommand_s * const commands, const size_t count, const uint64_t hash ) {
+    PROFILE_ZONE( "ReplayWriter_WriteTick" );
+
+    if ( w->failed || tick <= w->lastTick ) {
+        w->failed = 1;
+        return;
+    }
+    w->lastTick = tick;
+    w->lastHash = hash;
+
+    const int hashTick = tick % kReplay_HashInterval == 0;
+    if ( count == 0 && !hashTick ) {
+        return;
+    }
+    WriteRecord( w, tick, commands, count, hashTick ? &hash : nullptr );
+}
+
+int ReplayWriter_Destroy( replayWriter_s * const w ) {
+    if ( w == nullptr ) {
+        return 0;
+    }
+
+    // the last tick always gets a record, so the file knows where it ends and playback can check the final hash
+    if ( w->thread != nullptr && !w->failed ) {
+        if ( w->lastTick != w->recordTick ) {
+            WriteRecord( w, w->lastTick, nullptr, 0, &w->lastHash );
+        }
+        if ( !w->failed && w->block->size > 0 ) {
+            QueueBlock( w );
+        }
+    }
+
+    if ( w->thread != nullptr ) {
+        w->quit.store( 1, std::memory_order_release );
+        Signal_Raise( w->wake );
+        Thread_Join( w->thread );
+    }
+
+    int ok = w->thread != nullptr && !w->failed && !w->writeFailed.load( std::memory_order_relaxed );
+    if ( w->file != nullptr && fclose( w->file ) != 0 ) {
+        ok = 0;
+    }
+
+    Signal_Destroy( w->done );
+    Signal_Destroy( w->wake );
+    Mem_Free( w->block );
+    Stream_FreeWriter( &w->record );
+    w->~replayWriter_s();
+    Mem_Free( w );
+
+    return ok;
+}
+
+// moves the cursor past a record's body to the next record
+static void AdvanceCursor( const replay_s * const replay, replayCursor_s * const cursor, streamReader_s * const r ) {
+    cursor->offset = r->offset;
+    if ( r->offset == replay->size ) {
+        cursor->tick = UINT64_MAX;
+        return;
+    }
+
+    const uint64_t delta = Stream_ReadVarint( r );
+    cursor->tick = delta > 0 && delta < UINT64_MAX - cursor->tick ? cursor->tick + delta : UINT64_MAX;
+    cursor->offset = r->offset;
+    if ( delta == 0 ) {
+        r->failed = 1;
+    }
+}
+
+// decodes the body of the record at the cursor, submitting its commands to sim unless that is nullptr. returns
+// zero if it is malformed or a submit fails.
+static int ReadRecord( replay_s * const replay, replayCursor_s * const cursor, sim_s * const sim, uint64_t * const hash, int * const hasHash ) {
+    streamReader_s r;
+    Stream_InitReader( &r, replay->data, replay->size );
+    r.offset = cursor->offset;
+
+    const uint64_t header = Stream_ReadVarint( &r );
+    const uint64_t count = header >> 1;
+    if ( count > r.size - r.offset ) {
+        return 0;
+    }
+
+    for ( uint64_t i = 0; i < count && !r.failed; i++ ) {
+        simCommand_s command;
+        command.type = ( simCommand_e )Stream_ReadU8( &r );
+        switch ( command.type ) {
+            case kSimCommand_Move: {
+                const uint64_t unitCount = Stream_ReadVarint( &r );
+                if ( unitCount > r.size - r.offset ) { // every unit takes at least a byte
+                    return 0;
+                }
+                if ( unitCount > replay->unitCapacity ) {
+                    ecsEntity_s * const unit = ( ecsEntity_s * )Mem_Alloc( kMemTag_Replay, ( size_t )unitCount * sizeof( ecsEntity_s ) );
+                    if ( unit == nullptr ) {
+                        return 0;
+                    }
+                    Mem_Free( replay->unit );
+                    replay->unit = unit;
+                    replay->unitCapacity = ( size_t )unitCount;
+                }
+                for ( uint64_t j = 0; j < unitCount; j++ ) {
+                    cursor->delta.unit = ( uint32_t )( ( int64_t )cursor->delta.unit + Stream_ReadZigzag( &r ) );
+                    replay->unit[ j ].value = cursor->delta.unit;
+                }
+                cursor->delta.target.x = ( int32_t )( ( int64_t )cursor->delta.target.x + Stream_ReadZigzag( &r ) );
+                cursor->delta.target.y = ( int32_t )( ( int64_t )cursor->delta.target.y + Stream_ReadZigzag( &r ) );
+                command.units = replay->unit;
+                command.unitCount = ( size_t )unitCount;
+                command.target = { Fixed_FromRaw( cursor->delta.target.x ), Fixed_FromRaw( cursor->delta.target.y ) };
+                break;
+            }
+
+            case kSimCommand_Terrain:
+                command.cell.x = ( int32_t )Stream_ReadZigzag( &r );
+                command.cell.y = ( int32_t )Stream_ReadZigzag( &r );
+                command.cost = Stream_ReadU8( &r );
+                break;
+
+            default:
+                return 0;
+        }
+
+        if ( !r.failed && sim != nullptr && !Sim_Submit( sim, &command ) ) {
+            return 0;
+        }
+    }
+
+    *hasHash = ( header & 1 ) != 0;
+    *hash = *hasHash ? Stream_ReadU64( &r ) : 0;
+
+    AdvanceCursor( replay, cursor, &r );
+    return !r.failed;
+}
+
+replay_s * Replay_Open( const char * const path ) {
+    PROFILE_ZONE( "Replay_Open" );
+
+    if ( path == nullptr ) {
+        return nullptr;
+    }
+
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, path, "rb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( path, "rb" );
+#endif
+    if ( file == nullptr ) {
+        return nullptr;
+    }
+
+    replay_s * const replay = ( replay_s * )Mem_Alloc( kMemTag_Replay, sizeof( replay_s ) );
+    if ( replay == nullptr ) {
+        fclose( file );
+        return nullptr;
+    }
+
+    new ( replay ) replay_s;
+
+    long size = -1;
+    if ( fseek( file, 0, SEEK_END ) == 0 ) {
+        size = ftell( file );
+    }
+    if ( size > 0 && fseek( file, 0, SEEK_SET ) == 0 ) {
+        replay->size = ( size_t )size;
+        replay->data = ( uint8_t * )Mem_Alloc( kMemTag_Replay, replay->size );
+        if ( replay->data != nullptr && fread( replay->data, 1, replay->size, file ) != replay->size ) {
+            Mem_Free( replay->data );
+            replay->data = nullptr;
+        }
+    }
+    fclose( file );
+    if ( replay->data == nullptr ) {
+        Replay_Close( replay );
+        return nullptr;
+    }
+
+    streamReader_s r;
+    Stream_InitReader( &r, replay->data, replay->size );
+    const int known = Stream_ReadU32( &r ) == kReplay_Magic && Stream_ReadU32( &r ) == kReplay_Version;
+    if ( !known || !Sim_LoadDesc( &replay->desc, &r ) ) {
+        Replay_Close( replay );
+        return nullptr;
+    }
+
+    // one decoding pass up front finds the end, and means playback never meets a damaged record
+    replay->cursor.tick = 0;
+    AdvanceCursor( replay, &replay->cursor, &r );
+    if ( r.failed || replay->cursor.tick == UINT64_MAX ) {
+        Replay_Close( replay );
+        return nullptr;
+    }
+
+    const replayCursor_s start = replay->cursor;
+    replayCursor_s cursor = start;
+    while ( cursor.tick != UINT64_MAX ) {
+        replay->endTick = cursor.tick;
+        uint64_t hash;
+        int hasHash;
+        if ( !ReadRecord( replay, &cursor, nullptr, &hash, &hasHash ) ) {
+            Replay_Close( replay );
+            return nullptr;
+        }
+    }
+    replay->cursor = start;
+
+    replay->snapshotCount = ( size_t )( replay->endTick / kReplay_SnapshotInterval ) + 1;
+    replay->snapshot = ( replaySnapshot_s * )Mem_Alloc( kMemTag_Replay, replay->snapshotCount * sizeof( replaySnapshot_s ) );
+    if ( replay->snapshot == nullptr ) {
+        replay->snapshotCount = 0;
+        Replay_Close( replay );
+        return nullptr;
+    }
+    for ( size_t i = 0; i < replay->snapshotCount; i++ ) {
+        new ( &replay->snapshot[ i ] ) replaySnapshot_s;
+        replay->snapshot[ i ].state.tag = kMemTag_Replay;
+    }
+
+    return replay;
+}
+
+void Replay_Close( replay_s * const replay ) {
+    if ( replay == nullptr ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < replay->snapshotCount; i++ ) {
+        Stream_FreeWriter( &replay->snapshot[ i ].state );
+    }
+    Mem_Free( replay->snapshot );
+    Mem_Free( replay->unit );
+    Mem_Free( replay->data );
+    replay->~replay_s();
+    Mem_Free( replay );
+}
+
+const simDesc_s * Replay_GetDesc( const replay_s * const replay ) {
+    return &replay->desc;
+}
+
+uint64_t Replay_GetEndTick( const replay_s * const replay ) {
+    return replay->endTick;
+}
+
+// a snapshot that fails to save is left out; seeking then goes back to an earlier one
+static void TakeSnapshot( replay_s * const replay, sim_s * const sim, const uint64_t tick ) {
+    PROFILE_ZONE( "Replay_TakeSnapshot" );
+
+    replaySnapshot_s * const snapshot = &replay->snapshot[ tick / kReplay_SnapshotInterval ];
+    if ( snapshot->state.size > 0 ) {
+        return;
+    }
+
+    if ( !Sim_Save( sim, &snapshot->state ) ) {
+        Stream_FreeWriter( &snapshot->state );
+        return;
+    }
+    snapshot->cursor = replay->cursor;
+}
+
+replayStep_e Replay_Step( replay_s * const replay, sim_s * const sim ) {
+    PROFILE_ZONE( "Replay_Step" );
+
+    const uint64_t tick = Sim_GetTickCount( sim );
+    if ( tick >= replay->endTick ) {
+        return tick == replay->endTick ? kReplayStep_End : kReplayStep_Error;
+    }
+    if ( replay->cursor.tick <= tick ) {
+        return kReplayStep_Error;
+    }
+
+    if ( tick % kReplay_SnapshotInterval == 0 ) {
+        TakeSnapshot( replay, sim, tick );
+    }
+
+    uint64_t hash = 0;
+    int hasHash = 0;
+    if ( replay->cursor.tick == tick + 1 && !ReadRecord( replay, &replay->cursor, sim, &hash, &hasHash ) ) {
+        return kReplayStep_Error;
+    }
+
+    Sim_Tick( sim );
+
+    return hasHash && hash != Sim_GetTickHash( sim ) ? kReplayStep_Desync : kReplayStep_Ok;
+}
+
+int Replay_Seek( replay_s * const replay, sim_s * const sim, const uint64_t tick ) {
+    PROFILE_ZONE( "Replay_Seek" );
+
+    if ( tick > replay->endTick ) {
+        return 0;
+    }
+
+    // the newest snapshot at or before tick, if it is behind the sim or jumps ahead of it
+    const uint64_t current = Sim_GetTickCount( sim );
+    for ( size_t i = ( size_t )( tick / kReplay_SnapshotInterval ) + 1; i-- > 0; ) {
+        const replaySnapshot_s * const snapshot = &replay->snapshot[ i ];
+        if ( snapshot->state.size == 0 ) {
+            continue;
+        }
+        if ( tick < current || i * kReplay_SnapshotInterval > current ) {
+            streamReader_s r;
+            Stream_InitReader( &r, snapshot->state.data, snapshot->state.size );
+            if ( !Sim_Load( sim, &r ) ) {
+                return 0;
+            }
+            replay->cursor = snapshot->cursor;
+        }
+        break;
+    }
+
+    if ( Sim_GetTickCount( sim ) > tick ) {
+        return 0;
+    }
+    while ( Sim_GetTickCount( sim ) < tick ) {
+        if ( Replay_Step( replay, sim ) != kReplayStep_Ok ) {
+            return 0;
+        }
+    }
+    return 1;
+}
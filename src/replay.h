@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_REPLAY_H___
+#define ___RTSFS_REPLAY_H___
+
+#include "sim.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// replays: the commands a sim applied each tick, enough to run the same match again from its desc.
+//
+// a replay file is a header with the sim desc, then one record for each tick that applied commands: the distance in
+// ticks from the previous record, the command count, the commands, and every kReplay_HashInterval ticks the tick
+// hash so playback can tell where it desynced. moves store their units and target as zigzag varint deltas from the
+// previous move's, which for a selection of neighbouring entities is mostly a byte each. an idle tick costs nothing.
+//
+// the writer encodes on the sim thread into fixed blocks and hands full ones to its own thread for the file writes,
+// so recording never waits on the disk unless the disk falls a whole ring of blocks behind.
+//
+// playback takes an in-memory snapshot of the sim every kReplay_SnapshotInterval ticks it passes, so seeking back
+// loads the nearest snapshot before the target and steps from there, rather than replaying from the start.
+
+static constexpr uint64_t kReplay_HashInterval = 60;       // ticks between stored tick hashes
+static constexpr uint64_t kReplay_SnapshotInterval = 3600; // ticks between seek snapshots
+
+typedef struct replayWriter_s replayWriter_s;
+typedef struct replay_s replay_s;
+
+typedef enum replayStep_e {
+    kReplayStep_Ok = 0,
+    kReplayStep_End,    // the sim is at the last recorded tick; nothing ran
+    kReplayStep_Desync, // the tick ran but its hash differs from the recorded one
+    kReplayStep_Error   // the sim is not on a tick of this replay, or a command couldn't be submitted
+} replayStep_e;
+
+// starts recording a sim created from desc into a new file at path. returns nullptr on failure.
+replayWriter_s * ReplayWriter_Create( const char * const path, const simDesc_s * const desc );
+
+// records a tick, with the commands and hash Sim_GetTickCommands and Sim_GetTickHash return right after it
+void ReplayWriter_WriteTick( replayWriter_s * const w, const uint64_t tick, const simCommand_s * const commands, const size_t count, const uint64_t hash );
+
+// finishes the file, ending on the last tick written, and waits for it to be on disk. returns zero if any of it
+// failed to write.
+int ReplayWriter_Destroy( replayWriter_s * const w );
+
+// reads and validates a whole replay file. returns nullptr if it is missing or damaged.
+replay_s * Replay_Open( const char * const path );
+
+void Replay_Close( replay_s * const replay );
+
+// the desc to create the sim for Replay_Step and Replay_Seek from
+const simDesc_s * Replay_GetDesc( const replay_s * const replay );
+
+uint64_t Replay_GetEndTick( const replay_s * const replay );
+
+// runs the sim's next tick with its recorded commands
+replayStep_e Replay_Step( replay_s * const replay, sim_s * const sim );
+
+// moves the sim to tick, forwards by stepping or backwards from a snapshot. returns zero past the end, or if a
+// tick on the way desynced or failed.
+int Replay_Seek( replay_s * const replay, sim_s * const sim, const uint64_t tick );
+
+#endif // ___RTSFS_REPLAY_H___
@@ -21,7 +21,7 @@
  */
 
 #ifndef ___RTSFS_RGBA_H___
-#define ___RTSFS_RBBA_H___
+#define ___RTSFS_RGBA_H___
 
 #include <stdint.h>
 
@@ -0,0 +1,663 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "sim.h"
+#include "arena.h"
+#include "hash.h"
+#include "job.h"
+#include "los.h"
+#include "mem.h"
+#include "profile.h"
+#include "random.h"
+#include "simd.h"
+#include "steer.h"
+
+#include <new>
+
+// commands submitted for one tick; the units of each follow the previous command's in unit
+typedef struct simQueue_s {
+    simCommand_s * command = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+    ecsEntity_s * unit = nullptr;
+    size_t unitCount = 0;
+    size_t unitCapacity = 0;
+} simQueue_s;
+
+typedef struct sim_s {
+    ecs_s * ecs = nullptr;
+    spatialHash_s * spatial = nullptr;
+    flowField_s * flow = nullptr;
+    path_s * path = nullptr;
+    los_s * los = nullptr;
+    vec2_s< fixed_s > size;
+    fixed_s orderStep;          // order speed in world units per tick
+    random_s random;
+    uint64_t * chunkHash = nullptr; // per movement chunk, folded into stateHash in chunk order
+    size_t chunkCapacity = 0;
+    uint64_t stateHash = 0;
+    uint64_t tick = 0;
+    vec2_s< int32_t > mapSize;
+    simQueue_s queue[ 2 ];      // one takes submissions while the other holds what the last tick applied
+    size_t pending = 0;
+} sim_s;
+
+// a tick's scratch for steering, from the frame arena: the ordered units, and for each
+typedef struct simSteer_s {
+    ecsEntity_s * entity = nullptr;
+    uint32_t * unit = nullptr;              // its movement slot,
+    vec2_s< fixed_s > * desired = nullptr;  // the velocity its flow field asks for,
+    vec2_s< fixed_s > * result = nullptr;   // and the one steering gave it
+    uint8_t * touching = nullptr;
+} simSteer_s;
+
+static constexpr uint32_t kSim_MovementGroup = kEcsComponent_Position | kEcsComponent_Velocity;
+
+static constexpr int32_t kSim_MaxSpeed = 64; // world units per second
+static constexpr int32_t kSim_OrderSpeed = 48;
+static constexpr int32_t kSim_MaxHealth = 100;
+static constexpr float kSim_CellSize = 16.0f;  // around the typical proximity query radius
+static constexpr int32_t kSim_MaxExtent = 16384;
+static constexpr int32_t kSim_ArrivalCells = 4;  // map cells from the goal within which a unit pushed back has arrived
+static constexpr int32_t kSim_CrowdCells = 32;   // and within which one pushed back by stopped units has
+static constexpr uint64_t kSim_HashSeed = 0x5349d2a1e3f1b3c5ull;
+static constexpr uint32_t kSim_SaveMagic = 0x534d4953; // "SIMS"
+static constexpr uint32_t kSim_SaveVersion = 1;
+
+// position += velocity over count interleaved x, y pairs, reflecting off [ 0, size ], folding the new positions into
+// lanes as they are stored. the pairs are treated as a flat array, so x and y go through the same lanes with a per
+// lane bound. integer only, so every path gives the same bits.
+//
+// velocities are left out of the hash: they cost as much again, and every velocity ends up in the next tick's
+// positions, so a velocity desync still shows one tick later.
+static void MoveUnits( int32_t * const position, int32_t * const velocity, const size_t count, const vec2_s< fixed_s > size, hashLanes_s * const lanes ) {
+    const size_t n = count * 2;
+    size_t i = 0;
+
+#if RTSFS_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vbound = _mm_setr_epi32( size.x.raw, size.y.raw, size.x.raw, size.y.raw );
+    const __m128i vbound2 = _mm_add_epi32( vbound, vbound );
+    __m128i a = _mm_loadu_si128( ( const __m128i * )lanes->a );
+    __m128i b = _mm_loadu_si128( ( const __m128i * )lanes->b );
+
+    for ( ; i + 4 <= n; i += 4 ) {
+        __m128i p = _mm_loadu_si128( ( const __m128i * )( position + i ) );
+        __m128i v = _mm_loadu_si128( ( const __m128i * )( velocity + i ) );
+        p = _mm_add_epi32( p, v );
+
+        const __m128i below = _mm_cmpgt_epi32( zero, p );
+        const __m128i above = _mm_cmpgt_epi32( p, vbound );
+        const __m128i reflected = _mm_or_si128( _mm_and_si128( below, _mm_sub_epi32( zero, p ) ),
+            _mm_and_si128( above, _mm_sub_epi32( vbound2, p ) ) );
+        const __m128i hit = _mm_or_si128( below, above );
+        p = _mm_or_si128( _mm_andnot_si128( hit, p ), reflected );
+        v = _mm_sub_epi32( _mm_xor_si128( v, hit ), hit ); // negate where hit
+
+        _mm_storeu_si128( ( __m128i * )( position + i ), p );
+        _mm_storeu_si128( ( __m128i * )( velocity + i ), v );
+
+        a = _mm_add_epi32( a, p );
+        b = _mm_add_epi32( b, a );
+    }
+
+    _mm_storeu_si128( ( __m128i * )lanes->a, a );
+    _mm_storeu_si128( ( __m128i * )lanes->b, b );
+#endif
+
+    for ( ; i < n; i++ ) {
+        const int32_t bound = ( i & 1 ) ? size.y.raw : size.x.raw;
+        int32_t p = position[ i ] + velocity[ i ];
+        if ( p < 0 ) {
+            p = 0 - p;
+            velocity[ i ] = -velocity[ i ];
+        } else if ( p > bound ) {
+            p = ( bound + bound ) - p;
+            velocity[ i ] = -velocity[ i ];
+        }
+        position[ i ] = p;
+
+        lanes->a[ i & 3 ] += ( uint32_t )p;
+        lanes->b[ i & 3 ] += lanes->a[ i & 3 ];
+    }
+}
+
+static inline vec2_s< int32_t > MapCell( const vec2_s< fixed_s > position ) {
+    return { Fixed_ToInt( position.x ) / kSim_MapCellSize, Fixed_ToInt( position.y ) / kSim_MapCellSize };
+}
+
+// steers ordered units along their flow fields and around their neighbours. walks the order set backwards, so
+// dropping an order (which swaps the last one into its slot) never skips one.
+//
+// a crowd can't all fit in the goal cell, so a unit near the goal whose neighbours push it back instead of letting
+// it make headway has arrived too, and so has one further out pushed back by units that already stopped: the
+// crowd grows outwards from the goal rather than packing tighter around it.
+static void SteerOrders( sim_s * const sim, const ecsView_s * const orders, const simSteer_s * const steer ) {
+    const ecsView_s view = *orders;
+
+    size_t count = 0;
+    for ( size_t i = view.count; i-- > 0; ) {
+        const ecsEntity_s unit = view.entity[ i ];
+        const uint32_t handle = view.order[ i ];
+
+        // a field still building is waited for rather than skipped: when units start moving must not depend on
+        // how fast this machine's flow field thread happens to be
+        if ( !FlowField_IsReady( sim->flow, handle ) ) {
+            FlowField_Wait( sim->flow, handle );
+        }
+
+        const vec2_s< fixed_s > * const position = Ecs_GetPosition( sim->ecs, unit );
+        vec2_s< fixed_s > * const velocity = Ecs_GetVelocity( sim->ecs, unit );
+        if ( position == nullptr || velocity == nullptr ) {
+            continue;
+        }
+
+        const vec2_s< fixed_s > direction = FlowField_Sample( sim->flow, handle, MapCell( *position ) );
+        if ( direction.x.raw == 0 && direction.y.raw == 0 ) {
+            *velocity = vec2_zero< fixed_s >();
+            FlowField_Release( sim->flow, handle );
+            Ecs_Remove( sim->ecs, unit, kEcsComponent_Order );
+            continue;
+        }
+
+        steer->entity[ count ] = unit;
+        steer->desired[ count ] = Fixed_Vec2Scale( direction, sim->orderStep );
+        count++;
+    }
+
+    ecsView_s movement;
+    if ( count == 0 || !Ecs_Query( sim->ecs, kSim_MovementGroup, &movement ) ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        steer->unit[ i ] = ( uint32_t )( Ecs_GetPosition( sim->ecs, steer->entity[ i ] ) - movement.position );
+    }
+
+    steerBatch_s batch;
+    batch.position = movement.position;
+    batch.velocity = movement.velocity;
+    batch.units = steer->unit;
+    batch.desired = steer->desired;
+    batch.count = count;
+    batch.maxStep = sim->orderStep;
+    batch.result = steer->result;
+    batch.touching = steer->touching;
+    {
+        PROFILE_ZONE( "Sim_Steer" );
+        Steer_Batch( sim->spatial, &batch );
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const vec2_s< fixed_s > desired = steer->desired[ i ];
+        const vec2_s< fixed_s > steered = steer->result[ i ];
+        movement.velocity[ steer->unit[ i ] ] = steered;
+
+        const int64_t headway = ( int64_t )desired.x.raw * steered.x.raw + ( int64_t )desired.y.raw * steered.y.raw;
+        if ( headway > 0 ) {
+            continue;
+        }
+
+        const ecsEntity_s unit = steer->entity[ i ];
+        uint32_t * const order = Ecs_GetOrder( sim->ecs, unit );
+        const vec2_s< int32_t > goal = FlowField_GetGoal( sim->flow, *order );
+        const vec2_s< int32_t > cell = MapCell( movement.position[ steer->unit[ i ] ] );
+        const int32_t dx = cell.x - goal.x;
+        const int32_t dy = cell.y - goal.y;
+        const int32_t reach = steer->touching[ i ] ? kSim_CrowdCells : kSim_ArrivalCells;
+        if ( dx >= -reach && dx <= reach && dy >= -reach && dy <= reach ) {
+            movement.velocity[ steer->unit[ i ] ] = vec2_zero< fixed_s >();
+            FlowField_Release( sim->flow, *order );
+            Ecs_Remove( sim->ecs, unit, kEcsComponent_Order );
+        }
+    }
+}
+
+static void FollowOrders( sim_s * const sim ) {
+    PROFILE_ZONE( "Sim_Orders" );
+
+    ecsView_s view;
+    if ( !Ecs_Query( sim->ecs, kEcsComponent_Order, &view ) ) {
+        return;
+    }
+
+    // a tick can run many times a frame, so its scratch goes back as soon as it is done
+    const arenaMark_s mark = FrameArena_GetMark();
+    simSteer_s steer;
+    steer.entity = FrameArena_New< ecsEntity_s >( view.count );
+    steer.unit = FrameArena_New< uint32_t >( view.count );
+    steer.desired = FrameArena_New< vec2_s< fixed_s > >( view.count );
+    steer.result = FrameArena_New< vec2_s< fixed_s > >( view.count );
+    steer.touching = FrameArena_New< uint8_t >( view.count );
+    if ( steer.entity != nullptr && steer.unit != nullptr && steer.desired != nullptr && steer.result != nullptr && steer.touching != nullptr ) {
+        SteerOrders( sim, &view, &steer );
+    }
+    FrameArena_Rewind( mark );
+}
+
+sim_s * Sim_Create( const simDesc_s * const desc ) {
+    // positions reflect at twice the extent, which has to stay inside 16.16 range
+    if ( desc->tickRate == 0 || desc->playerCount == 0 || desc->playerCount > 256 || desc->size.x <= 0 || desc->size.y <= 0 ||
+         desc->size.x >= kSim_MaxExtent || desc->size.y >= kSim_MaxExtent ) {
+        return nullptr;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( sim_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    sim_s * const sim = new ( mem ) sim_s;
+    sim->size = Fixed_Vec2FromInt( desc->size.x, desc->size.y );
+    sim->orderStep = Fixed_FromRatio( kSim_OrderSpeed, ( int32_t )desc->tickRate );
+    Random_Seed( &sim->random, desc->seed, 0 );
+
+    const uint32_t groups[] = { kSim_MovementGroup };
+    const size_t capacity = desc->unitCount > 0 ? desc->unitCount : 1;
+    const rect_s< float > world{ { 0.0f, 0.0f }, { ( float )desc->size.x, ( float )desc->size.y } };
+    sim->ecs = Ecs_Create( capacity, groups, 1 );
+    sim->spatial = SpatialHash_Create( &world, kSim_CellSize, capacity );
+    sim->mapSize = { desc->size.x / kSim_MapCellSize + 1, desc->size.y / kSim_MapCellSize + 1 };
+    const vec2_s< size_t > mapSize{ ( size_t )sim->mapSize.x, ( size_t )sim->mapSize.y };
+    sim->flow = FlowField_Create( mapSize );
+    sim->path = Path_Create( mapSize );
+    sim->los = Los_Create( mapSize );
+    sim->chunkCapacity = ( capacity + kEcs_ChunkSize - 1 ) / kEcs_ChunkSize;
+    sim->chunkHash = ( uint64_t * )Mem_Alloc( kMemTag_Sim, sim->chunkCapacity * sizeof( uint64_t ) );
+    if ( sim->ecs == nullptr || sim->spatial == nullptr || sim->flow == nullptr || sim->path == nullptr || sim->los == nullptr ||
+         sim->chunkHash == nullptr ) {
+        Sim_Destroy( sim );
+        return nullptr;
+    }
+
+    const fixed_s maxStep = Fixed_FromRatio( kSim_MaxSpeed, ( int32_t )desc->tickRate );
+    for ( size_t i = 0; i < desc->unitCount; i++ ) {
+        const ecsEntity_s unit = Ecs_CreateEntity( sim->ecs );
+        Ecs_Add( sim->ecs, unit, kSim_MovementGroup | kEcsComponent_Health | kEcsComponent_Owner );
+
+        vec2_s< fixed_s > * const position = Ecs_GetPosition( sim->ecs, unit );
+        position->x = Random_Fixed( &sim->random, fixed_s{}, sim->size.x );
+        position->y = Random_Fixed( &sim->random, fixed_s{}, sim->size.y );
+        vec2_s< fixed_s > * const velocity = Ecs_GetVelocity( sim->ecs, unit );
+        velocity->x = Random_Fixed( &sim->random, -maxStep, maxStep );
+        velocity->y = Random_Fixed( &sim->random, -maxStep, maxStep );
+        *Ecs_GetHealth( sim->ecs, unit ) = Fixed_FromInt( kSim_MaxHealth );
+        *Ecs_GetOwner( sim->ecs, unit ) = ( uint8_t )( i % desc->playerCount );
+    }
+
+    // steering reads the neighbours from the hash from the first tick on
+    ecsView_s view;
+    if ( Ecs_Query( sim->ecs, kSim_MovementGroup, &view ) ) {
+        SpatialHash_Build( sim->spatial, view.position, view.count );
+    }
+
+    sim->stateHash = Sim_HashState( sim );
+    return sim;
+}
+
+void Sim_Destroy( sim_s * const sim ) {
+    if ( sim == nullptr ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < 2; i++ ) {
+        Mem_Free( sim->queue[ i ].unit );
+        Mem_Free( sim->queue[ i ].command );
+    }
+    Mem_Free( sim->chunkHash );
+    Los_Destroy( sim->los );
+    Path_Destroy( sim->path );
+    FlowField_Destroy( sim->flow );
+    SpatialHash_Destroy( sim->spatial );
+    Ecs_Destroy( sim->ecs );
+
+    sim->~sim_s();
+    Mem_Free( sim );
+}
+
+typedef struct simMoveTask_s {
+    sim_s * sim = nullptr;
+    const ecsView_s * view = nullptr;
+} simMoveTask_s;
+
+// chunks [ first, last ) of the movement group; units only touch their own slots, so chunks run on any job thread.
+// each chunk hashes into its own slot, so the combined hash doesn't depend on how the chunks were split.
+static void MoveChunks( void * const param, const size_t first, const size_t last ) {
+    const simMoveTask_s * const task = ( const simMoveTask_s * )param;
+    for ( size_t c = first; c < last; c++ ) {
+        const ecsView_s chunk = Ecs_GetChunk( task->view, c );
+        hashLanes_s lanes;
+        MoveUnits( &chunk.position->x.raw, &chunk.velocity->x.raw, chunk.count, task->sim->size, &lanes );
+        task->sim->chunkHash[ c ] = Hash_Finish( &lanes, c );
+    }
+}
+
+// the state the tick wrote: positions through the chunk hashes taken as they moved, plus the order set and the rng.
+// health and owner aren't written by any system yet; Sim_HashState covers them.
+static uint64_t HashTick( const sim_s * const sim, const size_t chunkCount ) {
+    uint64_t h = Hash_Mix( kSim_HashSeed, sim->tick );
+    h = Hash_Mix( h, sim->random.state );
+    h = Hash_Mix( h, Ecs_GetEntityCount( sim->ecs ) );
+    for ( size_t c = 0; c < chunkCount; c++ ) {
+        h = Hash_Mix( h, sim->chunkHash[ c ] );
+    }
+
+    ecsView_s orders;
+    if ( Ecs_Query( sim->ecs, kEcsComponent_Order, &orders ) ) {
+        h = Hash_Mix( h, Hash_Words( &orders.entity->value, orders.count, orders.count ) );
+        h = Hash_Mix( h, Hash_Words( orders.order, orders.count, orders.count ) );
+    }
+    return h;
+}
+
+static void SetTerrain( sim_s * const sim, const vec2_s< int32_t > cell, const uint8_t cost ) {
+    FlowField_SetCost( sim->flow, cell, cost );
+    Path_SetCost( sim->path, cell, cost );
+    Los_SetBlocked( sim->los, cell, cost == kFlowField_Wall );
+}
+
+// a full flow field cache drops the order; that happens the same way on every machine
+static void OrderMove( sim_s * const sim, const ecsEntity_s * const units, const size_t count, const vec2_s< fixed_s > target ) {
+    const uint32_t handle = FlowField_Acquire( sim->flow, MapCell( target ) );
+    if ( handle == 0 ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        uint32_t * order = Ecs_GetOrder( sim->ecs, units[ i ] );
+        if ( order != nullptr ) {
+            FlowField_Release( sim->flow, *order );
+        } else if ( Ecs_Add( sim->ecs, units[ i ], kEcsComponent_Order ) ) {
+            order = Ecs_GetOrder( sim->ecs, units[ i ] );
+        } else {
+            continue;
+        }
+
+        *order = handle;
+        FlowField_AddRef( sim->flow, handle );
+    }
+
+    FlowField_Release( sim->flow, handle );
+}
+
+// swaps the queues and applies what was submitted, pointing each move at its units now that they can't move
+static void ApplyCommands( sim_s * const sim ) {
+    simQueue_s * const applied = &sim->queue[ sim->pending ];
+    sim->pending ^= 1;
+    sim->queue[ sim->pending ].count = 0;
+    sim->queue[ sim->pending ].unitCount = 0;
+
+    size_t unit = 0;
+    for ( size_t i = 0; i < applied->count; i++ ) {
+        simCommand_s * const command = &applied->command[ i ];
+        switch ( command->type ) {
+            case kSimCommand_Move:
+                command->units = applied->unit + unit;
+                unit += command->unitCount;
+                OrderMove( sim, command->units, command->unitCount, command->target );
+                break;
+
+            case kSimCommand_Terrain:
+                SetTerrain( sim, command->cell, command->cost );
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void Sim_Tick( sim_s * const sim ) {
+    PROFILE_ZONE( "Sim_Tick" );
+
+    ApplyCommands( sim );
+
+    Path_Update( sim->path );
+
+    FollowOrders( sim );
+
+    size_t chunkCount = 0;
+    ecsView_s view;
+    if ( Ecs_Query( sim->ecs, kSim_MovementGroup, &view ) ) {
+        {
+            PROFILE_ZONE( "Sim_Movement" );
+            simMoveTask_s task;
+            task.sim = sim;
+            task.view = &view;
+            chunkCount = Ecs_GetChunkCount( &view );
+            Job_ParallelFor( chunkCount, 1, MoveChunks, &task );
+        }
+
+        SpatialHash_Build( sim->spatial, view.position, view.count );
+    }
+
+    sim->tick++;
+
+    {
+        PROFILE_ZONE( "Sim_Hash" );
+        sim->stateHash = HashTick( sim, chunkCount );
+    }
+}
+
+uint64_t Sim_GetTickHash( const sim_s * const sim ) {
+    return sim->stateHash;
+}
+
+// bytes as whole words plus a word of leftovers
+static uint64_t HashBytes( const uint64_t h, const void * const data, const size_t bytes ) {
+    const uint8_t * const byte = ( const uint8_t * )data;
+    uint32_t tail = 0;
+    for ( size_t i = bytes & ~( size_t )3; i < bytes; i++ ) {
+        tail = ( tail << 8 ) | byte[ i ];
+    }
+    return Hash_Mix( Hash_Words( ( const uint32_t * )data, bytes / 4, h ), tail );
+}
+
+uint64_t Sim_HashState( sim_s * const sim ) {
+    PROFILE_ZONE( "Sim_HashState" );
+
+    uint64_t h = Hash_Mix( kSim_HashSeed, sim->tick );
+    h = Hash_Mix( h, sim->random.state );
+    h = Hash_Mix( h, Ecs_GetEntityCount( sim->ecs ) );
+
+    static const uint32_t component[ kEcs_ComponentCount ] = {
+        kEcsComponent_Position, kEcsComponent_Velocity, kEcsComponent_Health, kEcsComponent_Owner, kEcsComponent_Order,
+    };
+    static const size_t componentSize[ kEcs_ComponentCount ] = {
+        sizeof( vec2_s< fixed_s > ), sizeof( vec2_s< fixed_s > ), sizeof( fixed_s ), sizeof( uint8_t ), sizeof( uint32_t ),
+    };
+
+    for ( size_t c = 0; c < kEcs_ComponentCount; c++ ) {
+        ecsView_s view;
+        if ( !Ecs_Query( sim->ecs, component[ c ], &view ) ) {
+            continue;
+        }
+
+        // a single component query fills in just that component's pointer
+        const void * const values = view.position ? ( const void * )view.position : view.velocity ? ( const void * )view.velocity :
+            view.health ? ( const void * )view.health : view.owner ? ( const void * )view.owner : ( const void * )view.order;
+        h = Hash_Mix( h, view.count );
+        h = HashBytes( h, view.entity, view.count * sizeof( ecsEntity_s ) );
+        h = HashBytes( h, values, view.count * componentSize[ c ] );
+    }
+    return h;
+}
+
+uint64_t Sim_GetTickCount( const sim_s * const sim ) {
+    return sim->tick;
+}
+
+ecs_s * Sim_GetEcs( sim_s * const sim ) {
+    return sim->ecs;
+}
+
+flowField_s * Sim_GetFlowField( sim_s * const sim ) {
+    return sim->flow;
+}
+
+const path_s * Sim_GetPath( const sim_s * const sim ) {
+    return sim->path;
+}
+
+const spatialHash_s * Sim_GetSpatialHash( const sim_s * const sim ) {
+    return sim->spatial;
+}
+
+los_s * Sim_GetLos( sim_s * const sim ) {
+    return sim->los;
+}
+
+int Sim_Submit( sim_s * const sim, const simCommand_s * const command ) {
+    if ( command->type >= kSimCommand_Count ) {
+        return 0;
+    }
+
+    simQueue_s * const queue = &sim->queue[ sim->pending ];
+    if ( queue->count == queue->capacity ) {
+        const size_t capacity = queue->capacity > 0 ? queue->capacity * 2 : 16;
+        const size_t bytes = capacity * sizeof( simCommand_s );
+        simCommand_s * const grown = ( simCommand_s * )Mem_Realloc( kMemTag_Sim, queue->command, bytes );
+        if ( grown == nullptr ) {
+            return 0;
+        }
+        queue->command = grown;
+        queue->capacity = capacity;
+    }
+
+    const size_t units = command->type == kSimCommand_Move ? command->unitCount : 0;
+    if ( queue->unitCapacity - queue->unitCount < units ) {
+        size_t capacity = queue->unitCapacity > 0 ? queue->unitCapacity : 256;
+        while ( capacity - queue->unitCount < units ) {
+            capacity *= 2;
+        }
+        const size_t bytes = capacity * sizeof( ecsEntity_s );
+        ecsEntity_s * const grown = ( ecsEntity_s * )Mem_Realloc( kMemTag_Sim, queue->unit, bytes );
+        if ( grown == nullptr ) {
+            return 0;
+        }
+        queue->unit = grown;
+        queue->unitCapacity = capacity;
+    }
+
+    simCommand_s * const queued = &queue->command[ queue->count++ ];
+    *queued = *command;
+    queued->units = nullptr;
+    queued->unitCount = units;
+    for ( size_t i = 0; i < units; i++ ) {
+        queue->unit[ queue->unitCount++ ] = command->units[ i ];
+    }
+    return 1;
+}
+
+const simCommand_s * Sim_GetTickCommands( const sim_s * const sim, size_t * const count ) {
+    const simQueue_s * const applied = &sim->queue[ sim->pending ^ 1 ];
+    *count = applied->count;
+    return applied->command;
+}
+
+void Sim_SaveDesc( const simDesc_s * const desc, streamWriter_s * const w ) {
+    Stream_WriteU32( w, desc->seed );
+    Stream_WriteVarint( w, desc->unitCount );
+    Stream_WriteVarint( w, desc->playerCount );
+    Stream_WriteVarint( w, desc->tickRate );
+    Stream_WriteZigzag( w, desc->size.x );
+    Stream_WriteZigzag( w, desc->size.y );
+}
+
+int Sim_LoadDesc( simDesc_s * const desc, streamReader_s * const r ) {
+    desc->seed = Stream_ReadU32( r );
+    desc->unitCount = ( size_t )Stream_ReadVarint( r );
+    desc->playerCount = ( size_t )Stream_ReadVarint( r );
+    const uint64_t tickRate = Stream_ReadVarint( r );
+    desc->tickRate = ( uint32_t )tickRate;
+    const int64_t width = Stream_ReadZigzag( r );
+    const int64_t height = Stream_ReadZigzag( r );
+    desc->size = { ( int32_t )width, ( int32_t )height };
+    return !r->failed && tickRate <= UINT32_MAX && width == desc->size.x && height == desc->size.y;
+}
+
+int Sim_Save( sim_s * const sim, streamWriter_s * const w ) {
+    PROFILE_ZONE( "Sim_Save" );
+
+    if ( sim->queue[ sim->pending ].count != 0 ) {
+        return 0;
+    }
+
+    Stream_WriteU32( w, kSim_SaveMagic );
+    Stream_WriteU32( w, kSim_SaveVersion );
+    Stream_WriteU64( w, sim->tick );
+    Stream_WriteU64( w, sim->random.state );
+    Stream_WriteU64( w, sim->random.stream );
+    Stream_WriteU64( w, sim->stateHash );
+    Stream_WriteU32( w, ( uint32_t )sim->size.x.raw );
+    Stream_WriteU32( w, ( uint32_t )sim->size.y.raw );
+    Stream_WriteU32( w, ( uint32_t )sim->orderStep.raw );
+    Ecs_Save( sim->ecs, w );
+    FlowField_Save( sim->flow, w );
+    return !w->failed;
+}
+
+int Sim_Load( sim_s * const sim, streamReader_s * const r ) {
+    PROFILE_ZONE( "Sim_Load" );
+
+    if ( Stream_ReadU32( r ) != kSim_SaveMagic || Stream_ReadU32( r ) != kSim_SaveVersion ) {
+        return 0;
+    }
+
+    const uint64_t tick = Stream_ReadU64( r );
+    random_s random;
+    random.state = Stream_ReadU64( r );
+    random.stream = Stream_ReadU64( r );
+    const uint64_t stateHash = Stream_ReadU64( r );
+    const int sameDesc = Stream_ReadU32( r ) == ( uint32_t )sim->size.x.raw && Stream_ReadU32( r ) == ( uint32_t )sim->size.y.raw &&
+        Stream_ReadU32( r ) == ( uint32_t )sim->orderStep.raw;
+    if ( !sameDesc || r->failed || !Ecs_Load( sim->ecs, r ) || !FlowField_Load( sim->flow, r ) ) {
+        return 0;
+    }
+
+    // the path graph is rebuilt from the restored costs rather than saved. its node numbering can then differ from
+    // the saved sim's, which is fine while nothing in a tick reads paths.
+    for ( int32_t y = 0; y < sim->mapSize.y; y++ ) {
+        for ( int32_t x = 0; x < sim->mapSize.x; x++ ) {
+            const uint8_t cost = FlowField_GetCost( sim->flow, { x, y } );
+            Path_SetCost( sim->path, { x, y }, cost );
+            Los_SetBlocked( sim->los, { x, y }, cost == kFlowField_Wall );
+        }
+    }
+    if ( Path_Update( sim->path ) == SIZE_MAX ) {
+        return 0;
+    }
+
+    ecsView_s view;
+    if ( Ecs_Query( sim->ecs, kSim_MovementGroup, &view ) ) {
+        SpatialHash_Build( sim->spatial, view.position, view.count );
+    }
+
+    for ( size_t i = 0; i < 2; i++ ) {
+        sim->queue[ i ].count = 0;
+        sim->queue[ i ].unitCount = 0;
+    }
+    sim->tick = tick;
+    sim->random = random;
+    sim->stateHash = stateHash;
+    return 1;
+}
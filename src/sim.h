@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_SIM_H___
+#define ___RTSFS_SIM_H___
+
+#include "ecs.h"
+#include "flowfield.h"
+#include "los.h"
+#include "path.h"
+#include "fixed.h"
+#include "spatialhash.h"
+#include "stream.h"
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the simulation world: the unit entities and the systems that advance them one fixed tick at a time.
+//
+// the sim is deterministic: all of its state is integer or 16.16 fixed point, its only randomness is its own
+// seeded random_s, and no result depends on timing or on how many job threads split the work. the same seed and
+// the same orders on the same ticks give the same bits on any machine, which lockstep and replays build on. every
+// tick ends with a hash of the state it wrote, so comparing hashes between peers catches a desync on the tick it
+// happens, or for velocities on the next one, once they have moved a unit.
+//
+// units are entities with position, velocity, health and owner. position and velocity form an owning group, so
+// movement is a single pass over two packed arrays. after movement the spatial hash is rebuilt from that group's
+// positions, so its item indices are slots of the movement query.
+//
+// everything from outside that changes the sim is a command. commands are queued with Sim_Submit and applied at the
+// start of the next tick in the order they came in, so recording each tick's commands is enough to replay a match.
+//
+// a move order gives units the order component holding a flow field handle towards the target. each tick, before
+// movement, ordered units take their velocity from the field at their cell, steered around their neighbours in the
+// spatial hash, and drop the order on arrival.
+
+typedef struct sim_s sim_s;
+
+typedef enum simCommand_e : uint8_t {
+    kSimCommand_Move = 0, // units towards target, replacing their previous orders
+    kSimCommand_Terrain,  // the cost of entering cell, 1 to 254 or kFlowField_Wall, for group and single unit pathing
+    kSimCommand_Count
+} simCommand_e;
+
+typedef struct simCommand_s {
+    simCommand_e type = kSimCommand_Move;
+    const ecsEntity_s * units = nullptr; // move
+    size_t unitCount = 0;                // move
+    vec2_s< fixed_s > target;            // move
+    vec2_s< int32_t > cell;              // terrain
+    uint8_t cost = 0;                    // terrain
+} simCommand_s;
+
+typedef struct simDesc_s {
+    size_t unitCount = 0;
+    size_t playerCount = 2;
+    uint32_t seed = 1;
+    vec2_s< int32_t > size{ 1024, 1024 }; // world extent; units bounce off its edges
+    uint32_t tickRate = 60;               // ticks per second
+} simDesc_s;
+
+// returns nullptr on failure
+sim_s * Sim_Create( const simDesc_s * const desc );
+
+void Sim_Destroy( sim_s * const sim );
+
+// takes its scratch from the calling thread's frame arena and gives it back before returning
+void Sim_Tick( sim_s * const sim );
+
+uint64_t Sim_GetTickCount( const sim_s * const sim );
+
+ecs_s * Sim_GetEcs( sim_s * const sim );
+
+// hash of the state as of the end of the last tick, or of the initial state before the first one. it is folded into
+// the passes that write the state, so it costs next to nothing.
+uint64_t Sim_GetTickHash( const sim_s * const sim );
+
+// hash of every component of every entity; a full pass, for verifying snapshots and replays rather than every tick
+uint64_t Sim_HashState( sim_s * const sim );
+
+static constexpr int32_t kSim_MapCellSize = 8; // world units per map grid cell
+
+// queues command for the start of the next tick, copying its units. returns zero on an unknown type or when out of
+// memory.
+int Sim_Submit( sim_s * const sim, const simCommand_s * const command );
+
+// the commands the last tick applied, in order; valid until the next Sim_Tick
+const simCommand_s * Sim_GetTickCommands( const sim_s * const sim, size_t * const count );
+
+// appends desc to w, for files that recreate a sim
+void Sim_SaveDesc( const simDesc_s * const desc, streamWriter_s * const w );
+
+// returns zero if r doesn't hold a desc Sim_SaveDesc wrote
+int Sim_LoadDesc( simDesc_s * const desc, streamReader_s * const r );
+
+// appends the whole sim state to w. only between ticks with no commands queued; returns zero otherwise.
+int Sim_Save( sim_s * const sim, streamWriter_s * const w );
+
+// replaces the state with what Sim_Save wrote from a sim created with the same desc. returns zero if it doesn't
+// match or is damaged, after which the state is undefined until another load succeeds.
+int Sim_Load( sim_s * const sim, streamReader_s * const r );
+
+// the map grid that move orders path over
+flowField_s * Sim_GetFlowField( sim_s * const sim );
+
+// hierarchical paths over the map grid, brought up to date with terrain changes at the start of every tick
+const path_s * Sim_GetPath( const sim_s * const sim );
+
+// unit positions as of the end of the last tick
+const spatialHash_s * Sim_GetSpatialHash( const sim_s * const sim );
+
+// line of sight over the map grid, walls blocking, kept in step with terrain changes as they are applied
+los_s * Sim_GetLos( sim_s * const sim );
+
+#endif // ___RTSFS_SIM_H___
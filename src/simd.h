@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_SIMD_H___
+#define ___RTSFS_SIMD_H___
+
+// compile time selection of the vector paths used by the pixel and simulation kernels.
+// every kernel keeps a scalar fallback, so an instruction set that isn't listed here just runs slower.
+//
+//   RTSFS_SIMD_SSE2 - 128 bit integer ops; always present on x64
+//   RTSFS_SIMD_AVX2 - 256 bit integer ops and gathers; needs /arch:AVX2 or -mavx2
+
+#if defined( _M_X64 ) || defined( __SSE2__ ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define RTSFS_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined( __AVX2__ )
+#define RTSFS_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+#endif // ___RTSFS_SIMD_H___
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "snapshot.h"
+
+#include "file.h"
+#include "hash.h"
+#include "profile.h"
+#include "stream.h"
+#include "thread.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+static constexpr uint32_t kSnapshot_Magic = 0x4e535452; // "RTSN"
+static constexpr uint32_t kSnapshot_Version = 1;
+static constexpr uint64_t kSnapshot_HashSeed = 0x6e5a3c1f27d4b809ull;
+static constexpr size_t kSnapshot_Align = 64;     // of every block in the file
+static constexpr size_t kSnapshot_HeaderSize = 32;
+static constexpr size_t kSnapshot_EntrySize = 32; // of a block table entry
+static constexpr uint32_t kSnapshot_MaxBlocks = 16;
+static constexpr uint32_t kSnapshot_BufferCount = 2;
+static constexpr size_t kSnapshot_MaxPath = 512;
+
+typedef enum snapshotBlock_e : uint32_t {
+    kSnapshotBlock_Desc = 1, // Sim_SaveDesc
+    kSnapshotBlock_Sim,      // Sim_Save
+} snapshotBlock_e;
+
+// one save between the calling thread and the writer thread
+typedef struct snapshotBuffer_s {
+    streamWriter_s desc;
+    streamWriter_s state;
+    char path[ kSnapshot_MaxPath ] = {};
+} snapshotBuffer_s;
+
+typedef struct snapshotWriter_s {
+    thread_s * thread = nullptr;
+    signal_s * wake = nullptr; // raised when a save is queued or on quit
+    signal_s * done = nullptr; // raised when a save is written
+
+    snapshotBuffer_s buffer[ kSnapshot_BufferCount ];
+    std::atomic< uint32_t > head{ 0 }; // calling thread
+    uint8_t headPad[ 60 ];
+    std::atomic< uint32_t > tail{ 0 }; // writer thread
+    uint8_t tailPad[ 60 ];
+    std::atomic< int > quit{ 0 };
+
+    std::atomic< uint64_t > saves{ 0 };
+    std::atomic< uint64_t > failed{ 0 };
+    std::atomic< uint64_t > busy{ 0 };
+    std::atomic< size_t > bytes{ 0 };
+    std::atomic< uint64_t > copyNs{ 0 };
+    std::atomic< uint64_t > writeNs{ 0 };
+} snapshotWriter_s;
+
+typedef struct snapshot_s {
+    fileMapping_s * mapping = nullptr;
+    simDesc_s desc;
+    const uint8_t * state = nullptr; // in the mapping
+    size_t stateSize = 0;
+} snapshot_s;
+
+static size_t AlignUp( const size_t size ) {
+    return ( size + kSnapshot_Align - 1 ) & ~( kSnapshot_Align - 1 );
+}
+
+// blocks start 64 byte aligned in the file and the mapping, so the words can be read in place
+static uint64_t Checksum( const void * const data, const size_t size ) {
+    const uint8_t * const byte = ( const uint8_t * )data;
+    uint32_t tail = 0;
+    for ( size_t i = size & ~( size_t )3; i < size; i++ ) {
+        tail = ( tail << 8 ) | byte[ i ];
+    }
+    return Hash_Mix( Hash_Words( ( const uint32_t * )data, size / 4, kSnapshot_HashSeed ), ( ( uint64_t )tail << 32 ) | ( size & 3 ) );
+}
+
+// the header's checksum covers the header, with the checksum itself as zero, and the block table after it
+static void WriteHeader( uint8_t * const header, const uint32_t blockCount, const uint64_t fileSize ) {
+    streamWriter_s w;
+    w.data = header;
+    w.capacity = kSnapshot_HeaderSize;
+    Stream_WriteU32( &w, kSnapshot_Magic );
+    Stream_WriteU32( &w, kSnapshot_Version );
+    Stream_WriteU32( &w, blockCount );
+    Stream_WriteU32( &w, 0 );
+    Stream_WriteU64( &w, fileSize );
+    Stream_WriteU64( &w, 0 );
+    const uint64_t checksum = Checksum( header, kSnapshot_HeaderSize + blockCount * kSnapshot_EntrySize );
+    memcpy( header + kSnapshot_HeaderSize - sizeof( checksum ), &checksum, sizeof( checksum ) );
+}
+
+static int WriteFile( const snapshotBuffer_s * const buffer, size_t * const fileSize ) {
+    PROFILE_ZONE( "SnapshotWriter_Write" );
+
+    const streamWriter_s * const block[] = { &buffer->desc, &buffer->state };
+    const snapshotBlock_e type[] = { kSnapshotBlock_Desc, kSnapshotBlock_Sim };
+    const uint32_t blockCount = sizeof( block ) / sizeof( block[ 0 ] );
+
+    uint8_t header[ kSnapshot_HeaderSize + kSnapshot_MaxBlocks * kSnapshot_EntrySize ] = {};
+    const size_t headerSize = AlignUp( kSnapshot_HeaderSize + blockCount * kSnapshot_EntrySize );
+    streamWriter_s table;
+    table.data = header + kSnapshot_HeaderSize;
+    table.capacity = blockCount * kSnapshot_EntrySize;
+    size_t offset = headerSize;
+    for ( uint32_t i = 0; i < blockCount; i++ ) {
+        Stream_WriteU32( &table, type[ i ] );
+        Stream_WriteU32( &table, 0 );
+        Stream_WriteU64( &table, offset );
+        Stream_WriteU64( &table, block[ i ]->size );
+        Stream_WriteU64( &table, Checksum( block[ i ]->data, block[ i ]->size ) );
+        offset = AlignUp( offset + block[ i ]->size );
+    }
+    WriteHeader( header, blockCount, offset );
+
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, buffer->path, "wb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( buffer->path, "wb" );
+#endif
+    if ( file == nullptr ) {
+        return 0;
+    }
+
+    static const uint8_t zero[ kSnapshot_Align ] = {};
+    size_t written = headerSize;
+    int ok = fwrite( header, 1, headerSize, file ) == headerSize;
+    for ( uint32_t i = 0; i < blockCount && ok; i++ ) {
+        const size_t pad = AlignUp( block[ i ]->size ) - block[ i ]->size;
+        ok = fwrite( block[ i ]->data, 1, block[ i ]->size, file ) == block[ i ]->size && fwrite( zero, 1, pad, file ) == pad;
+        written += block[ i ]->size + pad;
+    }
+    if ( fclose( file ) != 0 ) {
+        ok = 0;
+    }
+
+    *fileSize = written;
+    return ok;
+}
+
+static void WriterThread( void * const param ) {
+    snapshotWriter_s * const w = ( snapshotWriter_s * )param;
+
+    uint32_t tail = w->tail.load( std::memory_order_relaxed );
+    for ( ;; ) {
+        const uint32_t head = w->head.load( std::memory_order_acquire );
+        while ( tail != head ) {
+            const uint64_t start = Timer_Nanoseconds();
+            size_t size = 0;
+            if ( WriteFile( &w->buffer[ tail % kSnapshot_BufferCount ], &size ) ) {
+                w->saves.fetch_add( 1, std::memory_order_relaxed );
+                w->bytes.store( size, std::memory_order_relaxed );
+            } else {
+                w->failed.fetch_add( 1, std::memory_order_relaxed );
+            }
+            w->writeNs.store( Timer_Nanoseconds() - start, std::memory_order_relaxed );
+
+            tail++;
+            w->tail.store( tail, std::memory_order_release );
+            Signal_Raise( w->done );
+        }
+
+        // quit is only set after the last save was queued
+        if ( w->quit.load( std::memory_order_acquire ) && tail == w->head.load( std::memory_order_acquire ) ) {
+            break;
+        }
+        Signal_Wait( w->wake );
+    }
+}
+
+snapshotWriter_s * SnapshotWriter_Create( void ) {
+    snapshotWriter_s * const w = ( snapshotWriter_s * )Mem_Alloc( kMemTag_Replay, sizeof( snapshotWriter_s ) );
+    if ( w == nullptr ) {
+        return nullptr;
+    }
+
+    new ( w ) snapshotWriter_s;
+    for ( uint32_t i = 0; i < kSnapshot_BufferCount; i++ ) {
+        w->buffer[ i ].desc.tag = kMemTag_Replay;
+        w->buffer[ i ].state.tag = kMemTag_Replay;
+    }
+
+    w->wake = Signal_Create();
+    w->done = Signal_Create();
+    w->thread = w->wake != nullptr && w->done != nullptr ? Thread_Create( WriterThread, w ) : nullptr;
+    if ( w->thread == nullptr ) {
+        SnapshotWriter_Destroy( w );
+        return nullptr;
+    }
+
+    return w;
+}
+
+void SnapshotWriter_Destroy( snapshotWriter_s * const w ) {
+    if ( w == nullptr ) {
+        return;
+    }
+
+    if ( w->thread != nullptr ) {
+        w->quit.store( 1, std::memory_order_release );
+        Signal_Raise( w->wake );
+        Thread_Join( w->thread );
+    }
+
+    for ( uint32_t i = 0; i < kSnapshot_BufferCount; i++ ) {
+        Stream_FreeWriter( &w->buffer[ i ].state );
+        Stream_FreeWriter( &w->buffer[ i ].desc );
+    }
+    Signal_Destroy( w->done );
+    Signal_Destroy( w->wake );
+    w->~snapshotWriter_s();
+    Mem_Free( w );
+}
+
+int SnapshotWriter_Save( snapshotWriter_s * const w, sim_s * const sim, const simDesc_s * const desc, const char * const path ) {
+    PROFILE_ZONE( "SnapshotWriter_Save" );
+
+    const uint32_t head = w->head.load( std::memory_order_relaxed );
+    if ( head - w->tail.load( std::memory_order_acquire ) == kSnapshot_BufferCount ) {
+        w->busy.fetch_add( 1, std::memory_order_relaxed );
+        return 0;
+    }
+
+    const uint64_t start = Timer_Nanoseconds();
+
+    // the buffers keep their capacity between saves, so after the first only the copies remain
+    snapshotBuffer_s * const buffer = &w->buffer[ head % kSnapshot_BufferCount ];
+    buffer->desc.size = 0;
+    buffer->state.size = 0;
+    const size_t pathSize = strlen( path ) + 1;
+    if ( pathSize > kSnapshot_MaxPath ) {
+        w->failed.fetch_add( 1, std::memory_order_relaxed );
+        return 0;
+    }
+    memcpy( buffer->path, path, pathSize );
+
+    Sim_SaveDesc( desc, &buffer->desc );
+    if ( buffer->desc.failed || !Sim_Save( sim, &buffer->state ) ) {
+        // a failed grow dropped nothing, so the next save can try again
+        buffer->desc.failed = 0;
+        buffer->state.failed = 0;
+        w->failed.fetch_add( 1, std::memory_order_relaxed );
+        return 0;
+    }
+
+    w->copyNs.store( Timer_Nanoseconds() - start, std::memory_order_relaxed );
+    w->head.store( head + 1, std::memory_order_release );
+    Signal_Raise( w->wake );
+    return 1;
+}
+
+void SnapshotWriter_Flush( snapshotWriter_s * const w ) {
+    PROFILE_ZONE( "SnapshotWriter_Flush" );
+
+    const uint32_t head = w->head.load( std::memory_order_relaxed );
+    while ( w->tail.load( std::memory_order_acquire ) != head ) {
+        Signal_Wait( w->done );
+    }
+}
+
+void SnapshotWriter_GetStats( const snapshotWriter_s * const w, snapshotStats_s * const stats ) {
+    stats->saves = w->saves.load( std::memory_order_relaxed );
+    stats->failed = w->failed.load( std::memory_order_relaxed );
+    stats->busy = w->busy.load( std::memory_order_relaxed );
+    stats->bytes = w->bytes.load( std::memory_order_relaxed );
+    stats->copyNs = w->copyNs.load( std::memory_order_relaxed );
+    stats->writeNs = w->writeNs.load( std::memory_order_relaxed );
+}
+
+// checks the header, the table and every block, and finds the blocks the sim needs
+static int Validate( snapshot_s * const snapshot ) {
+    const uint8_t * const data = ( const uint8_t * )File_GetData( snapshot->mapping );
+    const size_t size = File_GetSize( snapshot->mapping );
+
+    streamReader_s r;
+    Stream_InitReader( &r, data, size );
+    const int known = Stream_ReadU32( &r ) == kSnapshot_Magic && Stream_ReadU32( &r ) == kSnapshot_Version;
+    const uint32_t blockCount = Stream_ReadU32( &r );
+    Stream_ReadU32( &r );
+    const uint64_t fileSize = Stream_ReadU64( &r );
+    const uint64_t checksum = Stream_ReadU64( &r );
+    if ( !known || r.failed || blockCount > kSnapshot_MaxBlocks || fileSize != size || size < kSnapshot_HeaderSize + blockCount * kSnapshot_EntrySize ) {
+        return 0;
+    }
+
+    uint8_t header[ kSnapshot_HeaderSize + kSnapshot_MaxBlocks * kSnapshot_EntrySize ];
+    memcpy( header, data, kSnapshot_HeaderSize + blockCount * kSnapshot_EntrySize );
+    memset( header + kSnapshot_HeaderSize - sizeof( checksum ), 0, sizeof( checksum ) );
+    if ( Checksum( header, kSnapshot_HeaderSize + blockCount * kSnapshot_EntrySize ) != checksum ) {
+        return 0;
+    }
+
+    const uint8_t * desc = nullptr;
+    size_t descSize = 0;
+    for ( uint32_t i = 0; i < blockCount; i++ ) {
+        const uint32_t type = Stream_ReadU32( &r );
+        Stream_ReadU32( &r );
+        const uint64_t offset = Stream_ReadU64( &r );
+        const uint64_t blockSize = Stream_ReadU64( &r );
+        const uint64_t blockChecksum = Stream_ReadU64( &r );
+        if ( offset % kSnapshot_Align != 0 || offset > size || blockSize > size - offset ) {
+            return 0;
+        }
+
+        const uint8_t * const block = data + offset;
+        if ( Checksum( block, ( size_t )blockSize ) != blockChecksum ) {
+            return 0;
+        }
+
+        // blocks of later versions are skipped
+        if ( type == kSnapshotBlock_Desc ) {
+            desc = block;
+            descSize = ( size_t )blockSize;
+        } else if ( type == kSnapshotBlock_Sim ) {
+            snapshot->state = block;
+            snapshot->stateSize = ( size_t )blockSize;
+        }
+    }
+
+    Stream_InitReader( &r, desc, descSize );
+    return desc != nullptr && snapshot->state != nullptr && Sim_LoadDesc( &snapshot->desc, &r );
+}
+
+snapshot_s * Snapshot_Open( const char * const path ) {
+    PROFILE_ZONE( "Snapshot_Open" );
+
+    snapshot_s * const snapshot = ( snapshot_s * )Mem_Alloc( kMemTag_Replay, sizeof( snapshot_s ) );
+    if ( snapshot == nullptr ) {
+        return nullptr;
+    }
+
+    new ( snapshot ) snapshot_s;
+    snapshot->mapping = File_Map( path, kMemTag_Replay );
+    if ( snapshot->mapping == nullptr || !Validate( snapshot ) ) {
+        Snapshot_Close( snapshot );
+        return nullptr;
+    }
+
+    return snapshot;
+}
+
+void Snapshot_Close( snapshot_s * const snapshot ) {
+    if ( snapshot == nullptr ) {
+        return;
+    }
+
+    File_Unmap( snapshot->mapping );
+    snapshot->~snapshot_s();
+    Mem_Free( snapshot );
+}
+
+const simDesc_s * Snapshot_GetDesc( const snapshot_s * const snapshot ) {
+    return &snapshot->desc;
+}
+
+int Snapshot_Restore( const snapshot_s * const snapshot, sim_s * const sim ) {
+    PROFILE_ZONE( "Snapshot_Restore" );
+
+    streamReader_s r;
+    Stream_InitReader( &r, snapshot->state, snapshot->stateSize );
+    return Sim_Load( sim, &r );
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_SNAPSHOT_H___
+#define ___RTSFS_SNAPSHOT_H___
+
+#include "sim.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// snapshot files: the whole sim state on disk, for save games and for handing a desync to someone to debug.
+//
+// a file is a header, a table of blocks, and the blocks themselves on 64 byte boundaries: the sim desc, then the
+// Sim_Save state, which is mostly the ecs component arrays and entity tables and the flow field grids as they sit in
+// memory. the header, the table and every block carry a checksum, and loading checks them all before it touches
+// the sim.
+//
+// saving copies the state into one of two buffers on the calling thread, which is a few large copies, and leaves
+// the checksums and the file write to the writer's own thread, so the sim is only held up by the copy. loading maps
+// the file and reads the state straight out of the mapping.
+
+typedef struct snapshotWriter_s snapshotWriter_s;
+typedef struct snapshot_s snapshot_s;
+
+typedef struct snapshotStats_s {
+    uint64_t saves = 0;    // written to disk
+    uint64_t failed = 0;   // copies or writes that failed
+    uint64_t busy = 0;     // saves refused with both buffers queued
+    size_t bytes = 0;      // file size of the last save
+    uint64_t copyNs = 0;   // calling thread time of the last save
+    uint64_t writeNs = 0;  // writer thread time of the last save
+} snapshotStats_s;
+
+// returns nullptr on failure
+snapshotWriter_s * SnapshotWriter_Create( void );
+
+// waits for the queued saves to finish
+void SnapshotWriter_Destroy( snapshotWriter_s * const w );
+
+// copies the state of sim, created from desc, and queues writing it to path. only between ticks with no commands
+// queued. returns zero if the copy failed or both buffers are still queued, in which case nothing was saved.
+int SnapshotWriter_Save( snapshotWriter_s * const w, sim_s * const sim, const simDesc_s * const desc, const char * const path );
+
+// waits until every queued save is on disk or failed
+void SnapshotWriter_Flush( snapshotWriter_s * const w );
+
+void SnapshotWriter_GetStats( const snapshotWriter_s * const w, snapshotStats_s * const stats );
+
+// maps the file at path and validates it. returns nullptr if it is missing, damaged, or from another version.
+snapshot_s * Snapshot_Open( const char * const path );
+
+void Snapshot_Close( snapshot_s * const snapshot );
+
+// the desc to create the sim for Snapshot_Restore from
+const simDesc_s * Snapshot_GetDesc( const snapshot_s * const snapshot );
+
+// replaces the state of sim with the snapshot's; see Sim_Load
+int Snapshot_Restore( const snapshot_s * const snapshot, sim_s * const sim );
+
+#endif // ___RTSFS_SNAPSHOT_H___
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "spatialhash.h"
+#include "job.h"
+#include "mem.h"
+#include "profile.h"
+#include "simd.h"
+
+#include <string.h>
+
+#include <new>
+
+typedef struct spatialHash_s {
+    vec2_s< float > origin;
+    float invCellSize = 0.0f;
+    int32_t cols = 0;
+    int32_t rows = 0;
+    size_t capacity = 0;
+    size_t count = 0;
+    uint32_t * cellStart = nullptr; // [ cell + 1 ] first sorted item of each cell, and the end of the last
+    uint32_t * cursor = nullptr;    // [ cell ] scatter position during a build
+    uint32_t * itemCell = nullptr;  // [ item ] cell of each input item during a build
+    uint32_t * index = nullptr;     // [ sorted ] input index
+    float * x = nullptr;            // [ sorted ] positions, split for the vector scan
+    float * y = nullptr;
+} spatialHash_s;
+
+static constexpr int32_t kSpatialHash_MaxCells = 1 << 22;
+
+static inline int32_t CellCoord( const float value, const float origin, const float invCellSize, const int32_t limit ) {
+    const float f = ( value - origin ) * invCellSize;
+    if ( !( f > 0.0f ) ) {
+        return 0;
+    }
+    return f < ( float )limit ? ( int32_t )f : limit - 1;
+}
+
+static inline size_t Emit( uint32_t * const results, const size_t maxResults, size_t found, const uint32_t item ) {
+    if ( found < maxResults ) {
+        results[ found ] = item;
+    }
+    return found + 1;
+}
+
+// emits the sorted items begin .. begin + 3 whose bits are set. hits are close to a coin flip, so while there is
+// room for all four every lane is stored and the count advances by the hit bits instead of branching on them.
+static inline size_t EmitLanes( const spatialHash_s * const hash, const size_t begin, const int bits, uint32_t * const results,
+    const size_t maxResults, size_t found ) {
+    if ( found + 4 <= maxResults ) {
+        for ( size_t lane = 0; lane < 4; lane++ ) {
+            results[ found ] = hash->index[ begin + lane ];
+            found += ( size_t )( ( bits >> lane ) & 1 );
+        }
+        return found;
+    }
+
+    for ( size_t lane = 0; lane < 4; lane++ ) {
+        if ( ( bits >> lane ) & 1 ) {
+            found = Emit( results, maxResults, found, hash->index[ begin + lane ] );
+        }
+    }
+    return found;
+}
+
+// matches in sorted items [ begin, end ) within sqrt( r2 ) of cx, cy
+static size_t ScanRadius( const spatialHash_s * const hash, size_t begin, const size_t end, const float cx, const float cy, const float r2,
+    uint32_t * const results, const size_t maxResults, size_t found ) {
+#if RTSFS_SIMD_SSE2
+    const __m128 vcx = _mm_set1_ps( cx );
+    const __m128 vcy = _mm_set1_ps( cy );
+    const __m128 vr2 = _mm_set1_ps( r2 );
+    for ( ; begin + 4 <= end; begin += 4 ) {
+        const __m128 dx = _mm_sub_ps( _mm_loadu_ps( hash->x + begin ), vcx );
+        const __m128 dy = _mm_sub_ps( _mm_loadu_ps( hash->y + begin ), vcy );
+        const __m128 d2 = _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) );
+        found = EmitLanes( hash, begin, _mm_movemask_ps( _mm_cmple_ps( d2, vr2 ) ), results, maxResults, found );
+    }
+#endif
+
+    for ( ; begin < end; begin++ ) {
+        const float dx = hash->x[ begin ] - cx;
+        const float dy = hash->y[ begin ] - cy;
+        if ( dx * dx + dy * dy <= r2 ) {
+            found = Emit( results, maxResults, found, hash->index[ begin ] );
+        }
+    }
+
+    return found;
+}
+
+static size_t ScanRect( const spatialHash_s * const hash, size_t begin, const size_t end, const rect_s< float > * const rect,
+    uint32_t * const results, const size_t maxResults, size_t found ) {
+#if RTSFS_SIMD_SSE2
+    const __m128 mnx = _mm_set1_ps( rect->mn.x );
+    const __m128 mny = _mm_set1_ps( rect->mn.y );
+    const __m128 mxx = _mm_set1_ps( rect->mx.x );
+    const __m128 mxy = _mm_set1_ps( rect->mx.y );
+    for ( ; begin + 4 <= end; begin += 4 ) {
+        const __m128 px = _mm_loadu_ps( hash->x + begin );
+        const __m128 py = _mm_loadu_ps( hash->y + begin );
+        const __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( px, mnx ), _mm_cmple_ps( px, mxx ) ),
+            _mm_and_ps( _mm_cmpge_ps( py, mny ), _mm_cmple_ps( py, mxy ) ) );
+        found = EmitLanes( hash, begin, _mm_movemask_ps( inside ), results, maxResults, found );
+    }
+#endif
+
+    for ( ; begin < end; begin++ ) {
+        const float px = hash->x[ begin ];
+        const float py = hash->y[ begin ];
+        if ( px >= rect->mn.x && px <= rect->mx.x && py >= rect->mn.y && py <= rect->mx.y ) {
+            found = Emit( results, maxResults, found, hash->index[ begin ] );
+        }
+    }
+
+    return found;
+}
+
+spatialHash_s * SpatialHash_Create( const rect_s< float > * const world, const float cellSize, const size_t capacity ) {
+    const float width = world->mx.x - world->mn.x;
+    const float height = world->mx.y - world->mn.y;
+    if ( !( cellSize > 0.0f ) || !( width > 0.0f ) || !( height > 0.0f ) || capacity == 0 || capacity >= UINT32_MAX ) {
+        return nullptr;
+    }
+
+    const float cols = width / cellSize + 1.0f;
+    const float rows = height / cellSize + 1.0f;
+    if ( cols * rows > ( float )kSpatialHash_MaxCells ) {
+        return nullptr;
+    }
+
+    void * const mem = Mem_Alloc( kMemTag_Sim, sizeof( spatialHash_s ) );
+    if ( mem == nullptr ) {
+        return nullptr;
+    }
+
+    spatialHash_s * const hash = new ( mem ) spatialHash_s;
+    hash->origin = world->mn;
+    hash->invCellSize = 1.0f / cellSize;
+    hash->cols = ( int32_t )cols;
+    hash->rows = ( int32_t )rows;
+    hash->capacity = capacity;
+
+    const size_t cells = ( size_t )hash->cols * ( size_t )hash->rows;
+    hash->cellStart = ( uint32_t * )Mem_Calloc( kMemTag_Sim, cells + 1, sizeof( uint32_t ) );
+    hash->cursor = ( uint32_t * )Mem_Alloc( kMemTag_Sim, cells * sizeof( uint32_t ) );
+    hash->itemCell = ( uint32_t * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( uint32_t ) );
+    hash->index = ( uint32_t * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( uint32_t ) );
+    hash->x = ( float * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( float ) );
+    hash->y = ( float * )Mem_Alloc( kMemTag_Sim, capacity * sizeof( float ) );
+    if ( hash->cellStart == nullptr || hash->cursor == nullptr || hash->itemCell == nullptr || hash->index == nullptr ||
+        hash->x == nullptr || hash->y == nullptr ) {
+        SpatialHash_Destroy( hash );
+        return nullptr;
+    }
+
+    return hash;
+}
+
+void SpatialHash_Destroy( spatialHash_s * const hash ) {
+    if ( hash == nullptr ) {
+        return;
+    }
+
+    Mem_Free( hash->y );
+    Mem_Free( hash->x );
+    Mem_Free( hash->index );
+    Mem_Free( hash->itemCell );
+    Mem_Free( hash->cursor );
+    Mem_Free( hash->cellStart );
+
+    hash->~spatialHash_s();
+    Mem_Free( hash );
+}
+
+int SpatialHash_Build( spatialHash_s * const hash, const vec2_s< fixed_s > * const positions, const size_t count ) {
+    PROFILE_ZONE( "SpatialHash_Build" );
+
+    if ( count > hash->capacity ) {
+        return 0;
+    }
+
+    const size_t cells = ( size_t )hash->cols * ( size_t )hash->rows;
+    uint32_t * const start = hash->cellStart;
+    memset( start, 0, ( cells + 1 ) * sizeof( uint32_t ) );
+
+    // count into start[ cell + 1 ], so the prefix sum leaves start[ cell ] at the cell's first slot
+    for ( size_t i = 0; i < count; i++ ) {
+        const int32_t cx = CellCoord( Fixed_ToFloat( positions[ i ].x ), hash->origin.x, hash->invCellSize, hash->cols );
+        const int32_t cy = CellCoord( Fixed_ToFloat( positions[ i ].y ), hash->origin.y, hash->invCellSize, hash->rows );
+        const uint32_t cell = ( uint32_t )( cy * hash->cols + cx );
+        hash->itemCell[ i ] = cell;
+        start[ cell + 1 ]++;
+    }
+
+    for ( size_t c = 0; c < cells; c++ ) {
+        start[ c + 1 ] += start[ c ];
+    }
+    memcpy( hash->cursor, start, cells * sizeof( uint32_t ) );
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const uint32_t slot = hash->cursor[ hash->itemCell[ i ] ]++;
+        hash->index[ slot ] = ( uint32_t )i;
+        hash->x[ slot ] = Fixed_ToFloat( positions[ i ].x );
+        hash->y[ slot ] = Fixed_ToFloat( positions[ i ].y );
+    }
+
+    hash->count = count;
+    return 1;
+}
+
+size_t SpatialHash_QueryRadius( const spatialHash_s * const hash, const vec2_s< float > center, const float radius, uint32_t * const results, const size_t maxResults ) {
+    if ( !( radius >= 0.0f ) ) {
+        return 0;
+    }
+
+    const int32_t x0 = CellCoord( center.x - radius, hash->origin.x, hash->invCellSize, hash->cols );
+    const int32_t x1 = CellCoord( center.x + radius, hash->origin.x, hash->invCellSize, hash->cols );
+    const int32_t y0 = CellCoord( center.y - radius, hash->origin.y, hash->invCellSize, hash->rows );
+    const int32_t y1 = CellCoord( center.y + radius, hash->origin.y, hash->invCellSize, hash->rows );
+
+    size_t found = 0;
+    for ( int32_t cy = y0; cy <= y1; cy++ ) {
+        const uint32_t * const row = hash->cellStart + cy * hash->cols;
+        found = ScanRadius( hash, row[ x0 ], row[ x1 + 1 ], center.x, center.y, radius * radius, results, maxResults, found );
+    }
+    return found;
+}
+
+size_t SpatialHash_QueryRect( const spatialHash_s * const hash, const rect_s< float > * const rect, uint32_t * const results, const size_t maxResults ) {
+    if ( !( rect->mn.x <= rect->mx.x ) || !( rect->mn.y <= rect->mx.y ) ) {
+        return 0;
+    }
+
+    const int32_t x0 = CellCoord( rect->mn.x, hash->origin.x, hash->invCellSize, hash->cols );
+    const int32_t x1 = CellCoord( rect->mx.x, hash->origin.x, hash->invCellSize, hash->cols );
+    const int32_t y0 = CellCoord( rect->mn.y, hash->origin.y, hash->invCellSize, hash->rows );
+    const int32_t y1 = CellCoord( rect->mx.y, hash->origin.y, hash->invCellSize, hash->rows );
+
+    size_t found = 0;
+    for ( int32_t cy = y0; cy <= y1; cy++ ) {
+        const uint32_t * const row = hash->cellStart + cy * hash->cols;
+        found = ScanRect( hash, row[ x0 ], row[ x1 + 1 ], rect, results, maxResults, found );
+    }
+    return found;
+}
+
+typedef struct spatialBatchTask_s {
+    const spatialHash_s * hash = nullptr;
+    const spatialBatch_s * batch = nullptr;
+} spatialBatchTask_s;
+
+void SpatialHash_QueryBatchRange( const spatialHash_s * const hash, const spatialBatch_s * const batch, const size_t first, const size_t last ) {
+    for ( size_t i = first; i < last; i++ ) {
+        const spatialQuery_s * const query = &batch->queries[ i ];
+        const size_t found = SpatialHash_QueryRadius( hash, query->center, query->radius,
+            batch->results + i * batch->maxPerQuery, batch->maxPerQuery );
+        batch->counts[ i ] = ( uint32_t )found;
+    }
+}
+
+static void BatchRange( void * const param, const size_t first, const size_t last ) {
+    const spatialBatchTask_s * const task = ( const spatialBatchTask_s * )param;
+    SpatialHash_QueryBatchRange( task->hash, task->batch, first, last );
+}
+
+void SpatialHash_QueryBatch( const spatialHash_s * const hash, const spatialBatch_s * const batch ) {
+    PROFILE_ZONE( "SpatialHash_QueryBatch" );
+
+    spatialBatchTask_s task;
+    task.hash = hash;
+    task.batch = batch;
+    Job_ParallelFor( batch->count, kSpatialHash_MinBatchChunk, BatchRange, &task );
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_SPATIALHASH_H___
+#define ___RTSFS_SPATIALHASH_H___
+
+#include "fixed.h"
+#include "rect.h"
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// uniform grid over a fixed world rectangle for proximity queries, rebuilt from scratch every tick.
+//
+// the rebuild is a counting sort by cell: count items per cell, prefix sum into cell starts, scatter. items of a
+// cell end up contiguous, and since cells are numbered row by row, so do the items of a run of cells in one row.
+// a query scans one contiguous range per covered row, over copies of the positions stored in sorted order, so it
+// never chases an index back into the caller's arrays. positions outside the world are clamped into edge cells.
+//
+// items are identified by their index in the positions array given to SpatialHash_Build, which for an ecs view
+// is the dense slot; map it through view.entity to get a handle.
+
+typedef struct spatialHash_s spatialHash_s;
+
+static constexpr size_t kSpatialHash_MinBatchChunk = 32; // queries per job in SpatialHash_QueryBatch
+
+typedef struct spatialQuery_s {
+    vec2_s< float > center;
+    float radius = 0.0f;
+} spatialQuery_s;
+
+// many radius queries answered at once. query i writes up to maxPerQuery indices to results + i * maxPerQuery and
+// its full match count to counts[ i ].
+typedef struct spatialBatch_s {
+    const spatialQuery_s * queries = nullptr;
+    size_t count = 0;
+    uint32_t * results = nullptr;
+    size_t maxPerQuery = 0;
+    uint32_t * counts = nullptr;
+} spatialBatch_s;
+
+// cellSize should be around the most common query radius. returns nullptr on failure.
+spatialHash_s * SpatialHash_Create( const rect_s< float > * const world, const float cellSize, const size_t capacity );
+
+void SpatialHash_Destroy( spatialHash_s * const hash );
+
+// replaces the contents with positions[ 0 .. count ), the sim's fixed point positions. they are stored as floats
+// for the query kernels; the conversion is exact below 256 world units and rounds the same way everywhere above,
+// so query results stay deterministic. returns zero if count exceeds the capacity.
+int SpatialHash_Build( spatialHash_s * const hash, const vec2_s< fixed_s > * const positions, const size_t count );
+
+// the queries below write up to maxResults matching indices, in no particular order, and return the number of
+// matches, which can be larger than maxResults. they only read the hash, so any number may run concurrently.
+
+// items within radius of center, boundary included
+size_t SpatialHash_QueryRadius( const spatialHash_s * const hash, const vec2_s< float > center, const float radius, uint32_t * const results, const size_t maxResults );
+
+// items inside rect, boundary included
+size_t SpatialHash_QueryRect( const spatialHash_s * const hash, const rect_s< float > * const rect, uint32_t * const results, const size_t maxResults );
+
+// answers queries [ first, last ) of batch on the calling thread
+void SpatialHash_QueryBatchRange( const spatialHash_s * const hash, const spatialBatch_s * const batch, const size_t first, const size_t last );
+
+// answers the whole batch across the job threads, the calling one included
+void SpatialHash_QueryBatch( const spatialHash_s * const hash, const spatialBatch_s * const batch );
+
+#endif // ___RTSFS_SPATIALHASH_H___
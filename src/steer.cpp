@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "steer.h"
+#include "job.h"
+#include "profile.h"
+#include "simd.h"
+
+// steer units are 8.8 fixed point: 16.16 raw values shifted down by kSteer_Shift. offsets stay under kSteer_Range
+// and relative velocities under kSteer_MaxRelative, so offset - relative * lookahead fits an int16 and every
+// product and sum below fits an int32.
+static constexpr int32_t kSteer_Shift = 8;
+static constexpr int32_t kSteer_RangeUnits = ( int32_t )kSteer_Range << kSteer_Shift;
+static constexpr int32_t kSteer_MaxRelative = 2047;
+static constexpr int32_t kSteer_LookaheadShift = 3; // log2 of kSteer_LookaheadTicks
+static constexpr int32_t kSteer_SeparationRadius2 = ( kSteer_SeparationRadius << kSteer_Shift ) * ( kSteer_SeparationRadius << kSteer_Shift );
+static constexpr int32_t kSteer_AvoidRadius2 = ( kSteer_AvoidRadius << kSteer_Shift ) * ( kSteer_AvoidRadius << kSteer_Shift );
+static constexpr int32_t kSteer_SeparationWeightShift = 4; // keeps weights inside int16
+static constexpr int32_t kSteer_AvoidWeightShift = 5;
+static constexpr int32_t kSteer_SeparationGainShift = 7;   // weighted sums back to 16.16 velocity
+static constexpr int32_t kSteer_AvoidGainShift = 8;
+static constexpr size_t kSteer_Lanes = 8;                   // neighbour lists are zero padded to this
+static constexpr float kSteer_QueryPad = 1.0f;              // world units; far more than float rounding of a position
+static constexpr size_t kSteer_MaxCandidates = kSteer_MaxNeighbors * 2; // the padded square also returns its corners
+
+static_assert( ( 1 << kSteer_LookaheadShift ) == kSteer_LookaheadTicks, "lookahead must match its shift" );
+static_assert( ( kSteer_SeparationRadius2 >> kSteer_SeparationWeightShift ) <= INT16_MAX, "separation weight overflows int16" );
+static_assert( ( kSteer_AvoidRadius2 >> kSteer_AvoidWeightShift ) <= INT16_MAX, "avoid weight overflows int16" );
+static_assert( kSteer_RangeUnits + ( kSteer_MaxRelative << kSteer_LookaheadShift ) <= INT16_MAX, "lookahead offset overflows int16" );
+
+typedef struct steerSums_s {
+    int32_t separation[ 2 ] = {};
+    int32_t avoid[ 2 ] = {};
+} steerSums_s;
+
+// neighbours [ 0 .. count ) as offset and relative velocity pairs, count a multiple of kSteer_Lanes. a zero pair
+// adds nothing, so the padding is harmless.
+static void SumNeighbours( const int16_t * const offset, const int16_t * const relative, const size_t count, steerSums_s * const sums ) {
+    size_t i = 0;
+
+#if defined( RTSFS_SIMD_AVX2 )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i separationRadius2 = _mm256_set1_epi32( kSteer_SeparationRadius2 );
+        const __m256i avoidRadius2 = _mm256_set1_epi32( kSteer_AvoidRadius2 );
+        __m256i sepX = zero;
+        __m256i sepY = zero;
+        __m256i avoidX = zero;
+        __m256i avoidY = zero;
+        for ( ; i < count; i += 8 ) {
+            const __m256i d = _mm256_loadu_si256( ( const __m256i * )( offset + i * 2 ) );
+            const __m256i v = _mm256_loadu_si256( ( const __m256i * )( relative + i * 2 ) );
+
+            const __m256i sepGap = _mm256_sub_epi32( separationRadius2, _mm256_madd_epi16( d, d ) );
+            const __m256i sepW = _mm256_srai_epi32( _mm256_and_si256( sepGap, _mm256_cmpgt_epi32( sepGap, zero ) ), kSteer_SeparationWeightShift );
+            sepX = _mm256_add_epi32( sepX, _mm256_madd_epi16( d, sepW ) );
+            sepY = _mm256_add_epi32( sepY, _mm256_madd_epi16( d, _mm256_slli_epi32( sepW, 16 ) ) );
+
+            const __m256i closing = _mm256_cmpgt_epi32( _mm256_madd_epi16( d, v ), zero );
+            const __m256i ahead = _mm256_sub_epi16( d, _mm256_slli_epi16( v, kSteer_LookaheadShift ) );
+            const __m256i avoidGap = _mm256_sub_epi32( avoidRadius2, _mm256_madd_epi16( ahead, ahead ) );
+            const __m256i avoidMask = _mm256_and_si256( closing, _mm256_cmpgt_epi32( avoidGap, zero ) );
+            const __m256i avoidW = _mm256_srai_epi32( _mm256_and_si256( avoidGap, avoidMask ), kSteer_AvoidWeightShift );
+            avoidX = _mm256_add_epi32( avoidX, _mm256_madd_epi16( ahead, avoidW ) );
+            avoidY = _mm256_add_epi32( avoidY, _mm256_madd_epi16( ahead, _mm256_slli_epi32( avoidW, 16 ) ) );
+        }
+
+        int32_t lanes[ 4 ][ 8 ];
+        _mm256_storeu_si256( ( __m256i * )lanes[ 0 ], sepX );
+        _mm256_storeu_si256( ( __m256i * )lanes[ 1 ], sepY );
+        _mm256_storeu_si256( ( __m256i * )lanes[ 2 ], avoidX );
+        _mm256_storeu_si256( ( __m256i * )lanes[ 3 ], avoidY );
+        for ( size_t l = 0; l < 8; l++ ) {
+            sums->separation[ 0 ] += lanes[ 0 ][ l ];
+            sums->separation[ 1 ] += lanes[ 1 ][ l ];
+            sums->avoid[ 0 ] += lanes[ 2 ][ l ];
+            sums->avoid[ 1 ] += lanes[ 3 ][ l ];
+        }
+    }
+#elif defined( RTSFS_SIMD_SSE2 )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i separationRadius2 = _mm_set1_epi32( kSteer_SeparationRadius2 );
+        const __m128i avoidRadius2 = _mm_set1_epi32( kSteer_AvoidRadius2 );
+        __m128i sepX = zero;
+        __m128i sepY = zero;
+        __m128i avoidX = zero;
+        __m128i avoidY = zero;
+        for ( ; i < count; i += 4 ) {
+            const __m128i d = _mm_loadu_si128( ( const __m128i * )( offset + i * 2 ) );
+            const __m128i v = _mm_loadu_si128( ( const __m128i * )( relative + i * 2 ) );
+
+            // madd of ( dx, dy ) pairs with ( w, 0 ) and ( 0, w ) pairs gives dx * w and dy * w
+            const __m128i sepGap = _mm_sub_epi32( separationRadius2, _mm_madd_epi16( d, d ) );
+            const __m128i sepW = _mm_srai_epi32( _mm_and_si128( sepGap, _mm_cmpgt_epi32( sepGap, zero ) ), kSteer_SeparationWeightShift );
+            sepX = _mm_add_epi32( sepX, _mm_madd_epi16( d, sepW ) );
+            sepY = _mm_add_epi32( sepY, _mm_madd_epi16( d, _mm_slli_epi32( sepW, 16 ) ) );
+
+            const __m128i closing = _mm_cmpgt_epi32( _mm_madd_epi16( d, v ), zero );
+            const __m128i ahead = _mm_sub_epi16( d, _mm_slli_epi16( v, kSteer_LookaheadShift ) );
+            const __m128i avoidGap = _mm_sub_epi32( avoidRadius2, _mm_madd_epi16( ahead, ahead ) );
+            const __m128i avoidMask = _mm_and_si128( closing, _mm_cmpgt_epi32( avoidGap, zero ) );
+            const __m128i avoidW = _mm_srai_epi32( _mm_and_si128( avoidGap, avoidMask ), kSteer_AvoidWeightShift );
+            avoidX = _mm_add_epi32( avoidX, _mm_madd_epi16( ahead, avoidW ) );
+            avoidY = _mm_add_epi32( avoidY, _mm_madd_epi16( ahead, _mm_slli_epi32( avoidW, 16 ) ) );
+        }
+
+        int32_t lanes[ 4 ][ 4 ];
+        _mm_storeu_si128( ( __m128i * )lanes[ 0 ], sepX );
+        _mm_storeu_si128( ( __m128i * )lanes[ 1 ], sepY );
+        _mm_storeu_si128( ( __m128i * )lanes[ 2 ], avoidX );
+        _mm_storeu_si128( ( __m128i * )lanes[ 3 ], avoidY );
+        for ( size_t l = 0; l < 4; l++ ) {
+            sums->separation[ 0 ] += lanes[ 0 ][ l ];
+            sums->separation[ 1 ] += lanes[ 1 ][ l ];
+            sums->avoid[ 0 ] += lanes[ 2 ][ l ];
+            sums->avoid[ 1 ] += lanes[ 3 ][ l ];
+        }
+    }
+#endif
+
+    for ( ; i < count; i++ ) {
+        const int32_t dx = offset[ i * 2 ];
+        const int32_t dy = offset[ i * 2 + 1 ];
+        const int32_t vx = relative[ i * 2 ];
+        const int32_t vy = relative[ i * 2 + 1 ];
+
+        const int32_t sepGap = kSteer_SeparationRadius2 - ( dx * dx + dy * dy );
+        if ( sepGap > 0 ) {
+            const int32_t w = sepGap >> kSteer_SeparationWeightShift;
+            sums->separation[ 0 ] += dx * w;
+            sums->separation[ 1 ] += dy * w;
+        }
+
+        const int32_t ax = ( int16_t )( dx - vx * kSteer_LookaheadTicks );
+        const int32_t ay = ( int16_t )( dy - vy * kSteer_LookaheadTicks );
+        const int32_t avoidGap = kSteer_AvoidRadius2 - ( ax * ax + ay * ay );
+        if ( dx * vx + dy * vy > 0 && avoidGap > 0 ) {
+            const int32_t w = avoidGap >> kSteer_AvoidWeightShift;
+            sums->avoid[ 0 ] += ax * w;
+            sums->avoid[ 1 ] += ay * w;
+        }
+    }
+}
+
+static inline int16_t ClampRelative( const int32_t v ) {
+    return ( int16_t )( v < -kSteer_MaxRelative ? -kSteer_MaxRelative : ( v > kSteer_MaxRelative ? kSteer_MaxRelative : v ) );
+}
+
+void Steer_BatchRange( const spatialHash_s * const hash, const steerBatch_s * const batch, const size_t first, const size_t last ) {
+    uint32_t found[ kSteer_MaxCandidates ];
+    int16_t offset[ ( kSteer_MaxNeighbors + kSteer_Lanes ) * 2 ];
+    int16_t relative[ ( kSteer_MaxNeighbors + kSteer_Lanes ) * 2 ];
+
+    for ( size_t i = first; i < last; i++ ) {
+        const uint32_t unit = batch->units[ i ];
+        const vec2_s< fixed_s > p = batch->position[ unit ];
+        const vec2_s< fixed_s > v = batch->velocity[ unit ];
+
+        // the float query is a square padded past kSteer_Range, a superset of the integer range check below, so
+        // that check alone decides and float rounding at the edge can't change a result
+        const float x = Fixed_ToFloat( p.x );
+        const float y = Fixed_ToFloat( p.y );
+        const float reach = kSteer_Range + kSteer_QueryPad;
+        const rect_s< float > square{ { x - reach, y - reach }, { x + reach, y + reach } };
+        size_t count = SpatialHash_QueryRect( hash, &square, found, kSteer_MaxCandidates );
+        count = count < kSteer_MaxCandidates ? count : kSteer_MaxCandidates;
+
+        size_t n = 0;
+        uint8_t touching = 0;
+        for ( size_t j = 0; j < count && n < kSteer_MaxNeighbors; j++ ) {
+            // the query finds the unit itself, which would take a neighbour slot and, stopped, count as touching
+            if ( found[ j ] == unit ) {
+                continue;
+            }
+            const vec2_s< fixed_s > q = batch->position[ found[ j ] ];
+            const int32_t dx = ( q.x - p.x ).raw >> kSteer_Shift;
+            const int32_t dy = ( q.y - p.y ).raw >> kSteer_Shift;
+            if ( dx <= -kSteer_RangeUnits || dx >= kSteer_RangeUnits || dy <= -kSteer_RangeUnits || dy >= kSteer_RangeUnits ) {
+                continue;
+            }
+            const vec2_s< fixed_s > w = batch->velocity[ found[ j ] ];
+            if ( w.x.raw == 0 && w.y.raw == 0 && dx * dx + dy * dy < kSteer_SeparationRadius2 ) {
+                touching = 1;
+            }
+            offset[ n * 2 ] = ( int16_t )dx;
+            offset[ n * 2 + 1 ] = ( int16_t )dy;
+            relative[ n * 2 ] = ClampRelative( ( v.x - w.x ).raw >> kSteer_Shift );
+            relative[ n * 2 + 1 ] = ClampRelative( ( v.y - w.y ).raw >> kSteer_Shift );
+            n++;
+        }
+        for ( ; n % kSteer_Lanes != 0; n++ ) {
+            offset[ n * 2 ] = offset[ n * 2 + 1 ] = 0;
+            relative[ n * 2 ] = relative[ n * 2 + 1 ] = 0;
+        }
+
+        steerSums_s sums;
+        SumNeighbours( offset, relative, n, &sums );
+
+        // both terms push away from the neighbours, against their offsets
+        vec2_s< fixed_s > steered = batch->desired[ i ];
+        steered.x.raw -= ( sums.separation[ 0 ] >> kSteer_SeparationGainShift ) + ( sums.avoid[ 0 ] >> kSteer_AvoidGainShift );
+        steered.y.raw -= ( sums.separation[ 1 ] >> kSteer_SeparationGainShift ) + ( sums.avoid[ 1 ] >> kSteer_AvoidGainShift );
+
+        // most units are under the limit, which the squared speed shows without a square root
+        const int64_t speed2 = ( int64_t )steered.x.raw * steered.x.raw + ( int64_t )steered.y.raw * steered.y.raw;
+        if ( speed2 > ( int64_t )batch->maxStep.raw * batch->maxStep.raw ) {
+            const fixed_s speed = Fixed_Vec2Length( steered );
+            steered.x.raw = ( int32_t )( ( int64_t )steered.x.raw * batch->maxStep.raw / speed.raw );
+            steered.y.raw = ( int32_t )( ( int64_t )steered.y.raw * batch->maxStep.raw / speed.raw );
+        }
+        batch->result[ i ] = steered;
+        batch->touching[ i ] = touching;
+    }
+}
+
+typedef struct steerBatchTask_s {
+    const spatialHash_s * hash = nullptr;
+    const steerBatch_s * batch = nullptr;
+} steerBatchTask_s;
+
+static void BatchRange( void * const param, const size_t first, const size_t last ) {
+    const steerBatchTask_s * const task = ( const steerBatchTask_s * )param;
+    Steer_BatchRange( task->hash, task->batch, first, last );
+}
+
+void Steer_Batch( const spatialHash_s * const hash, const steerBatch_s * const batch ) {
+    PROFILE_ZONE( "Steer_Batch" );
+
+    steerBatchTask_s task;
+    task.hash = hash;
+    task.batch = batch;
+    Job_ParallelFor( batch->count, kSteer_MinBatchChunk, BatchRange, &task );
+}
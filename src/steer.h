@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_STEER_H___
+#define ___RTSFS_STEER_H___
+
+#include "fixed.h"
+#include "spatialhash.h"
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// local steering for units moving under orders: the velocity a unit wants, from its flow field, adjusted to keep
+// it apart from its neighbours.
+//
+// two terms, both from the spatial hash neighbours within kSteer_Range on each axis. separation pushes away from
+// neighbours closer than kSteer_SeparationRadius, harder the closer they are. avoidance is a one sample velocity
+// obstacle: for each neighbour the unit is closing on, it looks kSteer_LookaheadTicks ahead at the relative motion
+// and pushes away from where the neighbour will be if that lands inside kSteer_AvoidRadius. neither needs a divide
+// or a square root per neighbour.
+//
+// the math is integer, on neighbour offsets and velocities cut down to 8.8 fixed point int16 pairs, which a madd
+// turns into squared distances and dot products four (sse2) or eight (avx2) neighbours at a time. every path gives
+// the same bits. each unit only reads the inputs and writes its own result, so the result is also the same for any
+// number of job threads.
+
+static constexpr float kSteer_Range = 8.0f;             // world units searched for neighbours
+static constexpr int32_t kSteer_SeparationRadius = 2;   // world units
+static constexpr int32_t kSteer_AvoidRadius = 3;        // world units, both units' extents together
+static constexpr int32_t kSteer_LookaheadTicks = 8;
+static constexpr size_t kSteer_MaxNeighbors = 32;       // nearest in hash order, not by distance, past this
+static constexpr size_t kSteer_MinBatchChunk = 64;      // units per job in Steer_Batch
+
+// steers units[ 0 .. count ), slots of the arrays the spatial hash was built from
+typedef struct steerBatch_s {
+    const vec2_s< fixed_s > * position = nullptr; // every unit, indexed by slot
+    const vec2_s< fixed_s > * velocity = nullptr; // every unit's last velocity, indexed by slot
+    const uint32_t * units = nullptr;
+    const vec2_s< fixed_s > * desired = nullptr;  // per steered unit
+    size_t count = 0;
+    fixed_s maxStep;                               // speed limit, world units per tick
+    vec2_s< fixed_s > * result = nullptr;         // per steered unit
+    uint8_t * touching = nullptr;                  // per steered unit, nonzero if a stopped unit is inside its separation radius
+} steerBatch_s;
+
+// steers units [ first, last ) of batch on the calling thread
+void Steer_BatchRange( const spatialHash_s * const hash, const steerBatch_s * const batch, const size_t first, const size_t last );
+
+// steers the whole batch across the job threads, the calling one included
+void Steer_Batch( const spatialHash_s * const hash, const steerBatch_s * const batch );
+
+#endif // ___RTSFS_STEER_H___
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stream.h"
+
+int Stream_Reserve( streamWriter_s * const w, const size_t size ) {
+    if ( w->failed ) {
+        return 0;
+    }
+    if ( w->capacity - w->size >= size ) {
+        return 1;
+    }
+
+    // doubling keeps appends amortized constant
+    size_t capacity = w->capacity > 0 ? w->capacity : 256;
+    while ( capacity - w->size < size ) {
+        capacity *= 2;
+    }
+
+    uint8_t * const data = ( uint8_t * )Mem_Realloc( w->tag, w->data, capacity );
+    if ( data == nullptr ) {
+        w->failed = 1;
+        return 0;
+    }
+    w->data = data;
+    w->capacity = capacity;
+    return 1;
+}
+
+void Stream_FreeWriter( streamWriter_s * const w ) {
+    Mem_Free( w->data );
+    w->data = nullptr;
+    w->size = 0;
+    w->capacity = 0;
+    w->failed = 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_STREAM_H___
+#define ___RTSFS_STREAM_H___
+
+#include "mem.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// byte streams for replays and snapshots. values are little endian; integers that are usually small go out as
+// varints, 7 bits a byte with the top bit set on all but the last, and signed ones zigzagged first so small
+// negative values stay short too.
+//
+// errors are sticky rather than checked per call: a writer that fails to grow, or a reader that runs off the end or
+// meets a malformed varint, sets failed and turns every later call into a no-op (reads return zero). check failed
+// once at the end.
+
+typedef struct streamWriter_s {
+    uint8_t * data = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
+    memTag_e tag = kMemTag_Other;
+    int failed = 0;
+} streamWriter_s;
+
+typedef struct streamReader_s {
+    const uint8_t * data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    int failed = 0;
+} streamReader_s;
+
+// grows the buffer to hold at least size more bytes; returns zero and sets failed if it can't
+int Stream_Reserve( streamWriter_s * const w, const size_t size );
+
+void Stream_FreeWriter( streamWriter_s * const w );
+
+inline void Stream_WriteBytes( streamWriter_s * const w, const void * const bytes, const size_t size ) {
+    if ( w->capacity - w->size < size && !Stream_Reserve( w, size ) ) {
+        return;
+    }
+    memcpy( w->data + w->size, bytes, size );
+    w->size += size;
+}
+
+inline void Stream_WriteU8( streamWriter_s * const w, const uint8_t value ) {
+    Stream_WriteBytes( w, &value, 1 );
+}
+
+inline void Stream_WriteU32( streamWriter_s * const w, const uint32_t value ) {
+    Stream_WriteBytes( w, &value, sizeof( value ) );
+}
+
+inline void Stream_WriteU64( streamWriter_s * const w, const uint64_t value ) {
+    Stream_WriteBytes( w, &value, sizeof( value ) );
+}
+
+inline void Stream_WriteVarint( streamWriter_s * const w, uint64_t value ) {
+    uint8_t bytes[ 10 ];
+    size_t count = 0;
+    while ( value >= 0x80 ) {
+        bytes[ count++ ] = ( uint8_t )( value | 0x80 );
+        value >>= 7;
+    }
+    bytes[ count++ ] = ( uint8_t )value;
+    Stream_WriteBytes( w, bytes, count );
+}
+
+inline void Stream_WriteZigzag( streamWriter_s * const w, const int64_t value ) {
+    Stream_WriteVarint( w, ( ( uint64_t )value << 1 ) ^ ( uint64_t )( value >> 63 ) );
+}
+
+inline void Stream_InitReader( streamReader_s * const r, const void * const data, const size_t size ) {
+    r->data = ( const uint8_t * )data;
+    r->size = size;
+    r->offset = 0;
+    r->failed = 0;
+}
+
+// returns a pointer to the next size bytes and skips them, or nullptr past the end
+inline const uint8_t * Stream_ReadBytes( streamReader_s * const r, const size_t size ) {
+    if ( r->failed || r->size - r->offset < size ) {
+        r->failed = 1;
+        return nullptr;
+    }
+    const uint8_t * const bytes = r->data + r->offset;
+    r->offset += size;
+    return bytes;
+}
+
+inline uint8_t Stream_ReadU8( streamReader_s * const r ) {
+    const uint8_t * const bytes = Stream_ReadBytes( r, 1 );
+    return bytes != nullptr ? bytes[ 0 ] : 0;
+}
+
+inline uint32_t Stream_ReadU32( streamReader_s * const r ) {
+    uint32_t value = 0;
+    const uint8_t * const bytes = Stream_ReadBytes( r, sizeof( value ) );
+    if ( bytes != nullptr ) {
+        memcpy( &value, bytes, sizeof( value ) );
+    }
+    return value;
+}
+
+inline uint64_t Stream_ReadU64( streamReader_s * const r ) {
+    uint64_t value = 0;
+    const uint8_t * const bytes = Stream_ReadBytes( r, sizeof( value ) );
+    if ( bytes != nullptr ) {
+        memcpy( &value, bytes, sizeof( value ) );
+    }
+    return value;
+}
+
+inline uint64_t Stream_ReadVarint( streamReader_s * const r ) {
+    uint64_t value = 0;
+    for ( uint32_t shift = 0; shift < 64; shift += 7 ) {
+        const uint8_t * const byte = Stream_ReadBytes( r, 1 );
+        if ( byte == nullptr ) {
+            return 0;
+        }
+        value |= ( uint64_t )( *byte & 0x7f ) << shift;
+        if ( ( *byte & 0x80 ) == 0 ) {
+            return value;
+        }
+    }
+    r->failed = 1;
+    return 0;
+}
+
+inline int64_t Stream_ReadZigzag( streamReader_s * const r ) {
+    const uint64_t value = Stream_ReadVarint( r );
+    return ( int64_t )( value >> 1 ) ^ -( int64_t )( value & 1 );
+}
+
+#endif // ___RTSFS_STREAM_H___
@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "text.h"
+#include "mem.h"
+#include "simd.h"
+
+#include <assert.h>
+#include <memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+
+typedef struct fontGlyph_s {
+    size_t offset = 0;  // first coverage byte in the atlas
+    uint16_t width = 0; // inked bounds within the cell
+    uint16_t height = 0;
+    uint16_t bearingX = 0;
+    uint16_t bearingY = 0;
+    uint16_t advance = 0;
+} fontGlyph_s;
+
+typedef struct font_s {
+    uint8_t * atlas = nullptr;
+    size_t atlasStride = 0;
+    size_t atlasHeight = 0;
+    size_t lineHeight = 0;
+    fontGlyph_s glyph[ 256 ];
+} font_s;
+
+enum {
+    kTextCache_Ways = 4,
+};
+
+typedef struct textCacheEntry_s {
+    uint64_t lastUse = 0;
+    textRun_s run;
+} textCacheEntry_s;
+
+typedef struct textCache_s {
+    textCacheEntry_s * entry = nullptr;
+    size_t setMask = 0;
+    uint64_t tick = 0;
+} textCache_s;
+
+// fnv-1a, seeded with the font so the same string in two fonts doesn't collide
+static uint64_t HashString( const font_s * const font, const char * const str ) {
+    uint64_t hash = 0xcbf29ce484222325ull ^ ( uint64_t )( uintptr_t )font;
+    for ( const char * c = str; *c != 0; c++ ) {
+        hash ^= ( uint8_t )*c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static int LayoutHashed( textRun_s * const run, const font_s * const font, const char * const str, const uint64_t hash ) {
+    if ( run->font == font && run->hash == hash ) {
+        return 0;
+    }
+
+    run->hash = hash;
+    run->font = font;
+    run->glyphCount = 0;
+
+    size_t penX = 0;
+    size_t penY = 0;
+    size_t width = 0;
+
+    for ( const char * c = str; *c != 0; c++ ) {
+        const uint8_t ch = ( uint8_t )*c;
+
+        if ( ch == '\n' ) {
+            penX = 0;
+            penY += font->lineHeight;
+            continue;
+        }
+
+        const fontGlyph_s * const glyph = font->glyph + ch;
+
+        if ( glyph->width != 0 && run->glyphCount < kText_MaxRunGlyphs && penX + glyph->bearingX <= INT16_MAX &&
+             penY + glyph->bearingY <= INT16_MAX ) {
+            textGlyph_s * const out = run->glyph + run->glyphCount++;
+            out->x = ( int16_t )( penX + glyph->bearingX );
+            out->y = ( int16_t )( penY + glyph->bearingY );
+            out->index = ch;
+        }
+
+        penX += glyph->advance;
+        if ( penX > width ) {
+            width = penX;
+        }
+    }
+
+    run->size = { width, penY + font->lineHeight };
+
+    return 1;
+}
+
+// ( x + 128 ) * 257 >> 16 is x / 255 rounded, for x in [ 0, 255 * 255 ]. the vector paths use the same math through
+// mulhi so every path produces identical pixels.
+static inline uint32_t Div255( const uint32_t x ) {
+    return ( ( x + 128 ) * 257 ) >> 16;
+}
+
+static void BlendSpan( rgba_s * dst, const uint8_t * cov, size_t count, const rgba_s color ) {
+#if defined( RTSFS_SIMD_SSE2 )
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16( 128 );
+    const __m128i m257 = _mm_set1_epi16( 257 );
+    const __m128i ca = _mm_set1_epi16( color.a );
+#endif
+
+#if defined( RTSFS_SIMD_AVX2 )
+    {
+        const __m256i zero256 = _mm256_setzero_si256();
+        const __m256i bias256 = _mm256_set1_epi16( 128 );
+        const __m256i m257256 = _mm256_set1_epi16( 257 );
+        const __m256i c255256 = _mm256_set1_epi16( 255 );
+        const __m256i src256 = _mm256_set_epi16( 255, color.r, color.g, color.b, 255, color.r, color.g, color.b,
+                                                 255, color.r, color.g, color.b, 255, color.r, color.g, color.b );
+
+        for ( ; count >= 8; count -= 8, dst += 8, cov += 8 ) {
+            uint64_t bits;
+            memcpy( &bits, cov, sizeof( bits ) );
+            if ( bits == 0 ) {
+                continue;
+            }
+
+            // a = cov * color.a / 255, for 8 pixels
+            const __m128i c16 = _mm_unpacklo_epi8( _mm_loadl_epi64( ( const __m128i * )cov ), zero );
+            const __m128i a16 = _mm_mulhi_epu16( _mm_add_epi16( _mm_mullo_epi16( c16, ca ), bias ), m257 );
+
+            // unpacks work per 128 bit lane, so the alpha for pixels 0-3 goes low and 4-7 goes high
+            const __m256i a2 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( a16, a16 ) ),
+                                                        _mm_unpackhi_epi16( a16, a16 ),
+                                                        1 );
+            const __m256i aLo = _mm256_unpacklo_epi32( a2, a2 );
+            const __m256i aHi = _mm256_unpackhi_epi32( a2, a2 );
+
+            const __m256i d = _mm256_loadu_si256( ( const __m256i * )dst );
+            const __m256i dLo = _mm256_unpacklo_epi8( d, zero256 );
+            const __m256i dHi = _mm256_unpackhi_epi8( d, zero256 );
+
+            __m256i lo = _mm256_add_epi16( _mm256_mullo_epi16( dLo, _mm256_sub_epi16( c255256, aLo ) ),
+                                           _mm256_mullo_epi16( src256, aLo ) );
+            __m256i hi = _mm256_add_epi16( _mm256_mullo_epi16( dHi, _mm256_sub_epi16( c255256, aHi ) ),
+                                           _mm256_mullo_epi16( src256, aHi ) );
+            lo = _mm256_mulhi_epu16( _mm256_add_epi16( lo, bias256 ), m257256 );
+            hi = _mm256_mulhi_epu16( _mm256_add_epi16( hi, bias256 ), m257256 );
+
+            _mm256_storeu_si256( ( __m256i * )dst, _mm256_packus_epi16( lo, hi ) );
+        }
+    }
+#endif
+
+#if defined( RTSFS_SIMD_SSE2 )
+    {
+        const __m128i c255 = _mm_set1_epi16( 255 );
+        const __m128i src = _mm_set_epi16( 255, color.r, color.g, color.b, 255, color.r, color.g, color.b );
+
+        for ( ; count >= 4; count -= 4, dst += 4, cov += 4 ) {
+            int32_t bits;
+            memcpy( &bits, cov, sizeof( bits ) );
+            if ( bits == 0 ) {
+                continue;
+            }
+
+            const __m128i c16 = _mm_unpacklo_epi8( _mm_cvtsi32_si128( bits ), zero );
+            const __m128i a16 = _mm_mulhi_epu16( _mm_add_epi16( _mm_mullo_epi16( c16, ca ), bias ), m257 );
+            const __m128i a2 = _mm_unpacklo_epi16( a16, a16 );
+            const __m128i aLo = _mm_unpacklo_epi32( a2, a2 );
+            const __m128i aHi = _mm_unpackhi_epi32( a2, a2 );
+
+            const __m128i d = _mm_loadu_si128( ( const __m128i * )dst );
+            const __m128i dLo = _mm_unpacklo_epi8( d, zero );
+            const __m128i dHi = _mm_unpackhi_epi8( d, zero );
+
+            __m128i lo = _mm_add_epi16( _mm_mullo_epi16( dLo, _mm_sub_epi16( c255, aLo ) ), _mm_mullo_epi16( src, aLo ) );
+            __m128i hi = _mm_add_epi16( _mm_mullo_epi16( dHi, _mm_sub_epi16( c255, aHi ) ), _mm_mullo_epi16( src, aHi ) );
+            lo = _mm_mulhi_epu16( _mm_add_epi16( lo, bias ), m257 );
+            hi = _mm_mulhi_epu16( _mm_add_epi16( hi, bias ), m257 );
+
+            _mm_storeu_si128( ( __m128i * )dst, _mm_packus_epi16( lo, hi ) );
+        }
+    }
+#endif
+
+    for ( ; count != 0; count--, dst++, cov++ ) {
+        if ( *cov == 0 ) {
+            continue;
+        }
+        const uint32_t a = Div255( ( uint32_t )*cov * color.a );
+        const uint32_t ia = 255 - a;
+        dst->b = ( uint8_t )Div255( dst->b * ia + color.b * a );
+        dst->g = ( uint8_t )Div255( dst->g * ia + color.g * a );
+        dst->r = ( uint8_t )Div255( dst->r * ia + color.r * a );
+        dst->a = ( uint8_t )Div255( dst->a * ia + 255 * a );
+    }
+}
+
+font_s * Text_CreateFont( const fontDesc_s * const desc ) {
+    if ( desc == nullptr || desc->coverage == nullptr ) {
+        return nullptr;
+    }
+    if ( desc->cellSize.x == 0 || desc->cellSize.y == 0 || desc->cellSize.x > UINT16_MAX || desc->cellSize.y > UINT16_MAX ) {
+        return nullptr;
+    }
+    if ( desc->stride < desc->cellSize.x * desc->cellCount.x ) {
+        return nullptr;
+    }
+
+    const size_t cellTotal = desc->cellCount.x * desc->cellCount.y;
+
+    // first pass: trim each cell and shelf pack the inked bounds into a fixed width atlas
+    fontGlyph_s glyph[ 256 ];
+    const size_t atlasWidth = desc->cellSize.x > 256 ? desc->cellSize.x : 256;
+    size_t shelfX = 0;
+    size_t shelfY = 0;
+    size_t shelfHeight = 0;
+
+    for ( size_t ch = 0; ch < 256; ch++ ) {
+        fontGlyph_s * const g = glyph + ch;
+
+        if ( ch < desc->firstChar || ch - desc->firstChar >= cellTotal ) {
+            continue;
+        }
+
+        const size_t cell = ch - desc->firstChar;
+        const size_t cellX = ( cell % desc->cellCount.x ) * desc->cellSize.x;
+        const size_t cellY = ( cell / desc->cellCount.x ) * desc->cellSize.y;
+
+        g->advance = ( uint16_t )( desc->advance ? desc->advance[ cell ] : desc->cellSize.x );
+
+        size_t mnX = SIZE_MAX;
+        size_t mnY = SIZE_MAX;
+        size_t mxX = 0;
+        size_t mxY = 0;
+        for ( size_t y = 0; y < desc->cellSize.y; y++ ) {
+            const uint8_t * const row = desc->coverage + ( cellY + y ) * desc->stride + cellX;
+            for ( size_t x = 0; x < desc->cellSize.x; x++ ) {
+                if ( row[ x ] != 0 ) {
+                    mnX = x < mnX ? x : mnX;
+                    mxX = x > mxX ? x : mxX;
+                    mnY = y < mnY ? y : mnY;
+                    mxY = y;
+                }
+            }
+        }
+
+        if ( mnX == SIZE_MAX ) {
+            continue; // blank cell, e.g. space: advance only
+        }
+
+        g->bearingX = ( uint16_t )mnX;
+        g->bearingY = ( uint16_t )mnY;
+        g->width = ( uint16_t )( mxX - mnX + 1 );
+        g->height = ( uint16_t )( mxY - mnY + 1 );
+
+        if ( shelfX + g->width > atlasWidth ) {
+            shelfX = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        g->offset = shelfY * atlasWidth + shelfX;
+        shelfX += g->width;
+        shelfHeight = g->height > shelfHeight ? g->height : shelfHeight;
+    }
+
+    const size_t atlasHeight = shelfY + shelfHeight;
+
+    font_s * const font = ( font_s * )Mem_Alloc( kMemTag_Assets, sizeof( font_s ) + atlasWidth * atlasHeight );
+    if ( font == nullptr ) {
+        return nullptr;
+    }
+
+    new ( font ) font_s;
+
+    font->atlas = ( uint8_t * )( font + 1 );
+    font->atlasStride = atlasWidth;
+    font->atlasHeight = atlasHeight;
+    font->lineHeight = desc->lineHeight ? desc->lineHeight : desc->cellSize.y;
+    memcpy( font->glyph, glyph, sizeof( glyph ) );
+
+    // second pass: copy the inked bounds into the atlas
+    for ( size_t ch = 0; ch < 256; ch++ ) {
+        const fontGlyph_s * const g = font->glyph + ch;
+        if ( g->width == 0 ) {
+            continue;
+        }
+
+        const size_t cell = ch - desc->firstChar;
+        const size_t cellX = ( cell % desc->cellCount.x ) * desc->cellSize.x + g->bearingX;
+        const size_t cellY = ( cell / desc->cellCount.x ) * desc->cellSize.y + g->bearingY;
+
+        for ( size_t y = 0; y < g->height; y++ ) {
+            memcpy( font->atlas + g->offset + y * font->atlasStride,
+                    desc->coverage + ( cellY + y ) * desc->stride + cellX,
+                    g->width );
+        }
+    }
+
+    return font;
+}
+
+static int ReadPgmNumber( FILE * const file, size_t * const number ) {
+    int c = fgetc( file );
+
+    for ( ;; ) {
+        if ( c == '#' ) {
+            while ( c != '\n' && c != EOF ) {
+                c = fgetc( file );
+            }
+        } else if ( c == ' ' || c == '\t' || c == '\r' || c == '\n' ) {
+            c = fgetc( file );
+        } else {
+            break;
+        }
+    }
+
+    if ( c < '0' || c > '9' ) {
+        return 0;
+    }
+
+    *number = 0;
+    while ( c >= '0' && c <= '9' ) {
+        *number = *number * 10 + ( size_t )( c - '0' );
+        c = fgetc( file );
+    }
+
+    // exactly one whitespace character follows the last header field
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+font_s * Text_LoadFont( const char * const path, const vec2_s< size_t > cellSize, const uint8_t firstChar ) {
+    if ( path == nullptr || cellSize.x == 0 || cellSize.y == 0 ) {
+        return nullptr;
+    }
+
+    FILE * file = nullptr;
+#if defined( _MSC_VER )
+    if ( fopen_s( &file, path, "rb" ) != 0 ) {
+        file = nullptr;
+    }
+#else
+    file = fopen( path, "rb" );
+#endif
+    if ( file == nullptr ) {
+        return nullptr;
+    }
+
+    font_s * font = nullptr;
+    size_t width = 0;
+    size_t height = 0;
+    size_t maxValue = 0;
+
+    if ( fgetc( file ) == 'P' && fgetc( file ) == '5' &&
+         ReadPgmNumber( file, &width ) && ReadPgmNumber( file, &height ) && ReadPgmNumber( file, &maxValue ) &&
+         maxValue != 0 && maxValue < 256 && width >= cellSize.x && height >= cellSize.y ) {
+        uint8_t * const pixels = ( uint8_t * )Mem_Alloc( kMemTag_Assets, width * height );
+        if ( pixels != nullptr ) {
+            if ( fread( pixels, 1, width * height, file ) == width * height ) {
+                fontDesc_s desc;
+                desc.coverage = pixels;
+                desc.stride = width;
+                desc.cellSize = cellSize;
+                desc.cellCount = { width / cellSize.x, height / cellSize.y };
+                desc.firstChar = firstChar;
+                font = Text_CreateFont( &desc );
+            }
+            Mem_Free( pixels );
+        }
+    }
+
+    fclose( file );
+
+    return font;
+}
+
+void Text_DestroyFont( font_s * const font ) {
+    Mem_Free( font );
+}
+
+size_t Text_GetLineHeight( const font_s * const font ) {
+    if ( font == nullptr ) {
+        return 0;
+    }
+    return font->lineHeight;
+}
+
+int Text_Layout( textRun_s * const run, const font_s * const font, const char * const str ) {
+    if ( run == nullptr || font == nullptr || str == nullptr ) {
+        return 0;
+    }
+
+    return LayoutHashed( run, font, str, HashString( font, str ) );
+}
+
+void Text_Draw( const textRun_s * const run,
+                rgba_s * const surface,
+                const size_t stride,
+                const rect_s< size_t > clip,
+                const vec2_s< size_t > position,
+                const rgba_s color ) {
+    if ( run == nullptr ) {
+        return;
+    }
+
+    Text_DrawGlyphs( run->font, run->glyph, run->glyphCount, surface, stride, clip, position, color );
+}
+
+void Text_DrawGlyphs( const font_s * const font,
+                      const textGlyph_s * const glyph,
+                      const size_t glyphCount,
+                      rgba_s * const surface,
+                      const size_t stride,
+                      const rect_s< size_t > clip,
+                      const vec2_s< size_t > position,
+                      const rgba_s color ) {
+    if ( font == nullptr || surface == nullptr || color.a == 0 ) {
+        return;
+    }
+
+    for ( size_t i = 0; i < glyphCount; i++ ) {
+        const textGlyph_s * const placed = glyph + i;
+        const fontGlyph_s * const inked = font->glyph + placed->index;
+
+        // inclusive bounds of the glyph on the surface
+        size_t x0 = position.x + ( size_t )placed->x;
+        size_t y0 = position.y + ( size_t )placed->y;
+        size_t x1 = x0 + inked->width - 1;
+        size_t y1 = y0 + inked->height - 1;
+
+        if ( x0 > clip.mx.x || y0 > clip.mx.y || x1 < clip.mn.x || y1 < clip.mn.y ) {
+            continue;
+        }
+
+        const size_t skipX = x0 < clip.mn.x ? clip.mn.x - x0 : 0;
+        const size_t skipY = y0 < clip.mn.y ? clip.mn.y - y0 : 0;
+        x0 += skipX;
+        y0 += skipY;
+        x1 = x1 > clip.mx.x ? clip.mx.x : x1;
+        y1 = y1 > clip.mx.y ? clip.mx.y : y1;
+
+        const uint8_t * cov = font->atlas + inked->offset + skipY * font->atlasStride + skipX;
+        rgba_s * dst = surface + y0 * stride + x0;
+        const size_t width = x1 - x0 + 1;
+
+        for ( size_t y = y0; y <= y1; y++ ) {
+            BlendSpan( dst, cov, width, color );
+            cov += font->atlasStride;
+            dst += stride;
+        }
+    }
+}
+
+textCache_s * Text_CreateCache( const size_t capacity ) {
+    size_t setCount = 1;
+    while ( setCount * kTextCache_Ways < capacity ) {
+        setCount <<= 1;
+    }
+
+    const size_t entryCount = setCount * kTextCache_Ways;
+
+    textCache_s * const cache = ( textCache_s * )Mem_Alloc( kMemTag_Other, sizeof( textCache_s ) + sizeof( textCacheEntry_s ) * entryCount );
+    if ( cache == nullptr ) {
+        return nullptr;
+    }
+
+    new ( cache ) textCache_s;
+
+    cache->entry = ( textCacheEntry_s * )( cache + 1 );
+    cache->setMask = setCount - 1;
+
+    for ( size_t i = 0; i < entryCount; i++ ) {
+        new ( cache->entry + i ) textCacheEntry_s;
+    }
+
+    return cache;
+}
+
+void Text_DestroyCache( textCache_s * const cache ) {
+    Mem_Free( cache );
+}
+
+const textRun_s * Text_CacheLayout( textCache_s * const cache, const font_s * const font, const char * const str ) {
+    if ( cache == nullptr || font == nullptr || str == nullptr ) {
+        return nullptr;
+    }
+
+    const uint64_t hash = HashString( font, str );
+    textCacheEntry_s * const set = cache->entry + ( ( size_t )hash & cache->setMask ) * kTextCache_Ways;
+    textCacheEntry_s * victim = set;
+
+    cache->tick++;
+
+    for ( textCacheEntry_s * entry = set; entry < set + kTextCache_Ways; entry++ ) {
+        if ( entry->run.hash == hash && entry->run.font == font ) {
+            entry->lastUse = cache->tick;
+            return &entry->run;
+        }
+        if ( entry->lastUse < victim->lastUse ) {
+            victim = entry;
+        }
+    }
+
+    LayoutHashed( &victim->run, font, str, hash );
+    victim->lastUse = cache->tick;
+
+    return &victim->run;
+}
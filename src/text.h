@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_TEXT_H___
+#define ___RTSFS_TEXT_H___
+
+#include "vec.h"
+#include "rect.h"
+#include "rgba.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bitmap font text rendering.
+//
+// a font is a grid of fixed size cells holding 8 bit coverage, one cell per character. on creation every cell is
+// trimmed to its inked bounds and packed into a single coverage atlas, so drawing only touches covered pixels.
+//
+// strings are laid out into runs. a run remembers the hash of the string it was built from, so laying out the same
+// label every frame costs a hash and a compare. runs are fixed size PODs that the caller owns (typically inside
+// window user data), or can be borrowed from a fixed size cache for transient strings. neither path allocates
+// after creation.
+
+typedef struct font_s font_s;
+typedef struct textCache_s textCache_s;
+
+enum {
+    kText_MaxRunGlyphs = 128, // characters past this are dropped from the run
+};
+
+typedef struct fontDesc_s {
+    const uint8_t * coverage = nullptr; // cellCount.x * cellSize.x by cellCount.y * cellSize.y 8 bit coverage
+    size_t stride = 0;                  // bytes between rows of coverage
+    vec2_s< size_t > cellSize;          // size of a single character cell
+    vec2_s< size_t > cellCount;         // number of cells across and down the sheet
+    uint8_t firstChar = 0;              // character stored in the top left cell
+    const uint8_t * advance = nullptr;  // optional: per cell advance in pixels; nullptr for monospace
+    size_t lineHeight = 0;              // optional: pixels between lines; 0 uses cellSize.y
+} fontDesc_s;
+
+typedef struct textGlyph_s {
+    int16_t x;      // top left of the glyph relative to the run origin
+    int16_t y;
+    uint16_t index; // glyph index within the font
+} textGlyph_s;
+
+typedef struct textRun_s {
+    uint64_t hash = 0;                  // hash of the font and string this run was laid out from
+    const font_s * font = nullptr;
+    vec2_s< size_t > size;              // bounds of the laid out text
+    size_t glyphCount = 0;
+    textGlyph_s glyph[ kText_MaxRunGlyphs ];
+} textRun_s;
+
+// returns nullptr on failure. the coverage is copied; desc may be released afterwards.
+font_s * Text_CreateFont( const fontDesc_s * const desc );
+
+// loads a binary (P5) pgm grid sheet. the cell count is derived from the image size.
+// returns nullptr on failure.
+font_s * Text_LoadFont( const char * const path, const vec2_s< size_t > cellSize, const uint8_t firstChar );
+
+void Text_DestroyFont( font_s * const font );
+
+size_t Text_GetLineHeight( const font_s * const font );
+
+// lays out a nul terminated string. '\n' starts a new line.
+// returns nonzero if the run was rebuilt, zero if it already held this string.
+int Text_Layout( textRun_s * const run, const font_s * const font, const char * const str );
+
+// blends the run into the surface using coverage * color.a, clipped to clip (inclusive).
+void Text_Draw( const textRun_s * const run,
+                rgba_s * const surface,
+                const size_t stride,
+                const rect_s< size_t > clip,
+                const vec2_s< size_t > position,
+                const rgba_s color );
+
+// blends laid out glyphs the same way, for callers that keep a copy of a run's glyphs rather than the run
+void Text_DrawGlyphs( const font_s * const font,
+                      const textGlyph_s * const glyph,
+                      const size_t glyphCount,
+                      rgba_s * const surface,
+                      const size_t stride,
+                      const rect_s< size_t > clip,
+                      const vec2_s< size_t > position,
+                      const rgba_s color );
+
+// capacity is rounded up to a multiple of the set size. returns nullptr on failure.
+textCache_s * Text_CreateCache( const size_t capacity );
+
+void Text_DestroyCache( textCache_s * const cache );
+
+// returns a run for the string, laying it out only if it isn't cached. the least recently used entry is evicted when
+// needed, so the returned run is only valid until the next capacity lookups of other strings.
+const textRun_s * Text_CacheLayout( textCache_s * const cache, const font_s * const font, const char * const str );
+
+#endif // ___RTSFS_TEXT_H___
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "thread.h"
+#include "mem.h"
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+
+typedef struct thread_s {
+    threadFunc_cb func = nullptr;
+    void * param = nullptr;
+#if defined( _WIN32 )
+    HANDLE handle = nullptr;
+#else
+    pthread_t handle;
+#endif
+} thread_s;
+
+typedef struct signal_s {
+    std::mutex mutex;
+    std::condition_variable cond;
+    int raised = 0;
+} signal_s;
+
+#if defined( _WIN32 )
+static DWORD WINAPI ThreadEntry( LPVOID param ) {
+    thread_s * const me = ( thread_s * )param;
+    me->func( me->param );
+    return 0;
+}
+#else
+static void * ThreadEntry( void * param ) {
+    thread_s * const me = ( thread_s * )param;
+    me->func( me->param );
+    return nullptr;
+}
+#endif
+
+thread_s * Thread_Create( threadFunc_cb const func, void * const param ) {
+    if ( func == nullptr ) {
+        return nullptr;
+    }
+
+    thread_s * const me = ( thread_s * )Mem_Alloc( kMemTag_Other, sizeof( thread_s ) );
+    if ( me == nullptr ) {
+        return nullptr;
+    }
+
+    new ( me ) thread_s;
+
+    me->func = func;
+    me->param = param;
+
+#if defined( _WIN32 )
+    me->handle = CreateThread( nullptr, 0, ThreadEntry, me, 0, nullptr );
+    if ( me->handle == nullptr ) {
+        Mem_Free( me );
+        return nullptr;
+    }
+#else
+    if ( pthread_create( &me->handle, nullptr, ThreadEntry, me ) != 0 ) {
+        Mem_Free( me );
+        return nullptr;
+    }
+#endif
+
+    return me;
+}
+
+void Thread_Join( thread_s * const thread ) {
+    if ( thread == nullptr ) {
+        return;
+    }
+
+#if defined( _WIN32 )
+    WaitForSingleObject( thread->handle, INFINITE );
+    CloseHandle( thread->handle );
+#else
+    pthread_join( thread->handle, nullptr );
+#endif
+
+    Mem_Free( thread );
+}
+
+size_t Thread_GetCoreCount( void ) {
+#if defined( _WIN32 )
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return info.dwNumberOfProcessors > 0 ? ( size_t )info.dwNumberOfProcessors : 1;
+#else
+    const long count = sysconf( _SC_NPROCESSORS_ONLN );
+    return count > 0 ? ( size_t )count : 1;
+#endif
+}
+
+void Thread_Yield( void ) {
+#if defined( _WIN32 )
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+signal_s * Signal_Create( void ) {
+    signal_s * const me = ( signal_s * )Mem_Alloc( kMemTag_Other, sizeof( signal_s ) );
+    if ( me == nullptr ) {
+        return nullptr;
+    }
+
+    new ( me ) signal_s;
+
+    return me;
+}
+
+void Signal_Destroy( signal_s * const signal ) {
+    if ( signal == nullptr ) {
+        return;
+    }
+
+    signal->~signal_s();
+    Mem_Free( signal );
+}
+
+void Signal_Raise( signal_s * const signal ) {
+    {
+        std::lock_guard< std::mutex > lock( signal->mutex );
+        signal->raised = 1;
+    }
+    signal->cond.notify_one();
+}
+
+void Signal_Wait( signal_s * const signal ) {
+    std::unique_lock< std::mutex > lock( signal->mutex );
+    while ( signal->raised == 0 ) {
+        signal->cond.wait( lock );
+    }
+    signal->raised = 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_THREAD_H___
+#define ___RTSFS_THREAD_H___
+
+#include <stddef.h>
+
+// os threads and a wake up signal for them
+
+typedef struct thread_s thread_s;
+typedef struct signal_s signal_s;
+
+typedef void ( * threadFunc_cb )( void * const param );
+
+// starts func( param ) on a new thread. returns nullptr on failure.
+thread_s * Thread_Create( threadFunc_cb const func, void * const param );
+
+// waits for the thread to return and frees it
+void Thread_Join( thread_s * const thread );
+
+// logical processors available to the process, at least 1
+size_t Thread_GetCoreCount( void );
+
+// gives up the rest of the calling thread's time slice
+void Thread_Yield( void );
+
+// an auto reset event: Signal_Wait returns once Signal_Raise has been called since the last Signal_Wait returned.
+// raises while nobody waits are coalesced into one.
+signal_s * Signal_Create( void );
+
+void Signal_Destroy( signal_s * const signal );
+
+void Signal_Raise( signal_s * const signal );
+
+void Signal_Wait( signal_s * const signal );
+
+#endif // ___RTSFS_THREAD_H___
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "timer.h"
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined( _WIN32 )
+// Sleep( 1 ) can take up to two scheduler quanta even with a 1 ms timer period
+static constexpr uint64_t kTimer_SpinMargin = 2000000;
+#else
+static constexpr uint64_t kTimer_SpinMargin = 200000;
+#endif
+
+static inline void Pause( void ) {
+#if defined( _WIN32 )
+    YieldProcessor();
+#elif defined( __i386__ ) || defined( __x86_64__ )
+    __builtin_ia32_pause();
+#endif
+}
+
+uint64_t Timer_Nanoseconds( void ) {
+#if defined( _WIN32 )
+    static LARGE_INTEGER frequency = { { 0, 0 } };
+    if ( frequency.QuadPart == 0 ) {
+        QueryPerformanceFrequency( &frequency );
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter( &counter );
+
+    // split to keep counter * 1e9 from overflowing
+    const uint64_t ticks = ( uint64_t )counter.QuadPart;
+    const uint64_t freq = ( uint64_t )frequency.QuadPart;
+    return ( ticks / freq ) * 1000000000ull + ( ticks % freq ) * 1000000000ull / freq;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t )ts.tv_sec * 1000000000ull + ( uint64_t )ts.tv_nsec;
+#endif
+}
+
+void Timer_WaitUntil( const uint64_t deadline ) {
+    for ( ;; ) {
+        const uint64_t now = Timer_Nanoseconds();
+        if ( now >= deadline ) {
+            return;
+        }
+
+        const uint64_t remaining = deadline - now;
+        if ( remaining <= kTimer_SpinMargin ) {
+            break;
+        }
+
+#if defined( _WIN32 )
+        Sleep( 1 );
+#else
+        const uint64_t nap = remaining - kTimer_SpinMargin;
+        struct timespec ts;
+        ts.tv_sec = ( time_t )( nap / 1000000000ull );
+        ts.tv_nsec = ( long )( nap % 1000000000ull );
+        nanosleep( &ts, nullptr );
+#endif
+    }
+
+    while ( Timer_Nanoseconds() < deadline ) {
+        Pause();
+    }
+}
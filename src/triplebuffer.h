@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021 wheezharde
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ___RTSFS_TRIPLEBUFFER_H___
+#define ___RTSFS_TRIPLEBUFFER_H___
+
+#include <stdint.h>
+
+#include <atomic>
+
+// lock-free triple buffer index protocol between exactly one writer thread and one reader thread. the writer and
+// the reader each own a slot outright; the third slot is shared and changes hands with a single atomic exchange.
+// neither side ever waits on the other, the reader always gets the newest completed slot, and a slot is never
+// written while it is being read. frames the reader is too slow to pick up are overwritten, never queued.
+//
+// the caller keeps the three payloads (surfaces, frame descriptions, ...) in an array indexed by slot.
+
+static constexpr uint32_t kTripleBuffer_SlotMask = 3;
+static constexpr uint32_t kTripleBuffer_Fresh = 4; // set on the shared slot when the writer published it
+
+typedef struct tripleBuffer_s {
+    uint32_t write = 0; // writer thread only
+    uint8_t writePad[ 60 ];
+    std::atomic< uint32_t > shared{ 1 };
+    uint8_t sharedPad[ 60 ];
+    uint32_t read = 2; // reader thread only
+} tripleBuffer_s;
+
+// writer: the slot to fill next
+inline uint32_t TripleBuffer_GetWriteSlot( const tripleBuffer_s * const tb ) {
+    return tb->write;
+}
+
+// writer: hands the filled slot to the reader and takes back whichever slot was shared
+inline void TripleBuffer_Publish( tripleBuffer_s * const tb ) {
+    const uint32_t previous = tb->shared.exchange( tb->write | kTripleBuffer_Fresh, std::memory_order_acq_rel );
+    tb->write = previous & kTripleBuffer_SlotMask;
+}
+
+// writer: nonzero if the slot published last has not been acquired yet, in which case the reader will skip it. the
+// reader can acquire it right after this returns, so a nonzero answer may be stale; a zero answer never is.
+inline int TripleBuffer_IsPending( const tripleBuffer_s * const tb, uint32_t * const slot ) {
+    const uint32_t shared = tb->shared.load( std::memory_order_acquire );
+    *slot = shared & kTripleBuffer_SlotMask;
+    return ( shared & kTripleBuffer_Fresh ) != 0;
+}
+
+// reader: nonzero if a newer slot was published since the last call; the read slot then refers to it
+inline int TripleBuffer_Acquire( tripleBuffer_s * const tb ) {
+    if ( ( tb->shared.load( std::memory_order_relaxed ) & kTripleBuffer_Fresh ) == 0 ) {
+        return 0;
+    }
+    const uint32_t previous = tb->shared.exchange( tb->read, std::memory_order_acq_rel );
+    tb->read = previous & kTripleBuffer_SlotMask;
+    return 1;
+}
+
+// reader: the newest slot acquired
+inline uint32_t TripleBuffer_GetReadSlot( const tripleBuffer_s * const tb ) {
+    return tb->read;
+}
+
+#endif // ___RTSFS_TRIPLEBUFFER_H___
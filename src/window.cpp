@@ -21,6 +21,10 @@
  */
 
  #include "window.h"
+#include "arena.h"
+#include "mem.h"
+#include "profile.h"
+#include "render.h"
 
 #include <assert.h>
 #include <memory.h>
@@ -33,32 +37,71 @@ typedef struct window_s {
     size_t userDataSize = 0;
     vec2_s< size_t > position;
     vec2_s< size_t > size;
+    window_s * parent = nullptr;
     window_s ** child = nullptr;
     size_t childCount = 0;
     size_t childSize = 0;
 } window_s;
 
 static window_s * root = 0;
+static size_t windowCount = 0; // every window but the root, so a walk of the tree never holds more
+
+// a window still to draw, with the clip its parent gives it
+typedef struct windowVisit_s {
+    window_s * window;
+    rect_s< size_t > clip;
+} windowVisit_s;
+
+static void RemoveChild( window_s * const parent, window_s * const child ) {
+    for ( size_t i = 0; i < parent->childCount; i++ ) {
+        if ( parent->child[ i ] == child ) {
+            memmove( parent->child + i, parent->child + i + 1, sizeof( window_s * ) * ( parent->childCount - ( i + 1 ) ) );
+            parent->childCount--;
+            break;
+        }
+    }
+    child->parent = nullptr;
 
-static void Window_RenderRecurse( window_s * const window, rgba_s * const surface, size_t stride, rect_s< size_t > clip ) {
-    windowRenderData_s renderData = {
-        surface,
-        stride,
-        clip,
-        window->position,
-        window->size
-    };
-
-    void * const userData = window->userDataSize ? window + 1 : 0;
-
-    if ( window->cb != nullptr ) {
-        window->cb( window, kWindow_OnRender, ( uintptr_t )&renderData, ( uintptr_t )userData );
+    // the root exists only to hold top level windows
+    if ( parent == root && root->childCount == 0 ) {
+        Mem_Free( root->child );
+        Mem_Free( root );
+        root = 0;
     }
+}
 
-    rect_s< size_t > windowClip = rectFrom( window->position, window->size );
+// draws window and its descendants parents first, each a layer above the one drawn before it. stack has room for
+// every window, so the walk needs neither recursion nor a check.
+static void Window_RenderTree( window_s * const window, renderList_s * const list, uint16_t * const layer, const rect_s< size_t > clip, windowVisit_s * const stack ) {
+    size_t depth = 0;
+    stack[ depth++ ] = { window, clip };
+
+    while ( depth > 0 ) {
+        const windowVisit_s visit = stack[ --depth ];
+        window_s * const w = visit.window;
+
+        windowRenderData_s renderData = {
+            list,
+            visit.clip,
+            w->position,
+            w->size
+        };
+
+        void * const userData = w->userDataSize ? w + 1 : 0;
+
+        if ( w->cb != nullptr ) {
+            PROFILE_ZONE( "kWindow_OnRender" );
+            RenderList_SetLayer( list, *layer );
+            RenderList_SetClip( list, visit.clip );
+            w->cb( w, kWindow_OnRender, ( uintptr_t )&renderData, ( uintptr_t )userData );
+        }
+        *layer = ( uint16_t )( *layer < UINT16_MAX ? *layer + 1 : *layer );
 
-    for ( size_t i = 0; i < window->childCount; i++ ) {
-        Window_RenderRecurse( window->child[ i ], surface, stride, windowClip );
+        // pushed last to first so the first child is drawn next
+        const rect_s< size_t > windowClip = rectFrom( w->position, w->size );
+        for ( size_t i = w->childCount; i-- > 0; ) {
+            stack[ depth++ ] = { w->child[ i ], windowClip };
+        }
     }
 }
 
@@ -70,12 +113,13 @@ window_s * Window_Create( window_s * const parent,
                           void * const param ) {
     const size_t mallocSize = sizeof( window_s ) + userDataSize;
 
-    window_s * const window = ( window_s * )malloc( mallocSize );
+    window_s * const window = ( window_s * )Mem_Alloc( kMemTag_Window, mallocSize );
     if ( window == 0 ) {
         return 0;
     }
 
     new ( window ) window_s;
+    windowCount++;
 
     window->cb = cb;
     window->userDataSize = userDataSize;
@@ -98,11 +142,22 @@ void Window_Destroy( window_s * const window ) {
         return;
     }
 
+    // children first, newest to oldest; each one removes itself from window->child
+    while ( window->childCount != 0 ) {
+        Window_Destroy( window->child[ window->childCount - 1 ] );
+    }
+
     if ( window->cb != nullptr ) {
-        window->cb( window, kWindow_OnDestroy, 0, ( uintptr_t )( window + 1 ) );
+        window->cb( window, kWindow_OnDestroy, 0, ( uintptr_t )Window_GetUserData( window ) );
+    }
+
+    if ( window->parent != nullptr ) {
+        RemoveChild( window->parent, window );
     }
 
-    free( window );
+    Mem_Free( window->child );
+    Mem_Free( window );
+    windowCount--;
 }
 
 uintptr_t Window_SendMessage( window_s * const window,
@@ -123,10 +178,17 @@ void * Window_GetUserData( window_s * const window ) {
     return window->userDataSize ? window + 1 : 0;
 }
 
-void Window_Render( rgba_s * const surface, const size_t stride, const rect_s< size_t > clip ) {
-    if ( root == 0 ) {
-        return;
+int Window_Render( renderBuffer_s * const buffer, const rect_s< size_t > clip, rect_s< size_t > * const drawn ) {
+    PROFILE_ZONE( "Window_Render" );
+
+    int any = 0;
+
+    renderList_s * const list = root != 0 ? RenderBuffer_GetList( buffer ) : nullptr;
+    windowVisit_s * const stack = list != nullptr ? FrameArena_New< windowVisit_s >( windowCount ) : nullptr;
+    if ( stack == nullptr ) {
+        return any;
     }
+    uint16_t layer = 0;
 
     for ( size_t i = 0; i < root->childCount; i++ ) {
         window_s * const window = root->child[ i ];
@@ -139,8 +201,31 @@ void Window_Render( rgba_s * const surface, const size_t stride, const rect_s< s
             continue;
         }
 
-        Window_RenderRecurse( window, surface, stride, clip );
+        Window_RenderTree( window, list, &layer, clip, stack );
+
+        if ( drawn != nullptr ) {
+            const rect_s< size_t > bounds = rectFrom( window->position, window->size );
+            if ( !any ) {
+                *drawn = bounds;
+            } else {
+                drawn->mn.x = bounds.mn.x < drawn->mn.x ? bounds.mn.x : drawn->mn.x;
+                drawn->mn.y = bounds.mn.y < drawn->mn.y ? bounds.mn.y : drawn->mn.y;
+                drawn->mx.x = bounds.mx.x > drawn->mx.x ? bounds.mx.x : drawn->mx.x;
+                drawn->mx.y = bounds.mx.y > drawn->mx.y ? bounds.mx.y : drawn->mx.y;
+            }
+        }
+        any = 1;
+    }
+
+    if ( any && drawn != nullptr ) {
+        drawn->mn.x = drawn->mn.x > clip.mn.x ? drawn->mn.x : clip.mn.x;
+        drawn->mn.y = drawn->mn.y > clip.mn.y ? drawn->mn.y : clip.mn.y;
+        drawn->mx.x = drawn->mx.x < clip.mx.x ? drawn->mx.x : clip.mx.x;
+        drawn->mx.y = drawn->mx.y < clip.mx.y ? drawn->mx.y : clip.mx.y;
+        any = drawn->mn.x <= drawn->mx.x && drawn->mn.y <= drawn->mx.y;
     }
+
+    return any;
 }
 
 void Window_SetParent( window_s * const parent, window_s * const child ) {
@@ -148,7 +233,7 @@ void Window_SetParent( window_s * const parent, window_s * const child ) {
 
     if ( parent == 0 ) {
         if ( root == 0 ) {
-            root = ( window_s * )malloc( sizeof( window_s ) );
+            root = ( window_s * )Mem_Alloc( kMemTag_Window, sizeof( window_s ) );
             if ( root == 0 ) {
                 assert( root != nullptr );
                 return;
@@ -158,11 +243,18 @@ void Window_SetParent( window_s * const parent, window_s * const child ) {
         top = root;
     }
 
+    if ( child->parent == top ) {
+        return;
+    }
+    if ( child->parent != nullptr ) {
+        RemoveChild( child->parent, child );
+    }
+
     if ( top->childSize == top->childCount ) {
         const size_t growthStep = 8;
         window_s ** const old = top->child;
         top->childSize += growthStep;
-        top->child = ( window_s ** )malloc( sizeof( window_s * ) * top->childSize );
+        top->child = ( window_s ** )Mem_Alloc( kMemTag_Window, sizeof( window_s * ) * top->childSize );
         if ( top->child == 0 ) {
             assert( top->child != nullptr );
             top->child = old;
@@ -171,11 +263,12 @@ void Window_SetParent( window_s * const parent, window_s * const child ) {
         }
         if ( old != nullptr ) {
             memcpy( top->child, old, sizeof( window_s * ) * top->childCount );
-            free( old );
+            Mem_Free( old );
         }
     }
 
     top->child[ top->childCount++ ] = child;
+    child->parent = top;
 
     if ( top->cb != nullptr ) {
         ( void )top->cb( top, kWindow_OnAddChild, 0, ( uintptr_t )child );
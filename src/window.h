@@ -29,7 +29,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
-typedef struct rgba_s rgba_s;
+typedef struct renderBuffer_s renderBuffer_s;
+typedef struct renderList_s renderList_s;
 typedef struct window_s window_s;
 
 typedef enum windowMsg_e : uint8_t {
@@ -47,7 +48,7 @@ typedef enum windowMsg_e : uint8_t {
     // return: ignored
     kWindow_OnDestroy,
 
-    // usage:  called to draw the window to the surface. changes to dimensions are ignored.
+    // usage:  called to record the window's drawing into a render list. changes to dimensions are ignored.
     // msg:    kWindow_OnRender
     // a:      windowRenderData_s *
     // b:      ( void * )userData
@@ -77,8 +78,7 @@ typedef enum windowMsg_e : uint8_t {
 } windowMsg_e;
 
 typedef struct windowRenderData_s {
-    rgba_s * surface = nullptr;
-    size_t stride = 0;
+    renderList_s * list = nullptr; // set to the window's own layer and clipped to clip
     rect_s< size_t > clip;
     vec2_s< size_t > position;
     vec2_s< size_t > size;
@@ -105,7 +105,11 @@ uintptr_t Window_SendMessage( window_s * const window,
 
 void * Window_GetUserData( window_s * const window );
 
-void Window_Render( rgba_s * const surface, const size_t stride, const rect_s< size_t > clip );
+// records every top level window and its children into the calling thread's list of buffer, each window in a layer
+// above its parent and the windows before it. returns nonzero if anything was recorded; drawn, if not nullptr, then
+// receives the bounds of the top level windows within clip. the walk takes its stack from the calling thread's frame
+// arena, and records nothing if that fails.
+int Window_Render( renderBuffer_s * const buffer, const rect_s< size_t > clip, rect_s< size_t > * const drawn );
 
 void Window_SetParent( window_s * const parent, window_s * const child );
 